@@ -0,0 +1,323 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <assimp/mesh.h>
+#include <assimp/postprocess.h>
+#include <bgfx/bgfx.h>
+
+#include "stb_image.h"
+
+#include "base64.h"
+#include "data_uri_io.h"
+#include "material_batch.h"
+#include "resource_cache.h"
+#include "vertex_format.h"
+
+// The CPU side of asset loading: file reads, image decoding, data URIs and mesh conversion.
+// Shared by the viewer and the loading benchmark (bench_loading.cpp), which runs it on bgfx's
+// Noop renderer. The includer defines STB_IMAGE_IMPLEMENTATION.
+
+// Post-processing every asset is imported with
+inline constexpr unsigned int kAssetImportFlags =
+    aiProcess_Triangulate |
+    aiProcess_GenNormals |
+    aiProcess_CalcTangentSpace |
+    aiProcess_LimitBoneWeights |       // <-- At most 4 bones per vertex, as the skin stream stores
+    //aiProcess_FlipUVs //|              // <-- Flips V texture coordinates
+    aiProcess_ConvertToLeftHanded;     // <-- Converts to left-handed coordinate system
+
+// Every texture, shader and program goes through here so identical content is only created once
+inline ResourceCache g_resources;
+
+// Load file into memory, with a terminating '\0' after the last byte (not counted in the returned size)
+inline bool loadMem(const char* filename, std::vector<uint8_t>& outData)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        std::cerr << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (size <= 0)
+    {
+        std::cerr << "File is empty: " << filename << std::endl;
+        fclose(fp);
+        return false;
+    }
+
+    outData.resize(size_t(size) + 1);
+    if (fread(outData.data(), 1, size, fp) != (size_t)size)
+    {
+        std::cerr << "Failed to read file: " << filename << std::endl;
+        fclose(fp);
+        outData.clear();
+        return false;
+    }
+    fclose(fp);
+
+    outData[size] = '\0';
+    outData.resize(size_t(size));
+    return true;
+}
+
+inline std::string canonicalPath(const char* path)
+{
+    char* resolved = realpath(path, nullptr);
+    if (!resolved)
+    {
+        return path;
+    }
+    std::string canonical = resolved;
+    free(resolved);
+    return canonical;
+}
+
+// Content key of a file, by canonical path if the cache has seen it before and otherwise by reading and hashing it
+// (the bytes are left in outData then). contentKind is one of the kContent* seeds.
+inline bool fileContentKey(const char* filePath, uint64_t contentKind, std::vector<uint8_t>& outData, uint64_t& outContentKey)
+{
+    std::string path = canonicalPath(filePath);
+    if (g_resources.findPathKey(path, contentKind, outContentKey))
+    {
+        return true;
+    }
+    if (!loadMem(filePath, outData))
+    {
+        return false;
+    }
+    outContentKey = hashBytes(outData.data(), outData.size(), contentKind);
+    g_resources.rememberPathKey(path, contentKind, outContentKey);
+    return true;
+}
+
+// Looks the file up in the cache by canonical path first, then by content, and only reads it if neither knows it.
+// createFromBytes(data, outGpuBytes) is only called for content that isn't cached yet.
+template <typename CreateFn>
+inline bgfx::TextureHandle acquireFileTexture(const char* filePath, uint64_t contentKind, CreateFn&& createFromBytes)
+{
+    std::vector<uint8_t> data;
+    uint64_t contentKey;
+    if (!fileContentKey(filePath, contentKind, data, contentKey))
+    {
+        return BGFX_INVALID_HANDLE;
+    }
+
+    return g_resources.acquireTexture(contentKey, [&](uint32_t& outGpuBytes) -> bgfx::TextureHandle
+    {
+        // The path was known but its texture has been released since
+        if (data.empty() && !loadMem(filePath, data))
+        {
+            return BGFX_INVALID_HANDLE;
+        }
+        return createFromBytes(data, outGpuBytes);
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Convert Assimp mesh data -> bgfx::alloc'd vertex/index memory, ready to hand
+// to createVertexBuffer/createIndexBuffer without an intermediate copy
+// -----------------------------------------------------------------------------
+inline bool assimpMeshToBuffers(const aiMesh* mesh,
+                         const bgfx::Memory*& outVertices,
+                         const bgfx::Memory*& outIndices)
+{
+    if (!mesh) return false;
+
+    outVertices = bgfx::alloc(uint32_t(sizeof(MyFancyVertex) * mesh->mNumVertices));
+    streamVertices<kFancyVertexFormat, kFancyVertexFormatCount>(mesh, outVertices->data);
+
+    // Load indices
+    outIndices = bgfx::alloc(uint32_t(sizeof(uint32_t) * countTriangleIndices(mesh)));
+    streamTriangleIndices(mesh, reinterpret_cast<uint32_t*>(outIndices->data));
+
+    return true;
+}
+
+// Largest texture side that can be created: bgfx takes uint16_t sizes, and the renderer has its own limit once
+// bgfx is up (its caps are zero before that)
+inline uint32_t maxTextureSide()
+{
+    const bgfx::Caps* caps = bgfx::getCaps();
+    return caps && caps->limits.maxTextureSize > 0 ? std::min<uint32_t>(caps->limits.maxTextureSize, UINT16_MAX) : UINT16_MAX;
+}
+
+// Decode a PNG/JPG/... into RGBA8 pixels, as stb_image produces them
+inline bool decodeImageRGBA(const unsigned char* imageData, size_t dataSize, DecodedImage& outImage)
+{
+    if (!imageData || dataSize == 0)
+    {
+        std::cerr << "[decodeImageRGBA] Invalid data or size.\n";
+        return false;
+    }
+
+    // Images too big for a texture would wrap their uint16_t sizes; the header tells before decoding anything
+    int width, height, channels;
+    const uint32_t maxSide = maxTextureSide();
+    if (stbi_info_from_memory(imageData, static_cast<int>(dataSize), &width, &height, &channels)
+        && (uint32_t(width) > maxSide || uint32_t(height) > maxSide))
+    {
+        std::cerr << "[decodeImageRGBA] " << width << "x" << height << " is larger than the " << maxSide << " texels a texture side can have.\n";
+        return false;
+    }
+    // Use STBI_rgb_alpha to force 4 channels
+    unsigned char* decoded = stbi_load_from_memory(
+                imageData,
+                static_cast<int>(dataSize),
+                &width,
+                &height,
+                &channels,
+                STBI_rgb_alpha
+                );
+
+    if (!decoded)
+    {
+        std::cerr << "[decodeImageRGBA] stbi_load_from_memory failed.\n";
+        return false;
+    }
+    if (uint32_t(width) > maxSide || uint32_t(height) > maxSide)
+    {
+        std::cerr << "[decodeImageRGBA] " << width << "x" << height << " is larger than the " << maxSide << " texels a texture side can have.\n";
+        stbi_image_free(decoded);
+        return false;
+    }
+
+    outImage.width = static_cast<uint16_t>(width);
+    outImage.height = static_cast<uint16_t>(height);
+    outImage.pixels = std::shared_ptr<uint8_t>(decoded, stbi_image_free);
+    return true;
+}
+
+// RGBA8 <-> BGRA8 in place
+inline void swapRedBlue(uint8_t* pixels, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount * 4; i += 4)
+    {
+        std::swap(pixels[i + 0], pixels[i + 2]); // R <-> B
+    }
+}
+
+// Decode a PNG/JPG/... into BGRA8 pixels
+inline bool decodeImageBGRA(const unsigned char* imageData, size_t dataSize, DecodedImage& outImage)
+{
+    if (!decodeImageRGBA(imageData, dataSize, outImage))
+    {
+        return false;
+    }
+
+    // STB outputs RGBA; BGFX expects BGRA by default.
+    swapRedBlue(outImage.pixels.get(), size_t(outImage.width) * outImage.height);
+    return true;
+}
+
+inline bgfx::TextureHandle createBgfxTextureFromMemory(const unsigned char* imageData, size_t dataSize, uint32_t* outGpuBytes = nullptr)
+{
+    DecodedImage image;
+    if (!decodeImageBGRA(imageData, dataSize, image))
+    {
+        std::cerr << "[createBgfxTextureFromMemory] Decoding failed.\n";
+        return BGFX_INVALID_HANDLE;
+    }
+
+    const uint32_t imageBytes = uint32_t(image.width) * image.height * 4;
+    const bgfx::Memory* mem = bgfx::copy(image.pixels.get(), imageBytes);
+
+    // Create the BGFX texture
+    bgfx::TextureHandle handle = bgfx::createTexture2D(
+                image.width,
+                image.height,
+                false,     // no mipmaps
+                1,         // number of layers
+                bgfx::TextureFormat::BGRA8,
+                0,
+                mem
+                );
+
+    if (!bgfx::isValid(handle))
+    {
+        std::cerr << "[createBgfxTextureFromMemory] Failed to create BGFX texture.\n";
+    }
+    else if (outGpuBytes)
+    {
+        *outGpuBytes = imageBytes;
+    }
+    return handle;
+}
+
+// Decoded once per unique image; materials sharing an embedded "*N" texture, or the same bytes under another index,
+// in a data URI or in a file, get the same handle
+inline bgfx::TextureHandle acquireTextureFromMemory(const unsigned char* imageData, size_t dataSize)
+{
+    return g_resources.acquireTexture(hashBytes(imageData, dataSize, kContentEncodedImage), [&](uint32_t& outGpuBytes)
+    {
+        return createBgfxTextureFromMemory(imageData, dataSize, &outGpuBytes);
+    });
+}
+
+// BGRA8 texels that need no decoding (uncompressed embedded textures, generated images)
+inline bgfx::TextureHandle acquirePixelsTexture(const uint8_t* bgra, uint16_t width, uint16_t height)
+{
+    return g_resources.acquireTexture(pixelsContentKey(bgra, width, height), [&](uint32_t& outGpuBytes)
+    {
+        const uint32_t imageBytes = uint32_t(width) * height * 4;
+        outGpuBytes = imageBytes;
+        return bgfx::createTexture2D(width, height, false, 1, bgfx::TextureFormat::BGRA8, 0, bgfx::copy(bgra, imageBytes));
+    });
+}
+
+inline bgfx::TextureHandle loadExternalTexture(const std::string& filePath)
+{
+    // Simple file load into memory, then decode
+    // (You might need a more robust file I/O system.)
+    bgfx::TextureHandle handle = acquireFileTexture(filePath.c_str(), kContentEncodedImage, [](const std::vector<uint8_t>& data, uint32_t& outGpuBytes)
+    {
+        return createBgfxTextureFromMemory(data.data(), data.size(), &outGpuBytes);
+    });
+
+    if (!bgfx::isValid(handle))
+    {
+        std::cerr << "[loadExternalTexture] Failed to load: " << filePath << "\n";
+    }
+    return handle;
+}
+
+
+
+// Decode target for data: URIs, reused so each texture doesn't allocate its own buffer
+inline std::vector<uint8_t> s_base64Scratch;
+
+// A helper if your path is "data:image/png;base64,XXX..."
+inline bgfx::TextureHandle loadBase64Texture(std::string_view base64Uri)
+{
+    // Typically the URI is something like "data:image/png;base64,iVBORw0KGgoAAAANSUhE..."
+    // The payload after the comma is decoded in place, without copying it out of the URI first
+    std::string_view base64Part;
+    if (!parseBase64DataUri(base64Uri, base64Part))
+    {
+        std::cerr << "[loadBase64Texture] Invalid data URI.\n";
+        return BGFX_INVALID_HANDLE;
+    }
+
+    // Keyed by the decoded bytes like files and embedded textures, so the same image inlined and on disk is one texture
+    s_base64Scratch.resize(base64DecodedCapacity(base64Part.size()));
+    size_t decodedSize = 0;
+    if (!base64Decode(base64Part, s_base64Scratch.data(), decodedSize) || decodedSize == 0)
+    {
+        std::cerr << "[loadBase64Texture] Base64 decode failed.\n";
+        return BGFX_INVALID_HANDLE;
+    }
+    return acquireTextureFromMemory(s_base64Scratch.data(), decodedSize);
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define BASE64_NEON 1
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#define BASE64_WASM_SIMD 1
+#include <wasm_simd128.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// Vectorized base64 decoder for data: URIs, working in place on a string_view.
+//
+// Validation + translation uses the nibble lookup scheme from Wojciech Mula's
+// "Base64 decoding with SIMD instructions": the low and high nibble of every
+// character index two 16-entry tables whose AND is non-zero for anything that
+// isn't in the alphabet, and the high nibble (plus a fixup for '/') picks the
+// offset that turns the ASCII code into its 6-bit value. The vector loops only
+// run on the bulk of the input; the tail and the '=' padding go through the
+// scalar decoder.
+// -----------------------------------------------------------------------------
+
+// Upper bound on the decoded size of `encodedSize` characters, size the output buffer with this
+inline size_t base64DecodedCapacity(size_t encodedSize)
+{
+    return (encodedSize / 4) * 3 + 3;
+}
+
+namespace base64_detail
+{
+
+inline uint8_t scalarValue(char c)
+{
+    if (c >= 'A' && c <= 'Z') return uint8_t(c - 'A');
+    if (c >= 'a' && c <= 'z') return uint8_t(c - 'a' + 26);
+    if (c >= '0' && c <= '9') return uint8_t(c - '0' + 52);
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return 0xff;
+}
+
+// Decodes the remaining characters, including an optionally padded final quantum
+inline bool decodeScalar(const char* in, size_t inSize, uint8_t* out, size_t& outSize)
+{
+    // Strip padding, at most two '='
+    size_t padding = 0;
+    while (inSize > 0 && padding < 2 && in[inSize - 1] == '=')
+    {
+        --inSize;
+        ++padding;
+    }
+    if (inSize % 4 == 1) return false;
+
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (size_t i = 0; i < inSize; ++i)
+    {
+        uint8_t value = scalarValue(in[i]);
+        if (value == 0xff) return false;
+        accumulator = (accumulator << 6) | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[outSize++] = uint8_t(accumulator >> bits);
+        }
+    }
+    return true;
+}
+
+#if BASE64_X86
+
+// Returns false if the 16 characters contain anything outside the alphabet
+__attribute__((target("ssse3")))
+inline bool translateSsse3(__m128i& chars)
+{
+    const __m128i lutLo   = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi   = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F  = _mm_set1_epi8(0x2F);
+
+    // pshufb only looks at bits 0-3 (and 7), so the shifted-in bits of the neighbour byte don't matter
+    __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask2F);
+    __m128i loNibbles = _mm_and_si128(chars, mask2F);
+    __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+    {
+        return false;
+    }
+    __m128i eq2F = _mm_cmpeq_epi8(chars, mask2F);
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+    chars = _mm_add_epi8(chars, roll);
+    return true;
+}
+
+// 16 characters -> 12 bytes, stored as 16 (the caller leaves 4 bytes of slack)
+__attribute__((target("ssse3")))
+inline size_t decodeSsse3(const char* in, size_t inSize, uint8_t* out)
+{
+    const __m128i packShuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t consumed = 0;
+    // Keep 8 characters back so the overlapping store always lands inside the output
+    while (inSize - consumed >= 24)
+    {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + consumed));
+        if (!translateSsse3(chars)) break;
+
+        __m128i merged = _mm_maddubs_epi16(chars, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        merged = _mm_shuffle_epi8(merged, packShuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), merged);
+
+        consumed += 16;
+        out += 12;
+    }
+    return consumed;
+}
+
+// 32 characters -> 24 bytes, stored as 32 (the caller leaves 8 bytes of slack)
+__attribute__((target("avx2")))
+inline size_t decodeAvx2(const char* in, size_t inSize, uint8_t* out)
+{
+    const __m256i lutLo   = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                             0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi   = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                             0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F  = _mm256_set1_epi8(0x2F);
+    const __m256i packShuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i packLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t consumed = 0;
+    // Keep 16 characters back so the overlapping store always lands inside the output
+    while (inSize - consumed >= 48)
+    {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + consumed));
+
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask2F);
+        __m256i loNibbles = _mm256_and_si256(chars, mask2F);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+
+        __m256i eq2F = _mm256_cmpeq_epi8(chars, mask2F);
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+        chars = _mm256_add_epi8(chars, roll);
+
+        __m256i merged = _mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, packShuffle);
+        merged = _mm256_permutevar8x32_epi32(merged, packLanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), merged);
+
+        consumed += 32;
+        out += 24;
+    }
+    return consumed;
+}
+
+#elif BASE64_NEON
+
+inline bool translateNeon(uint8x16_t& chars)
+{
+    static const uint8_t kLutLo[16]   = { 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A };
+    static const uint8_t kLutHi[16]   = { 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 };
+    static const int8_t  kLutRoll[16] = { 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    uint8x16_t hiNibbles = vshrq_n_u8(chars, 4);
+    uint8x16_t lo = vqtbl1q_u8(vld1q_u8(kLutLo), vandq_u8(chars, vdupq_n_u8(0x0F)));
+    uint8x16_t hi = vqtbl1q_u8(vld1q_u8(kLutHi), hiNibbles);
+    if (vmaxvq_u8(vandq_u8(lo, hi)) != 0) return false;
+
+    uint8x16_t eq2F = vceqq_u8(chars, vdupq_n_u8(0x2F));
+    uint8x16_t roll = vqtbl1q_u8(vreinterpretq_u8_s8(vld1q_s8(kLutRoll)), vaddq_u8(eq2F, hiNibbles));
+    chars = vaddq_u8(chars, roll);
+    return true;
+}
+
+// 64 characters -> 48 bytes, de-interleaved by vld4 so no slack is needed
+inline size_t decodeNeon(const char* in, size_t inSize, uint8_t* out)
+{
+    size_t consumed = 0;
+    // Keep the final quantum (which may be padded) for the scalar tail
+    while (inSize - consumed > 64)
+    {
+        uint8x16x4_t chars = vld4q_u8(reinterpret_cast<const uint8_t*>(in + consumed));
+        if (!translateNeon(chars.val[0]) || !translateNeon(chars.val[1]) ||
+            !translateNeon(chars.val[2]) || !translateNeon(chars.val[3]))
+        {
+            break;
+        }
+
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(chars.val[0], 2), vshrq_n_u8(chars.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(chars.val[1], 4), vshrq_n_u8(chars.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(chars.val[2], 6), chars.val[3]);
+        vst3q_u8(out, bytes);
+
+        consumed += 64;
+        out += 48;
+    }
+    return consumed;
+}
+
+#elif BASE64_WASM_SIMD
+
+// 16 characters -> 12 bytes, stored as 16 (the caller leaves 4 bytes of slack)
+inline size_t decodeWasmSimd(const char* in, size_t inSize, uint8_t* out)
+{
+    const v128_t lutLo   = wasm_i8x16_make(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const v128_t lutHi   = wasm_i8x16_make(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const v128_t lutRoll = wasm_i8x16_make(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const v128_t packShuffle = wasm_i8x16_make(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t consumed = 0;
+    while (inSize - consumed >= 24)
+    {
+        v128_t chars = wasm_v128_load(in + consumed);
+
+        v128_t hiNibbles = wasm_u8x16_shr(chars, 4);
+        v128_t lo = wasm_i8x16_swizzle(lutLo, wasm_v128_and(chars, wasm_i8x16_splat(0x0F)));
+        v128_t hi = wasm_i8x16_swizzle(lutHi, hiNibbles);
+        if (wasm_v128_any_true(wasm_v128_and(lo, hi))) break;
+
+        v128_t eq2F = wasm_i8x16_eq(chars, wasm_i8x16_splat(0x2F));
+        v128_t roll = wasm_i8x16_swizzle(lutRoll, wasm_i8x16_add(eq2F, hiNibbles));
+        chars = wasm_i8x16_add(chars, roll);
+
+        // Each 32-bit lane holds the sextets a,b,c,d (a lowest), pack them into a 24-bit big-endian value
+        v128_t merged = wasm_v128_or(
+                    wasm_v128_or(wasm_i32x4_shl(wasm_v128_and(chars, wasm_i32x4_splat(0x000000FF)), 18),
+                                 wasm_i32x4_shl(wasm_v128_and(chars, wasm_i32x4_splat(0x0000FF00)), 4)),
+                    wasm_v128_or(wasm_u32x4_shr(wasm_v128_and(chars, wasm_i32x4_splat(0x00FF0000)), 10),
+                                 wasm_u32x4_shr(chars, 24)));
+        merged = wasm_i8x16_swizzle(merged, packShuffle);
+        wasm_v128_store(out, merged);
+
+        consumed += 16;
+        out += 12;
+    }
+    return consumed;
+}
+
+#endif
+
+} // namespace base64_detail
+
+// -----------------------------------------------------------------------------
+// Decodes `in` into `out`, which must have room for base64DecodedCapacity(in.size())
+// bytes. On success outSize is the number of bytes written. Returns false on
+// characters outside the base64 alphabet or a truncated final quantum.
+// -----------------------------------------------------------------------------
+inline bool base64Decode(std::string_view in, uint8_t* out, size_t& outSize)
+{
+    const char* chars = in.data();
+    size_t remaining = in.size();
+    outSize = 0;
+
+    size_t consumed = 0;
+#if BASE64_X86
+    static const bool s_hasAvx2 = __builtin_cpu_supports("avx2");
+    static const bool s_hasSsse3 = __builtin_cpu_supports("ssse3");
+    if (s_hasAvx2)
+    {
+        consumed = base64_detail::decodeAvx2(chars, remaining, out);
+    }
+    if (s_hasSsse3)
+    {
+        consumed += base64_detail::decodeSsse3(chars + consumed, remaining - consumed, out + consumed / 4 * 3);
+    }
+#elif BASE64_NEON
+    consumed = base64_detail::decodeNeon(chars, remaining, out);
+#elif BASE64_WASM_SIMD
+    consumed = base64_detail::decodeWasmSimd(chars, remaining, out);
+#endif
+    // Every vector block is a whole number of 4-character quanta
+    outSize = consumed / 4 * 3;
+
+    return base64_detail::decodeScalar(chars + consumed, remaining - consumed, out, outSize);
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+#include "parallel_for.h"
+
+// Uncompressed scanline OpenEXR from RGBA half floats (as read back from an RGBA16F texture).
+// bottomUp: the first row in `pixels` is the bottom of the image (GL render targets).
+inline bool writeExrHalfRGBA(const char* path, uint32_t width, uint32_t height, const uint16_t* pixels, bool bottomUp)
+{
+    std::vector<uint8_t> out;
+    auto put = [&](const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+    auto putInt = [&](int32_t value) { put(&value, sizeof(value)); }; // EXR is little endian, like every target here
+    auto putAttribute = [&](const char* name, const char* type, const void* data, int32_t size)
+    {
+        put(name, std::strlen(name) + 1);
+        put(type, std::strlen(type) + 1);
+        putInt(size);
+        put(data, size_t(size));
+    };
+
+    const uint8_t magic[8] = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 }; // version 2, single part scanline
+    put(magic, sizeof(magic));
+
+    // Channels are stored in alphabetical order, each HALF (1), linear 0, sampling 1x1
+    static const char kChannels[4] = { 'A', 'B', 'G', 'R' };
+    static const int kSourceChannel[4] = { 3, 2, 1, 0 };
+    std::vector<uint8_t> channelList;
+    for (char channel : kChannels)
+    {
+        const int32_t fields[4] = { 1, 0, 1, 1 };
+        channelList.push_back(uint8_t(channel));
+        channelList.push_back(0);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(fields);
+        channelList.insert(channelList.end(), bytes, bytes + sizeof(fields));
+    }
+    channelList.push_back(0);
+    putAttribute("channels", "chlist", channelList.data(), int32_t(channelList.size()));
+    const uint8_t noCompression = 0;
+    putAttribute("compression", "compression", &noCompression, 1);
+    const int32_t window[4] = { 0, 0, int32_t(width) - 1, int32_t(height) - 1 };
+    putAttribute("dataWindow", "box2i", window, sizeof(window));
+    putAttribute("displayWindow", "box2i", window, sizeof(window));
+    const uint8_t increasingY = 0;
+    putAttribute("lineOrder", "lineOrder", &increasingY, 1);
+    const float aspect = 1.0f;
+    putAttribute("pixelAspectRatio", "float", &aspect, sizeof(aspect));
+    const float center[2] = { 0.0f, 0.0f };
+    putAttribute("screenWindowCenter", "v2f", center, sizeof(center));
+    putAttribute("screenWindowWidth", "float", &aspect, sizeof(aspect));
+    out.push_back(0);
+
+    // Offset table, then one block per scanline: y, size, and the row of each channel in turn
+    const uint32_t rowBytes = width * 4 * sizeof(uint16_t);
+    const uint64_t firstBlock = out.size() + uint64_t(height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint64_t offset = firstBlock + uint64_t(y) * (8 + rowBytes);
+        put(&offset, sizeof(offset));
+    }
+    std::vector<uint16_t> row(size_t(width) * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint16_t* source = pixels + size_t(bottomUp ? height - 1 - y : y) * width * 4;
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                row[size_t(channel) * width + x] = source[x * 4 + kSourceChannel[channel]];
+            }
+        }
+        putInt(int32_t(y));
+        putInt(int32_t(rowBytes));
+        put(row.data(), rowBytes);
+    }
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "[writeExrHalfRGBA] Could not open " << path << " for writing.\n";
+        return false;
+    }
+    const bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    std::fclose(file);
+    return written;
+}
+
+// -----------------------------------------------------------------------------
+// Reads rendered images back without stalling: each image is blitted into the
+// next of N read-back textures and bgfx::readTexture() is queued on it, which
+// completes a couple of frames later. Only when all N are still in flight does
+// the caller have to run frames until the oldest one has arrived, so the GPU
+// keeps rendering while earlier images are copied out.
+// -----------------------------------------------------------------------------
+class ReadbackRing
+{
+public:
+    struct Image
+    {
+        uint32_t tag;
+        std::vector<uint8_t> pixels;
+    };
+
+    bool create(uint16_t width, uint16_t height, bgfx::TextureFormat::Enum format, uint32_t numSlots)
+    {
+        const bgfx::Caps* caps = bgfx::getCaps();
+        if (0 == (caps->supported & BGFX_CAPS_TEXTURE_BLIT) || 0 == (caps->supported & BGFX_CAPS_TEXTURE_READ_BACK))
+        {
+            std::cerr << "[ReadbackRing] Texture blits and read-back aren't supported by this renderer.\n";
+            return false;
+        }
+
+        bgfx::TextureInfo info;
+        bgfx::calcTextureSize(info, width, height, 1, false, false, 1, format);
+        m_width = width;
+        m_height = height;
+        m_imageBytes = info.storageSize;
+        m_slots.resize(std::max(numSlots, 1u));
+        for (Slot& slot : m_slots)
+        {
+            slot.texture = bgfx::createTexture2D(width, height, false, 1, format, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK | BGFX_SAMPLER_POINT);
+            slot.busy = false;
+            if (!bgfx::isValid(slot.texture))
+            {
+                std::cerr << "[ReadbackRing] Could not create a " << width << "x" << height << " read-back texture.\n";
+                destroy();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void destroy()
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (bgfx::isValid(slot.texture)) bgfx::destroy(slot.texture);
+        }
+        m_slots.clear();
+    }
+
+    bool hasFreeSlot() const { return m_slots[m_next].busy == false; }
+    bool idle() const { return std::none_of(m_slots.begin(), m_slots.end(), [](const Slot& slot) { return slot.busy; }); }
+    uint32_t inFlight() const { return uint32_t(std::count_if(m_slots.begin(), m_slots.end(), [](const Slot& slot) { return slot.busy; })); }
+
+    // Copies `source` (same size and format) into the next slot in `blitView` and queues its read-back;
+    // the view must come after the ones rendering into `source`. Requires hasFreeSlot().
+    void submit(bgfx::ViewId blitView, bgfx::TextureHandle source, uint32_t tag)
+    {
+        Slot& slot = m_slots[m_next];
+        slot.pixels.resize(m_imageBytes);
+        slot.tag = tag;
+        slot.busy = true;
+        bgfx::blit(blitView, slot.texture, 0, 0, source);
+        slot.readyFrame = bgfx::readTexture(slot.texture, slot.pixels.data());
+        m_next = (m_next + 1) % uint32_t(m_slots.size());
+    }
+
+    // Moves the images that have arrived by `frame` (what bgfx::frame() returned) to `out`
+    void collect(uint32_t frame, std::vector<Image>& out)
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (slot.busy && frame >= slot.readyFrame)
+            {
+                out.push_back(Image{ slot.tag, std::move(slot.pixels) });
+                slot.pixels = std::vector<uint8_t>();
+                slot.busy = false;
+            }
+        }
+    }
+
+    uint16_t width() const { return m_width; }
+    uint16_t height() const { return m_height; }
+
+private:
+    struct Slot
+    {
+        bgfx::TextureHandle texture = BGFX_INVALID_HANDLE;
+        std::vector<uint8_t> pixels; // readTexture target, handed over with the image
+        uint32_t readyFrame = 0;
+        uint32_t tag = 0;
+        bool busy = false;
+    };
+
+    std::vector<Slot> m_slots;
+    uint32_t m_next = 0;
+    uint16_t m_width = 0;
+    uint16_t m_height = 0;
+    uint32_t m_imageBytes = 0;
+};
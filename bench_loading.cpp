@@ -0,0 +1,1021 @@
+// Loading benchmark: times the CPU side of asset loading on synthetic and real inputs, without a
+// window or GPU (bgfx runs its Noop renderer). One JSON object per line on stdout, e.g.
+//   ./bench_loading --commit $(git rev-parse HEAD) >> loading.jsonl
+// Run it from the build directory so the drill asset and its textures are found.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <bgfx/bgfx.h>
+#include <bgfx/platform.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "asset_loading.h"
+#include "chunk_streaming.h"
+#include "ply_chunking.h"
+
+#ifndef BENCH_BGFX_BUILD
+#define BENCH_BGFX_BUILD "unknown"
+#endif
+
+// How this binary was compiled, recorded with every result so debug numbers can't pass for release ones
+#if defined(__OPTIMIZE__) && defined(NDEBUG)
+static const char* const kBuildType = "release";
+#elif defined(__OPTIMIZE__)
+static const char* const kBuildType = "optimized+asserts";
+#else
+static const char* const kBuildType = "debug";
+#endif
+
+static bgfx::VertexLayout s_vertexLayout;
+static std::string s_commit = "unknown";
+static std::string s_filter;
+static double s_minSeconds = 0.2;
+static uint32_t s_repetitions = 5;
+
+// Accumulates the time between begin() and end(), so per-op setup and cleanup can stay out of the measurement
+struct BenchTimer
+{
+    typedef std::chrono::steady_clock Clock;
+
+    void begin() { m_start = Clock::now(); }
+    void end() { m_ns += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count()); }
+
+    uint64_t m_ns = 0;
+    Clock::time_point m_start;
+};
+
+static std::string jsonString(const std::string& str)
+{
+    std::string out = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (uint8_t(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(uint8_t(c)));
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Runs `op` until the timed part adds up to s_minSeconds, s_repetitions times, and prints the median and
+// fastest repetition. bytes and items are per op (0 if they don't apply). op returns false on failure.
+static void runBenchmark(const std::string& name, const std::string& input, uint64_t bytes, uint64_t items,
+                         const std::function<bool(BenchTimer&)>& op)
+{
+    if (!s_filter.empty() && name.find(s_filter) == std::string::npos)
+    {
+        return;
+    }
+
+    BenchTimer warmup;
+    if (!op(warmup))
+    {
+        std::cerr << "[runBenchmark] " << name << " failed on " << input << ", skipped.\n";
+        return;
+    }
+
+    std::vector<double> nsPerOp;
+    uint64_t iterations = 0;
+    const uint64_t minNs = uint64_t(s_minSeconds * 1e9);
+    for (uint32_t rep = 0; rep < s_repetitions; ++rep)
+    {
+        BenchTimer timer;
+        uint64_t ops = 0;
+        while (timer.m_ns < minNs)
+        {
+            if (!op(timer))
+            {
+                std::cerr << "[runBenchmark] " << name << " failed on " << input << ", skipped.\n";
+                return;
+            }
+            ++ops;
+        }
+        iterations += ops;
+        nsPerOp.push_back(double(timer.m_ns) / double(ops));
+    }
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    const double median = nsPerOp[nsPerOp.size() / 2];
+    std::printf("{\"commit\":%s,\"build_type\":%s,\"bgfx\":%s,\"name\":%s,\"input\":%s,\"bytes\":%llu,\"items\":%llu,\"iterations\":%llu,"
+                "\"ns_per_op\":%.1f,\"min_ns_per_op\":%.1f,\"mb_per_s\":%.2f,\"items_per_s\":%.1f}\n",
+                jsonString(s_commit).c_str(), jsonString(kBuildType).c_str(), jsonString(BENCH_BGFX_BUILD).c_str(),
+                jsonString(name).c_str(), jsonString(input).c_str(),
+                (unsigned long long)bytes, (unsigned long long)items, (unsigned long long)iterations,
+                median, nsPerOp.front(), double(bytes) * 1e3 / median, double(items) * 1e9 / median);
+    std::fflush(stdout);
+}
+
+// -----------------------------------------------------------------------------
+// Synthetic inputs
+// -----------------------------------------------------------------------------
+
+// A (side+1)^2 vertex grid with every stream the vertex format reads, as assimp hands it over after import
+static aiMesh* makeGridMesh(uint32_t side)
+{
+    const uint32_t numVertices = (side + 1) * (side + 1);
+    aiMesh* mesh = new aiMesh();
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    mesh->mNumVertices = numVertices;
+    mesh->mVertices = new aiVector3D[numVertices];
+    mesh->mNormals = new aiVector3D[numVertices];
+    mesh->mTangents = new aiVector3D[numVertices];
+    mesh->mBitangents = new aiVector3D[numVertices];
+    mesh->mTextureCoords[0] = new aiVector3D[numVertices];
+    mesh->mNumUVComponents[0] = 2;
+    for (uint32_t y = 0; y <= side; ++y)
+    {
+        for (uint32_t x = 0; x <= side; ++x)
+        {
+            const uint32_t v = y * (side + 1) + x;
+            const float u = float(x) / float(side);
+            const float w = float(y) / float(side);
+            mesh->mVertices[v] = aiVector3D(u, 0.1f * std::sin(u * 20.0f), w);
+            mesh->mNormals[v] = aiVector3D(0.0f, 1.0f, 0.0f);
+            mesh->mTangents[v] = aiVector3D(1.0f, 0.0f, 0.0f);
+            mesh->mBitangents[v] = aiVector3D(0.0f, 0.0f, 1.0f);
+            mesh->mTextureCoords[0][v] = aiVector3D(u, w, 0.0f);
+        }
+    }
+
+    mesh->mNumFaces = side * side * 2;
+    mesh->mFaces = new aiFace[mesh->mNumFaces];
+    uint32_t f = 0;
+    for (uint32_t y = 0; y < side; ++y)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            const uint32_t v = y * (side + 1) + x;
+            const uint32_t quad[2][3] = { { v, v + side + 1, v + 1 }, { v + 1, v + side + 1, v + side + 2 } };
+            for (const uint32_t* triangle : quad)
+            {
+                aiFace& face = mesh->mFaces[f++];
+                face.mNumIndices = 3;
+                face.mIndices = new unsigned int[3];
+                std::memcpy(face.mIndices, triangle, 3 * sizeof(unsigned int));
+            }
+        }
+    }
+    return mesh;
+}
+
+// The same grid as a Wavefront OBJ, for timing the importer on something other than glTF
+static bool writeGridObj(const std::string& path, uint32_t side)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "[writeGridObj] Could not open " << path << " for writing.\n";
+        return false;
+    }
+    for (uint32_t y = 0; y <= side; ++y)
+    {
+        for (uint32_t x = 0; x <= side; ++x)
+        {
+            const float u = float(x) / float(side);
+            const float w = float(y) / float(side);
+            std::fprintf(file, "v %f %f %f\nvt %f %f\n", u, 0.1f * std::sin(u * 20.0f), w, u, w);
+        }
+    }
+    for (uint32_t y = 0; y < side; ++y)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            // OBJ indices are 1-based, one quad per cell (triangulated on import)
+            const uint32_t v = y * (side + 1) + x + 1;
+            std::fprintf(file, "f %u/%u %u/%u %u/%u %u/%u\n", v, v, v + side + 1, v + side + 1, v + side + 2, v + side + 2, v + 1, v + 1);
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+// The same grid as a binary PLY with quads, for the out-of-core chunker
+static bool writeGridPly(const std::string& path, uint32_t side)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "[writeGridPly] Could not open " << path << " for writing.\n";
+        return false;
+    }
+    std::fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+        "property float u\nproperty float v\nelement face %u\nproperty list uchar int vertex_indices\nend_header\n",
+        (side + 1) * (side + 1), side * side);
+    bool ok = true;
+    for (uint32_t y = 0; y <= side; ++y)
+    {
+        for (uint32_t x = 0; x <= side; ++x)
+        {
+            const float u = float(x) / float(side);
+            const float w = float(y) / float(side);
+            const float vertex[5] = { u, 0.1f * std::sin(u * 20.0f), w, u, w };
+            ok = ok && std::fwrite(vertex, sizeof(vertex), 1, file) == 1;
+        }
+    }
+    for (uint32_t y = 0; y < side; ++y)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            const int32_t v = int32_t(y * (side + 1) + x);
+            const uint8_t count = 4;
+            const int32_t quad[4] = { v, v + int32_t(side) + 1, v + int32_t(side) + 2, v + 1 };
+            ok = ok && std::fwrite(&count, 1, 1, file) == 1 && std::fwrite(quad, sizeof(quad), 1, file) == 1;
+        }
+    }
+    return std::fclose(file) == 0 && ok;
+}
+
+// Smooth gradients plus some noise, so the encoders neither collapse it nor give up on it
+static std::vector<uint8_t> makeTestPixels(uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    std::mt19937 rng(1234);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+            const uint8_t noise = uint8_t(rng() & 15);
+            pixel[0] = uint8_t(x * 255 / width) ^ noise;
+            pixel[1] = uint8_t(y * 255 / height) ^ noise;
+            pixel[2] = uint8_t((x + y) * 127 / (width + height)) ^ noise;
+            pixel[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+static void appendToVector(void* context, void* data, int size)
+{
+    std::vector<uint8_t>& out = *static_cast<std::vector<uint8_t>*>(context);
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static std::vector<uint8_t> encodeTestImage(uint32_t size, bool jpeg)
+{
+    std::vector<uint8_t> pixels = makeTestPixels(size, size);
+    std::vector<uint8_t> encoded;
+    if (jpeg)
+    {
+        stbi_write_jpg_to_func(appendToVector, &encoded, int(size), int(size), 4, pixels.data(), 90);
+    }
+    else
+    {
+        stbi_write_png_to_func(appendToVector, &encoded, int(size), int(size), 4, pixels.data(), int(size) * 4);
+    }
+    return encoded;
+}
+
+static std::string base64Encode(const uint8_t* data, size_t size)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    for (size_t i = 0; i < size; i += 3)
+    {
+        const uint32_t remaining = uint32_t(std::min<size_t>(size - i, 3));
+        uint32_t bits = uint32_t(data[i]) << 16;
+        if (remaining > 1) bits |= uint32_t(data[i + 1]) << 8;
+        if (remaining > 2) bits |= uint32_t(data[i + 2]);
+        out += kAlphabet[(bits >> 18) & 63];
+        out += kAlphabet[(bits >> 12) & 63];
+        out += remaining > 1 ? kAlphabet[(bits >> 6) & 63] : '=';
+        out += remaining > 2 ? kAlphabet[bits & 63] : '=';
+    }
+    return out;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "[writeFile] Could not open " << path << " for writing.\n";
+        return false;
+    }
+    const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// -----------------------------------------------------------------------------
+// Benchmarks
+// -----------------------------------------------------------------------------
+
+// The per-vertex converter assimpMeshToBuffers() was before the vertex format generated it, kept as the
+// baseline for benchMeshConversion (minus its vertex and index count printout)
+static void convertMeshBaseline(const aiMesh* mesh, std::vector<MyFancyVertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+    outVertices.clear();
+    outIndices.clear();
+    outVertices.reserve(mesh->mNumVertices);
+    outIndices.reserve(mesh->mNumFaces * 3);
+
+    bool hasNormals   = mesh->HasNormals();
+    bool hasTexcoords = (mesh->mTextureCoords[0] != nullptr);
+    bool hasTangents  = (mesh->HasTangentsAndBitangents());
+
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        MyFancyVertex v;
+
+        v.px = mesh->mVertices[i].x;
+        v.py = mesh->mVertices[i].y;
+        v.pz = mesh->mVertices[i].z;
+
+        if (hasNormals)
+        {
+            v.nx = mesh->mNormals[i].x;
+            v.ny = mesh->mNormals[i].y;
+            v.nz = mesh->mNormals[i].z;
+        }
+        else
+        {
+            v.nx = 0.0f; v.ny = 1.0f; v.nz = 0.0f;
+        }
+
+        if (hasTangents)
+        {
+            v.tx = mesh->mTangents[i].x;
+            v.ty = mesh->mTangents[i].y;
+            v.tz = mesh->mTangents[i].z;
+        }
+        else
+        {
+            v.tx = 1.0f; v.ty = 0.0f; v.tz = 0.0f;
+        }
+        v.tw = 1.0f; // the old vertex had no handedness
+
+        if (hasTexcoords)
+        {
+            v.u = mesh->mTextureCoords[0][i].x;
+            v.v = mesh->mTextureCoords[0][i].y;
+        }
+        else
+        {
+            v.u = 0.0f; v.v = 0.0f;
+        }
+
+        outVertices.push_back(v);
+    }
+
+    for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+    {
+        const aiFace& face = mesh->mFaces[f];
+        if (face.mNumIndices == 3)
+        {
+            outIndices.push_back(face.mIndices[0]);
+            outIndices.push_back(face.mIndices[1]);
+            outIndices.push_back(face.mIndices[2]);
+        }
+    }
+}
+
+static void benchMeshConversion(const std::string& input, const aiMesh* mesh)
+{
+    const uint64_t vertexBytes = uint64_t(sizeof(MyFancyVertex)) * mesh->mNumVertices;
+    const uint64_t indexBytes = uint64_t(sizeof(uint32_t)) * countTriangleIndices(mesh);
+    runBenchmark("assimpMeshToBuffers_baseline", input, vertexBytes + indexBytes, mesh->mNumVertices, [&](BenchTimer& timer)
+    {
+        // The buffers were handed to bgfx with makeRef, so filling the vectors was the whole conversion
+        std::vector<MyFancyVertex> vertices;
+        std::vector<uint32_t> indices;
+        timer.begin();
+        convertMeshBaseline(mesh, vertices, indices);
+        timer.end();
+        return vertices.size() == mesh->mNumVertices;
+    });
+    runBenchmark("assimpMeshToBuffers", input, vertexBytes + indexBytes, mesh->mNumVertices, [&](BenchTimer& timer)
+    {
+        const bgfx::Memory* vertices = nullptr;
+        const bgfx::Memory* indices = nullptr;
+        timer.begin();
+        const bool converted = assimpMeshToBuffers(mesh, vertices, indices);
+        timer.end();
+        if (!converted) return false;
+
+        // Handing the memory to bgfx is the only way to free it again
+        bgfx::destroy(bgfx::createVertexBuffer(vertices, s_vertexLayout));
+        bgfx::destroy(bgfx::createIndexBuffer(indices, BGFX_BUFFER_INDEX32));
+        bgfx::frame();
+        return true;
+    });
+}
+
+// The Boost.Beast decoder (boost/beast/core/detail/base64.hpp) loadBase64Texture() used before base64.h, kept as
+// the baseline for base64Decode: an inverse table, one character at a time, stopping at '=' or anything invalid
+static std::pair<size_t, size_t> beastBase64Decode(void* dest, const char* src, size_t len)
+{
+    static const std::array<int8_t, 256> inverse = []
+    {
+        std::array<int8_t, 256> table;
+        table.fill(-1);
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i) table[uint8_t(alphabet[i])] = int8_t(i);
+        return table;
+    }();
+
+    char* out = static_cast<char*>(dest);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    unsigned char c3[3];
+    unsigned char c4[4] = { 0, 0, 0, 0 };
+    int i = 0;
+    while (len-- && *in != '=')
+    {
+        const int8_t v = inverse[*in];
+        if (v == -1) break;
+        ++in;
+        c4[i] = uint8_t(v);
+        if (++i == 4)
+        {
+            c3[0] = uint8_t((c4[0] << 2) + ((c4[1] & 0x30) >> 4));
+            c3[1] = uint8_t(((c4[1] & 0xf) << 4) + ((c4[2] & 0x3c) >> 2));
+            c3[2] = uint8_t(((c4[2] & 0x3) << 6) + c4[3]);
+            for (i = 0; i < 3; i++) *out++ = char(c3[i]);
+            i = 0;
+        }
+    }
+    if (i)
+    {
+        c3[0] = uint8_t((c4[0] << 2) + ((c4[1] & 0x30) >> 4));
+        c3[1] = uint8_t(((c4[1] & 0xf) << 4) + ((c4[2] & 0x3c) >> 2));
+        c3[2] = uint8_t(((c4[2] & 0x3) << 6) + c4[3]);
+        for (int j = 0; j < i - 1; j++) *out++ = char(c3[j]);
+    }
+    return { size_t(out - static_cast<char*>(dest)), size_t(in - reinterpret_cast<const unsigned char*>(src)) };
+}
+
+// The old base64Decode(const std::string&): a fresh vector per call, sized by Beast's decoded_size()
+static std::vector<unsigned char> base64DecodeBaseline(const std::string& base64Str)
+{
+    std::vector<unsigned char> decoded(base64Str.size() / 4 * 3);
+    const auto result = beastBase64Decode(decoded.data(), base64Str.data(), base64Str.size());
+    decoded.resize(result.first);
+    return decoded;
+}
+
+// The old loadBase64Texture(): copies the payload out with substr(), decodes it into a new vector and creates
+// the texture from that, without the resource cache
+static bgfx::TextureHandle loadBase64TextureBaseline(const std::string& base64Uri)
+{
+    const size_t commaPos = base64Uri.find(',');
+    if (commaPos == std::string::npos)
+    {
+        return BGFX_INVALID_HANDLE;
+    }
+    std::string base64Part = base64Uri.substr(commaPos + 1);
+    std::vector<unsigned char> rawBytes = base64DecodeBaseline(base64Part);
+    if (rawBytes.empty())
+    {
+        return BGFX_INVALID_HANDLE;
+    }
+    return createBgfxTextureFromMemory(rawBytes.data(), rawBytes.size());
+}
+
+static void benchImage(const std::string& input, const std::vector<uint8_t>& encoded)
+{
+    DecodedImage probe;
+    if (!decodeImageRGBA(encoded.data(), encoded.size(), probe))
+    {
+        std::cerr << "[benchImage] Could not decode " << input << ", skipped.\n";
+        return;
+    }
+    const uint64_t pixels = uint64_t(probe.width) * probe.height;
+
+    runBenchmark("decodeImageRGBA", input, encoded.size(), pixels, [&](BenchTimer& timer)
+    {
+        DecodedImage image;
+        timer.begin();
+        const bool decoded = decodeImageRGBA(encoded.data(), encoded.size(), image);
+        timer.end();
+        return decoded;
+    });
+
+    runBenchmark("swapRedBlue", input, pixels * 4, pixels, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        swapRedBlue(probe.pixels.get(), size_t(pixels));
+        timer.end();
+        return true;
+    });
+
+    runBenchmark("createBgfxTextureFromMemory", input, encoded.size(), pixels, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        bgfx::TextureHandle texture = createBgfxTextureFromMemory(encoded.data(), encoded.size());
+        timer.end();
+        if (!bgfx::isValid(texture)) return false;
+        bgfx::destroy(texture);
+        bgfx::frame();
+        return true;
+    });
+
+    const std::string base64 = base64Encode(encoded.data(), encoded.size());
+    const std::string uri = "data:application/octet-stream;base64," + base64;
+    runBenchmark("loadBase64Texture", input, uri.size(), pixels, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        bgfx::TextureHandle texture = loadBase64Texture(uri);
+        timer.end();
+        if (!bgfx::isValid(texture)) return false;
+        g_resources.release(texture);
+        bgfx::frame();
+        return true;
+    });
+
+    runBenchmark("loadBase64Texture_baseline", input, uri.size(), pixels, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        bgfx::TextureHandle texture = loadBase64TextureBaseline(uri);
+        timer.end();
+        if (!bgfx::isValid(texture)) return false;
+        bgfx::destroy(texture);
+        bgfx::frame();
+        return true;
+    });
+}
+
+static void benchBase64(const std::string& input, size_t decodedSize)
+{
+    std::vector<uint8_t> payload(decodedSize);
+    std::mt19937 rng(5678);
+    for (uint8_t& byte : payload) byte = uint8_t(rng());
+    const std::string encoded = base64Encode(payload.data(), payload.size());
+
+    std::vector<uint8_t> decoded(base64DecodedCapacity(encoded.size()));
+    runBenchmark("base64Decode", input, encoded.size(), 0, [&](BenchTimer& timer)
+    {
+        size_t outSize = 0;
+        timer.begin();
+        const bool ok = base64Decode(encoded, decoded.data(), outSize);
+        timer.end();
+        return ok && outSize == decodedSize;
+    });
+
+    // The scalar decoder base64Decode() finishes the tail with, over the whole input: the baseline the SIMD paths replace
+    runBenchmark("base64Decode_scalar", input, encoded.size(), 0, [&](BenchTimer& timer)
+    {
+        size_t outSize = 0;
+        timer.begin();
+        const bool ok = base64_detail::decodeScalar(encoded.data(), encoded.size(), decoded.data(), outSize);
+        timer.end();
+        return ok && outSize == decodedSize;
+    });
+
+    // What the viewer decoded with before base64.h, allocation included
+    runBenchmark("base64Decode_beast", input, encoded.size(), 0, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        const std::vector<unsigned char> baseline = base64DecodeBaseline(encoded);
+        timer.end();
+        return baseline.size() == decodedSize && std::memcmp(baseline.data(), payload.data(), decodedSize) == 0;
+    });
+}
+
+static void benchFileRead(const std::string& path)
+{
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        std::cerr << "[benchFileRead] " << path << " not found, skipped.\n";
+        return;
+    }
+
+    // The file is in the page cache after the warm-up, so this is the read path, not the disk
+    runBenchmark("loadMem", path, size, 0, [&](BenchTimer& timer)
+    {
+        std::vector<uint8_t> data;
+        timer.begin();
+        const bool loaded = loadMem(path.c_str(), data);
+        timer.end();
+        return loaded;
+    });
+}
+
+static void benchExternalTexture(const std::string& path)
+{
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        std::cerr << "[benchExternalTexture] " << path << " not found, skipped.\n";
+        return;
+    }
+
+    // Released after every load, so each one reads and decodes the file again (the path stays known to the cache)
+    runBenchmark("loadExternalTexture", path, size, 0, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        bgfx::TextureHandle texture = loadExternalTexture(path);
+        timer.end();
+        if (!bgfx::isValid(texture)) return false;
+        g_resources.release(texture);
+        bgfx::frame();
+        return true;
+    });
+}
+
+static void benchImport(const std::string& path)
+{
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        std::cerr << "[benchImport] " << path << " not found, skipped.\n";
+        return;
+    }
+
+    uint64_t numVertices = 0;
+    {
+        Assimp::Importer importer;
+        importer.SetIOHandler(new DataUriIOSystem());
+        const aiScene* scene = importer.ReadFile(path, kAssetImportFlags);
+        for (unsigned int m = 0; scene && m < scene->mNumMeshes; ++m)
+        {
+            numVertices += scene->mMeshes[m]->mNumVertices;
+        }
+    }
+
+    // Set up like loadScene() does, importer construction included
+    runBenchmark("Importer::ReadFile", path, size, numVertices, [&](BenchTimer& timer)
+    {
+        timer.begin();
+        Assimp::Importer importer;
+        importer.SetIOHandler(new DataUriIOSystem()); // importer takes ownership
+        const bool imported = importer.ReadFile(path, kAssetImportFlags) != nullptr;
+        timer.end();
+        if (!imported)
+        {
+            std::cerr << "[benchImport] " << importer.GetErrorString() << "\n";
+        }
+        return imported;
+    });
+}
+
+static void benchImportedMeshes(const std::string& path)
+{
+    Assimp::Importer importer;
+    importer.SetIOHandler(new DataUriIOSystem());
+    const aiScene* scene = importer.ReadFile(path, kAssetImportFlags);
+    if (!scene)
+    {
+        std::cerr << "[benchImportedMeshes] " << path << " not loaded, skipped.\n";
+        return;
+    }
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+    {
+        benchMeshConversion(path + "#mesh" + std::to_string(m), scene->mMeshes[m]);
+    }
+}
+
+// --chunk-mesh on an imported mesh; every triangle has to end up in a chunk
+static void benchChunkMesh(const std::string& input, const aiMesh* mesh, const std::string& outputPath)
+{
+    runBenchmark("writeChunkedMesh", input, 0, mesh->mNumFaces, [&](BenchTimer& timer)
+    {
+        ChunkWriteStats stats;
+        timer.begin();
+        const bool written = writeChunkedMesh(outputPath.c_str(), &mesh, 1, kDefaultChunkTriangles, &stats);
+        timer.end();
+        return written && stats.numTriangles == mesh->mNumFaces;
+    });
+}
+
+// --chunk-mesh on a PLY file, out of core
+static void benchChunkPly(const std::string& plyPath, uint64_t numTriangles, const std::string& outputPath)
+{
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(plyPath, error);
+    runBenchmark("writeChunkedMeshFromPly", plyPath, error ? 0 : size, numTriangles, [&](BenchTimer& timer)
+    {
+        ChunkWriteStats stats;
+        timer.begin();
+        const bool written = writeChunkedMeshFromPly(plyPath.c_str(), outputPath.c_str(), kDefaultChunkTriangles, &stats);
+        timer.end();
+        return written && stats.numTriangles == numTriangles;
+    });
+}
+
+// ChunkStreamer::update() under a budget of a few chunks, with the camera circling the mesh so chunks keep
+// entering and leaving the frustum. The timed part includes uploading the reads that finished since the last op.
+static void benchChunkStreaming(const std::string& chunkPath)
+{
+    ChunkStreamer streamer;
+    if (!streamer.open(chunkPath.c_str(), 8 * 1024 * 1024, s_vertexLayout))
+    {
+        return;
+    }
+    const ChunkFileHeader& header = streamer.header();
+    const bx::Vec3 center = { (header.boundsMin[0] + header.boundsMax[0]) * 0.5f, (header.boundsMin[1] + header.boundsMax[1]) * 0.5f,
+                              (header.boundsMin[2] + header.boundsMax[2]) * 0.5f };
+    const float radius = bx::length(bx::sub(bx::Vec3{ header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] }, center));
+
+    float model[16];
+    bx::mtxIdentity(model);
+    float proj[16];
+    bx::mtxProj(proj, 60.0f, 1.0f, 0.01f, 100.0f, false);
+    uint32_t step = 0;
+    runBenchmark("ChunkStreamer::update", chunkPath, 0, header.numChunks, [&](BenchTimer& timer)
+    {
+        const float angle = float(step++) * 0.02f;
+        const bx::Vec3 eye = { center.x + 0.8f * radius * std::sin(angle), center.y + 0.3f * radius, center.z + 0.8f * radius * std::cos(angle) };
+        float view[16];
+        bx::mtxLookAt(view, eye, center);
+        float viewProj[16];
+        bx::mtxMul(viewProj, view, proj);
+
+        uint32_t numVisible = 0;
+        timer.begin();
+        streamer.update(model, viewProj, eye, false);
+        streamer.forEachVisible([&](bgfx::DynamicVertexBufferHandle, bgfx::DynamicIndexBufferHandle, uint32_t, uint32_t) { ++numVisible; });
+        timer.end();
+        bgfx::frame();
+        return numVisible <= header.numChunks;
+    });
+}
+
+// Every vertex of a chunked mesh file
+static bool readChunkedVertices(const std::string& path, std::vector<MyFancyVertex>& out)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "[readChunkedVertices] Could not open " << path << ".\n";
+        return false;
+    }
+    ChunkFileHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, kChunkFileMagic, sizeof(kChunkFileMagic)) == 0;
+    std::vector<ChunkRecord> records(ok ? header.numChunks : 0);
+    ok = ok && seekChunkFile(file, header.chunkTableOffset) && std::fread(records.data(), sizeof(ChunkRecord), records.size(), file) == records.size();
+    out.clear();
+    for (size_t c = 0; c < records.size() && ok; ++c)
+    {
+        const size_t first = out.size();
+        out.resize(first + records[c].numVertices);
+        ok = seekChunkFile(file, records[c].offset) && std::fread(&out[first], sizeof(MyFancyVertex), records[c].numVertices, file) == records[c].numVertices;
+    }
+    std::fclose(file);
+    if (!ok)
+    {
+        std::cerr << "[readChunkedVertices] Could not read " << path << ".\n";
+    }
+    return ok;
+}
+
+// Both --chunk-mesh paths have to give a PLY the same UVs: assimp's import (kAssetImportFlags flip z and v)
+// and the out-of-core chunker are matched vertex by vertex on position
+static bool checkPlyChunkUvs(const std::filesystem::path& scratchDir)
+{
+    const std::string plyPath = (scratchDir / "uv_check.ply").string();
+    const std::string assimpChunks = (scratchDir / "uv_check_assimp.chunks").string();
+    const std::string plyChunks = (scratchDir / "uv_check_ply.chunks").string();
+    if (!writeGridPly(plyPath, 16))
+    {
+        return false;
+    }
+    Assimp::Importer importer;
+    importer.SetIOHandler(new DataUriIOSystem()); // importer takes ownership
+    const aiScene* scene = importer.ReadFile(plyPath, kAssetImportFlags | aiProcess_PreTransformVertices);
+    std::vector<MyFancyVertex> fromAssimp;
+    std::vector<MyFancyVertex> fromPly;
+    if (!scene || !writeChunkedMesh(assimpChunks.c_str(), scene->mMeshes, scene->mNumMeshes, kDefaultChunkTriangles)
+        || !writeChunkedMeshFromPly(plyPath.c_str(), plyChunks.c_str(), kDefaultChunkTriangles)
+        || !readChunkedVertices(assimpChunks, fromAssimp) || !readChunkedVertices(plyChunks, fromPly))
+    {
+        std::cerr << "[checkPlyChunkUvs] Could not chunk " << plyPath << " both ways.\n";
+        return false;
+    }
+
+    const auto key = [](const MyFancyVertex& vertex)
+    {
+        return std::make_tuple(std::lround(vertex.px * 1e5f), std::lround(vertex.py * 1e5f), std::lround(vertex.pz * 1e5f));
+    };
+    std::map<std::tuple<long, long, long>, const MyFancyVertex*> byPosition;
+    for (const MyFancyVertex& vertex : fromAssimp)
+    {
+        byPosition[key(vertex)] = &vertex;
+    }
+    size_t missing = 0;
+    size_t mismatched = 0;
+    for (const MyFancyVertex& vertex : fromPly)
+    {
+        const auto found = byPosition.find(key(vertex));
+        if (found == byPosition.end())
+        {
+            ++missing;
+        }
+        else if (std::fabs(found->second->u - vertex.u) > 1e-5f || std::fabs(found->second->v - vertex.v) > 1e-5f)
+        {
+            ++mismatched;
+        }
+    }
+    if (fromPly.empty() || missing != 0 || mismatched != 0)
+    {
+        std::cerr << "[checkPlyChunkUvs] Of " << fromPly.size() << " out-of-core vertices, " << missing << " aren't in assimp's chunks and "
+                  << mismatched << " have other UVs.\n";
+        return false;
+    }
+    return true;
+}
+
+static bool loadFile(const std::string& path, std::vector<uint8_t>& out)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        std::cerr << "[loadFile] " << path << " not found, skipped.\n";
+        return false;
+    }
+    return loadMem(path.c_str(), out);
+}
+
+int main(int argc, char** argv)
+{
+    // --commit SHA: recorded in every result line (default "unknown")
+    // --filter TEXT: only run benchmarks whose name contains TEXT
+    // --min-time SECONDS: timed seconds per repetition (default 0.2)
+    // --repetitions N: repetitions per benchmark, the median is reported (default 5)
+    // --asset FILE: real asset to import (default Drill_01_1k.gltf), repeatable
+    // --texture FILE: real image to decode (default the drill's three JPGs), repeatable
+    std::vector<std::string> assets;
+    std::vector<std::string> textures;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--commit" && i + 1 < argc)
+        {
+            s_commit = argv[++i];
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            s_filter = argv[++i];
+        }
+        else if (arg == "--min-time" && i + 1 < argc)
+        {
+            s_minSeconds = std::max(0.001, std::atof(argv[++i]));
+        }
+        else if (arg == "--repetitions" && i + 1 < argc)
+        {
+            s_repetitions = uint32_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--asset" && i + 1 < argc)
+        {
+            assets.push_back(argv[++i]);
+        }
+        else if (arg == "--texture" && i + 1 < argc)
+        {
+            textures.push_back(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (assets.empty())
+    {
+        assets.push_back("Drill_01_1k.gltf");
+    }
+    if (textures.empty())
+    {
+        textures = { "Drill_01_diff_1k.jpg", "Drill_01_nor_gl_1k.jpg", "Drill_01_arm_1k.jpg" };
+    }
+
+    // Single-threaded, so bgfx::frame() processes the creates and destroys right away
+    bgfx::renderFrame();
+    bgfx::Init init;
+    init.type = bgfx::RendererType::Noop;
+    init.resolution.width = 1;
+    init.resolution.height = 1;
+    init.resolution.reset = BGFX_RESET_NONE;
+    if (!bgfx::init(init))
+    {
+        std::cerr << "bgfx init failed!\n";
+        return 1;
+    }
+    buildVertexLayout(kFancyVertexFormat, kFancyVertexFormatCount, s_vertexLayout);
+
+    std::error_code error;
+    const std::filesystem::path scratchDir = std::filesystem::temp_directory_path(error) / "bench_loading";
+    std::filesystem::create_directories(scratchDir, error);
+
+    // Checked before anything is timed, so wrong output can't be benchmarked
+    if (!checkPlyChunkUvs(scratchDir))
+    {
+        std::filesystem::remove_all(scratchDir, error);
+        bgfx::shutdown();
+        return 1;
+    }
+
+    // Mesh conversion
+    for (uint32_t side : { 64u, 1024u })
+    {
+        aiMesh* mesh = makeGridMesh(side);
+        benchMeshConversion("synthetic grid " + std::to_string(mesh->mNumVertices) + " vertices", mesh);
+        delete mesh;
+    }
+    for (const std::string& asset : assets)
+    {
+        benchImportedMeshes(asset);
+    }
+
+    // Image decoding, the R/B swap, texture creation and data URIs
+    for (uint32_t size : { 256u, 2048u })
+    {
+        for (bool jpeg : { false, true })
+        {
+            benchImage("synthetic " + std::to_string(size) + "x" + std::to_string(size) + (jpeg ? " jpg" : " png"), encodeTestImage(size, jpeg));
+        }
+    }
+    for (const std::string& texture : textures)
+    {
+        std::vector<uint8_t> data;
+        if (loadFile(texture, data))
+        {
+            benchImage(texture, data);
+        }
+    }
+
+    // Base64 on its own
+    benchBase64("synthetic 64 KiB", 64 * 1024);
+    benchBase64("synthetic 16 MiB", 16 * 1024 * 1024);
+
+    // File reads
+    const std::string syntheticFile = (scratchDir / "synthetic_64MiB.bin").string();
+    if (writeFile(syntheticFile, std::vector<uint8_t>(64 * 1024 * 1024, 0x5a)))
+    {
+        benchFileRead(syntheticFile);
+    }
+    const std::string syntheticImage = (scratchDir / "synthetic_2048.png").string();
+    if (writeFile(syntheticImage, encodeTestImage(2048, false)))
+    {
+        benchExternalTexture(syntheticImage);
+    }
+    for (const std::string& texture : textures)
+    {
+        benchFileRead(texture);
+        benchExternalTexture(texture);
+    }
+
+    // Import with the post-processing the viewer uses
+    const std::string syntheticObj = (scratchDir / "synthetic_grid_256.obj").string();
+    if (writeGridObj(syntheticObj, 256))
+    {
+        benchImport(syntheticObj);
+    }
+    for (const std::string& asset : assets)
+    {
+        benchFileRead(asset);
+        benchImport(asset);
+    }
+
+    // Chunking for --stream-mesh, in memory and out of core, then streaming the chunks back
+    {
+        aiMesh* mesh = makeGridMesh(1024);
+        benchChunkMesh("synthetic grid " + std::to_string(mesh->mNumFaces) + " triangles", mesh, (scratchDir / "synthetic_grid_1024.chunks").string());
+        delete mesh;
+    }
+    const std::string syntheticPly = (scratchDir / "synthetic_grid_1024.ply").string();
+    const std::string syntheticChunks = (scratchDir / "synthetic_grid_1024_ply.chunks").string();
+    if (writeGridPly(syntheticPly, 1024))
+    {
+        benchChunkPly(syntheticPly, 1024ull * 1024ull * 2ull, syntheticChunks);
+        benchChunkStreaming(syntheticChunks);
+    }
+
+    std::filesystem::remove_all(scratchDir, error);
+    bgfx::shutdown();
+    return 0;
+}
@@ -0,0 +1,781 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <assimp/mesh.h>
+#include <bgfx/bgfx.h>
+#include <bx/math.h>
+#include <bx/timer.h>
+
+#include "parallel_for.h"
+#include "simd_float4.h"
+#include "vertex_format.h"
+
+// -----------------------------------------------------------------------------
+// Chunked mesh files: a mesh split offline into spatially coherent chunks that
+// are streamed in and out at runtime (ChunkStreamer below), so meshes bigger
+// than memory, or than one buffer, can be drawn. Layout:
+//   page 0:  ChunkFileHeader
+//   pages:   per chunk, numVertices MyFancyVertex then numIndices 16-bit local
+//            indices, starting on a page boundary so a chunk is one read
+//   end:     ChunkRecord table
+// -----------------------------------------------------------------------------
+static constexpr char kChunkFileMagic[8] = { 'D', 'R', 'C', 'H', 'U', 'N', 'K', 'S' };
+static constexpr uint32_t kChunkFileVersion = 1;
+static constexpr uint32_t kChunkPageSize = 64 * 1024;
+// At most 3 new vertices per triangle, so chunks of up to this many triangles always fit 16-bit indices
+static constexpr uint32_t kMaxChunkTriangles = 65535 / 3;
+static constexpr uint32_t kDefaultChunkTriangles = 16 * 1024;
+
+struct ChunkFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexStride;     // the file is only valid for the vertex layout it was written with
+    uint32_t pageSize;
+    uint32_t numChunks;
+    uint32_t maxChunkVertices; // sizes the runtime's buffer slots
+    uint32_t maxChunkIndices;
+    uint64_t chunkTableOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+static_assert(sizeof(ChunkFileHeader) == 64, "ChunkFileHeader is written as is");
+
+struct ChunkRecord
+{
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t offset;
+    uint32_t numVertices;
+    uint32_t numIndices;
+};
+static_assert(sizeof(ChunkRecord) == 40, "ChunkRecord is written as is");
+
+struct ChunkWriteStats
+{
+    uint32_t numChunks = 0;
+    uint64_t numTriangles = 0;
+    uint64_t fileBytes = 0;
+};
+
+// fseek takes a long, which is 32 bits on wasm; chunk files can be bigger than 2 GiB
+inline bool seekChunkFile(FILE* file, uint64_t offset)
+{
+    static_assert(sizeof(off_t) >= 8, "chunk files need 64-bit file offsets (build with _FILE_OFFSET_BITS=64)");
+    return fseeko(file, off_t(offset), SEEK_SET) == 0;
+}
+
+// Writes a chunked mesh file one chunk at a time: fill the buffers beginChunk() returns, then endChunk()
+// pads the chunk to a page and writes it. finish() appends the chunk table and the header.
+class ChunkFileWriter
+{
+public:
+    ~ChunkFileWriter()
+    {
+        if (m_file)
+        {
+            std::fclose(m_file);
+        }
+    }
+
+    bool open(const char* path)
+    {
+        m_file = std::fopen(path, "wb");
+        if (!m_file)
+        {
+            std::cerr << "[ChunkFileWriter] Could not open " << path << " for writing.\n";
+            return false;
+        }
+        m_path = path;
+
+        m_header = {};
+        std::memcpy(m_header.magic, kChunkFileMagic, sizeof(m_header.magic));
+        m_header.version = kChunkFileVersion;
+        m_header.vertexStride = sizeof(MyFancyVertex);
+        m_header.pageSize = kChunkPageSize;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            m_header.boundsMin[axis] = FLT_MAX;
+            m_header.boundsMax[axis] = -FLT_MAX;
+        }
+
+        // The header is rewritten at the end, its page is reserved for now
+        m_chunkData.assign(kChunkPageSize, 0);
+        m_ok = std::fwrite(m_chunkData.data(), 1, m_chunkData.size(), m_file) == m_chunkData.size();
+        m_offset = kChunkPageSize;
+        m_records.clear();
+        m_numTriangles = 0;
+        return m_ok;
+    }
+
+    // Room for the next chunk's vertices and 16-bit local indices
+    MyFancyVertex* beginChunk(uint32_t numVertices, uint32_t numIndices)
+    {
+        m_numVertices = numVertices;
+        m_numIndices = numIndices;
+        const size_t usedBytes = vertexBytes() + size_t(numIndices) * sizeof(uint16_t);
+        m_chunkData.resize((usedBytes + kChunkPageSize - 1) / kChunkPageSize * kChunkPageSize);
+        return reinterpret_cast<MyFancyVertex*>(m_chunkData.data());
+    }
+
+    uint16_t* chunkIndices() { return reinterpret_cast<uint16_t*>(m_chunkData.data() + vertexBytes()); }
+
+    bool endChunk()
+    {
+        ChunkRecord record;
+        record.offset = m_offset;
+        record.numVertices = m_numVertices;
+        record.numIndices = m_numIndices;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            record.boundsMin[axis] = FLT_MAX;
+            record.boundsMax[axis] = -FLT_MAX;
+        }
+        const MyFancyVertex* vertices = reinterpret_cast<const MyFancyVertex*>(m_chunkData.data());
+        for (uint32_t i = 0; i < m_numVertices; ++i)
+        {
+            const float position[3] = { vertices[i].px, vertices[i].py, vertices[i].pz };
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                record.boundsMin[axis] = std::min(record.boundsMin[axis], position[axis]);
+                record.boundsMax[axis] = std::max(record.boundsMax[axis], position[axis]);
+            }
+        }
+
+        const size_t usedBytes = vertexBytes() + size_t(m_numIndices) * sizeof(uint16_t);
+        std::memset(m_chunkData.data() + usedBytes, 0, m_chunkData.size() - usedBytes);
+        m_ok = m_ok && std::fwrite(m_chunkData.data(), 1, m_chunkData.size(), m_file) == m_chunkData.size();
+        m_offset += m_chunkData.size();
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            m_header.boundsMin[axis] = std::min(m_header.boundsMin[axis], record.boundsMin[axis]);
+            m_header.boundsMax[axis] = std::max(m_header.boundsMax[axis], record.boundsMax[axis]);
+        }
+        m_header.maxChunkVertices = std::max(m_header.maxChunkVertices, record.numVertices);
+        m_header.maxChunkIndices = std::max(m_header.maxChunkIndices, record.numIndices);
+        m_records.push_back(record);
+        m_numTriangles += m_numIndices / 3;
+        return m_ok;
+    }
+
+    bool finish(ChunkWriteStats* outStats = nullptr)
+    {
+        m_header.numChunks = uint32_t(m_records.size());
+        m_header.chunkTableOffset = m_offset;
+        bool ok = m_ok && std::fwrite(m_records.data(), sizeof(ChunkRecord), m_records.size(), m_file) == m_records.size();
+        ok = ok && seekChunkFile(m_file, 0) && std::fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+        ok = std::fclose(m_file) == 0 && ok;
+        m_file = nullptr;
+        if (!ok)
+        {
+            std::cerr << "[ChunkFileWriter] Could not write " << m_path << ".\n";
+            return false;
+        }
+        if (m_records.empty())
+        {
+            std::cerr << "[ChunkFileWriter] No triangles to write.\n";
+            return false;
+        }
+
+        if (outStats)
+        {
+            outStats->numChunks = m_header.numChunks;
+            outStats->numTriangles = m_numTriangles;
+            outStats->fileBytes = m_offset + m_records.size() * sizeof(ChunkRecord);
+        }
+        return true;
+    }
+
+private:
+    size_t vertexBytes() const { return size_t(m_numVertices) * sizeof(MyFancyVertex); }
+
+    FILE* m_file = nullptr;
+    std::string m_path;
+    bool m_ok = false;
+    ChunkFileHeader m_header = {};
+    std::vector<uint8_t> m_chunkData;
+    std::vector<ChunkRecord> m_records;
+    uint64_t m_offset = 0;
+    uint64_t m_numTriangles = 0;
+    uint32_t m_numVertices = 0;
+    uint32_t m_numIndices = 0;
+};
+
+// Mesh vertex id -> local index in the chunk being built. Sized for the most vertices a chunk can have,
+// so it costs the same whatever the size of the mesh.
+class ChunkVertexMap
+{
+public:
+    ChunkVertexMap() : m_keys(kSize, UINT32_MAX), m_values(kSize) {}
+
+    // The local index of `vertex`, appending it to `ids` the first time it's seen
+    uint16_t localIndex(uint32_t vertex, std::vector<uint32_t>& ids)
+    {
+        uint32_t slot = (vertex * 0x9e3779b1u) >> (32 - kSizeLog2);
+        while (m_keys[slot] != UINT32_MAX)
+        {
+            if (m_keys[slot] == vertex)
+            {
+                return m_values[slot];
+            }
+            slot = (slot + 1) & (kSize - 1);
+        }
+        m_keys[slot] = vertex;
+        m_values[slot] = uint16_t(ids.size());
+        m_used.push_back(slot);
+        ids.push_back(vertex);
+        return m_values[slot];
+    }
+
+    void clear()
+    {
+        for (uint32_t slot : m_used)
+        {
+            m_keys[slot] = UINT32_MAX;
+        }
+        m_used.clear();
+    }
+
+private:
+    static constexpr uint32_t kSizeLog2 = 17;
+    static constexpr uint32_t kSize = 1u << kSizeLog2; // at most half full: a chunk has at most 3 * kMaxChunkTriangles vertices
+    static_assert(kSize >= 6 * kMaxChunkTriangles, "ChunkVertexMap is too small for the biggest chunk");
+
+    std::vector<uint32_t> m_keys;
+    std::vector<uint16_t> m_values;
+    std::vector<uint32_t> m_used;
+};
+
+// Median splits triangles[begin, end) along the longest axis of their centroids (3 floats per triangle
+// id) until every range has at most maxTriangles, then calls emit(begin, end) for the ranges, depth first
+// so chunks that are close in space mostly end up close in the file too. Stops when emit returns false.
+template <typename Fn>
+inline bool splitTrianglesByCentroid(std::vector<uint32_t>& triangles, const float* centroids, uint32_t maxTriangles, Fn&& emit)
+{
+    std::vector<std::pair<size_t, size_t>> stack;
+    stack.push_back({ 0, triangles.size() });
+    while (!stack.empty())
+    {
+        const size_t begin = stack.back().first;
+        const size_t end = stack.back().second;
+        stack.pop_back();
+        if (begin == end)
+        {
+            continue;
+        }
+
+        if (end - begin > maxTriangles)
+        {
+            float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (size_t t = begin; t < end; ++t)
+            {
+                const float* centroid = &centroids[size_t(triangles[t]) * 3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    centroidMin[axis] = std::min(centroidMin[axis], centroid[axis]);
+                    centroidMax[axis] = std::max(centroidMax[axis], centroid[axis]);
+                }
+            }
+            int axis = 0;
+            for (int a = 1; a < 3; ++a)
+            {
+                if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis]) axis = a;
+            }
+
+            const size_t mid = begin + (end - begin) / 2;
+            std::nth_element(triangles.begin() + begin, triangles.begin() + mid, triangles.begin() + end, [&](uint32_t a, uint32_t b)
+            {
+                return centroids[size_t(a) * 3 + axis] < centroids[size_t(b) * 3 + axis];
+            });
+            stack.push_back({ mid, end });
+            stack.push_back({ begin, mid });
+            continue;
+        }
+
+        if (!emit(begin, end))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Splits the meshes' triangles into chunks of at most maxTriangles and writes them to `path`, ready to
+// upload. The meshes have to fit in memory here (plus a centroid per triangle); meshes that don't can be
+// chunked from a PLY file with writeChunkedMeshFromPly (ply_chunking.h). The viewer then only holds the
+// chunks it draws.
+inline bool writeChunkedMesh(const char* path, const aiMesh* const* meshes, size_t numMeshes, uint32_t maxTriangles, ChunkWriteStats* outStats = nullptr)
+{
+    maxTriangles = std::clamp(maxTriangles, 1u, kMaxChunkTriangles);
+
+    ChunkFileWriter writer;
+    if (!writer.open(path))
+    {
+        return false;
+    }
+
+    ChunkVertexMap vertexMap;
+    std::vector<uint32_t> chunkVertexIds;
+    for (size_t m = 0; m < numMeshes; ++m)
+    {
+        const aiMesh* mesh = meshes[m];
+        if (!mesh || !mesh->HasPositions())
+        {
+            continue;
+        }
+
+        std::vector<uint32_t> triangles;
+        triangles.reserve(mesh->mNumFaces);
+        for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+        {
+            if (mesh->mFaces[f].mNumIndices == 3) triangles.push_back(f);
+        }
+        std::vector<float> centroids(size_t(mesh->mNumFaces) * 3);
+        parallelFor(triangles.size(), 64 * 1024, [&](size_t begin, size_t end)
+        {
+            for (size_t t = begin; t < end; ++t)
+            {
+                const aiFace& face = mesh->mFaces[triangles[t]];
+                float* centroid = &centroids[size_t(triangles[t]) * 3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    centroid[axis] = (mesh->mVertices[face.mIndices[0]][axis] + mesh->mVertices[face.mIndices[1]][axis] + mesh->mVertices[face.mIndices[2]][axis]) * (1.0f / 3.0f);
+                }
+            }
+        });
+
+        const bool ok = splitTrianglesByCentroid(triangles, centroids.data(), maxTriangles, [&](size_t begin, size_t end)
+        {
+            chunkVertexIds.clear();
+            vertexMap.clear();
+            std::vector<uint16_t> localIndices;
+            localIndices.reserve((end - begin) * 3);
+            for (size_t t = begin; t < end; ++t)
+            {
+                const aiFace& face = mesh->mFaces[triangles[t]];
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    localIndices.push_back(vertexMap.localIndex(face.mIndices[corner], chunkVertexIds));
+                }
+            }
+
+            MyFancyVertex* vertices = writer.beginChunk(uint32_t(chunkVertexIds.size()), uint32_t(localIndices.size()));
+            gatherVertices<kFancyVertexFormat, kFancyVertexFormatCount>(mesh, chunkVertexIds.data(), chunkVertexIds.size(), vertices);
+            std::memcpy(writer.chunkIndices(), localIndices.data(), localIndices.size() * sizeof(uint16_t));
+            return writer.endChunk();
+        });
+        if (!ok)
+        {
+            break;
+        }
+    }
+    return writer.finish(outStats);
+}
+
+// -----------------------------------------------------------------------------
+// Keeps the chunks of a chunked mesh file that matter most to the camera in a
+// fixed pool of dynamic vertex/index buffers. Every slot fits the file's
+// largest chunk, so the pool is allocated once from the memory budget and
+// never grows. Chunks rank by bounding radius over distance, with the ones
+// outside the frustum weighted down but still prefetched when there's room; a
+// resident chunk is only evicted for one that ranks higher. Reads run on a
+// background thread (inline in the wasm build) and are uploaded by the next
+// update().
+// -----------------------------------------------------------------------------
+class ChunkStreamer
+{
+public:
+    ~ChunkStreamer() { close(); }
+
+    bool open(const char* path, uint64_t budgetBytes, const bgfx::VertexLayout& layout)
+    {
+        close();
+        m_file = std::fopen(path, "rb");
+        if (!m_file)
+        {
+            std::cerr << "[ChunkStreamer] Could not open " << path << ".\n";
+            return false;
+        }
+
+        if (std::fread(&m_header, sizeof(m_header), 1, m_file) != 1 || std::memcmp(m_header.magic, kChunkFileMagic, sizeof(kChunkFileMagic)) != 0
+            || m_header.version != kChunkFileVersion)
+        {
+            std::cerr << "[ChunkStreamer] " << path << " isn't a chunked mesh file (or an old version of one).\n";
+            close();
+            return false;
+        }
+        if (m_header.vertexStride != layout.getStride())
+        {
+            std::cerr << "[ChunkStreamer] " << path << " was written for another vertex layout, chunk it again.\n";
+            close();
+            return false;
+        }
+
+        std::vector<ChunkRecord> records(m_header.numChunks);
+        if (m_header.numChunks == 0 || !seekChunkFile(m_file, m_header.chunkTableOffset)
+            || std::fread(records.data(), sizeof(ChunkRecord), records.size(), m_file) != records.size())
+        {
+            std::cerr << "[ChunkStreamer] Could not read the chunk table of " << path << ".\n";
+            close();
+            return false;
+        }
+        m_chunks.resize(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            m_chunks[i].record = records[i];
+        }
+
+        m_slotBytes = uint64_t(m_header.maxChunkVertices) * m_header.vertexStride + uint64_t(m_header.maxChunkIndices) * sizeof(uint16_t);
+        const uint64_t numSlots = std::min<uint64_t>(budgetBytes / m_slotBytes, m_chunks.size());
+        if (numSlots == 0)
+        {
+            std::cerr << "[ChunkStreamer] The budget doesn't fit the largest chunk (" << m_slotBytes << " bytes).\n";
+            close();
+            return false;
+        }
+        m_slots.resize(size_t(numSlots));
+        for (Slot& slot : m_slots)
+        {
+            slot.vb = bgfx::createDynamicVertexBuffer(m_header.maxChunkVertices, layout);
+            slot.ib = bgfx::createDynamicIndexBuffer(m_header.maxChunkIndices);
+        }
+
+#if !__EMSCRIPTEN__
+        m_io.reset(new BackgroundJobQueue(1));
+#endif // !__EMSCRIPTEN__
+        return true;
+    }
+
+    void close()
+    {
+#if !__EMSCRIPTEN__
+        m_io.reset(); // finishes the reads in flight
+#endif // !__EMSCRIPTEN__
+        for (Slot& slot : m_slots)
+        {
+            bgfx::destroy(slot.vb);
+            bgfx::destroy(slot.ib);
+        }
+        m_slots.clear();
+        m_chunks.clear();
+        m_order.clear();
+        m_finished.clear();
+        m_readsInFlight = 0;
+        m_residentBytes = 0;
+        m_stagingBytes = 0;
+        m_stats = Stats();
+        if (m_file)
+        {
+            std::fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+
+    bool isOpen() const { return m_file != nullptr; }
+    const ChunkFileHeader& header() const { return m_header; }
+
+    // Uploads the chunks that have been read, ranks all of them for this camera and queues the reads
+    // for the best ranked ones that aren't resident. `model` places the file's chunks in the world.
+    void update(const float* model, const float* viewProj, const bx::Vec3& eye, bool homogeneousDepth)
+    {
+        uploadFinished();
+
+        float modelViewProj[16];
+        simd4::multiplyMatrix(model, viewProj, modelViewProj);
+        float invModel[16];
+        bx::mtxInverse(invModel, model);
+        const bx::Vec3 localEye = bx::mul(eye, invModel);
+
+        // Radius over distance doesn't change under the model's (uniform) scale, so it's ranked in file space
+        parallelFor(m_chunks.size(), 1024, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                Chunk& chunk = m_chunks[i];
+                const ChunkRecord& record = chunk.record;
+                chunk.visible = isInFrustum(modelViewProj, record.boundsMin, record.boundsMax, homogeneousDepth);
+                const bx::Vec3 center =
+                {
+                    (record.boundsMin[0] + record.boundsMax[0]) * 0.5f,
+                    (record.boundsMin[1] + record.boundsMax[1]) * 0.5f,
+                    (record.boundsMin[2] + record.boundsMax[2]) * 0.5f,
+                };
+                const float radius = bx::length(bx::sub(bx::Vec3{ record.boundsMax[0], record.boundsMax[1], record.boundsMax[2] }, center));
+                const float distance = std::max(bx::length(bx::sub(center, localEye)), radius * 0.01f + 1e-6f);
+                chunk.priority = radius / distance * (chunk.visible ? 1.0f : kOutsideFrustumWeight);
+                chunk.wanted = false;
+            }
+        });
+
+        // The pool holds the best ranked chunks
+        const size_t numWanted = m_slots.size();
+        m_order.resize(m_chunks.size());
+        for (size_t i = 0; i < m_order.size(); ++i)
+        {
+            m_order[i] = uint32_t(i);
+        }
+        std::partial_sort(m_order.begin(), m_order.begin() + numWanted, m_order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return m_chunks[a].priority > m_chunks[b].priority;
+        });
+        for (size_t rank = 0; rank < numWanted; ++rank)
+        {
+            m_chunks[m_order[rank]].wanted = true;
+        }
+
+        for (size_t rank = 0; rank < numWanted && m_readsInFlight < kMaxReadsInFlight; ++rank)
+        {
+            const uint32_t chunkIndex = m_order[rank];
+            if (m_chunks[chunkIndex].slot >= 0)
+            {
+                continue; // resident or being read
+            }
+
+            // A free slot, or else the one holding the lowest ranked chunk that's no longer wanted
+            int32_t victim = -1;
+            for (size_t s = 0; s < m_slots.size(); ++s)
+            {
+                const Slot& slot = m_slots[s];
+                if (slot.loading || (slot.chunk >= 0 && m_chunks[slot.chunk].wanted))
+                {
+                    continue;
+                }
+                if (slot.chunk < 0)
+                {
+                    victim = int32_t(s);
+                    break;
+                }
+                if (victim < 0 || m_chunks[slot.chunk].priority < m_chunks[m_slots[victim].chunk].priority)
+                {
+                    victim = int32_t(s);
+                }
+            }
+            if (victim < 0)
+            {
+                break;
+            }
+
+            Slot& slot = m_slots[victim];
+            if (slot.chunk >= 0)
+            {
+                m_chunks[slot.chunk].slot = -1;
+                m_residentBytes -= chunkBytes(m_chunks[slot.chunk].record);
+                slot.chunk = -1;
+                ++m_stats.evictions;
+            }
+            slot.loading = true;
+            m_chunks[chunkIndex].slot = victim;
+            requestRead(chunkIndex, uint32_t(victim));
+        }
+    }
+
+    // fn(vertexBuffer, indexBuffer, numVertices, numIndices) for every resident chunk in the frustum
+    template <typename Fn>
+    void forEachVisible(Fn&& fn) const
+    {
+        for (const Slot& slot : m_slots)
+        {
+            if (slot.chunk >= 0 && m_chunks[slot.chunk].visible)
+            {
+                const ChunkRecord& record = m_chunks[slot.chunk].record;
+                fn(slot.vb, slot.ib, record.numVertices, record.numIndices);
+            }
+        }
+    }
+
+    void printStats()
+    {
+        uint32_t resident = 0;
+        uint32_t visible = 0;
+        uint32_t visibleMissing = 0;
+        for (const Chunk& chunk : m_chunks)
+        {
+            const bool isResident = chunk.slot >= 0 && !m_slots[chunk.slot].loading;
+            resident += isResident ? 1 : 0;
+            visible += chunk.visible ? 1 : 0;
+            visibleMissing += chunk.visible && !isResident ? 1 : 0;
+        }
+
+        std::sort(m_stats.loadMs.begin(), m_stats.loadMs.end());
+        double averageMs = 0.0;
+        for (float ms : m_stats.loadMs) averageMs += ms;
+        averageMs /= double(std::max<size_t>(m_stats.loadMs.size(), 1));
+        const float p95Ms = m_stats.loadMs.empty() ? 0.0f : m_stats.loadMs[m_stats.loadMs.size() * 95 / 100];
+        const float maxMs = m_stats.loadMs.empty() ? 0.0f : m_stats.loadMs.back();
+        const double readMs = m_stats.readMsAccum / double(std::max<size_t>(m_stats.loadMs.size(), 1));
+
+        const double mib = 1.0 / (1024.0 * 1024.0);
+        std::cout << "[ChunkStreaming] " << resident << "/" << m_chunks.size() << " chunks resident, " << visible << " in the frustum ("
+                  << visibleMissing << " of them not loaded); " << double(m_residentBytes) * mib << " of "
+                  << double(m_slotBytes * m_slots.size()) * mib << " MiB of buffers in use, " << double(m_stagingBytes) * mib
+                  << " MiB in read buffers, " << double(m_chunks.size() * sizeof(Chunk)) * mib << " MiB chunk table; "
+                  << m_stats.loadMs.size() << " loads, " << m_stats.evictions << " evictions; load latency avg " << averageMs
+                  << " ms, p95 " << p95Ms << " ms, max " << maxMs << " ms (" << readMs << " ms of it reading)" << std::endl;
+        m_stats = Stats();
+    }
+
+private:
+    static constexpr uint32_t kMaxReadsInFlight = 4;
+    static constexpr float kOutsideFrustumWeight = 0.25f;
+
+    struct Slot
+    {
+        bgfx::DynamicVertexBufferHandle vb = BGFX_INVALID_HANDLE;
+        bgfx::DynamicIndexBufferHandle ib = BGFX_INVALID_HANDLE;
+        int32_t chunk = -1;   // resident chunk; stays -1 while `loading` so forEachVisible skips it, the chunk being read is Read::chunk
+        bool loading = false;
+    };
+
+    struct Chunk
+    {
+        ChunkRecord record;
+        int32_t slot = -1; // resident in or being read into
+        float priority = 0.0f;
+        bool visible = false;
+        bool wanted = false;
+    };
+
+    struct Read
+    {
+        uint32_t chunk;
+        uint32_t slot;
+        uint64_t offset;
+        uint64_t size;
+        int64_t requestTime;
+        int64_t readTicks;
+        bool ok;
+        std::vector<uint8_t> data;
+    };
+
+    struct Stats
+    {
+        std::vector<float> loadMs; // request to upload
+        double readMsAccum = 0.0;
+        uint32_t evictions = 0;
+    };
+
+    static uint64_t chunkBytes(const ChunkRecord& record)
+    {
+        return uint64_t(record.numVertices) * sizeof(MyFancyVertex) + uint64_t(record.numIndices) * sizeof(uint16_t);
+    }
+
+    static bool isInFrustum(const float* modelViewProj, const float boundsMin[3], const float boundsMax[3], bool homogeneousDepth)
+    {
+        uint32_t outsideAll = 0x3f; // planes -x, +x, -y, +y, near, far that every corner is outside of
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float local[3] =
+            {
+                (corner & 1) ? boundsMax[0] : boundsMin[0],
+                (corner & 2) ? boundsMax[1] : boundsMin[1],
+                (corner & 4) ? boundsMax[2] : boundsMin[2],
+            };
+            float clip[4];
+            simd4::transformPoint(modelViewProj, local, clip);
+            const float nearDistance = homogeneousDepth ? clip[2] + clip[3] : clip[2];
+            outsideAll &= (clip[0] < -clip[3] ? 1u : 0u) | (clip[0] > clip[3] ? 2u : 0u) | (clip[1] < -clip[3] ? 4u : 0u)
+                        | (clip[1] > clip[3] ? 8u : 0u) | (nearDistance < 0.0f ? 16u : 0u) | (clip[2] > clip[3] ? 32u : 0u);
+        }
+        return outsideAll == 0;
+    }
+
+    void requestRead(uint32_t chunk, uint32_t slot)
+    {
+        m_stagingBytes += chunkBytes(m_chunks[chunk].record);
+        ++m_readsInFlight;
+
+        Read read;
+        read.chunk = chunk;
+        read.slot = slot;
+        read.offset = m_chunks[chunk].record.offset;
+        read.size = chunkBytes(m_chunks[chunk].record);
+        read.requestTime = bx::getHPCounter();
+        read.readTicks = 0;
+        read.ok = false;
+#if __EMSCRIPTEN__
+        readChunk(read);
+#else // Linux/X11
+        m_io->push([this, read]() mutable { readChunk(read); });
+#endif // __EMSCRIPTEN__
+    }
+
+    // Runs on the IO thread; the file is only ever read from there (or inline)
+    void readChunk(Read& read)
+    {
+        const int64_t start = bx::getHPCounter();
+        read.data.resize(size_t(read.size));
+        read.ok = seekChunkFile(m_file, read.offset)
+               && std::fread(read.data.data(), 1, read.data.size(), m_file) == read.data.size();
+        read.readTicks = bx::getHPCounter() - start;
+
+        std::lock_guard<std::mutex> lock(m_finishedMutex);
+        m_finished.push_back(std::move(read));
+    }
+
+    void uploadFinished()
+    {
+        std::vector<Read> finished;
+        {
+            std::lock_guard<std::mutex> lock(m_finishedMutex);
+            finished.swap(m_finished);
+        }
+
+        const double msPerTick = 1000.0 / double(bx::getHPFrequency());
+        for (Read& read : finished)
+        {
+            Slot& slot = m_slots[read.slot];
+            const ChunkRecord& record = m_chunks[read.chunk].record;
+            slot.loading = false;
+            --m_readsInFlight;
+            m_stagingBytes -= chunkBytes(record);
+            if (!read.ok)
+            {
+                std::cerr << "[ChunkStreamer] Could not read chunk " << read.chunk << ".\n";
+                m_chunks[read.chunk].slot = -1;
+                slot.chunk = -1;
+                continue;
+            }
+
+            const uint32_t vertexBytes = record.numVertices * uint32_t(sizeof(MyFancyVertex));
+            bgfx::update(slot.vb, 0, bgfx::copy(read.data.data(), vertexBytes));
+            bgfx::update(slot.ib, 0, bgfx::copy(read.data.data() + vertexBytes, record.numIndices * uint32_t(sizeof(uint16_t))));
+            slot.chunk = int32_t(read.chunk);
+            m_residentBytes += chunkBytes(record);
+
+            m_stats.loadMs.push_back(float(double(bx::getHPCounter() - read.requestTime) * msPerTick));
+            m_stats.readMsAccum += double(read.readTicks) * msPerTick;
+        }
+    }
+
+    FILE* m_file = nullptr;
+    ChunkFileHeader m_header = {};
+    std::vector<Chunk> m_chunks;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_order;
+    uint64_t m_slotBytes = 0;
+    uint64_t m_residentBytes = 0;
+    uint64_t m_stagingBytes = 0;
+    uint32_t m_readsInFlight = 0;
+    Stats m_stats;
+
+    std::mutex m_finishedMutex;
+    std::vector<Read> m_finished;
+#if !__EMSCRIPTEN__
+    std::unique_ptr<BackgroundJobQueue> m_io;
+#endif // !__EMSCRIPTEN__
+};
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+#include "parallel_for.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A point or spot light for clustered shading: world-space position, range and premultiplied color.
+// Spots also have a cone: full intensity inside cosInner, fading to nothing at cosOuter.
+struct ClusterLight
+{
+    float position[3];
+    float radius;   // no contribution beyond this distance
+    float color[3]; // linear color * intensity
+    float direction[3] = { 0.0f, 0.0f, 0.0f }; // unit direction the spot shines in
+    float cosOuter = -2.0f; // the defaults make a point light: every direction is inside the cone
+    float cosInner = -1.0f;
+
+    bool isSpot() const { return cosOuter > -1.0f; }
+};
+
+namespace cluster_detail
+{
+
+struct Aabb
+{
+    float min[3];
+    float max[3];
+};
+
+// Index of the lowest set bit, mask must not be 0
+inline uint32_t lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctz(mask));
+#endif
+}
+
+// Bit i is set when sphere i of the 4 (SoA x/y/z, squared radius) touches the box
+inline uint32_t spheresTouchAabb4(const float* x, const float* y, const float* z, const float* radius2, const Aabb& box)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_loadu_ps(x);
+    __m128 cy = _mm_loadu_ps(y);
+    __m128 cz = _mm_loadu_ps(z);
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min[0]), cx), _mm_sub_ps(cx, _mm_set1_ps(box.max[0]))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min[1]), cy), _mm_sub_ps(cy, _mm_set1_ps(box.max[1]))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min[2]), cz), _mm_sub_ps(cz, _mm_set1_ps(box.max[2]))), zero);
+    __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    return uint32_t(_mm_movemask_ps(_mm_cmple_ps(dist2, _mm_loadu_ps(radius2))));
+#elif defined(__ARM_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t cx = vld1q_f32(x);
+    float32x4_t cy = vld1q_f32(y);
+    float32x4_t cz = vld1q_f32(z);
+    float32x4_t dx = vmaxq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(box.min[0]), cx), vsubq_f32(cx, vdupq_n_f32(box.max[0]))), zero);
+    float32x4_t dy = vmaxq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(box.min[1]), cy), vsubq_f32(cy, vdupq_n_f32(box.max[1]))), zero);
+    float32x4_t dz = vmaxq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(box.min[2]), cz), vsubq_f32(cz, vdupq_n_f32(box.max[2]))), zero);
+    float32x4_t dist2 = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz);
+    static const uint32_t kBits[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vandq_u32(vcleq_f32(dist2, vld1q_f32(radius2)), vld1q_u32(kBits));
+    uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(vpadd_u32(sum, sum), 0);
+#elif defined(__wasm_simd128__)
+    const v128_t zero = wasm_f32x4_splat(0.0f);
+    v128_t cx = wasm_v128_load(x);
+    v128_t cy = wasm_v128_load(y);
+    v128_t cz = wasm_v128_load(z);
+    v128_t dx = wasm_f32x4_max(wasm_f32x4_max(wasm_f32x4_sub(wasm_f32x4_splat(box.min[0]), cx), wasm_f32x4_sub(cx, wasm_f32x4_splat(box.max[0]))), zero);
+    v128_t dy = wasm_f32x4_max(wasm_f32x4_max(wasm_f32x4_sub(wasm_f32x4_splat(box.min[1]), cy), wasm_f32x4_sub(cy, wasm_f32x4_splat(box.max[1]))), zero);
+    v128_t dz = wasm_f32x4_max(wasm_f32x4_max(wasm_f32x4_sub(wasm_f32x4_splat(box.min[2]), cz), wasm_f32x4_sub(cz, wasm_f32x4_splat(box.max[2]))), zero);
+    v128_t dist2 = wasm_f32x4_add(wasm_f32x4_add(wasm_f32x4_mul(dx, dx), wasm_f32x4_mul(dy, dy)), wasm_f32x4_mul(dz, dz));
+    return uint32_t(wasm_i32x4_bitmask(wasm_f32x4_le(dist2, wasm_v128_load(radius2))));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        float dx = std::max(std::max(box.min[0] - x[i], x[i] - box.max[0]), 0.0f);
+        float dy = std::max(std::max(box.min[1] - y[i], y[i] - box.max[1]), 0.0f);
+        float dz = std::max(std::max(box.min[2] - z[i], z[i] - box.max[2]), 0.0f);
+        if (dx * dx + dy * dy + dz * dz <= radius2[i]) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+struct Sphere
+{
+    float center[3];
+    float radius;
+};
+
+// Conservative cone vs sphere test (the sphere bounds a froxel): false only when the sphere is
+// entirely outside the cone's angle, past its range or behind its apex
+inline bool coneTouchesSphere(const float apex[3], const float direction[3], float range, float cosAngle, float sinAngle, const Sphere& sphere)
+{
+    const float center[3] = { sphere.center[0] - apex[0], sphere.center[1] - apex[1], sphere.center[2] - apex[2] };
+    const float radius = sphere.radius;
+    const float distance2 = center[0] * center[0] + center[1] * center[1] + center[2] * center[2];
+    const float alongAxis = center[0] * direction[0] + center[1] * direction[1] + center[2] * direction[2];
+    const float fromAxis = std::sqrt(std::max(distance2 - alongAxis * alongAxis, 0.0f));
+    const float distanceToCone = cosAngle * fromAxis - sinAngle * alongAxis;
+    return distanceToCone <= radius && alongAxis <= range + radius && alongAxis >= -radius;
+}
+
+} // namespace cluster_detail
+
+// -----------------------------------------------------------------------------
+// Clustered forward lighting. The view frustum is cut into a froxel grid
+// (screen tiles x exponential depth slices) and every frame each froxel gets
+// the list of lights whose sphere touches it; spots are then also tested
+// against the froxel with their cone. Slices are assigned in parallel; within a
+// slice only the lights overlapping its depth range are tested against the
+// slice's tiles, four at a time. The result goes to the GPU as three textures
+// read with texelFetch in fs_drill.sc:
+//   grid    RG32F   (tile, slice)      -> (first index, light count)
+//   indices R32F    row-major list     -> light index
+//   lights  RGBA32F (light, row)       -> (position, radius), (color, cos inner), (direction, cos outer)
+// A froxel holds at most kMaxLightsPerCluster lights and the index texture
+// kIndexTextureWidth * kIndexTextureHeight entries; what doesn't fit is dropped
+// and counted in droppedAssignments().
+// -----------------------------------------------------------------------------
+class LightClusterer
+{
+public:
+    static constexpr uint32_t kTilesX = 16;
+    static constexpr uint32_t kTilesY = 9;
+    static constexpr uint32_t kSlices = 24;
+    static constexpr uint32_t kNumClusters = kTilesX * kTilesY * kSlices;
+    static constexpr uint32_t kMaxLights = 1024;
+    static constexpr uint32_t kMaxLightsPerCluster = 128;
+    static constexpr uint16_t kIndexTextureWidth = 1024;
+    static constexpr uint16_t kIndexTextureHeight = 128;
+
+    // xScale/yScale are proj[0]/proj[5] of a bx (left-handed, +z forward) perspective projection
+    void setProjection(float xScale, float yScale, float nearZ, float farZ)
+    {
+        if (xScale == m_xScale && yScale == m_yScale && nearZ == m_near && farZ == m_far)
+        {
+            return;
+        }
+        m_xScale = xScale;
+        m_yScale = yScale;
+        m_near = nearZ;
+        m_far = farZ;
+
+        const float logRatio = std::log(farZ / nearZ);
+        m_sliceScale = float(kSlices) / logRatio;
+        m_sliceBias = -float(kSlices) * std::log(nearZ) / logRatio;
+
+        m_clusterBounds.resize(kNumClusters);
+        m_clusterSpheres.resize(kNumClusters);
+        for (uint32_t slice = 0; slice < kSlices; ++slice)
+        {
+            float zNear = sliceDepth(slice);
+            float zFar = sliceDepth(slice + 1);
+            for (uint32_t tileY = 0; tileY < kTilesY; ++tileY)
+            {
+                float ndcY0 = -1.0f + 2.0f * float(tileY) / float(kTilesY);
+                float ndcY1 = -1.0f + 2.0f * float(tileY + 1) / float(kTilesY);
+                for (uint32_t tileX = 0; tileX < kTilesX; ++tileX)
+                {
+                    float ndcX0 = -1.0f + 2.0f * float(tileX) / float(kTilesX);
+                    float ndcX1 = -1.0f + 2.0f * float(tileX + 1) / float(kTilesX);
+
+                    // View-space extents of the froxel's 8 corners (x = ndc.x * z / xScale)
+                    cluster_detail::Aabb& box = m_clusterBounds[clusterIndex(tileX, tileY, slice)];
+                    box.min[0] = std::min(std::min(ndcX0 * zNear, ndcX0 * zFar), std::min(ndcX1 * zNear, ndcX1 * zFar)) / xScale;
+                    box.max[0] = std::max(std::max(ndcX0 * zNear, ndcX0 * zFar), std::max(ndcX1 * zNear, ndcX1 * zFar)) / xScale;
+                    box.min[1] = std::min(std::min(ndcY0 * zNear, ndcY0 * zFar), std::min(ndcY1 * zNear, ndcY1 * zFar)) / yScale;
+                    box.max[1] = std::max(std::max(ndcY0 * zNear, ndcY0 * zFar), std::max(ndcY1 * zNear, ndcY1 * zFar)) / yScale;
+                    box.min[2] = zNear;
+                    box.max[2] = zFar;
+
+                    cluster_detail::Sphere& sphere = m_clusterSpheres[clusterIndex(tileX, tileY, slice)];
+                    float radius2 = 0.0f;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        float half = 0.5f * (box.max[axis] - box.min[axis]);
+                        sphere.center[axis] = box.min[axis] + half;
+                        radius2 += half * half;
+                    }
+                    sphere.radius = std::sqrt(radius2);
+                }
+            }
+        }
+    }
+
+    // Assigns the lights (world space) to the clusters of `view`. Lights past kMaxLights are ignored.
+    void assign(const float view[16], const ClusterLight* lights, uint32_t numLights)
+    {
+        m_numLights = std::min(numLights, kMaxLights);
+
+        // View-space SoA, padded to a multiple of 4 with lights that can't touch anything
+        const uint32_t padded = (m_numLights + 3) & ~3u;
+        m_viewX.assign(padded, 0.0f);
+        m_viewY.assign(padded, 0.0f);
+        m_viewZ.assign(padded, -1e30f);
+        m_radius.assign(padded, 0.0f);
+        m_spots.clear();
+        m_spotOfLight.assign(m_numLights, kNoSpot);
+        for (uint32_t i = 0; i < m_numLights; ++i)
+        {
+            const float* p = lights[i].position;
+            m_viewX[i] = p[0] * view[0] + p[1] * view[4] + p[2] * view[8] + view[12];
+            m_viewY[i] = p[0] * view[1] + p[1] * view[5] + p[2] * view[9] + view[13];
+            m_viewZ[i] = p[0] * view[2] + p[1] * view[6] + p[2] * view[10] + view[14];
+            m_radius[i] = lights[i].radius;
+
+            if (lights[i].isSpot())
+            {
+                const float* d = lights[i].direction;
+                ViewSpot spot;
+                spot.apex[0] = m_viewX[i];
+                spot.apex[1] = m_viewY[i];
+                spot.apex[2] = m_viewZ[i];
+                spot.direction[0] = d[0] * view[0] + d[1] * view[4] + d[2] * view[8];
+                spot.direction[1] = d[0] * view[1] + d[1] * view[5] + d[2] * view[9];
+                spot.direction[2] = d[0] * view[2] + d[1] * view[6] + d[2] * view[10];
+                spot.cosAngle = std::min(lights[i].cosOuter, 1.0f);
+                spot.sinAngle = std::sqrt(1.0f - spot.cosAngle * spot.cosAngle);
+                m_spotOfLight[i] = uint16_t(m_spots.size());
+                m_spots.push_back(spot);
+            }
+        }
+
+        m_clusterLights.resize(size_t(kNumClusters) * kMaxLightsPerCluster);
+        m_clusterCounts.resize(kNumClusters);
+        m_sliceScratch.resize(kSlices);
+
+        parallelFor(kSlices, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t slice = begin; slice < end; ++slice)
+            {
+                assignSlice(uint32_t(slice));
+            }
+        });
+
+        m_droppedAssignments = 0;
+        for (const SliceScratch& scratch : m_sliceScratch)
+        {
+            m_droppedAssignments += scratch.dropped;
+        }
+
+        // Compact the per-cluster lists into the index texture and write (first, count) per cluster
+        m_gridData.resize(size_t(kNumClusters) * 2);
+        m_indexData.resize(size_t(kIndexTextureWidth) * kIndexTextureHeight);
+        uint32_t total = 0;
+        for (uint32_t cluster = 0; cluster < kNumClusters; ++cluster)
+        {
+            uint32_t count = std::min<uint32_t>(m_clusterCounts[cluster], uint32_t(m_indexData.size()) - total);
+            m_droppedAssignments += m_clusterCounts[cluster] - count;
+            const uint16_t* src = &m_clusterLights[size_t(cluster) * kMaxLightsPerCluster];
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_indexData[total + i] = float(src[i]);
+            }
+            m_gridData[cluster * 2 + 0] = float(total);
+            m_gridData[cluster * 2 + 1] = float(count);
+            total += count;
+        }
+        m_totalIndices = total;
+
+        // Three rows of m_numLights texels, packed so upload() can send just that rectangle
+        m_lightData.resize(size_t(kMaxLights) * 4 * kLightDataRows);
+        const size_t rowFloats = size_t(m_numLights) * 4;
+        for (uint32_t i = 0; i < m_numLights; ++i)
+        {
+            float* positionRadius = &m_lightData[size_t(i) * 4];
+            std::memcpy(positionRadius, lights[i].position, sizeof(float) * 3);
+            positionRadius[3] = lights[i].radius;
+            float* colorInner = positionRadius + rowFloats;
+            std::memcpy(colorInner, lights[i].color, sizeof(float) * 3);
+            colorInner[3] = lights[i].cosInner;
+            float* directionOuter = colorInner + rowFloats;
+            std::memcpy(directionOuter, lights[i].direction, sizeof(float) * 3);
+            directionOuter[3] = lights[i].cosOuter;
+        }
+    }
+
+    uint32_t numLights() const { return m_numLights; }
+    uint32_t numSpots() const { return uint32_t(m_spots.size()); }
+    float averageLightsPerCluster() const { return float(m_totalIndices) / float(kNumClusters); }
+
+    // Light-in-froxel pairs the last assign() had no room for (per-froxel limit or index texture full)
+    uint32_t droppedAssignments() const { return m_droppedAssignments; }
+
+    // (tilesX, tilesY, slices, index texture width) and (slice = log(viewZ) * x + y) for fs_drill.sc
+    void getShaderParams(float outGrid[4], float outDepth[4]) const
+    {
+        outGrid[0] = float(kTilesX);
+        outGrid[1] = float(kTilesY);
+        outGrid[2] = float(kSlices);
+        outGrid[3] = float(kIndexTextureWidth);
+        outDepth[0] = m_sliceScale;
+        outDepth[1] = m_sliceBias;
+        outDepth[2] = 0.0f;
+        outDepth[3] = 0.0f;
+    }
+
+    void createTextures()
+    {
+        const uint64_t flags = BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP;
+        m_gridTexture = bgfx::createTexture2D(uint16_t(kTilesX * kTilesY), uint16_t(kSlices), false, 1, bgfx::TextureFormat::RG32F, flags);
+        m_indexTexture = bgfx::createTexture2D(kIndexTextureWidth, kIndexTextureHeight, false, 1, bgfx::TextureFormat::R32F, flags);
+        m_lightTexture = bgfx::createTexture2D(uint16_t(kMaxLights), kLightDataRows, false, 1, bgfx::TextureFormat::RGBA32F, flags);
+    }
+
+    // Uploads the result of the last assign(), only the rows of the index list that are in use
+    void upload()
+    {
+        bgfx::updateTexture2D(m_gridTexture, 0, 0, 0, 0, uint16_t(kTilesX * kTilesY), uint16_t(kSlices),
+                              bgfx::copy(m_gridData.data(), uint32_t(m_gridData.size() * sizeof(float))));
+
+        uint16_t indexRows = uint16_t(std::max<uint32_t>((m_totalIndices + kIndexTextureWidth - 1) / kIndexTextureWidth, 1));
+        bgfx::updateTexture2D(m_indexTexture, 0, 0, 0, 0, kIndexTextureWidth, indexRows,
+                              bgfx::copy(m_indexData.data(), uint32_t(indexRows) * kIndexTextureWidth * sizeof(float)));
+
+        if (m_numLights > 0)
+        {
+            bgfx::updateTexture2D(m_lightTexture, 0, 0, 0, 0, uint16_t(m_numLights), kLightDataRows,
+                                  bgfx::copy(m_lightData.data(), m_numLights * kLightDataRows * 4 * sizeof(float)));
+        }
+    }
+
+    bgfx::TextureHandle gridTexture() const { return m_gridTexture; }
+    bgfx::TextureHandle indexTexture() const { return m_indexTexture; }
+    bgfx::TextureHandle lightTexture() const { return m_lightTexture; }
+
+    void destroyTextures()
+    {
+        if (bgfx::isValid(m_gridTexture)) bgfx::destroy(m_gridTexture);
+        if (bgfx::isValid(m_indexTexture)) bgfx::destroy(m_indexTexture);
+        if (bgfx::isValid(m_lightTexture)) bgfx::destroy(m_lightTexture);
+        m_gridTexture = BGFX_INVALID_HANDLE;
+        m_indexTexture = BGFX_INVALID_HANDLE;
+        m_lightTexture = BGFX_INVALID_HANDLE;
+    }
+
+private:
+    static constexpr uint16_t kLightDataRows = 3;
+    static constexpr uint16_t kNoSpot = 0xffff;
+
+    struct SliceScratch
+    {
+        std::vector<float> x, y, z, radius2;
+        std::vector<uint16_t> index;
+        uint32_t dropped = 0;
+    };
+
+    // A spot's cone in view space
+    struct ViewSpot
+    {
+        float apex[3];
+        float direction[3];
+        float cosAngle;
+        float sinAngle;
+    };
+
+    static uint32_t clusterIndex(uint32_t tileX, uint32_t tileY, uint32_t slice)
+    {
+        return tileX + tileY * kTilesX + slice * kTilesX * kTilesY;
+    }
+
+    float sliceDepth(uint32_t slice) const
+    {
+        return m_near * std::pow(m_far / m_near, float(slice) / float(kSlices));
+    }
+
+    void assignSlice(uint32_t slice)
+    {
+        const float zNear = sliceDepth(slice);
+        const float zFar = sliceDepth(slice + 1);
+
+        // Lights overlapping this slice's depth range, SoA and padded to 4
+        SliceScratch& scratch = m_sliceScratch[slice];
+        scratch.x.clear();
+        scratch.y.clear();
+        scratch.z.clear();
+        scratch.radius2.clear();
+        scratch.index.clear();
+        scratch.dropped = 0;
+        for (uint32_t i = 0; i < m_numLights; ++i)
+        {
+            if (m_viewZ[i] + m_radius[i] >= zNear && m_viewZ[i] - m_radius[i] <= zFar)
+            {
+                scratch.x.push_back(m_viewX[i]);
+                scratch.y.push_back(m_viewY[i]);
+                scratch.z.push_back(m_viewZ[i]);
+                scratch.radius2.push_back(m_radius[i] * m_radius[i]);
+                scratch.index.push_back(uint16_t(i));
+            }
+        }
+        const size_t numSliceLights = scratch.index.size();
+        while (scratch.x.size() & 3)
+        {
+            scratch.x.push_back(0.0f);
+            scratch.y.push_back(0.0f);
+            scratch.z.push_back(-1e30f);
+            scratch.radius2.push_back(0.0f);
+        }
+
+        for (uint32_t tile = 0; tile < kTilesX * kTilesY; ++tile)
+        {
+            const uint32_t cluster = tile + slice * kTilesX * kTilesY;
+            const cluster_detail::Aabb& box = m_clusterBounds[cluster];
+            uint16_t* out = &m_clusterLights[size_t(cluster) * kMaxLightsPerCluster];
+            uint32_t count = 0;
+
+            for (size_t i = 0; i < numSliceLights; i += 4)
+            {
+                uint32_t mask = cluster_detail::spheresTouchAabb4(&scratch.x[i], &scratch.y[i], &scratch.z[i], &scratch.radius2[i], box);
+                while (mask)
+                {
+                    uint32_t lane = cluster_detail::lowestBit(mask);
+                    mask &= mask - 1;
+                    const uint16_t light = scratch.index[i + lane];
+                    const uint16_t spot = m_spotOfLight[light];
+                    if (spot != kNoSpot)
+                    {
+                        const ViewSpot& cone = m_spots[spot];
+                        if (!cluster_detail::coneTouchesSphere(cone.apex, cone.direction, m_radius[light], cone.cosAngle, cone.sinAngle, m_clusterSpheres[cluster]))
+                        {
+                            continue;
+                        }
+                    }
+                    if (count < kMaxLightsPerCluster)
+                    {
+                        out[count++] = light;
+                    }
+                    else
+                    {
+                        ++scratch.dropped;
+                    }
+                }
+            }
+            m_clusterCounts[cluster] = count;
+        }
+    }
+
+    float m_xScale = 0.0f;
+    float m_yScale = 0.0f;
+    float m_near = 0.0f;
+    float m_far = 0.0f;
+    float m_sliceScale = 0.0f;
+    float m_sliceBias = 0.0f;
+    std::vector<cluster_detail::Aabb> m_clusterBounds;
+    std::vector<cluster_detail::Sphere> m_clusterSpheres; // bounds the froxel, for the spot cone test
+
+    uint32_t m_numLights = 0;
+    std::vector<float> m_viewX, m_viewY, m_viewZ, m_radius;
+    std::vector<ViewSpot> m_spots;
+    std::vector<uint16_t> m_spotOfLight; // index into m_spots, kNoSpot for point lights
+    std::vector<SliceScratch> m_sliceScratch;
+    std::vector<uint16_t> m_clusterLights; // kMaxLightsPerCluster slots per cluster
+    std::vector<uint32_t> m_clusterCounts;
+
+    uint32_t m_totalIndices = 0;
+    uint32_t m_droppedAssignments = 0;
+    std::vector<float> m_gridData;
+    std::vector<float> m_indexData;
+    std::vector<float> m_lightData;
+
+    bgfx::TextureHandle m_gridTexture = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle m_indexTexture = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle m_lightTexture = BGFX_INVALID_HANDLE;
+};
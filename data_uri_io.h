@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/MemoryIOWrapper.h>
+
+#include "base64.h"
+
+// Splits "data:[<mediatype>];base64,<payload>" and returns the payload as a view into the URI.
+// Only base64 payloads are supported.
+inline bool parseBase64DataUri(std::string_view uri, std::string_view& outPayload)
+{
+    size_t commaPos = uri.find(',');
+    if (uri.rfind("data:", 0) != 0 || commaPos == std::string_view::npos)
+    {
+        return false;
+    }
+
+    std::string_view header = uri.substr(0, commaPos);
+    constexpr std::string_view kBase64Suffix = ";base64";
+    if (header.size() < kBase64Suffix.size() || header.substr(header.size() - kBase64Suffix.size()) != kBase64Suffix)
+    {
+        return false;
+    }
+
+    outPayload = uri.substr(commaPos + 1);
+    return true;
+}
+
+// Media types glTF gives base64 buffers (images are left to the importer, it turns them into embedded textures)
+inline bool isGltfBufferMediaType(std::string_view uri)
+{
+    return uri.rfind("data:application/octet-stream;", 0) == 0 || uri.rfind("data:application/gltf-buffer;", 0) == 0;
+}
+
+// Decodes every base64 buffer URI in a glTF document into `buffers` and replaces the URI with
+// namePrefix + its index in `buffers` + ".bin". URIs that don't decode are left to the importer.
+// Returns the number of URIs replaced.
+inline size_t extractGltfBufferUris(std::string& json, std::vector<std::vector<uint8_t>>& buffers, std::string_view namePrefix)
+{
+    std::string out;
+    size_t replaced = 0;
+    size_t copied = 0;
+    size_t pos = json.find("\"data:");
+    while (pos != std::string::npos)
+    {
+        const size_t uriStart = pos + 1;
+        const size_t uriEnd = json.find('"', uriStart);
+        if (uriEnd == std::string::npos)
+        {
+            break;
+        }
+
+        const std::string_view uri(json.data() + uriStart, uriEnd - uriStart);
+        std::string_view payload;
+        if (isGltfBufferMediaType(uri) && parseBase64DataUri(uri, payload))
+        {
+            std::vector<uint8_t> decoded(base64DecodedCapacity(payload.size()));
+            size_t decodedSize = 0;
+            if (base64Decode(payload, decoded.data(), decodedSize))
+            {
+                decoded.resize(decodedSize);
+                out.append(json, copied, uriStart - copied);
+                out += namePrefix;
+                out += std::to_string(buffers.size());
+                out += ".bin";
+                copied = uriEnd;
+                buffers.push_back(std::move(decoded));
+                ++replaced;
+            }
+        }
+        pos = json.find("\"data:", uriEnd + 1);
+    }
+
+    if (replaced > 0)
+    {
+        out.append(json, copied, std::string::npos);
+        json.swap(out);
+    }
+    return replaced;
+}
+
+// A MemoryIOStream that owns its bytes, so they're freed as soon as the importer is done with the stream
+// (whether it Close()s it or deletes it)
+struct OwnedStreamBytes
+{
+    std::vector<uint8_t> bytes;
+};
+class OwningMemoryIOStream : private OwnedStreamBytes, public Assimp::MemoryIOStream
+{
+public:
+    explicit OwningMemoryIOStream(std::vector<uint8_t>&& data)
+        : OwnedStreamBytes{ std::move(data) }, MemoryIOStream(bytes.data(), bytes.size(), false)
+    {
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Assimp IO handler that decodes the base64 buffers of .gltf files with
+// base64.h. Assimp's glTF2 importer decodes data: URIs itself and never asks
+// the IO system for them, so this serves it each .gltf with its buffer URIs
+// swapped for made-up file names (extractGltfBufferUris) and then serves those
+// names from the decoded bytes. Everything else goes to the default file IO.
+// A decoded buffer moves into the stream it is opened with, the importer reads
+// each buffer once, so embedded buffers of hundreds of MB aren't held twice
+// next to the importer's own copy. A document is kept (for the importer's
+// second open) only until its last buffer has been handed out.
+// -----------------------------------------------------------------------------
+class DataUriIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    bool Exists(const char* pFile) const override
+    {
+        const size_t index = findBuffer(pFile);
+        if (index != kNoBuffer)
+        {
+            return !m_consumed[index];
+        }
+        return DefaultIOSystem::Exists(pFile);
+    }
+
+    Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+    {
+        const size_t index = findBuffer(pFile);
+        if (index != kNoBuffer)
+        {
+            if (m_consumed[index])
+            {
+                std::cerr << "[DataUriIOSystem] " << pFile << " was already read.\n";
+                return nullptr;
+            }
+            m_consumed[index] = true;
+            Assimp::IOStream* stream = new OwningMemoryIOStream(std::move(m_buffers[index]));
+            m_buffers[index] = std::vector<uint8_t>();
+            releaseReadDocuments();
+            return stream;
+        }
+        if (pMode[0] != 'r' || !isGltfDocument(pFile))
+        {
+            return DefaultIOSystem::Open(pFile, pMode);
+        }
+
+        // The importer opens the document more than once (to probe it, then to load it)
+        auto found = m_documents.find(pFile);
+        if (found == m_documents.end())
+        {
+            Assimp::IOStream* file = DefaultIOSystem::Open(pFile, pMode);
+            if (!file)
+            {
+                return nullptr;
+            }
+            std::string json(file->FileSize(), '\0');
+            const size_t read = file->Read(json.data(), 1, json.size());
+            DefaultIOSystem::Close(file);
+            if (read != json.size())
+            {
+                std::cerr << "[DataUriIOSystem] Could not read " << pFile << ".\n";
+                return nullptr;
+            }
+
+            Document document;
+            document.firstBuffer = m_buffers.size();
+            document.numBuffers = extractGltfBufferUris(json, m_buffers, kBufferPrefix);
+            m_consumed.resize(m_buffers.size(), false);
+            if (document.numBuffers == 0)
+            {
+                // Nothing decoded, so nothing worth keeping for the next open
+                return new OwningMemoryIOStream(std::vector<uint8_t>(json.begin(), json.end()));
+            }
+            document.json = std::move(json);
+            found = m_documents.emplace(pFile, std::move(document)).first;
+        }
+        // A copy, so the document can go while the importer still holds the stream (it's small without its buffers)
+        const std::string& json = found->second.json;
+        return new OwningMemoryIOStream(std::vector<uint8_t>(json.begin(), json.end()));
+    }
+
+private:
+    static constexpr std::string_view kBufferPrefix = "data-uri-buffer-";
+    static constexpr size_t kNoBuffer = SIZE_MAX;
+
+    struct Document
+    {
+        std::string json; // with its buffer URIs replaced
+        size_t firstBuffer = 0;
+        size_t numBuffers = 0;
+    };
+
+    static bool isGltfDocument(std::string_view path)
+    {
+        constexpr std::string_view kExtension = ".gltf";
+        if (path.size() < kExtension.size())
+        {
+            return false;
+        }
+        const std::string_view extension = path.substr(path.size() - kExtension.size());
+        return std::equal(extension.begin(), extension.end(), kExtension.begin(),
+                          [](char a, char b) { return std::tolower(uint8_t(a)) == b; });
+    }
+
+    // The importer prepends the document's directory to the names extractGltfBufferUris() wrote
+    size_t findBuffer(std::string_view path) const
+    {
+        const size_t slash = path.find_last_of("/\\");
+        const std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        if (name.rfind(kBufferPrefix, 0) != 0)
+        {
+            return kNoBuffer;
+        }
+        const size_t index = size_t(std::strtoul(std::string(name.substr(kBufferPrefix.size())).c_str(), nullptr, 10));
+        return index < m_buffers.size() ? index : kNoBuffer;
+    }
+
+    // Documents whose buffers have all been read are done with; opening one again decodes it afresh
+    void releaseReadDocuments()
+    {
+        for (auto it = m_documents.begin(); it != m_documents.end();)
+        {
+            const Document& document = it->second;
+            const auto first = m_consumed.begin() + document.firstBuffer;
+            if (std::all_of(first, first + document.numBuffers, [](bool consumed) { return consumed; }))
+            {
+                it = m_documents.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    std::unordered_map<std::string, Document> m_documents;
+    std::vector<std::vector<uint8_t>> m_buffers; // emptied once handed to a stream
+    std::vector<bool> m_consumed;
+};
@@ -7,6 +7,7 @@ mat3 v_tbn       : TEXCOORD2 = mat3(vec3(1.0, 0.0, 0.0),
                                     vec3(0.0, 0.0, 1.0));
 
 vec3 v_worldPos  : TEXCOORD3 = vec3(0.0, 0.0, 0.0);
+vec3 v_layers    : TEXCOORD4 = vec3(0.0, 0.0, 0.0);
 
 vec3 a_position  : POSITION;
 vec3 a_normal    : NORMAL0;
@@ -15,3 +16,11 @@ vec3 a_bitangent : BITANGENT0;
 vec4 a_color0    : COLOR0;
 vec4 a_color1    : COLOR1;
 vec2 a_texcoord0 : TEXCOORD0;
+vec4 a_indices   : BLENDINDICES;
+vec4 a_weight    : BLENDWEIGHT;
+
+vec4 i_data0     : TEXCOORD7;
+vec4 i_data1     : TEXCOORD6;
+vec4 i_data2     : TEXCOORD5;
+vec4 i_data3     : TEXCOORD4;
+vec4 i_data4     : TEXCOORD3;
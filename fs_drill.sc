@@ -1,25 +1,180 @@
-$input v_texcoord0, v_tbn, v_worldPos
+$input v_texcoord0, v_tbn, v_worldPos, v_layers
 
 #include <bgfx_shader.sh>
 
 // Base PBR textures
+#if MATERIAL_BATCHING
+// Built as fs_drill_batched.bin: every material slot is a 2D texture array, v_layers picks the material's layer in each
+SAMPLER2DARRAY(s_texColor, 0);
+SAMPLER2DARRAY(s_texNormal, 1);
+SAMPLER2DARRAY(s_texARM, 2);
+#define sampleMaterial(_sampler, _layer) texture2DArray(_sampler, vec3(v_texcoord0, _layer))
+#else
 SAMPLER2D(s_texColor, 0);
 SAMPLER2D(s_texNormal, 1);
 SAMPLER2D(s_texARM, 2);
+#define sampleMaterial(_sampler, _layer) texture2D(_sampler, v_texcoord0)
+#endif
 
 // IBL textures
 SAMPLERCUBE(s_irradiance, 3);
 SAMPLERCUBE(s_radiance, 4);
 SAMPLER2D(s_brdfLUT, 5);
 
+// Clustered lights (see clustered_lights.h), all read with texelFetch
+SAMPLER2D(s_clusterGrid, 6);  // (tile, slice) -> (first index, count)
+SAMPLER2D(s_lightIndices, 7); // row-major light index list
+SAMPLER2D(s_lightData, 8);    // (light, 0/1/2) -> (position, radius), (color, cos inner), (direction, cos outer)
+
+// Shadow atlas (see shadow_maps.h): cascades of the sun, then one tile per spotlight
+SAMPLER2DSHADOW(s_shadowMap, 9);
+
 // Camera position in world space
 uniform vec4 u_camPos;
 
+// (tilesX, tilesY, slices, light index texture width), (slice = log(viewZ) * x + y)
+uniform vec4 u_clusterParams;
+uniform vec4 u_clusterDepth;
+
+// Sun (direction the light travels) and its cascades: view-space far distance per cascade, w = spotlight count
+uniform vec4 u_sunDirection;
+uniform vec4 u_sunColor;
+uniform vec4 u_cascadeSplits;
+uniform mat4 u_cascadeMtx[3];
+
+// Shadowed spotlights: (position, range), (direction, cos outer angle), (color, cos inner angle)
+uniform vec4 u_spotPosition[4];
+uniform vec4 u_spotDirection[4];
+uniform vec4 u_spotColor[4];
+uniform mat4 u_spotShadowMtx[4];
+
+// (1 / atlas width, 1 / atlas height, depth bias, normal offset), all 0 when shadows are off
+uniform vec4 u_shadowParams;
+
+// Cook-Torrance (GGX, Smith-Schlick, Schlick Fresnel) for one light, times NdotL
+vec3 evaluateDirectLight(vec3 N, vec3 V, vec3 L, vec3 albedo, float roughness, float metallic, vec3 F0)
+{
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 H = normalize(L + V);
+    float NdotH = max(dot(N, H), 0.0);
+
+    float alpha = roughness * roughness;
+    float alpha2 = alpha * alpha;
+    float denom = NdotH * NdotH * (alpha2 - 1.0) + 1.0;
+    float D = alpha2 / (3.14159 * denom * denom);
+
+    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    float G = NdotL / (NdotL * (1.0 - k) + k) * NdotV / (NdotV * (1.0 - k) + k);
+
+    vec3 F = F0 + (1.0 - F0) * pow(1.0 - max(dot(H, V), 0.0), 5.0);
+
+    vec3 specular = (D * G * F) / (4.0 * NdotL * NdotV + 0.0001);
+    vec3 diffuse = (1.0 - F) * (1.0 - metallic) * albedo / 3.14159;
+    return (diffuse + specular) * NdotL;
+}
+
+// 3x3 PCF over hardware-filtered depth compares, 1 = lit
+float sampleShadow(vec4 shadowCoord)
+{
+    if (u_shadowParams.x == 0.0)
+    {
+        return 1.0;
+    }
+
+    vec3 coord = shadowCoord.xyz / shadowCoord.w;
+    coord.z -= u_shadowParams.z;
+
+    float visibility = 0.0;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            visibility += shadow2D(s_shadowMap, vec3(coord.xy + vec2(float(x), float(y)) * u_shadowParams.xy, coord.z));
+        }
+    }
+    return visibility / 9.0;
+}
+
+vec3 sunLighting(vec3 N, vec3 V, vec3 geometryNormal, float viewZ, vec3 albedo, float roughness, float metallic, vec3 F0)
+{
+    vec3 L = -u_sunDirection.xyz;
+    float visibility = 1.0;
+    if (viewZ < u_cascadeSplits.z)
+    {
+        // Normal offset against acne on surfaces at grazing angles to the light
+        vec4 receiver = vec4(v_worldPos + geometryNormal * u_shadowParams.w, 1.0);
+        if (viewZ < u_cascadeSplits.x)      visibility = sampleShadow(mul(u_cascadeMtx[0], receiver));
+        else if (viewZ < u_cascadeSplits.y) visibility = sampleShadow(mul(u_cascadeMtx[1], receiver));
+        else                                visibility = sampleShadow(mul(u_cascadeMtx[2], receiver));
+    }
+    return evaluateDirectLight(N, V, L, albedo, roughness, metallic, F0) * u_sunColor.rgb * visibility;
+}
+
+vec3 spotLighting(vec3 N, vec3 V, vec3 geometryNormal, vec3 albedo, float roughness, float metallic, vec3 F0)
+{
+    vec3 lighting = vec3_splat(0.0);
+    int count = int(u_cascadeSplits.w);
+    for (int i = 0; i < count; ++i)
+    {
+        vec3 toLight = u_spotPosition[i].xyz - v_worldPos;
+        float dist2 = dot(toLight, toLight);
+        float range = u_spotPosition[i].w;
+        vec3 L = toLight * inversesqrt(dist2 + 0.000001);
+
+        float cone = smoothstep(u_spotDirection[i].w, u_spotColor[i].w, dot(-L, u_spotDirection[i].xyz));
+        float window = saturate(1.0 - (dist2 * dist2) / (range * range * range * range));
+        float attenuation = cone * window * window / (dist2 + 0.0001);
+        if (attenuation > 0.0)
+        {
+            float visibility = sampleShadow(mul(u_spotShadowMtx[i], vec4(v_worldPos + geometryNormal * u_shadowParams.w, 1.0)));
+            lighting += evaluateDirectLight(N, V, L, albedo, roughness, metallic, F0) * u_spotColor[i].rgb * attenuation * visibility;
+        }
+    }
+    return lighting;
+}
+
+// Sums the lights of the fragment's cluster
+vec3 clusteredLighting(vec3 N, vec3 V, float viewZ, vec3 albedo, float roughness, float metallic, vec3 F0)
+{
+    vec4 clipPos = mul(u_viewProj, vec4(v_worldPos, 1.0));
+    vec2 tile = clamp(floor((clipPos.xy / clipPos.w * 0.5 + 0.5) * u_clusterParams.xy), vec2_splat(0.0), u_clusterParams.xy - 1.0);
+    float slice = clamp(floor(log(max(viewZ, 0.0001)) * u_clusterDepth.x + u_clusterDepth.y), 0.0, u_clusterParams.z - 1.0);
+
+    vec2 cluster = texelFetch(s_clusterGrid, ivec2(int(tile.x + tile.y * u_clusterParams.x), int(slice)), 0).xy;
+    int first = int(cluster.x);
+    int count = int(cluster.y);
+    int indexWidth = int(u_clusterParams.w);
+
+    vec3 lighting = vec3_splat(0.0);
+    for (int i = 0; i < count; ++i)
+    {
+        int index = first + i;
+        int light = int(texelFetch(s_lightIndices, ivec2(index % indexWidth, index / indexWidth), 0).x);
+        vec4 positionRadius = texelFetch(s_lightData, ivec2(light, 0), 0);
+        vec4 colorInner = texelFetch(s_lightData, ivec2(light, 1), 0);
+        vec4 directionOuter = texelFetch(s_lightData, ivec2(light, 2), 0);
+
+        vec3 toLight = positionRadius.xyz - v_worldPos;
+        float dist2 = dot(toLight, toLight);
+        vec3 L = toLight * inversesqrt(dist2 + 0.000001);
+
+        // Inverse square with a smooth window that reaches 0 at the light's radius, times the spot cone
+        // (point lights have cos outer -2, cos inner -1, so their cone is 1 everywhere)
+        float cone = smoothstep(directionOuter.w, colorInner.w, dot(-L, directionOuter.xyz));
+        float window = saturate(1.0 - (dist2 * dist2) / (positionRadius.w * positionRadius.w * positionRadius.w * positionRadius.w));
+        float attenuation = cone * window * window / (dist2 + 0.0001);
+
+        lighting += evaluateDirectLight(N, V, L, albedo, roughness, metallic, F0) * colorInner.rgb * attenuation;
+    }
+    return lighting;
+}
+
 void main()
 {
-    vec4 baseColor = texture2D(s_texColor, v_texcoord0);
-    vec3 normalMap = texture2D(s_texNormal, v_texcoord0).rgb;
-    vec4 arm = texture2D(s_texARM, v_texcoord0);
+    vec4 baseColor = sampleMaterial(s_texColor, v_layers.x);
+    vec3 normalMap = sampleMaterial(s_texNormal, v_layers.y).rgb;
+    vec4 arm = sampleMaterial(s_texARM, v_layers.z);
 
     float ao = arm.r;
     float roughness = arm.g;
@@ -35,29 +190,11 @@ void main()
     vec3 R = reflect(-V, N);
     float NdotV = max(dot(N, V), 0.0);
 
-#if 0 //hardcoded lighting
-    vec3 lightDir = normalize(vec3(0.3, 0.7, 0.5));
-    vec3 L = lightDir;
-    float NdotL = max(dot(N, L), 0.0);
-
-    vec3 directDiffuse = albedo * NdotL;
-
-    vec3 H = normalize(L + V);
-    float NdotH = max(dot(N, H), 0.0);
-
-    float alpha = roughness * roughness;
-    float alpha2 = alpha * alpha;
-    float D = alpha2 / (3.14159 * pow((NdotH * NdotH * (alpha2 - 1.0) + 1.0), 2.0));
-
-    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
-    float G = NdotL / (NdotL * (1.0 - k) + k) * NdotV / (NdotV * (1.0 - k) + k);
-
-    float fresnelL = pow(1.0 - max(dot(H, V), 0.0), 5.0);
-    vec3 F_L = F0 + (1.0 - F0) * fresnelL;
-
-    vec3 directSpecular = (D * G * F_L) / (4.0 * NdotL * NdotV + 0.0001);
-    vec3 directLight = (directDiffuse + directSpecular) * NdotL;
-#endif
+    float viewZ = mul(u_view, vec4(v_worldPos, 1.0)).z;
+    vec3 geometryNormal = normalize(v_tbn[2]);
+    vec3 directLight = clusteredLighting(N, V, viewZ, albedo, roughness, metallic, F0)
+                     + sunLighting(N, V, geometryNormal, viewZ, albedo, roughness, metallic, F0)
+                     + spotLighting(N, V, geometryNormal, albedo, roughness, metallic, F0);
 
     // Compute skymap brightness (approximated by sampling irradiance map at zenith)
     float skyBrightness = length(textureCube(s_irradiance, vec3(0.0, 1.0, 0.0)).rgb);
@@ -77,5 +214,6 @@ void main()
 
     vec3 color = diffuseIBL + specularIBL;
     color = mix(color, albedo, 0.4); // Retain more original color richness
+    color += directLight;
     gl_FragColor = vec4(color, baseColor.a);
 }
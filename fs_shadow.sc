@@ -0,0 +1,7 @@
+#include <bgfx_shader.sh>
+
+// Depth only, the shadow atlas has no color attachment
+void main()
+{
+    gl_FragColor = vec4_splat(0.0);
+}
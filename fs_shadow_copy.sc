@@ -0,0 +1,12 @@
+$input v_texcoord0
+
+#include <bgfx_shader.sh>
+
+// The static shadow cache, copied depth to depth
+SAMPLER2D(s_shadowCache, 0);
+
+void main()
+{
+    gl_FragDepth = texture2D(s_shadowCache, v_texcoord0).r;
+    gl_FragColor = vec4_splat(0.0);
+}
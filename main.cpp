@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <iostream>
 #include <cmath>
@@ -31,18 +32,35 @@
 // stb_image for decoding the embedded texture
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#if !__EMSCRIPTEN__
+// stb_image_write for the batch renderer's PNGs
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#endif
 
-#include <boost/beast/core/detail/base64.hpp>
+#include <atomic>
+#include <functional>
 #include <string>
-
-struct MyFancyVertex
-{
-    float px, py, pz;  // Position
-    float nx, ny, nz;  // Normal
-    float tx, ty, tz, tw;  // Tangent (includes handedness)
-    float u, v;        // Texture coordinates
-};
-
+#include <string_view>
+
+#include "asset_loading.h"
+#include "chunk_streaming.h"
+#include "clustered_lights.h"
+#include "data_uri_io.h"
+#include "material_batch.h"
+#include "occlusion_culling.h"
+#include "resource_cache.h"
+#include "shadow_maps.h"
+#include "skinning.h"
+#include "triangle_bvh.h"
+#include "vertex_format.h"
+
+#if !__EMSCRIPTEN__
+#include <filesystem>
+
+#include "batch_render.h"
+#include "ply_chunking.h"
+#endif // !__EMSCRIPTEN__
 
 static bgfx::VertexLayout g_vertexLayout;
 
@@ -96,78 +114,42 @@ struct SkyboxVertex
     float x, y, z;
 };
 
-// Load file into bgfx memory buffer
-static const bgfx::Memory* loadMem(const char* filename)
-{
-    FILE* fp = fopen(filename, "rb");
-    if (!fp)
-    {
-        std::cerr << "Could not open file: " << filename << std::endl;
-        return nullptr;
-    }
-
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    const bgfx::Memory* mem = bgfx::alloc(size + 1);
-    fread(mem->data, 1, size, fp);
-    fclose(fp);
-
-    mem->data[size] = '\0';
-    return mem;
-}
-
 // Load a compiled shader (e.g. vs_skybox.bin, fs_skybox.bin)
+// Like acquireFileTexture(): a path the cache has seen isn't read or hashed again
 static bgfx::ShaderHandle loadShader(const char* fpath)
 {
-    const bgfx::Memory* mem = loadMem(fpath);
-    if (!mem)
+    std::vector<uint8_t> data;
+    uint64_t contentKey;
+    if (!fileContentKey(fpath, kContentShader, data, contentKey))
     {
         return BGFX_INVALID_HANDLE;
     }
-    return bgfx::createShader(mem);
-}
-
-static bgfx::TextureHandle loadTexture(const char* filePath)
-{
-    bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
-
-    // Open the texture file.
-    FILE* fp = fopen(filePath, "rb");
-    if (!fp)
-    {
-        std::cerr << "Could not open texture: " << filePath << std::endl;
-        return handle;
-    }
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
 
-    if (size <= 0)
+    return g_resources.acquireShader(contentKey, [&]() -> bgfx::ShaderHandle
     {
-        std::cerr << "Texture file is empty: " << filePath << std::endl;
-        fclose(fp);
+        // The path was known but its shader has been released since
+        if (data.empty() && !loadMem(fpath, data))
+        {
+            return BGFX_INVALID_HANDLE;
+        }
+        // Include the terminating '\0'
+        bgfx::ShaderHandle handle = bgfx::createShader(bgfx::copy(data.data(), uint32_t(data.size() + 1)));
+        bgfx::setName(handle, fpath);
         return handle;
-    }
+    });
+}
 
-    // Read the file data.
-    uint8_t* data = new uint8_t[size];
-    if (fread(data, 1, size, fp) != (size_t)size)
+static bgfx::TextureHandle loadTexture(const char* filePath)
+{
+    bgfx::TextureHandle handle = acquireFileTexture(filePath, kContentTextureFile, [&](const std::vector<uint8_t>& data, uint32_t& outGpuBytes)
     {
-        std::cerr << "Failed to read texture file: " << filePath << std::endl;
-        fclose(fp);
-        delete[] data;
-        return handle;
-    }
-    fclose(fp);
-
-    // Create a bgfx memory reference and upload it as a texture.
-    const bgfx::Memory* mem = bgfx::copy(data, size);
-    delete[] data; // Safe to delete now, because bgfx owns the memory.
-
-    handle = bgfx::createTexture(mem);
-    bgfx::setName(handle, filePath);
+        // Create a bgfx memory copy and upload it as a texture.
+        bgfx::TextureInfo info;
+        bgfx::TextureHandle texture = bgfx::createTexture(bgfx::copy(data.data(), uint32_t(data.size())), BGFX_TEXTURE_NONE | BGFX_SAMPLER_NONE, 0, &info);
+        bgfx::setName(texture, filePath);
+        outGpuBytes = info.storageSize;
+        return texture;
+    });
 
     if (!bgfx::isValid(handle))
     {
@@ -179,14 +161,9 @@ static bgfx::TextureHandle loadTexture(const char* filePath)
 
 static void initVertexLayout()
 {
-    // This layout must match the usage in varying.def.sc (POSITION, NORMAL0, TEXCOORD0).
+    // Generated from kFancyVertexFormat (see vertex_format.h), the same description the mesh converter uses.
     // We skip COLOR0, COLOR1 in the actual geometry data for brevity (we can fill them if needed).
-    g_vertexLayout.begin()
-        .add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
-        .add(bgfx::Attrib::Normal,    3, bgfx::AttribType::Float)
-        .add(bgfx::Attrib::Tangent,   4, bgfx::AttribType::Float)
-        .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
-        .end();
+    buildVertexLayout(kFancyVertexFormat, kFancyVertexFormatCount, g_vertexLayout);
 }
 
 // -----------------------------------------------------------------------------
@@ -196,285 +173,171 @@ bgfx::ProgramHandle loadProgram(const char* _vsName, const char* _fsName)
 {
     bgfx::ShaderHandle vsh = loadShader(_vsName);
     bgfx::ShaderHandle fsh = loadShader(_fsName);
-    return bgfx::createProgram(vsh, fsh, true /* destroy shaders when program is destroyed */);
+    return g_resources.acquireProgram(vsh, fsh); // the cache owns (and shares) the shaders
 }
 
-// -----------------------------------------------------------------------------
-// Convert Assimp mesh data -> our geometry buffers
-// -----------------------------------------------------------------------------
-void assimpMeshToBuffers(const aiMesh* mesh,
-                         std::vector<MyFancyVertex>& outVertices,
-                         std::vector<uint32_t>& outIndices)
+// Where a material's texture comes from, as resolveMaterialTexture() finds it
+struct MaterialTextureSource
 {
-    if (!mesh) return;
-
-    outVertices.clear();
-    outIndices.clear();
-    outVertices.reserve(mesh->mNumVertices);
-    outIndices.reserve(mesh->mNumFaces * 3);
-
-    bool hasNormals   = mesh->HasNormals();
-    bool hasTexcoords = (mesh->mTextureCoords[0] != nullptr);
-    bool hasTangents  = (mesh->HasTangentsAndBitangents());
-
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    enum Kind
     {
-        MyFancyVertex v;
+        Embedded,       // encoded image bytes inside the scene ("*N")
+        EmbeddedTexels, // uncompressed aiTexels (BGRA8) inside the scene ("*N")
+        DataUri,        // base64 image in the path itself
+        File,           // external file, relative to the working directory
+    };
+
+    Kind kind = File;
+    const uint8_t* data = nullptr; // Embedded, EmbeddedTexels
+    size_t size = 0;               // Embedded
+    uint16_t width = 0;            // EmbeddedTexels
+    uint16_t height = 0;
+    std::string path;              // DataUri (the whole URI), File
+};
 
-        // Position
-        v.px = mesh->mVertices[i].x;
-        v.py = mesh->mVertices[i].y;
-        v.pz = mesh->mVertices[i].z;
+// The "*N" / data URI / file lookup both loadTextureType (per-draw textures) and loadMaterialImage (batching) go through
+static bool resolveMaterialTexture(const aiMaterial* mat, aiTextureType type, const aiScene* scene, MaterialTextureSource& out)
+{
+    aiString aiPath;
+    if (mat->GetTexture(type, 0, &aiPath) != AI_SUCCESS || aiPath.length == 0)
+    {
+        // No texture of this type on this material
+        return false;
+    }
 
-        // Normal (default to up if missing)
-        if (hasNormals)
-        {
-            v.nx = mesh->mNormals[i].x;
-            v.ny = mesh->mNormals[i].y;
-            v.nz = mesh->mNormals[i].z;
-        }
-        else
-        {
-            v.nx = 0.0f; v.ny = 1.0f; v.nz = 0.0f;
-        }
+    std::string_view path(aiPath.C_Str(), aiPath.length);
 
-        // Tangent
-        if (hasTangents)
-        {
-            v.tx = mesh->mTangents[i].x;
-            v.ty = mesh->mTangents[i].y;
-            v.tz = mesh->mTangents[i].z;
-        }
-        else
+    // Embedded texture data like "*0", "*1", etc. (Assimp uses '*' prefix for embedded index references.)
+    if (path[0] == '*')
+    {
+        int texIndex = std::atoi(aiPath.C_Str() + 1);
+        if (!scene || texIndex < 0 || texIndex >= static_cast<int>(scene->mNumTextures) || !scene->mTextures[texIndex])
         {
-            // Generate dummy tangent space (not ideal but prevents crashes)
-            v.tx = 1.0f; v.ty = 0.0f; v.tz = 0.0f;
+            std::cerr << "[resolveMaterialTexture] Invalid texture index.\n";
+            return false;
         }
 
-        // Texture Coordinates (UVs)
-        if (hasTexcoords)
+        // If mHeight == 0, pcData is a compressed image (PNG/JPG) of mWidth bytes, otherwise mWidth x mHeight aiTexels
+        const aiTexture* aiTex = scene->mTextures[texIndex];
+        out.data = reinterpret_cast<const uint8_t*>(aiTex->pcData);
+        if (aiTex->mHeight == 0)
         {
-            v.u = mesh->mTextureCoords[0][i].x;
-            v.v = mesh->mTextureCoords[0][i].y;
+            out.kind = MaterialTextureSource::Embedded;
+            out.size = size_t(aiTex->mWidth);
         }
         else
         {
-            v.u = 0.0f; v.v = 0.0f;
-        }
-
-        outVertices.push_back(v);
-    }
-
-    // Load indices
-    for (unsigned int f = 0; f < mesh->mNumFaces; f++)
-    {
-        const aiFace& face = mesh->mFaces[f];
-        if (face.mNumIndices == 3)  // Ensure it's a triangle
-        {
-            outIndices.push_back(face.mIndices[0]);
-            outIndices.push_back(face.mIndices[1]);
-            outIndices.push_back(face.mIndices[2]);
+            if (aiTex->mWidth > maxTextureSide() || aiTex->mHeight > maxTextureSide())
+            {
+                std::cerr << "[resolveMaterialTexture] Embedded texture " << aiTex->mWidth << "x" << aiTex->mHeight << " is too large.\n";
+                return false;
+            }
+            out.kind = MaterialTextureSource::EmbeddedTexels;
+            out.width = uint16_t(aiTex->mWidth);
+            out.height = uint16_t(aiTex->mHeight);
         }
+        return true;
     }
 
-    std::cout << "num vertices:" << outVertices.size() << std::endl;
-    std::cout << "num indices:" << outIndices.size() << std::endl;
-}
-
-static bgfx::TextureHandle createBgfxTextureFromMemory(const unsigned char* imageData, size_t dataSize)
-{
-    if (!imageData || dataSize == 0)
-    {
-        std::cerr << "[createBgfxTextureFromMemory] Invalid data or size.\n";
-        return BGFX_INVALID_HANDLE;
-    }
-
-    int width, height, channels;
-    // Use STBI_rgb_alpha to force 4 channels
-    unsigned char* decoded = stbi_load_from_memory(
-                imageData,
-                static_cast<int>(dataSize),
-                &width,
-                &height,
-                &channels,
-                STBI_rgb_alpha
-                );
-
-    if (!decoded)
-    {
-        std::cerr << "[createBgfxTextureFromMemory] stbi_load_from_memory failed.\n";
-        return BGFX_INVALID_HANDLE;
-    }
-
-    // STB outputs RGBA; BGFX expects BGRA by default.
-    // Swap R/B in-place:
-    for (int i = 0; i < width * height * 4; i += 4)
-    {
-        std::swap(decoded[i + 0], decoded[i + 2]); // R <-> B
-    }
-
-    const bgfx::Memory* mem = bgfx::copy(decoded, width * height * 4);
-    stbi_image_free(decoded);
-
-    // Create the BGFX texture
-    bgfx::TextureHandle handle = bgfx::createTexture2D(
-                static_cast<uint16_t>(width),
-                static_cast<uint16_t>(height),
-                false,     // no mipmaps
-                1,         // number of layers
-                bgfx::TextureFormat::BGRA8,
-                0,
-                mem
-                );
-
-    if (!bgfx::isValid(handle))
-    {
-        std::cerr << "[createBgfxTextureFromMemory] Failed to create BGFX texture.\n";
-    }
-    return handle;
+    // Data embedded in the path as base64 (rare in .gltf), or an external file
+    out.kind = path.rfind("data:", 0) == 0 ? MaterialTextureSource::DataUri : MaterialTextureSource::File;
+    out.path = path;
+    return true;
 }
 
-static bgfx::TextureHandle loadEmbeddedTexture(const aiScene* scene, int texIndex)
+bgfx::TextureHandle loadTextureType(const aiMaterial* mat, aiTextureType type, const aiScene* scene)
 {
-    if (!scene || texIndex < 0 || texIndex >= static_cast<int>(scene->mNumTextures))
-    {
-        std::cerr << "[loadEmbeddedTexture] Invalid texture index.\n";
-        return BGFX_INVALID_HANDLE;
-    }
-
-    const aiTexture* aiTex = scene->mTextures[texIndex];
-    if (!aiTex)
+    MaterialTextureSource source;
+    if (!resolveMaterialTexture(mat, type, scene, source))
     {
-        std::cerr << "[loadEmbeddedTexture] aiTexture is null.\n";
         return BGFX_INVALID_HANDLE;
     }
 
-    // If mHeight == 0, it's likely a compressed image in memory (PNG/JPG)
-    if (aiTex->mHeight == 0)
+    switch (source.kind)
     {
-        // aiTex->pcData is actually raw compressed data
-        // The size is stored in mWidth
-        const unsigned char* rawData = reinterpret_cast<const unsigned char*>(aiTex->pcData);
-        size_t dataSize = static_cast<size_t>(aiTex->mWidth);
-
-        return createBgfxTextureFromMemory(rawData, dataSize);
-    }
-    else
-    {
-        // If mHeight != 0, this means it's an uncompressed (e.g. RGBA) array:
-        // size = mWidth * mHeight * bytesPerPixel
-        // But it's very unusual in GLTF/GLB. You can handle it similarly:
-        size_t dataSize = size_t(aiTex->mWidth * aiTex->mHeight * 4); // 4 is a guess for RGBA
-        const unsigned char* rawData = reinterpret_cast<const unsigned char*>(aiTex->pcData);
-        return createBgfxTextureFromMemory(rawData, dataSize);
+    case MaterialTextureSource::Embedded:
+        return acquireTextureFromMemory(source.data, source.size);
+    case MaterialTextureSource::EmbeddedTexels:
+        return acquirePixelsTexture(source.data, source.width, source.height);
+    case MaterialTextureSource::DataUri:
+        return loadBase64Texture(source.path);
+    case MaterialTextureSource::File:
+        return loadExternalTexture(source.path);
     }
+    return BGFX_INVALID_HANDLE;
 }
 
-static bgfx::TextureHandle loadExternalTexture(const std::string& filePath)
+// CPU-side counterpart of loadTextureType for material batching: the same lookup, but the image is decoded
+// into memory for packing into a texture array. Content the batcher already has isn't decoded again (outImage stays empty).
+static bool loadMaterialImage(const aiMaterial* mat, aiTextureType type, const aiScene* scene, const MaterialBatcher& batcher,
+                              MaterialBatcher::Slot slot, uint64_t& outKey, DecodedImage& outImage)
 {
-    // Example: simple file load into memory, then decode
-    // (You might need a more robust file I/O system.)
-    FILE* fp = fopen(filePath.c_str(), "rb");
-    if (!fp)
-    {
-        std::cerr << "[loadExternalTexture] Failed to open file: " << filePath << "\n";
-        return BGFX_INVALID_HANDLE;
-    }
-
-    fseek(fp, 0, SEEK_END);
-    long fileSize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    if (fileSize <= 0)
+    MaterialTextureSource source;
+    if (!resolveMaterialTexture(mat, type, scene, source))
     {
-        std::cerr << "[loadExternalTexture] Invalid file size: " << filePath << "\n";
-        fclose(fp);
-        return BGFX_INVALID_HANDLE;
+        return false;
     }
 
-    std::vector<unsigned char> buffer(fileSize);
-    fread(buffer.data(), 1, fileSize, fp);
-    fclose(fp);
-
-    // Now decode
-    return createBgfxTextureFromMemory(buffer.data(), buffer.size());
-}
-
-
-
-static std::vector<unsigned char> base64Decode(const std::string& base64Str) {
-    std::vector<unsigned char> decoded(boost::beast::detail::base64::decoded_size(base64Str.size()));
-    auto result = boost::beast::detail::base64::decode(decoded.data(), base64Str.data(), base64Str.size());
-    decoded.resize(result.first);  // Resize to actual output size
-    return decoded;
-}
-
-
-// A helper if your path is "data:image/png;base64,XXX..."
-static bgfx::TextureHandle loadBase64Texture(const std::string& base64Uri)
-{
-    // Typically the URI is something like "data:image/png;base64,iVBORw0KGgoAAAANSUhE..."
-    // We need to find the comma that separates the header from the data
-    size_t commaPos = base64Uri.find(',');
-    if (commaPos == std::string::npos)
+    std::vector<uint8_t> fileData;
+    const uint8_t* data = source.data;
+    size_t dataSize = source.size;
+    switch (source.kind)
     {
-        std::cerr << "[loadBase64Texture] Invalid data URI.\n";
-        return BGFX_INVALID_HANDLE;
-    }
-
-    std::string base64Part = base64Uri.substr(commaPos + 1);
-
-    // decode
-    std::vector<unsigned char> rawBytes = base64Decode(base64Part);
-    if (rawBytes.empty())
+    case MaterialTextureSource::Embedded:
+        outKey = hashBytes(data, dataSize, kContentEncodedImage);
+        break;
+    case MaterialTextureSource::EmbeddedTexels:
     {
-        std::cerr << "[loadBase64Texture] Base64 decode failed.\n";
-        return BGFX_INVALID_HANDLE;
+        // Already BGRA8, only copied
+        outKey = pixelsContentKey(data, source.width, source.height);
+        if (!batcher.hasImage(slot, outKey))
+        {
+            const size_t imageBytes = size_t(source.width) * source.height * 4;
+            outImage.width = source.width;
+            outImage.height = source.height;
+            outImage.pixels = std::shared_ptr<uint8_t>(new uint8_t[imageBytes], std::default_delete<uint8_t[]>());
+            std::memcpy(outImage.pixels.get(), data, imageBytes);
+        }
+        return true;
     }
-
-    return createBgfxTextureFromMemory(rawBytes.data(), rawBytes.size());
-}
-
-
-bgfx::TextureHandle loadTextureType(const aiMaterial* mat, aiTextureType type, const aiScene* scene)
-{
-    aiString aiPath;
-    if (mat->GetTexture(type, 0, &aiPath) != AI_SUCCESS)
+    case MaterialTextureSource::DataUri:
     {
-        // No texture found for this type on this material
-        return BGFX_INVALID_HANDLE;
+        std::string_view base64Part;
+        if (!parseBase64DataUri(source.path, base64Part))
+        {
+            std::cerr << "[loadMaterialImage] Invalid data URI.\n";
+            return false;
+        }
+        s_base64Scratch.resize(base64DecodedCapacity(base64Part.size()));
+        if (!base64Decode(base64Part, s_base64Scratch.data(), dataSize) || dataSize == 0)
+        {
+            std::cerr << "[loadMaterialImage] Base64 decode failed.\n";
+            return false;
+        }
+        data = s_base64Scratch.data();
+        outKey = hashBytes(data, dataSize, kContentEncodedImage);
+        break;
     }
-
-    std::string path = aiPath.C_Str();
-    if (path.empty())
-    {
-        // Path is empty, no texture
-        return BGFX_INVALID_HANDLE;
+    case MaterialTextureSource::File:
+        // A path seen before isn't read again unless the batcher needs its pixels
+        if (!fileContentKey(source.path.c_str(), kContentEncodedImage, fileData, outKey))
+        {
+            return false;
+        }
+        if (!batcher.hasImage(slot, outKey) && fileData.empty() && !loadMem(source.path.c_str(), fileData))
+        {
+            return false;
+        }
+        data = fileData.data();
+        dataSize = fileData.size();
+        break;
     }
 
-    // Check if it's referencing embedded texture data like "*0", "*1", etc.
-    // (Assimp uses '*' prefix for embedded index references.)
-    if (path[0] == '*')
-    {
-        int texIndex = std::stoi(path.substr(1));
-        return loadEmbeddedTexture(scene, texIndex);
-    }
-    // Check if it's a data URI (rare in .gltf)
-    else if (path.rfind("data:", 0) == 0)
-    {
-        // We have data embedded in the path as base64
-        return loadBase64Texture(path);
-    }
-    else
+    if (batcher.hasImage(slot, outKey))
     {
-        // Otherwise, assume it's an external file reference
-        // path is relative to the .gltf/.glb; you may need to prepend the model directory
-        return loadExternalTexture(path);
+        return true;
     }
-
-    // Shouldn't get here, but if we do:
-    std::cerr << "[loadTextureType] Unknown texture path format.\n";
-    return BGFX_INVALID_HANDLE;
+    return decodeImageBGRA(data, dataSize, outImage);
 }
 
 
@@ -541,10 +404,13 @@ void printMaterialTextures(const aiScene* scene)
 }
 
 static float theTime;
+static float s_cameraOrbitSpeed = 0.0f; // radians per second, 0 keeps the camera still
 static int fbWidth;
 static int fbHeight;
-static const int viewId_Skybox = 0;
-static const int viewId_Mesh = 1;
+static const int viewId_ShadowFirst = 0; // CachedShadowMaps::kNumViews views, rendered before anything samples them
+static const int viewId_Skybox = viewId_ShadowFirst + CachedShadowMaps::kNumViews;
+static const int viewId_Mesh = viewId_Skybox + 1;
+static const int viewId_Readback = viewId_Mesh + 1; // --batch-render's blits into the read-back textures
 
 static bgfx::UniformHandle u_myModelMatrix;
 static bgfx::UniformHandle u_camPos;
@@ -559,152 +425,2711 @@ static bgfx::UniformHandle s_brdfLUT;
 
 static bgfx::VertexLayout skyboxVertLayout;
 
-static bgfx::ShaderHandle vsh;
-static bgfx::ShaderHandle fsh;
+struct DrillMaterial
+{
+    bgfx::TextureHandle diffuseTex;
+    bgfx::TextureHandle normalTex;
+    bgfx::TextureHandle armTex;
+};
+
+struct DrillMesh
+{
+    bgfx::VertexBufferHandle vbh;
+    bgfx::IndexBufferHandle ibh;
+    uint32_t materialIndex;
+    float boundsMin[3]; // local AABB
+    float boundsMax[3];
+    int32_t occluder;   // index into s_occluderMeshes, -1 if the mesh is too detailed to be one
+    int32_t skin;       // index into s_skins, -1 for rigid meshes
+    bgfx::VertexBufferHandle skinVbh; // SkinInfluence stream, drawn next to vbh
+};
+
+// One per mesh reference in the node hierarchy
+struct DrillDrawItem
+{
+    uint32_t meshIndex;
+    uint32_t materialIndex; // the mesh's material, unless overridden (--material-stress)
+    bool isStatic;       // doesn't spin with the drill, so unless it's skinned it goes into the cached shadow layer
+    int32_t skinInstance; // index into s_skinInstances, -1 if the item isn't animated
+    float transform[16]; // node's world transform
+};
+
+// Draw items sharing a mesh and a material batch, submitted as one instanced draw
+struct DrillInstanceGroup
+{
+    uint32_t meshIndex;
+    uint16_t batch;
+    std::vector<uint32_t> drawItems;
+};
+
+static std::vector<DrillMaterial> s_materials; // per-draw path only
+static std::vector<DrillMesh> s_meshes;
+static std::vector<DrillDrawItem> s_drawItems;
 
-static std::vector<MyFancyVertex> vertices;
-static std::vector<uint32_t> indices;
+// Material batching: materials live in texture arrays and draws are grouped into instanced submits
+static bool s_materialBatching = true;
+static MaterialBatcher s_materialBatcher;
+static std::vector<DrillInstanceGroup> s_instanceGroups;
 
-static bgfx::VertexBufferHandle vbh;
+// Per-instance data for vs_drill_instanced: model matrix (i_data0..3) + material layers (i_data4)
+static const uint16_t kDrillInstanceStride = 80;
 
-static bgfx::IndexBufferHandle ibh;
+// CPU submit time of the drill draws, printed with the draw call count every few seconds
+static int64_t s_submitTimeAccum = 0;
+static uint32_t s_submitFrames = 0;
+static double s_lastSubmitReport = 0.0;
+
+// Clustered forward lights: the scene's point/spot lights and the unshadowed --spots, followed by the generated orbiting ones (--lights N)
+struct OrbitingLight
+{
+    float orbitRadius;
+    float height;
+    float speed;
+    float phase;
+};
 
-static bgfx::TextureHandle diffuseTex;
-static bgfx::TextureHandle normalTex;
-static bgfx::TextureHandle armTex;
-static bgfx::TextureHandle irradianceTex;
-static bgfx::TextureHandle radianceTex;
+static LightClusterer s_lightClusterer;
+static std::vector<ClusterLight> s_lights;
+static std::vector<OrbitingLight> s_orbitingLights;
+static int64_t s_lightAssignTimeAccum = 0;
+static uint64_t s_lightDroppedAccum = 0; // light-in-cluster pairs that didn't fit, see LightClusterer::droppedAssignments
+
+static bgfx::UniformHandle s_clusterGrid;
+static bgfx::UniformHandle s_lightIndices;
+static bgfx::UniformHandle s_lightData;
+static bgfx::UniformHandle u_clusterParams;
+static bgfx::UniformHandle u_clusterDepth;
+
+// Shadowed lights: the sun (cascades) and up to CachedShadowMaps::kMaxSpots spotlights
+static const float kDefaultSunDirection[3] = { 0.37f, -0.84f, 0.39f }; // unless the asset has a directional light
+static const float kDefaultSunColor[3] = { 0.8f, 0.77f, 0.72f };
+static float s_sunDirection[3];
+static float s_sunColor[3];
+static std::vector<ShadowedSpotLight> s_spotLights;
+static CachedShadowMaps s_shadowMaps;
+static bgfx::ProgramHandle s_shadowProgram = BGFX_INVALID_HANDLE;
+
+// Everything the shadows have to cover, including the spin of the dynamic items
+static float s_sceneCenter[3];
+static float s_sceneRadius;
+
+// Bounds of the asset's own draw items (spin included), to frame it in --batch-render
+static float s_assetBoundsMin[3];
+static float s_assetBoundsMax[3];
+
+// Software occlusion culling (--occlusion-culling): the biggest occluders on screen are rasterized on the CPU
+// each frame and draw items hidden behind them aren't submitted to the main view
+static const uint32_t kMaxOccluderMeshTriangles = 4096;
+static const uint32_t kOccluderTriangleBudget = 16384;
+static bool s_occlusionCulling = false;
+static OcclusionCuller s_occlusionCuller;
+static std::vector<OccluderMesh> s_occluderMeshes;
+static std::vector<uint8_t> s_itemVisible; // per draw item, this frame
+static int64_t s_occlusionRasterTimeAccum = 0;
+static int64_t s_occlusionTestTimeAccum = 0;
+static uint64_t s_occluderTrianglesAccum = 0;
+static uint64_t s_occlusionTestedAccum = 0;
+static uint64_t s_occlusionCulledAccum = 0;
+static uint64_t s_offScreenCulledAccum = 0;
+
+// Skeletal animation: every scene node is a joint, skinned meshes bind some of them as bones and each
+// animated draw item gets its own stretch of the palette, evaluated on the CPU and read by vs_drill_skinned
+static const uint16_t kSkinPaletteWidth = 1024; // texels, SKIN_PALETTE_WIDTH in vs_drill_skinned.sc
+static Skeleton s_skeleton;
+static std::vector<AnimationClip> s_clips;
+static std::vector<SkinBinding> s_skins;
+static std::vector<SkinInstance> s_skinInstances;
+static SkinningPaletteEvaluator s_paletteEvaluator;
+static std::vector<float> s_skinPalette; // SkinningPaletteEvaluator::kFloatsPerBone per bone, padded to whole texture rows
+static uint16_t s_skinPaletteRows = 0;
+static bgfx::VertexLayout s_skinLayout;
+static bgfx::TextureHandle s_skinPaletteTexture = BGFX_INVALID_HANDLE;
+static bgfx::UniformHandle s_skinPaletteSampler;
+static bgfx::UniformHandle u_skinParams;
+static bgfx::ProgramHandle s_skinnedProgram = BGFX_INVALID_HANDLE;
+static bgfx::ProgramHandle s_skinnedShadowProgram = BGFX_INVALID_HANDLE; // bind pose shadows without it
+static int64_t s_paletteTimeAccum = 0;
+
+// --cpu-skinning: the same palettes applied on the CPU into a dynamic vertex buffer per instance, to check the shader
+static bool s_cpuSkinning = false;
+static std::vector<std::vector<MyFancyVertex>> s_skinBindVertices; // per skin
+static std::vector<MyFancyVertex> s_cpuSkinnedVertices;           // scratch
+static std::vector<bgfx::DynamicVertexBufferHandle> s_cpuSkinnedBuffers; // per skin instance
+static int64_t s_cpuSkinTimeAccum = 0;
+
+// Ray picking (left click): a BVH per asset mesh in mesh space, the cursor ray is tested against every
+// draw item in the item's space. Generated meshes (ground plane, stress scene walls) aren't pickable
+struct PickMesh
+{
+    std::string name;
+    TriangleBvh bvh;
+    std::vector<uint32_t> indices;  // what the BVH's triangle ids refer to
+    std::vector<float> texcoords;   // first UV channel per vertex, empty if the mesh has none
+};
+static std::vector<PickMesh> s_pickMeshes; // per asset mesh
+static GLFWwindow* s_window = nullptr;
+static bool s_pickButtonDown = false;
+
+// Geometry streaming (--stream-mesh): a mesh chunked offline with --chunk-mesh, of which only the chunks that
+// rank best for the camera are resident, in a pool of dynamic buffers sized by --stream-budget-mb. It's placed
+// behind the drill and isn't shadowed, occlusion culled or pickable
+static const float kStreamedMeshCenter[3] = { 0.0f, 0.05f, -0.6f };
+static const float kStreamedMeshRadius = 0.5f;
+static ChunkStreamer s_chunkStreamer;
+static float s_streamedFit[16];        // file space to kStreamedMeshRadius around kStreamedMeshCenter
+static float s_streamedModel[16];      // s_streamedFit, spun about kStreamedMeshCenter
+static float s_streamedSpinSpeed = 0.2f; // radians per second; chunks keep changing rank even with a still camera
+
+// Spotlight uniform arrays, rebuilt once per frame
+static float s_spotPositionData[CachedShadowMaps::kMaxSpots][4];
+static float s_spotDirectionData[CachedShadowMaps::kMaxSpots][4];
+static float s_spotColorData[CachedShadowMaps::kMaxSpots][4];
+
+static bgfx::UniformHandle s_shadowMap;
+static bgfx::UniformHandle u_sunDirection;
+static bgfx::UniformHandle u_sunColor;
+static bgfx::UniformHandle u_cascadeSplits;
+static bgfx::UniformHandle u_cascadeMtx;
+static bgfx::UniformHandle u_spotPosition;
+static bgfx::UniformHandle u_spotDirection;
+static bgfx::UniformHandle u_spotColor;
+static bgfx::UniformHandle u_spotShadowMtx;
+static bgfx::UniformHandle u_shadowParams;
+
+static bgfx::TextureHandle irradianceTex = BGFX_INVALID_HANDLE;
+static bgfx::TextureHandle radianceTex = BGFX_INVALID_HANDLE;
 static bgfx::TextureHandle brdfLutTex;
 
 static bgfx::ProgramHandle program;
 
-void renderFrame()
+// The material slots and their stand-ins (BGRA) for when the asset doesn't provide one
+static const aiTextureType kMaterialTextureTypes[MaterialBatcher::Slot_Count] =
 {
-    glfwPollEvents();
-
-    // Update time and do a rotation
-    double currentTime = glfwGetTime();
-    theTime = float(currentTime);
+    aiTextureType_DIFFUSE,
+    aiTextureType_NORMALS,
+#ifdef __EMSCRIPTEN__
+    aiTextureType_METALNESS,
+#else // Linux/X11
+    //my old Debian Bullseye version of assimp uses "UNKNOWN" for the arm, but the bleeding edge git version (which i had to get for wasm) uses either METALNESS or ROUGHNESS
+    aiTextureType_UNKNOWN,
+#endif // __EMSCRIPTEN__
+};
+static const uint8_t kMaterialFallbackPixels[MaterialBatcher::Slot_Count][4] =
+{
+    { 255, 255, 255, 255 }, // white
+    { 255, 128, 128, 255 }, // flat normal
+    { 0, 255, 255, 255 },   // ao 1, roughness 1, metalness 0
+};
+static const char* const kMaterialSlotNames[MaterialBatcher::Slot_Count] = { "diffuse", "normal", "ARM (AO, Roughness, Metalness)" };
 
-    // Set up a simple camera
-    float view[16];
-    const bx::Vec3 at   = {0.0f, 0.1f, 0.0f};
-    const bx::Vec3 eye  = {0.0f, 0.25f, 0.25f}; // Move slightly back so we can see the drill
-    const bx::Vec3 up   = {0.0f, 1.0f, 0.0f};
-    bx::mtxLookAt(view, eye, at, up);
+static bgfx::TextureHandle acquireImageTexture(const DecodedImage& image)
+{
+    return acquirePixelsTexture(image.pixels.get(), image.width, image.height);
+}
 
+// 1x1 stand-in for a material slot the asset doesn't provide (pixel is BGRA)
+static bgfx::TextureHandle acquireSolidTexture(const uint8_t pixel[4])
+{
+    return acquireImageTexture(makeSolidImage(pixel[0], pixel[1], pixel[2], pixel[3]));
+}
 
-    float proj[16];
+// Small checkerboard in a color derived from `index`, a distinct material texture for the --material-stress scene
+static DecodedImage makeStressMaterialImage(uint32_t index)
+{
+    const uint16_t size = 64;
+    const uint64_t color = hashBytes(&index, sizeof(index));
+
+    DecodedImage image;
+    image.width = size;
+    image.height = size;
+    image.pixels = std::shared_ptr<uint8_t>(new uint8_t[size * size * 4], std::default_delete<uint8_t[]>());
+    for (uint32_t y = 0; y < size; ++y)
     {
-        bx::mtxProj(proj, 60.0f, float(fbWidth)/float(fbHeight), 0.1f, 500.0f, bgfx::getCaps()->homogeneousDepth);
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint8_t shade = ((x / 8 + y / 8) & 1) ? 255 : 160;
+            uint8_t* pixel = image.pixels.get() + (y * size + x) * 4;
+            pixel[0] = uint8_t(((color >> 0) & 0xff) * shade / 255);
+            pixel[1] = uint8_t(((color >> 8) & 0xff) * shade / 255);
+            pixel[2] = uint8_t(((color >> 16) & 0xff) * shade / 255);
+            pixel[3] = 255;
+        }
     }
+    return image;
+}
 
+static DrillMaterial loadMaterial(const aiScene* scene, unsigned int materialIndex)
+{
+    const aiMaterial* mat = scene->mMaterials[materialIndex];
 
-    //Skybox
-    float viewNoTrans[16];
-    bx::memCopy(viewNoTrans, view, sizeof(viewNoTrans));
-    viewNoTrans[12] = 0.0f;
-    viewNoTrans[13] = 0.0f;
-    viewNoTrans[14] = 0.0f;
-    float viewProjNoTrans[16];
-    bx::mtxMul(viewProjNoTrans, viewNoTrans, proj);
-    bgfx::setViewTransform(viewId_Skybox, viewNoTrans, viewProjNoTrans);
-    // Set uniforms for the skybox vertex shader
-    bgfx::setUniform(s_uView, view);
-    bgfx::setUniform(s_uProj, proj);
+    bgfx::TextureHandle textures[MaterialBatcher::Slot_Count];
+    for (int slot = 0; slot < MaterialBatcher::Slot_Count; ++slot)
+    {
+        textures[slot] = loadTextureType(mat, kMaterialTextureTypes[slot], scene);
+        if (!bgfx::isValid(textures[slot]))
+        {
+            std::cerr << "Warning: material " << materialIndex << " has no valid " << kMaterialSlotNames[slot] << " texture, using a 1x1 stand-in." << std::endl;
+            textures[slot] = acquireSolidTexture(kMaterialFallbackPixels[slot]);
+        }
+    }
 
-    // Submit the skybox draw
-    bgfx::setVertexBuffer(0, s_skyboxVertBuffer);
-    bgfx::setIndexBuffer(s_skyboxIndexBuffer);
+    DrillMaterial material;
+    material.diffuseTex = textures[MaterialBatcher::Slot_Color];
+    material.normalTex  = textures[MaterialBatcher::Slot_Normal];
+    material.armTex     = textures[MaterialBatcher::Slot_ARM];
+    return material;
+}
 
-    // Bind the cubemap
-    bgfx::setTexture(0, s_skyboxUniform, s_skyboxTexture);
+// Batching counterpart of loadMaterial: queues the material's images for the texture arrays
+static void addBatchedMaterial(const aiScene* scene, unsigned int materialIndex)
+{
+    const aiMaterial* mat = scene->mMaterials[materialIndex];
 
-    bgfx::setState(BGFX_STATE_WRITE_RGB);
+    uint64_t keys[MaterialBatcher::Slot_Count];
+    DecodedImage images[MaterialBatcher::Slot_Count];
+    for (int slot = 0; slot < MaterialBatcher::Slot_Count; ++slot)
+    {
+        MaterialBatcher::Slot batchSlot = MaterialBatcher::Slot(slot);
+        if (!loadMaterialImage(mat, kMaterialTextureTypes[slot], scene, s_materialBatcher, batchSlot, keys[slot], images[slot]) ||
+            (!images[slot].pixels && !s_materialBatcher.hasImage(batchSlot, keys[slot])))
+        {
+            std::cerr << "Warning: material " << materialIndex << " has no valid " << kMaterialSlotNames[slot] << " texture, using a 1x1 stand-in." << std::endl;
+            images[slot] = makeSolidImage(kMaterialFallbackPixels[slot][0], kMaterialFallbackPixels[slot][1], kMaterialFallbackPixels[slot][2], kMaterialFallbackPixels[slot][3]);
+            keys[slot] = pixelsContentKey(images[slot].pixels.get(), 1, 1);
+        }
+    }
+    s_materialBatcher.addMaterial(keys, images);
+}
 
-    bgfx::submit(viewId_Skybox, s_skyboxProgram);
+// Adds `count` extra drills in a grid, each with its own material, to measure per-material draw overhead
+static void addMaterialStressScene(uint32_t count)
+{
+    const uint32_t columns = uint32_t(std::ceil(std::sqrt(double(count))));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        DecodedImage color = makeStressMaterialImage(i);
+        uint32_t materialIndex;
+        if (s_materialBatching)
+        {
+            uint64_t keys[MaterialBatcher::Slot_Count];
+            DecodedImage images[MaterialBatcher::Slot_Count] =
+            {
+                color,
+                makeSolidImage(kMaterialFallbackPixels[1][0], kMaterialFallbackPixels[1][1], kMaterialFallbackPixels[1][2], kMaterialFallbackPixels[1][3]),
+                makeSolidImage(kMaterialFallbackPixels[2][0], kMaterialFallbackPixels[2][1], kMaterialFallbackPixels[2][2], kMaterialFallbackPixels[2][3]),
+            };
+            keys[0] = pixelsContentKey(color.pixels.get(), color.width, color.height);
+            keys[1] = pixelsContentKey(kMaterialFallbackPixels[1], 1, 1);
+            keys[2] = pixelsContentKey(kMaterialFallbackPixels[2], 1, 1);
+            materialIndex = s_materialBatcher.addMaterial(keys, images);
+        }
+        else
+        {
+            DrillMaterial material;
+            material.diffuseTex = acquireImageTexture(color);
+            material.normalTex  = acquireSolidTexture(kMaterialFallbackPixels[1]);
+            material.armTex     = acquireSolidTexture(kMaterialFallbackPixels[2]);
+            s_materials.push_back(material);
+            materialIndex = uint32_t(s_materials.size() - 1);
+        }
 
+        DrillDrawItem item;
+        item.meshIndex = 0;
+        item.materialIndex = materialIndex;
+        item.isStatic = true;
+        item.skinInstance = -1;
+        bx::mtxTranslate(item.transform, (float(i % columns) - 0.5f * float(columns)) * 0.15f, 0.0f, -0.2f - float(i / columns) * 0.15f);
+        s_drawItems.push_back(item);
+    }
+}
 
+// Returns the occluder index for DrillMesh::occluder
+static int32_t addOccluderMesh(std::vector<float> positions, std::vector<uint32_t> indices)
+{
+    OccluderMesh occluder;
+    occluder.positions = std::move(positions);
+    occluder.indices = std::move(indices);
+    s_occluderMeshes.push_back(std::move(occluder));
+    return int32_t(s_occluderMeshes.size() - 1);
+}
 
+static int32_t addOccluderMesh(const aiMesh* mesh)
+{
+    if (mesh->mNumFaces > kMaxOccluderMeshTriangles)
+    {
+        return -1;
+    }
 
-    //Drill mesh
-    bgfx::setViewTransform(viewId_Mesh, view, proj);
+    std::vector<float> positions(size_t(mesh->mNumVertices) * 3);
+    for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+    {
+        positions[v * 3 + 0] = mesh->mVertices[v].x;
+        positions[v * 3 + 1] = mesh->mVertices[v].y;
+        positions[v * 3 + 2] = mesh->mVertices[v].z;
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(size_t(mesh->mNumFaces) * 3);
+    for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+    {
+        const aiFace& face = mesh->mFaces[f];
+        if (face.mNumIndices == 3)
+        {
+            indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+        }
+    }
+    return indices.empty() ? -1 : addOccluderMesh(std::move(positions), std::move(indices));
+}
 
-    float mtxRotateY[16];
-    bx::mtxRotateY(mtxRotateY, theTime);
+// Axis-aligned box with per-face normals, returns the mesh index
+static uint32_t addBoxMesh(const float boxMin[3], const float boxMax[3], uint32_t materialIndex)
+{
+    // Per face: normal axis and sign, and the two axes spanning it (u, v) such that u x v = normal
+    static const int kFaces[6][4] =
+    {
+        { 0,  1, 2, 1 }, { 0, -1, 1, 2 },
+        { 1,  1, 0, 2 }, { 1, -1, 2, 0 },
+        { 2,  1, 1, 0 }, { 2, -1, 0, 1 },
+    };
+
+    std::vector<MyFancyVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<float> positions;
+    for (const int* face : kFaces)
+    {
+        const int axis = face[0];
+        const int uAxis = face[2];
+        const int vAxis = face[3];
+        const uint32_t base = uint32_t(vertices.size());
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            const bool uMax = corner == 1 || corner == 2;
+            const bool vMax = corner >= 2;
+            float position[3];
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            float tangent[3] = { 0.0f, 0.0f, 0.0f };
+            position[axis] = face[1] > 0 ? boxMax[axis] : boxMin[axis];
+            position[uAxis] = uMax ? boxMax[uAxis] : boxMin[uAxis];
+            position[vAxis] = vMax ? boxMax[vAxis] : boxMin[vAxis];
+            normal[axis] = float(face[1]);
+            tangent[uAxis] = 1.0f;
+
+            MyFancyVertex vertex =
+            {
+                position[0], position[1], position[2],
+                normal[0], normal[1], normal[2],
+                tangent[0], tangent[1], tangent[2], 1.0f,
+                uMax ? 1.0f : 0.0f, vMax ? 1.0f : 0.0f,
+            };
+            vertices.push_back(vertex);
+            positions.insert(positions.end(), position, position + 3);
+        }
+        const uint32_t quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+        indices.insert(indices.end(), quad, quad + 6);
+    }
 
-    float mtxTranslate[16];
-    bx::mtxTranslate(mtxTranslate, 0.0f, 0.0f, 0.0f);
+    DrillMesh box;
+    box.vbh = bgfx::createVertexBuffer(bgfx::copy(vertices.data(), uint32_t(vertices.size() * sizeof(MyFancyVertex))), g_vertexLayout);
+    box.ibh = bgfx::createIndexBuffer(bgfx::copy(indices.data(), uint32_t(indices.size() * sizeof(uint32_t))), BGFX_BUFFER_INDEX32);
+    box.materialIndex = materialIndex;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        box.boundsMin[axis] = boxMin[axis];
+        box.boundsMax[axis] = boxMax[axis];
+    }
+    box.occluder = addOccluderMesh(std::move(positions), std::move(indices));
+    box.skin = -1;
+    box.skinVbh = BGFX_INVALID_HANDLE;
+    s_meshes.push_back(box);
+    return uint32_t(s_meshes.size() - 1);
+}
+
+static uint32_t addSolidMaterial(const uint8_t color[4]);
+
+// Dense showroom for --occlusion-stress: rows of drills going away from the camera with a partition wall
+// after every few rows, so most of them are hidden
+static void addOcclusionStressScene(uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const uint32_t kColumns = 16;
+    const uint32_t kRowsPerRoom = 4;
+    const float spacingX = 0.2f;
+    const float spacingZ = 0.12f;
+    const DrillMesh& drill = s_meshes[0];
+    const uint32_t drillMaterial = drill.materialIndex;
+    const float floorY = drill.boundsMin[1];
+
+    const uint8_t wallColor[4] = { 190, 190, 190, 255 };
+    const uint32_t wallMaterial = addSolidMaterial(wallColor);
+    const uint32_t rows = (count + kColumns - 1) / kColumns;
+    const float halfWidth = 0.5f * float(kColumns) * spacingX;
+    for (uint32_t room = 1; room * kRowsPerRoom < rows; ++room)
+    {
+        // Takes the place of one row
+        const float z = -0.3f - float(room * (kRowsPerRoom + 1) - 1) * spacingZ;
+        const float wallMin[3] = { -halfWidth, floorY, z - 0.01f };
+        const float wallMax[3] = { halfWidth, floorY + 0.3f, z + 0.01f };
+
+        DrillDrawItem wall;
+        wall.meshIndex = addBoxMesh(wallMin, wallMax, wallMaterial);
+        wall.materialIndex = wallMaterial;
+        wall.isStatic = true;
+        wall.skinInstance = -1;
+        bx::mtxIdentity(wall.transform);
+        s_drawItems.push_back(wall);
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t row = i / kColumns;
+        DrillDrawItem item;
+        item.meshIndex = 0;
+        item.materialIndex = drillMaterial;
+        item.isStatic = true;
+        item.skinInstance = -1;
+        bx::mtxTranslate(item.transform, (float(i % kColumns) - 0.5f * float(kColumns - 1)) * spacingX, 0.0f,
+                         -0.3f - float(row + row / kRowsPerRoom) * spacingZ);
+        s_drawItems.push_back(item);
+    }
+}
+
+static void computeMeshBounds(const aiMesh* mesh, DrillMesh& drillMesh)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        drillMesh.boundsMin[axis] = mesh->mNumVertices ? 1e30f : 0.0f;
+        drillMesh.boundsMax[axis] = mesh->mNumVertices ? -1e30f : 0.0f;
+    }
+    for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+    {
+        const float position[3] = { mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            drillMesh.boundsMin[axis] = std::min(drillMesh.boundsMin[axis], position[axis]);
+            drillMesh.boundsMax[axis] = std::max(drillMesh.boundsMax[axis], position[axis]);
+        }
+    }
+}
+
+// World AABB of the draw items; dynamic ones are widened to everything they sweep while spinning around Y
+static void computeDrawItemBounds(float outMin[3], float outMax[3])
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        outMin[axis] = 1e30f;
+        outMax[axis] = -1e30f;
+    }
+    for (const DrillDrawItem& item : s_drawItems)
+    {
+        const DrillMesh& mesh = s_meshes[item.meshIndex];
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const bx::Vec3 local =
+            {
+                (corner & 1) ? mesh.boundsMax[0] : mesh.boundsMin[0],
+                (corner & 2) ? mesh.boundsMax[1] : mesh.boundsMin[1],
+                (corner & 4) ? mesh.boundsMax[2] : mesh.boundsMin[2],
+            };
+            bx::Vec3 world = bx::mul(local, item.transform);
+            float sweptX[2] = { world.x, world.x };
+            float sweptZ[2] = { world.z, world.z };
+            if (!item.isStatic)
+            {
+                float orbit = std::sqrt(world.x * world.x + world.z * world.z);
+                sweptX[0] = sweptZ[0] = -orbit;
+                sweptX[1] = sweptZ[1] = orbit;
+            }
+            outMin[0] = std::min(outMin[0], sweptX[0]);
+            outMax[0] = std::max(outMax[0], sweptX[1]);
+            outMin[1] = std::min(outMin[1], world.y);
+            outMax[1] = std::max(outMax[1], world.y);
+            outMin[2] = std::min(outMin[2], sweptZ[0]);
+            outMax[2] = std::max(outMax[2], sweptZ[1]);
+        }
+    }
+}
+
+static uint32_t addSolidMaterial(const uint8_t color[4])
+{
+    if (s_materialBatching)
+    {
+        uint64_t keys[MaterialBatcher::Slot_Count];
+        DecodedImage images[MaterialBatcher::Slot_Count];
+        const uint8_t* pixels[MaterialBatcher::Slot_Count] = { color, kMaterialFallbackPixels[1], kMaterialFallbackPixels[2] };
+        for (int slot = 0; slot < MaterialBatcher::Slot_Count; ++slot)
+        {
+            images[slot] = makeSolidImage(pixels[slot][0], pixels[slot][1], pixels[slot][2], pixels[slot][3]);
+            keys[slot] = pixelsContentKey(pixels[slot], 1, 1);
+        }
+        return s_materialBatcher.addMaterial(keys, images);
+    }
+
+    DrillMaterial material;
+    material.diffuseTex = acquireSolidTexture(color);
+    material.normalTex  = acquireSolidTexture(kMaterialFallbackPixels[1]);
+    material.armTex     = acquireSolidTexture(kMaterialFallbackPixels[2]);
+    s_materials.push_back(material);
+    return uint32_t(s_materials.size() - 1);
+}
+
+// Static floor under the drill(s), so the shadows have something to fall on
+static void addGroundPlane()
+{
+    float boundsMin[3];
+    float boundsMax[3];
+    computeDrawItemBounds(boundsMin, boundsMax);
+
+    const float y = boundsMin[1];
+    const float centerX = 0.5f * (boundsMin[0] + boundsMax[0]);
+    const float centerZ = 0.5f * (boundsMin[2] + boundsMax[2]);
+    const float halfSize = std::max(0.3f, 0.6f * std::max(boundsMax[0] - boundsMin[0], boundsMax[2] - boundsMin[2]));
+
+    const MyFancyVertex vertices[4] =
+    {
+        { centerX - halfSize, y, centerZ - halfSize, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+        { centerX - halfSize, y, centerZ + halfSize, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f },
+        { centerX + halfSize, y, centerZ + halfSize, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+        { centerX + halfSize, y, centerZ - halfSize, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f },
+    };
+    const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+
+    const uint8_t groundColor[4] = { 150, 150, 150, 255 };
+    DrillMesh ground;
+    ground.vbh = bgfx::createVertexBuffer(bgfx::copy(vertices, sizeof(vertices)), g_vertexLayout);
+    ground.ibh = bgfx::createIndexBuffer(bgfx::copy(indices, sizeof(indices)), BGFX_BUFFER_INDEX32);
+    ground.materialIndex = addSolidMaterial(groundColor);
+    ground.boundsMin[0] = vertices[0].px; ground.boundsMin[1] = y; ground.boundsMin[2] = vertices[0].pz;
+    ground.boundsMax[0] = vertices[2].px; ground.boundsMax[1] = y; ground.boundsMax[2] = vertices[2].pz;
+    std::vector<float> groundPositions;
+    for (const MyFancyVertex& vertex : vertices)
+    {
+        groundPositions.insert(groundPositions.end(), { vertex.px, vertex.py, vertex.pz });
+    }
+    ground.occluder = addOccluderMesh(std::move(groundPositions), std::vector<uint32_t>(indices, indices + 6));
+    ground.skin = -1;
+    ground.skinVbh = BGFX_INVALID_HANDLE;
+    s_meshes.push_back(ground);
+
+    DrillDrawItem item;
+    item.meshIndex = uint32_t(s_meshes.size() - 1);
+    item.materialIndex = ground.materialIndex;
+    item.isStatic = true;
+    item.skinInstance = -1;
+    bx::mtxIdentity(item.transform);
+    s_drawItems.push_back(item);
+}
+
+static void computeSceneBounds()
+{
+    float boundsMin[3];
+    float boundsMax[3];
+    computeDrawItemBounds(boundsMin, boundsMax);
+
+    float radius2 = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        s_sceneCenter[axis] = 0.5f * (boundsMin[axis] + boundsMax[axis]);
+        float half = 0.5f * (boundsMax[axis] - boundsMin[axis]);
+        radius2 += half * half;
+    }
+    s_sceneRadius = std::max(std::sqrt(radius2), 0.01f);
+}
+
+static void drawItemModelMatrix(const DrillDrawItem& item, const float* mtxSpin, float* result)
+{
+    if (item.isStatic)
+    {
+        bx::memCopy(result, item.transform, sizeof(item.transform));
+    }
+    else
+    {
+        bx::mtxMul(result, item.transform, mtxSpin);
+    }
+}
+
+// Buckets the draw items by (mesh, material batch); each bucket becomes one instanced submit per frame
+static void buildInstanceGroups()
+{
+    std::map<std::pair<uint32_t, uint16_t>, size_t> groupIndex;
+    for (uint32_t i = 0; i < s_drawItems.size(); ++i)
+    {
+        const DrillDrawItem& item = s_drawItems[i];
+        if (item.skinInstance >= 0)
+        {
+            // Each reads its own palette range, see submitSkinnedItem
+            continue;
+        }
+        uint16_t batch = s_materialBatcher.material(item.materialIndex).batch;
+        auto inserted = groupIndex.emplace(std::make_pair(item.meshIndex, batch), s_instanceGroups.size());
+        if (inserted.second)
+        {
+            s_instanceGroups.push_back(DrillInstanceGroup{ item.meshIndex, batch, {} });
+        }
+        s_instanceGroups[inserted.first->second].drawItems.push_back(i);
+    }
+    std::cout << "[MaterialBatch] " << s_drawItems.size() << " draw items in " << s_instanceGroups.size() << " instanced submit(s)" << std::endl;
+}
+
+static void collectDrawItems(const aiNode* node, const aiMatrix4x4& parentTransform)
+{
+    aiMatrix4x4 transform = parentTransform * node->mTransformation;
+
+    // Assimp matrices are row-major for column vectors, bx wants the transpose
+    aiMatrix4x4 transposed = transform;
+    transposed.Transpose();
+
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+    {
+        DrillDrawItem item;
+        item.meshIndex = node->mMeshes[i];
+        item.materialIndex = s_meshes[item.meshIndex].materialIndex;
+        item.isStatic = false;
+        item.skinInstance = -1;
+        bx::memCopy(item.transform, &transposed, sizeof(item.transform));
+        s_drawItems.push_back(item);
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; ++i)
+    {
+        collectDrawItems(node->mChildren[i], transform);
+    }
+}
+
+// The influences become the mesh's second vertex stream; the bind pose vertices are kept for --cpu-skinning
+static void addSkin(SkinBinding&& binding, const bgfx::Memory* vertices, DrillMesh& drillMesh)
+{
+    drillMesh.skinVbh = bgfx::createVertexBuffer(
+                bgfx::copy(binding.influences.data(), uint32_t(binding.influences.size() * sizeof(SkinInfluence))),
+                s_skinLayout
+                );
+    const MyFancyVertex* first = reinterpret_cast<const MyFancyVertex*>(vertices->data);
+    s_skinBindVertices.emplace_back(first, first + vertices->size / sizeof(MyFancyVertex));
+    s_skins.push_back(std::move(binding));
+    drillMesh.skin = int32_t(s_skins.size() - 1);
+}
+
+// Stand-in rig for --skinning-demo, as the drill asset has no bones: the chuck end (-x, upper half) is bound
+// to a joint spinning about the x axis and the rest to a static body joint, blended over a short band
+static bool buildChuckSpinRig(const aiMesh* mesh, const DrillMesh& drillMesh, SkinBinding& out)
+{
+    const float length = drillMesh.boundsMax[0] - drillMesh.boundsMin[0];
+    const float height = drillMesh.boundsMax[1] - drillMesh.boundsMin[1];
+    const float bandStart = drillMesh.boundsMin[0] + 0.2f * length;
+    const float bandEnd = drillMesh.boundsMin[0] + 0.28f * length;
+    const float bandBottom = drillMesh.boundsMin[1] + 0.45f * height;
+    const float bandTop = drillMesh.boundsMin[1] + 0.55f * height;
+    auto chuckWeight = [&](const aiVector3D& p)
+    {
+        const float alongX = bx::clamp((bandEnd - p.x) / (bandEnd - bandStart), 0.0f, 1.0f);
+        const float alongY = bx::clamp((p.y - bandBottom) / (bandTop - bandBottom), 0.0f, 1.0f);
+        return alongX * alongY;
+    };
+
+    // Spin axis through the middle of the fully bound vertices
+    double centerY = 0.0;
+    double centerZ = 0.0;
+    uint32_t numChuckVertices = 0;
+    for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+    {
+        if (chuckWeight(mesh->mVertices[v]) >= 1.0f)
+        {
+            centerY += mesh->mVertices[v].y;
+            centerZ += mesh->mVertices[v].z;
+            ++numChuckVertices;
+        }
+    }
+    if (numChuckVertices == 0)
+    {
+        std::cerr << "[buildChuckSpinRig] No vertices in the chuck region of " << mesh->mName.C_Str() << "." << std::endl;
+        return false;
+    }
+
+    const float zero[3] = { 0.0f, 0.0f, 0.0f };
+    const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float unitScale[3] = { 1.0f, 1.0f, 1.0f };
+    const float pivot[3] = { drillMesh.boundsMin[0], float(centerY / numChuckVertices), float(centerZ / numChuckVertices) };
+    const uint32_t body = s_skeleton.addJoint("ChuckSpinBody", -1, zero, identity, unitScale);
+    const uint32_t chuck = s_skeleton.addJoint("ChuckSpinChuck", int32_t(body), pivot, identity, unitScale);
+
+    out.joints = { body, chuck };
+    out.inverseBind.resize(2 * 16);
+    bx::mtxIdentity(&out.inverseBind[0]);
+    bx::mtxTranslate(&out.inverseBind[16], -pivot[0], -pivot[1], -pivot[2]);
+    out.jointsInMeshSpace = true;
+
+    std::vector<std::vector<std::pair<float, uint32_t>>> weights(mesh->mNumVertices);
+    for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+    {
+        const float weight = chuckWeight(mesh->mVertices[v]);
+        weights[v] = { std::make_pair(1.0f - weight, 0u), std::make_pair(weight, 1u) };
+    }
+    packInfluences(weights, out.influences);
+
+    // A turn every 0.4 seconds, in quarter turns so the keys are never more than 90 degrees apart
+    AnimationClip clip;
+    clip.name = "ChuckSpin";
+    clip.duration = 0.4f;
+    AnimationChannel channel;
+    channel.joint = chuck;
+    for (int key = 0; key <= 4; ++key)
+    {
+        const float halfAngle = 0.25f * bx::kPi * float(key);
+        channel.rotationTimes.push_back(0.1f * float(key));
+        channel.rotations.insert(channel.rotations.end(), { std::sin(halfAngle), 0.0f, 0.0f, std::cos(halfAngle) });
+    }
+    clip.channels.push_back(std::move(channel));
+    s_clips.push_back(std::move(clip));
+    return true;
+}
+
+// The first clip moving any of the skin's joints, -1 (rest pose) if none does
+static int32_t findClipForSkin(const SkinBinding& skin)
+{
+    for (size_t c = 0; c < s_clips.size(); ++c)
+    {
+        for (const AnimationChannel& channel : s_clips[c].channels)
+        {
+            if (std::find(skin.joints.begin(), skin.joints.end(), channel.joint) != skin.joints.end())
+            {
+                return int32_t(c);
+            }
+        }
+    }
+    return -1;
+}
+
+// Gives a draw item of a skinned mesh its own range of the palette
+static void addSkinInstance(DrillDrawItem& item, float timeOffset)
+{
+    const DrillMesh& mesh = s_meshes[item.meshIndex];
+    const SkinBinding& skin = s_skins[size_t(mesh.skin)];
+
+    SkinInstance instance;
+    instance.skin = uint32_t(mesh.skin);
+    instance.clip = findClipForSkin(skin);
+    instance.timeOffset = timeOffset;
+    instance.firstBone = 0;
+    if (!s_skinInstances.empty())
+    {
+        const SkinInstance& previous = s_skinInstances.back();
+        instance.firstBone = previous.firstBone + s_skins[previous.skin].numBones();
+    }
+    if (skin.jointsInMeshSpace)
+    {
+        bx::mtxIdentity(instance.meshInverse);
+    }
+    else
+    {
+        bx::mtxInverse(instance.meshInverse, item.transform);
+    }
+    s_skinInstances.push_back(instance);
+    item.skinInstance = int32_t(s_skinInstances.size() - 1);
+}
+
+// Every item of the asset drawing a skinned mesh is animated
+static void addSceneSkinInstances()
+{
+    for (DrillDrawItem& item : s_drawItems)
+    {
+        if (s_meshes[item.meshIndex].skin >= 0)
+        {
+            addSkinInstance(item, 0.0f);
+        }
+    }
+}
+
+// --skinning-demo N: N more drills behind the first one, each spinning its chuck at its own phase
+static void addSkinningDemo(uint32_t count)
+{
+    if (count == 0 || s_meshes[0].skin < 0)
+    {
+        return;
+    }
+
+    const uint32_t columns = uint32_t(std::ceil(std::sqrt(double(count))));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        DrillDrawItem item;
+        item.meshIndex = 0;
+        item.materialIndex = s_meshes[0].materialIndex;
+        item.isStatic = true; // stays in place, but its skin makes it a dynamic shadow caster
+        item.skinInstance = -1;
+        bx::mtxTranslate(item.transform, (float(i % columns) - 0.5f * float(columns - 1)) * 0.2f, 0.0f, -0.3f - float(i / columns) * 0.15f);
+        addSkinInstance(item, 0.037f * float(i));
+        s_drawItems.push_back(item);
+    }
+}
+
+// Sizes the palette for all instances, plus its texture or the CPU-skinned vertex buffers
+static void createSkinningResources()
+{
+    const SkinInstance& last = s_skinInstances.back();
+    const uint32_t numBones = last.firstBone + s_skins[last.skin].numBones();
+    const uint32_t texels = numBones * (SkinningPaletteEvaluator::kFloatsPerBone / 4);
+    s_skinPaletteRows = uint16_t((texels + kSkinPaletteWidth - 1) / kSkinPaletteWidth);
+    s_skinPalette.assign(size_t(s_skinPaletteRows) * kSkinPaletteWidth * 4, 0.0f);
+
+    if (s_cpuSkinning)
+    {
+        for (const SkinInstance& instance : s_skinInstances)
+        {
+            s_cpuSkinnedBuffers.push_back(bgfx::createDynamicVertexBuffer(uint32_t(s_skinBindVertices[instance.skin].size()), g_vertexLayout));
+        }
+    }
+    else
+    {
+        s_skinPaletteTexture = bgfx::createTexture2D(kSkinPaletteWidth, s_skinPaletteRows, false, 1, bgfx::TextureFormat::RGBA32F,
+                                                     BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+        bgfx::setName(s_skinPaletteTexture, "Skinning palette");
+    }
+    std::cout << "[Skinning] " << s_skinInstances.size() << " instance(s) of " << s_skins.size() << " skin(s), " << numBones
+              << " palette bones, " << s_clips.size() << " clip(s), " << (s_cpuSkinning ? "CPU" : "GPU") << " skinning" << std::endl;
+}
+
+// This frame's palettes, uploaded for vs_drill_skinned or applied to each instance's vertices on the CPU
+static void updateSkinning()
+{
+    const int64_t paletteStart = bx::getHPCounter();
+    s_paletteEvaluator.evaluate(s_skeleton, s_clips, s_skins, s_skinInstances, theTime, s_skinPalette.data());
+    const int64_t paletteEnd = bx::getHPCounter();
+    s_paletteTimeAccum += paletteEnd - paletteStart;
+
+    if (!s_cpuSkinning)
+    {
+        bgfx::updateTexture2D(s_skinPaletteTexture, 0, 0, 0, 0, kSkinPaletteWidth, s_skinPaletteRows,
+                              bgfx::copy(s_skinPalette.data(), uint32_t(s_skinPalette.size() * sizeof(float))));
+        return;
+    }
+
+    for (size_t i = 0; i < s_skinInstances.size(); ++i)
+    {
+        const SkinInstance& instance = s_skinInstances[i];
+        const std::vector<MyFancyVertex>& bindVertices = s_skinBindVertices[instance.skin];
+        s_cpuSkinnedVertices.resize(bindVertices.size());
+        skinVertices(bindVertices.data(), s_skins[instance.skin].influences.data(), bindVertices.size(),
+                     s_skinPalette.data() + size_t(instance.firstBone) * SkinningPaletteEvaluator::kFloatsPerBone, s_cpuSkinnedVertices.data());
+        bgfx::update(s_cpuSkinnedBuffers[i], 0, bgfx::copy(s_cpuSkinnedVertices.data(), uint32_t(s_cpuSkinnedVertices.size() * sizeof(MyFancyVertex))));
+    }
+    s_cpuSkinTimeAccum += bx::getHPCounter() - paletteEnd;
+}
+
+// An unshadowed spot for the clusters, angles in degrees as for ShadowedSpotLight
+static ClusterLight makeClusterSpot(const float position[3], const float direction[3], float range, float outerAngle, float innerAngle, const float color[3])
+{
+    ClusterLight light;
+    std::memcpy(light.position, position, sizeof(light.position));
+    std::memcpy(light.direction, direction, sizeof(light.direction));
+    std::memcpy(light.color, color, sizeof(light.color));
+    light.radius = range;
+    light.cosOuter = std::cos(bx::toRad(outerAngle));
+    // smoothstep needs inner > outer
+    light.cosInner = std::max(std::cos(bx::toRad(innerAngle)), light.cosOuter + 0.0001f);
+    return light;
+}
+
+// Lights from the asset, placed by their nodes: the first directional light becomes the sun, the first
+// few spots get shadow maps, and the remaining point and spot lights go to the clusters
+static void collectSceneLights(const aiScene* scene)
+{
+    bool haveSun = false;
+    for (unsigned int i = 0; i < scene->mNumLights; ++i)
+    {
+        const aiLight* light = scene->mLights[i];
+
+        aiMatrix4x4 transform;
+        for (const aiNode* node = scene->mRootNode->FindNode(light->mName); node; node = node->mParent)
+        {
+            transform = node->mTransformation * transform;
+        }
+        aiVector3D position = transform * light->mPosition;
+        aiVector3D direction = transform * (light->mPosition + light->mDirection) - position;
+        float directionLength = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+        if (directionLength > 0.0f)
+        {
+            direction = aiVector3D(direction.x / directionLength, direction.y / directionLength, direction.z / directionLength);
+        }
+
+        if (light->mType == aiLightSource_DIRECTIONAL && !haveSun && directionLength > 0.0f)
+        {
+            haveSun = true;
+            s_sunDirection[0] = direction.x;
+            s_sunDirection[1] = direction.y;
+            s_sunDirection[2] = direction.z;
+            s_sunColor[0] = light->mColorDiffuse.r;
+            s_sunColor[1] = light->mColorDiffuse.g;
+            s_sunColor[2] = light->mColorDiffuse.b;
+            continue;
+        }
+        if (light->mType != aiLightSource_POINT && light->mType != aiLightSource_SPOT)
+        {
+            continue;
+        }
+
+        // Range where the inverse-square falloff drops below 1/256 of the light's intensity
+        float intensity = std::max(light->mColorDiffuse.r, std::max(light->mColorDiffuse.g, light->mColorDiffuse.b));
+        float quadratic = light->mAttenuationQuadratic > 0.0f ? light->mAttenuationQuadratic : 1.0f;
+
+        if (light->mType == aiLightSource_SPOT && directionLength > 0.0f && s_spotLights.size() >= CachedShadowMaps::kMaxSpots)
+        {
+            const float spotPosition[3] = { position.x, position.y, position.z };
+            const float spotDirection[3] = { direction.x, direction.y, direction.z };
+            const float spotColor[3] = { light->mColorDiffuse.r, light->mColorDiffuse.g, light->mColorDiffuse.b };
+            s_lights.push_back(makeClusterSpot(spotPosition, spotDirection, std::sqrt(256.0f * intensity / quadratic), bx::toDeg(light->mAngleOuterCone),
+                                               bx::toDeg(std::min(light->mAngleInnerCone, light->mAngleOuterCone)), spotColor));
+            continue;
+        }
+        if (light->mType == aiLightSource_SPOT && directionLength > 0.0f)
+        {
+            ShadowedSpotLight spot;
+            spot.position[0] = position.x;
+            spot.position[1] = position.y;
+            spot.position[2] = position.z;
+            spot.direction[0] = direction.x;
+            spot.direction[1] = direction.y;
+            spot.direction[2] = direction.z;
+            spot.range = std::sqrt(256.0f * intensity / quadratic);
+            spot.outerAngle = bx::toDeg(light->mAngleOuterCone);
+            spot.innerAngle = bx::toDeg(std::min(light->mAngleInnerCone, light->mAngleOuterCone));
+            spot.color[0] = light->mColorDiffuse.r;
+            spot.color[1] = light->mColorDiffuse.g;
+            spot.color[2] = light->mColorDiffuse.b;
+            s_spotLights.push_back(spot);
+            continue;
+        }
+
+        ClusterLight clusterLight;
+        clusterLight.position[0] = position.x;
+        clusterLight.position[1] = position.y;
+        clusterLight.position[2] = position.z;
+        clusterLight.radius = std::sqrt(256.0f * intensity / quadratic);
+        clusterLight.color[0] = light->mColorDiffuse.r;
+        clusterLight.color[1] = light->mColorDiffuse.g;
+        clusterLight.color[2] = light->mColorDiffuse.b;
+        s_lights.push_back(clusterLight);
+    }
+}
+
+// Small colored lights circling the drill(s), spread out to cover the --material-stress grid if there is one
+static void addOrbitingLights(uint32_t count)
+{
+    float extent = 0.0f;
+    for (const DrillDrawItem& item : s_drawItems)
+    {
+        extent = std::max(extent, std::sqrt(item.transform[12] * item.transform[12] + item.transform[14] * item.transform[14]));
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint64_t random = hashBytes(&i, sizeof(i), 0x4c49474854ull);
+        auto unit = [&](int shift) { return float((random >> shift) & 0xffff) / 65535.0f; };
+
+        OrbitingLight orbit;
+        orbit.orbitRadius = 0.08f + unit(0) * (0.07f + extent);
+        orbit.height = 0.02f + unit(16) * 0.2f;
+        orbit.speed = (0.3f + unit(32)) * ((i & 1) ? 1.0f : -1.0f);
+        orbit.phase = unit(48) * 6.2831853f;
+        s_orbitingLights.push_back(orbit);
+
+        // Hue around the color wheel
+        float hue = float(i) * 0.618034f;
+        hue -= std::floor(hue);
+        ClusterLight light;
+        light.radius = 0.15f;
+        light.color[0] = 0.01f * (0.5f + 0.5f * std::cos(6.2831853f * (hue + 0.0f)));
+        light.color[1] = 0.01f * (0.5f + 0.5f * std::cos(6.2831853f * (hue + 0.333f)));
+        light.color[2] = 0.01f * (0.5f + 0.5f * std::cos(6.2831853f * (hue + 0.667f)));
+        s_lights.push_back(light);
+    }
+}
+
+static void updateLights(const float* view, const float* proj, float nearZ, float farZ)
+{
+    const size_t firstOrbiting = s_lights.size() - s_orbitingLights.size();
+    for (size_t i = 0; i < s_orbitingLights.size(); ++i)
+    {
+        const OrbitingLight& orbit = s_orbitingLights[i];
+        float angle = orbit.phase + orbit.speed * theTime;
+        ClusterLight& light = s_lights[firstOrbiting + i];
+        light.position[0] = std::cos(angle) * orbit.orbitRadius;
+        light.position[1] = orbit.height;
+        light.position[2] = std::sin(angle) * orbit.orbitRadius;
+    }
+
+    const int64_t assignStart = bx::getHPCounter();
+    s_lightClusterer.setProjection(proj[0], proj[5], nearZ, farZ);
+    s_lightClusterer.assign(view, s_lights.data(), uint32_t(s_lights.size()));
+    s_lightAssignTimeAccum += bx::getHPCounter() - assignStart;
+    s_lightDroppedAccum += s_lightClusterer.droppedAssignments();
+
+    s_lightClusterer.upload();
+}
+
+// Spotlights above the scene aiming at its center. The first ones, up to the shadowed maximum, get shadow
+// maps; the rest go to the clusters unshadowed.
+static void addDefaultSpotLights(uint32_t count)
+{
+    static const float kColors[CachedShadowMaps::kMaxSpots][3] =
+    {
+        { 1.0f, 0.8f, 0.6f },
+        { 0.6f, 0.75f, 1.0f },
+        { 0.9f, 1.0f, 0.7f },
+        { 1.0f, 0.7f, 0.9f },
+    };
+
+    const bx::Vec3 center = { s_sceneCenter[0], s_sceneCenter[1], s_sceneCenter[2] };
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        float angle = 0.8f + 6.2831853f * float(i) / float(count);
+        bx::Vec3 position = { center.x + std::cos(angle) * s_sceneRadius * 1.5f, center.y + s_sceneRadius * 1.5f, center.z + std::sin(angle) * s_sceneRadius * 1.5f };
+        bx::Vec3 toCenter = bx::sub(center, position);
+        float distance = bx::length(toCenter);
+        bx::Vec3 direction = bx::mul(toCenter, 1.0f / distance);
+
+        // Scaled by distance^2, so the spot lands with about the same brightness whatever the scene's size
+        const float* color = kColors[i % CachedShadowMaps::kMaxSpots];
+        if (s_spotLights.size() >= CachedShadowMaps::kMaxSpots)
+        {
+            const float spotPosition[3] = { position.x, position.y, position.z };
+            const float spotDirection[3] = { direction.x, direction.y, direction.z };
+            const float spotColor[3] = { color[0] * 0.6f * distance * distance, color[1] * 0.6f * distance * distance, color[2] * 0.6f * distance * distance };
+            s_lights.push_back(makeClusterSpot(spotPosition, spotDirection, distance * 2.0f, 25.0f, 18.0f, spotColor));
+            continue;
+        }
+        ShadowedSpotLight spot;
+        spot.position[0] = position.x;
+        spot.position[1] = position.y;
+        spot.position[2] = position.z;
+        spot.direction[0] = direction.x;
+        spot.direction[1] = direction.y;
+        spot.direction[2] = direction.z;
+        spot.range = distance * 2.0f;
+        spot.outerAngle = 25.0f;
+        spot.innerAngle = 18.0f;
+        spot.color[0] = color[0] * 0.6f * distance * distance;
+        spot.color[1] = color[1] * 0.6f * distance * distance;
+        spot.color[2] = color[2] * 0.6f * distance * distance;
+        s_spotLights.push_back(spot);
+    }
+}
+
+// Items whose shadow can be cached: not spinning and not animated. Skinned items deform every frame even
+// when their transform stays put, so they are drawn into the dynamic layer.
+static bool isCachedShadowCaster(const DrillDrawItem& item)
+{
+    return item.isStatic && item.skinInstance < 0;
+}
+
+// Static caster transforms, so moving one invalidates the cached shadow layer
+static uint64_t staticCasterHash()
+{
+    uint64_t hash = 0;
+    for (const DrillDrawItem& item : s_drawItems)
+    {
+        if (isCachedShadowCaster(item))
+        {
+            hash = hashBytes(item.transform, sizeof(item.transform), hash);
+        }
+    }
+    return hash;
+}
+
+static void submitShadowCaster(bgfx::ViewId viewId, const DrillDrawItem& item, const float* mtxSpin)
+{
+    const DrillMesh& mesh = s_meshes[item.meshIndex];
+
+    float mtxModel[16];
+    drawItemModelMatrix(item, mtxSpin, mtxModel);
+    bgfx::setTransform(mtxModel);
+    bgfx::setIndexBuffer(mesh.ibh);
+    bgfx::setState(BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS);
+
+    // Skinned casters in their current pose, like the mesh pass
+    if (item.skinInstance >= 0 && s_cpuSkinning)
+    {
+        bgfx::setVertexBuffer(0, s_cpuSkinnedBuffers[item.skinInstance]);
+    }
+    else if (item.skinInstance >= 0 && bgfx::isValid(s_skinnedShadowProgram))
+    {
+        const float skinParams[4] = { float(s_skinInstances[item.skinInstance].firstBone), 0.0f, 0.0f, 0.0f };
+        bgfx::setUniform(u_skinParams, skinParams);
+        bgfx::setVertexBuffer(0, mesh.vbh);
+        bgfx::setVertexBuffer(1, mesh.skinVbh);
+        bgfx::setTexture(10, s_skinPaletteSampler, s_skinPaletteTexture);
+        bgfx::submit(viewId, s_skinnedShadowProgram);
+        return;
+    }
+    else
+    {
+        bgfx::setVertexBuffer(0, mesh.vbh);
+    }
+    bgfx::submit(viewId, s_shadowProgram);
+}
+
+// Refits the shadow maps, re-renders the static layer of the tiles that were invalidated and draws the dynamic casters
+static void updateShadows(const float* view, const float* proj, const float* mtxSpin)
+{
+    const uint32_t numSpots = uint32_t(std::min<size_t>(s_spotLights.size(), CachedShadowMaps::kMaxSpots));
+    for (uint32_t i = 0; i < numSpots; ++i)
+    {
+        const ShadowedSpotLight& spot = s_spotLights[i];
+        const float outerCos = std::cos(bx::toRad(spot.outerAngle));
+        const float innerCos = std::cos(bx::toRad(spot.innerAngle));
+        const float position[4] = { spot.position[0], spot.position[1], spot.position[2], spot.range };
+        const float direction[4] = { spot.direction[0], spot.direction[1], spot.direction[2], outerCos };
+        const float color[4] = { spot.color[0], spot.color[1], spot.color[2], std::max(innerCos, outerCos + 0.0001f) };
+        bx::memCopy(s_spotPositionData[i], position, sizeof(position));
+        bx::memCopy(s_spotDirectionData[i], direction, sizeof(direction));
+        bx::memCopy(s_spotColorData[i], color, sizeof(color));
+    }
+
+    if (!s_shadowMaps.isEnabled())
+    {
+        return;
+    }
+
+    s_shadowMaps.update(view, proj, s_sceneCenter, s_sceneRadius, s_sunDirection, s_spotLights.data(), numSpots, staticCasterHash());
+    for (uint32_t tile = 0; tile < CachedShadowMaps::kNumTiles; ++tile)
+    {
+        if (!s_shadowMaps.isTileActive(tile))
+        {
+            continue;
+        }
+        for (const DrillDrawItem& item : s_drawItems)
+        {
+            if (!isCachedShadowCaster(item))
+            {
+                submitShadowCaster(s_shadowMaps.dynamicView(tile), item, mtxSpin);
+            }
+            else if (s_shadowMaps.needsStaticRender(tile))
+            {
+                submitShadowCaster(s_shadowMaps.staticView(tile), item, mtxSpin);
+            }
+        }
+    }
+}
+
+// Picks the occluders that are biggest on screen, rasterizes them and tests every draw item against the result
+static void cullDrawItems(const float* view, const float* proj, const float* mtxSpin)
+{
+    float viewProj[16];
+    bx::mtxMul(viewProj, view, proj);
+    float invView[16];
+    bx::mtxInverse(invView, view);
+    const bx::Vec3 eye = { invView[12], invView[13], invView[14] };
+
+    const int64_t rasterStart = bx::getHPCounter();
+
+    static std::vector<std::pair<float, uint32_t>> candidates;
+    candidates.clear();
+    for (uint32_t i = 0; i < s_drawItems.size(); ++i)
+    {
+        const DrillDrawItem& item = s_drawItems[i];
+        const DrillMesh& mesh = s_meshes[item.meshIndex];
+        if (mesh.occluder < 0 || item.skinInstance >= 0)
+        {
+            continue;
+        }
+
+        float model[16];
+        drawItemModelMatrix(item, mtxSpin, model);
+        const bx::Vec3 localCenter =
+        {
+            0.5f * (mesh.boundsMin[0] + mesh.boundsMax[0]),
+            0.5f * (mesh.boundsMin[1] + mesh.boundsMax[1]),
+            0.5f * (mesh.boundsMin[2] + mesh.boundsMax[2]),
+        };
+        const bx::Vec3 halfExtent = bx::sub(bx::Vec3{ mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2] }, localCenter);
+        float scale = 0.0f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            scale = std::max(scale, bx::length(bx::Vec3{ model[axis * 4 + 0], model[axis * 4 + 1], model[axis * 4 + 2] }));
+        }
+        const float radius = bx::length(halfExtent) * scale;
+        const float distance = bx::length(bx::sub(bx::mul(localCenter, model), eye));
+        candidates.push_back(std::make_pair(radius / std::max(distance - radius, 0.01f), i));
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, uint32_t>>());
+
+    s_occlusionCuller.beginFrame(viewProj, bgfx::getCaps()->homogeneousDepth);
+    uint32_t triangles = 0;
+    for (const auto& candidate : candidates)
+    {
+        const DrillDrawItem& item = s_drawItems[candidate.second];
+        const OccluderMesh& occluder = s_occluderMeshes[s_meshes[item.meshIndex].occluder];
+        const uint32_t occluderTriangles = uint32_t(occluder.indices.size() / 3);
+        if (triangles + occluderTriangles > kOccluderTriangleBudget)
+        {
+            continue;
+        }
+        float model[16];
+        drawItemModelMatrix(item, mtxSpin, model);
+        s_occlusionCuller.addOccluder(occluder, model);
+        triangles += occluderTriangles;
+    }
+    s_occlusionCuller.rasterize();
+
+    const int64_t testStart = bx::getHPCounter();
+    s_occlusionRasterTimeAccum += testStart - rasterStart;
+
+    std::atomic<uint32_t> culled{0};
+    std::atomic<uint32_t> offScreen{0};
+    parallelFor(s_drawItems.size(), 256, [&](size_t begin, size_t end)
+    {
+        uint32_t rangeCulled = 0;
+        uint32_t rangeOffScreen = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const DrillDrawItem& item = s_drawItems[i];
+            if (item.skinInstance >= 0)
+            {
+                // Animated vertices can leave the bind pose bounds
+                s_itemVisible[i] = 1;
+                continue;
+            }
+            const DrillMesh& mesh = s_meshes[item.meshIndex];
+            float model[16];
+            drawItemModelMatrix(item, mtxSpin, model);
+            bool isOffScreen = false;
+            s_itemVisible[i] = s_occlusionCuller.isVisible(mesh.boundsMin, mesh.boundsMax, model, &isOffScreen) ? 1 : 0;
+            rangeCulled += s_itemVisible[i] ? 0 : 1;
+            rangeOffScreen += isOffScreen ? 1 : 0;
+        }
+        culled += rangeCulled;
+        offScreen += rangeOffScreen;
+    });
+
+    s_occlusionTestTimeAccum += bx::getHPCounter() - testStart;
+    s_occluderTrianglesAccum += s_occlusionCuller.stats().trianglesSubmitted;
+    s_occlusionTestedAccum += s_drawItems.size();
+    s_occlusionCulledAccum += culled - offScreen;
+    s_offScreenCulledAccum += offScreen;
+}
+
+// BVHs for the asset's meshes: big meshes are built one after the other with the build itself spread over
+// the threads, the small ones are built side by side
+static void buildPickMeshes(const aiScene* scene)
+{
+    static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "The BVH reads aiMesh::mVertices as packed floats");
+
+    const int64_t buildStart = bx::getHPCounter();
+    s_pickMeshes.resize(scene->mNumMeshes);
+    auto buildMesh = [&](uint32_t m)
+    {
+        const aiMesh* mesh = scene->mMeshes[m];
+        PickMesh& pick = s_pickMeshes[m];
+        pick.name = mesh->mName.C_Str();
+        pick.indices.resize(countTriangleIndices(mesh));
+        streamTriangleIndices(mesh, pick.indices.data());
+        if (mesh->HasTextureCoords(0))
+        {
+            pick.texcoords.resize(size_t(mesh->mNumVertices) * 2);
+            for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+            {
+                pick.texcoords[v * 2 + 0] = mesh->mTextureCoords[0][v].x;
+                pick.texcoords[v * 2 + 1] = mesh->mTextureCoords[0][v].y;
+            }
+        }
+        if (!pick.indices.empty())
+        {
+            pick.bvh.build(&mesh->mVertices[0].x, pick.indices.data(), uint32_t(pick.indices.size() / 3));
+        }
+    };
+
+    std::vector<uint32_t> smallMeshes;
+    for (uint32_t m = 0; m < scene->mNumMeshes; ++m)
+    {
+        if (scene->mMeshes[m]->mNumFaces >= TriangleBvh::kParallelBuildTriangles)
+        {
+            buildMesh(m);
+        }
+        else
+        {
+            smallMeshes.push_back(m);
+        }
+    }
+    parallelFor(smallMeshes.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            buildMesh(smallMeshes[i]);
+        }
+    });
+
+    size_t triangles = 0;
+    size_t nodes = 0;
+    size_t bytes = 0;
+    for (const PickMesh& pick : s_pickMeshes)
+    {
+        triangles += pick.bvh.numTriangles();
+        nodes += pick.bvh.numNodes();
+        bytes += pick.bvh.memoryBytes();
+    }
+    const double buildMs = double(bx::getHPCounter() - buildStart) * 1000.0 / double(bx::getHPFrequency());
+    std::cout << "[BVH] " << triangles << " triangles in " << s_pickMeshes.size() << " meshes: " << nodes << " nodes, "
+              << bytes / 1024 << " KiB, built in " << buildMs << " ms (" << parallelForNumThreads() << " threads)" << std::endl;
+}
+
+struct PickResult
+{
+    uint32_t drawItem;
+    RayHit hit;   // t is in units of the world space ray direction
+    float uv[2];  // interpolated texture coordinates, 0 if the mesh has none
+};
+
+// Closest draw item along the world space ray. Skinned items are tested in their bind pose
+static bool pickDrawItems(const float* mtxSpin, const bx::Vec3& origin, const bx::Vec3& direction, PickResult& result)
+{
+    bool found = false;
+    result.hit = RayHit();
+    for (uint32_t i = 0; i < s_drawItems.size(); ++i)
+    {
+        const DrillDrawItem& item = s_drawItems[i];
+        if (item.meshIndex >= s_pickMeshes.size() || s_pickMeshes[item.meshIndex].bvh.empty())
+        {
+            continue;
+        }
+
+        // The model matrix is affine, so t means the same along the ray in mesh space
+        float model[16];
+        float inverse[16];
+        drawItemModelMatrix(item, mtxSpin, model);
+        bx::mtxInverse(inverse, model);
+        const bx::Vec3 localOrigin = bx::mul(origin, inverse);
+        const bx::Vec3 localDirection = bx::mulXyz0(direction, inverse);
+        const float rayOrigin[3] = { localOrigin.x, localOrigin.y, localOrigin.z };
+        const float rayDirection[3] = { localDirection.x, localDirection.y, localDirection.z };
+        if (s_pickMeshes[item.meshIndex].bvh.intersect(rayOrigin, rayDirection, result.hit))
+        {
+            result.drawItem = i;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        return false;
+    }
+
+    const PickMesh& pick = s_pickMeshes[s_drawItems[result.drawItem].meshIndex];
+    result.uv[0] = 0.0f;
+    result.uv[1] = 0.0f;
+    if (!pick.texcoords.empty())
+    {
+        const uint32_t* triangle = &pick.indices[size_t(result.hit.triangle) * 3];
+        const float weights[3] = { 1.0f - result.hit.u - result.hit.v, result.hit.u, result.hit.v };
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            result.uv[0] += weights[corner] * pick.texcoords[size_t(triangle[corner]) * 2 + 0];
+            result.uv[1] += weights[corner] * pick.texcoords[size_t(triangle[corner]) * 2 + 1];
+        }
+    }
+    return true;
+}
+
+// Prints what's under the cursor: the draw item, its mesh, the triangle, the UV and the distance from the eye
+static void pickAtCursor(const float* view, const float* proj, const float* mtxSpin)
+{
+    double cursorX;
+    double cursorY;
+    int windowWidth;
+    int windowHeight;
+    glfwGetCursorPos(s_window, &cursorX, &cursorY);
+    glfwGetWindowSize(s_window, &windowWidth, &windowHeight);
+    if (windowWidth < 1 || windowHeight < 1)
+    {
+        return;
+    }
+
+    // Unproject the cursor at the near and far planes
+    float viewProj[16];
+    float inverseViewProj[16];
+    bx::mtxMul(viewProj, view, proj);
+    bx::mtxInverse(inverseViewProj, viewProj);
+    const float ndcX = float(cursorX / double(windowWidth)) * 2.0f - 1.0f;
+    const float ndcY = 1.0f - float(cursorY / double(windowHeight)) * 2.0f;
+    const float nearZ = bgfx::getCaps()->homogeneousDepth ? -1.0f : 0.0f;
+    const bx::Vec3 nearPoint = bx::mulH({ ndcX, ndcY, nearZ }, inverseViewProj);
+    const bx::Vec3 farPoint = bx::mulH({ ndcX, ndcY, 1.0f }, inverseViewProj);
+    const bx::Vec3 direction = bx::sub(farPoint, nearPoint);
+
+    PickResult result;
+    const int64_t pickStart = bx::getHPCounter();
+    const bool hit = pickDrawItems(mtxSpin, nearPoint, direction, result);
+    const double pickMs = double(bx::getHPCounter() - pickStart) * 1000.0 / double(bx::getHPFrequency());
+    if (!hit)
+    {
+        std::cout << "[Picking] nothing under the cursor (" << pickMs << " ms)" << std::endl;
+        return;
+    }
+
+    const DrillDrawItem& item = s_drawItems[result.drawItem];
+    const bx::Vec3 position = bx::add(nearPoint, bx::mul(direction, result.hit.t));
+    std::cout << "[Picking] draw item " << result.drawItem << ", mesh " << item.meshIndex << " \"" << s_pickMeshes[item.meshIndex].name
+              << "\", triangle " << result.hit.triangle << ", uv (" << result.uv[0] << ", " << result.uv[1] << "), position ("
+              << position.x << ", " << position.y << ", " << position.z << "), " << bx::length(bx::sub(position, nearPoint))
+              << " from the near plane (" << pickMs << " ms)" << std::endl;
+}
+
+// --bvh-benchmark: a grid of primary rays at every asset mesh from outside its bounds, traced one at a time
+// and as 2x2 packets
+static void runBvhBenchmark()
+{
+    const uint32_t kResolution = 1024;
+    const float kFieldOfView = 0.45f; // tan of half the angle
+    for (uint32_t m = 0; m < s_pickMeshes.size(); ++m)
+    {
+        const TriangleBvh& bvh = s_pickMeshes[m].bvh;
+        if (bvh.empty())
+        {
+            continue;
+        }
+
+        const TriangleBvh::Node& root = bvh.root();
+        const bx::Vec3 center = { 0.5f * (root.boundsMin[0] + root.boundsMax[0]), 0.5f * (root.boundsMin[1] + root.boundsMax[1]), 0.5f * (root.boundsMin[2] + root.boundsMax[2]) };
+        const float extent = std::max({ root.boundsMax[0] - root.boundsMin[0], root.boundsMax[1] - root.boundsMin[1], root.boundsMax[2] - root.boundsMin[2] });
+        const bx::Vec3 eye = bx::add(center, bx::mul(bx::Vec3{ 0.7f, 0.5f, 1.2f }, extent));
+        const bx::Vec3 forward = bx::normalize(bx::sub(center, eye));
+        const bx::Vec3 right = bx::normalize(bx::cross(bx::Vec3{ 0.0f, 1.0f, 0.0f }, forward));
+        const bx::Vec3 up = bx::cross(forward, right);
+        auto rayDirection = [&](uint32_t x, uint32_t y)
+        {
+            const float sx = ((float(x) + 0.5f) / float(kResolution) * 2.0f - 1.0f) * kFieldOfView;
+            const float sy = ((float(y) + 0.5f) / float(kResolution) * 2.0f - 1.0f) * kFieldOfView;
+            return bx::add(forward, bx::add(bx::mul(right, sx), bx::mul(up, sy)));
+        };
+        const float origin[3] = { eye.x, eye.y, eye.z };
+
+        std::atomic<uint64_t> singleHits{ 0 };
+        const int64_t singleStart = bx::getHPCounter();
+        parallelFor(kResolution, 8, [&](size_t begin, size_t end)
+        {
+            uint64_t hits = 0;
+            for (size_t y = begin; y < end; ++y)
+            {
+                for (uint32_t x = 0; x < kResolution; ++x)
+                {
+                    const bx::Vec3 d = rayDirection(x, uint32_t(y));
+                    const float direction[3] = { d.x, d.y, d.z };
+                    RayHit hit;
+                    hits += bvh.intersect(origin, direction, hit) ? 1 : 0;
+                }
+            }
+            singleHits += hits;
+        });
+        const int64_t singleTime = bx::getHPCounter() - singleStart;
+
+        std::atomic<uint64_t> packetHits{ 0 };
+        const int64_t packetStart = bx::getHPCounter();
+        parallelFor(kResolution / 2, 4, [&](size_t begin, size_t end)
+        {
+            uint64_t hits = 0;
+            for (size_t row = begin; row < end; ++row)
+            {
+                for (uint32_t x = 0; x < kResolution; x += 2)
+                {
+                    RayPacket4 packet;
+                    RayHit packetHit[4];
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        const bx::Vec3 d = rayDirection(x + (lane & 1), uint32_t(row * 2) + (lane >> 1));
+                        const float direction[3] = { d.x, d.y, d.z };
+                        for (int axis = 0; axis < 3; ++axis)
+                        {
+                            packet.origin[axis][lane] = origin[axis];
+                            packet.direction[axis][lane] = direction[axis];
+                        }
+                        packet.tMax[lane] = FLT_MAX;
+                    }
+                    bvh.intersect4(packet, packetHit);
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        hits += packetHit[lane].triangle != UINT32_MAX ? 1 : 0;
+                    }
+                }
+            }
+            packetHits += hits;
+        });
+        const int64_t packetTime = bx::getHPCounter() - packetStart;
+
+        const double frequency = double(bx::getHPFrequency());
+        const double rays = double(kResolution) * double(kResolution);
+        std::cout << "[BVH] mesh " << m << " (" << bvh.numTriangles() << " triangles): " << kResolution << "x" << kResolution << " primary rays, "
+                  << rays / (double(singleTime) / frequency) / 1e6 << " Mrays/s single, " << rays / (double(packetTime) / frequency) / 1e6
+                  << " Mrays/s 2x2 packets (" << parallelForNumThreads() << " threads, " << (100.0 * double(singleHits) / rays) << "% hit";
+        if (singleHits != packetHits)
+        {
+            std::cout << ", packets disagree: " << packetHits << " hits";
+        }
+        std::cout << ")" << std::endl;
+    }
+}
+
+// IBL maps plus this frame's light clusters
+static void setLightingTextures()
+{
+    float clusterParams[4];
+    float clusterDepth[4];
+    s_lightClusterer.getShaderParams(clusterParams, clusterDepth);
+    bgfx::setUniform(u_clusterParams, clusterParams);
+    bgfx::setUniform(u_clusterDepth, clusterDepth);
+    bgfx::setTexture(6, s_clusterGrid, s_lightClusterer.gridTexture());
+    bgfx::setTexture(7, s_lightIndices, s_lightClusterer.indexTexture());
+    bgfx::setTexture(8, s_lightData, s_lightClusterer.lightTexture());
+
+    const uint32_t numSpots = uint32_t(std::min<size_t>(s_spotLights.size(), CachedShadowMaps::kMaxSpots));
+    const bool shadows = s_shadowMaps.isEnabled();
+    const float sunDirection[4] = { s_sunDirection[0], s_sunDirection[1], s_sunDirection[2], 0.0f };
+    const float sunColor[4] = { s_sunColor[0], s_sunColor[1], s_sunColor[2], 0.0f };
+    const float* splits = s_shadowMaps.cascadeSplits();
+    const float cascadeSplits[4] = { shadows ? splits[0] : 0.0f, shadows ? splits[1] : 0.0f, shadows ? splits[2] : 0.0f, float(numSpots) };
+    const float shadowParams[4] =
+    {
+        shadows ? 1.0f / CachedShadowMaps::kAtlasWidth : 0.0f,
+        shadows ? 1.0f / CachedShadowMaps::kAtlasHeight : 0.0f,
+        0.0015f, // depth bias
+        0.002f,  // normal offset (world units)
+    };
+    bgfx::setUniform(u_sunDirection, sunDirection);
+    bgfx::setUniform(u_sunColor, sunColor);
+    bgfx::setUniform(u_cascadeSplits, cascadeSplits);
+    bgfx::setUniform(u_shadowParams, shadowParams);
+    bgfx::setUniform(u_cascadeMtx, s_shadowMaps.shadowMatrix(0), CachedShadowMaps::kNumCascades);
+    if (numSpots > 0)
+    {
+        bgfx::setUniform(u_spotPosition, s_spotPositionData, uint16_t(numSpots));
+        bgfx::setUniform(u_spotDirection, s_spotDirectionData, uint16_t(numSpots));
+        bgfx::setUniform(u_spotColor, s_spotColorData, uint16_t(numSpots));
+        bgfx::setUniform(u_spotShadowMtx, s_shadowMaps.shadowMatrix(CachedShadowMaps::kNumCascades), uint16_t(numSpots));
+    }
+    if (shadows)
+    {
+        bgfx::setTexture(9, s_shadowMap, s_shadowMaps.shadowTexture());
+    }
+
+    if (bgfx::isValid(irradianceTex)) bgfx::setTexture(3, s_irradiance, irradianceTex);
+    else std::cerr << "Error: irradianceTex (s_irradiance) is invalid!" << std::endl;
+
+    if (bgfx::isValid(radianceTex)) bgfx::setTexture(4, s_radiance, radianceTex);
+    else std::cerr << "Error: radianceTex (s_radiance) is invalid!" << std::endl;
+
+    if (bgfx::isValid(brdfLutTex)) bgfx::setTexture(5, s_brdfLUT, brdfLutTex);
+    else std::cerr << "Error: brdfLutTex (s_brdfLUT) is invalid!" << std::endl;
+}
+
+// Takes as many of `count` vs_drill_instanced instances as still fit in this frame's transient memory, 0 when it's used up
+static uint32_t allocDrillInstances(uint32_t count, bgfx::InstanceDataBuffer& idb)
+{
+    count = bgfx::getAvailInstanceDataBuffer(count, kDrillInstanceStride);
+    if (count == 0)
+    {
+        // Out of transient instance memory for this frame
+        return 0;
+    }
+    bgfx::allocInstanceDataBuffer(&idb, count, kDrillInstanceStride);
+    return count;
+}
+
+// Fills instance `index` of idb with a model matrix and the material's texture array layers (Slot_Count floats)
+static void writeDrillInstance(bgfx::InstanceDataBuffer& idb, uint32_t index, const float* model, const float* layers)
+{
+    float* data = reinterpret_cast<float*>(idb.data + index * kDrillInstanceStride);
+    bx::memCopy(data, model, 16 * sizeof(float));
+    data[16] = layers[MaterialBatcher::Slot_Color];
+    data[17] = layers[MaterialBatcher::Slot_Normal];
+    data[18] = layers[MaterialBatcher::Slot_ARM];
+    data[19] = 0.0f;
+}
+
+// Skinned items are drawn one at a time with either material path's textures: vs_drill_skinned reads the
+// instance's palette range, or with --cpu-skinning the already skinned vertices go through the regular program
+static void submitSkinnedItem(const DrillDrawItem& item, const float* mtxSpin, const float* camPos, uint64_t meshState)
+{
+    const DrillMesh& mesh = s_meshes[item.meshIndex];
+    const SkinInstance& instance = s_skinInstances[item.skinInstance];
+    bgfx::InstanceDataBuffer idb;
+    if (s_cpuSkinning && s_materialBatching && allocDrillInstances(1, idb) == 0)
+    {
+        return;
+    }
 
     float mtxModel[16];
-    bx::mtxMul(mtxModel, mtxRotateY, mtxTranslate);
+    drawItemModelMatrix(item, mtxSpin, mtxModel);
+
+    float layers[MaterialBatcher::Slot_Count] = { 0.0f, 0.0f, 0.0f };
+    if (s_materialBatching)
+    {
+        const MaterialBatcher::MaterialRef& material = s_materialBatcher.material(item.materialIndex);
+        const MaterialBatcher::Batch& batch = s_materialBatcher.batch(material.batch);
+        bgfx::setTexture(0, s_texColor, batch.arrays[MaterialBatcher::Slot_Color]);
+        bgfx::setTexture(1, s_texNormal, batch.arrays[MaterialBatcher::Slot_Normal]);
+        bgfx::setTexture(2, s_texARM, batch.arrays[MaterialBatcher::Slot_ARM]);
+        bx::memCopy(layers, material.layers, sizeof(layers));
+    }
+    else
+    {
+        const DrillMaterial& material = s_materials[item.materialIndex];
+        bgfx::setTexture(0, s_texColor, material.diffuseTex);
+        bgfx::setTexture(1, s_texNormal, material.normalTex);
+        bgfx::setTexture(2, s_texARM, material.armTex);
+    }
+
+    bgfx::setUniform(u_camPos, camPos);
+    bgfx::setIndexBuffer(mesh.ibh);
+    if (s_cpuSkinning)
+    {
+        bgfx::setVertexBuffer(0, s_cpuSkinnedBuffers[item.skinInstance]);
+        if (s_materialBatching)
+        {
+            // `program` is vs_drill_instanced here, so the model matrix and layers go in as a single instance
+            writeDrillInstance(idb, 0, mtxModel, layers);
+            bgfx::setInstanceDataBuffer(&idb);
+        }
+        else
+        {
+            bgfx::setUniform(u_myModelMatrix, mtxModel);
+            bgfx::setTransform(mtxModel);
+        }
+    }
+    else
+    {
+        const float skinParams[4] =
+        {
+            float(instance.firstBone),
+            layers[MaterialBatcher::Slot_Color],
+            layers[MaterialBatcher::Slot_Normal],
+            layers[MaterialBatcher::Slot_ARM],
+        };
+        bgfx::setUniform(u_myModelMatrix, mtxModel);
+        bgfx::setUniform(u_skinParams, skinParams);
+        bgfx::setTransform(mtxModel);
+        bgfx::setVertexBuffer(0, mesh.vbh);
+        bgfx::setVertexBuffer(1, mesh.skinVbh);
+        bgfx::setTexture(10, s_skinPaletteSampler, s_skinPaletteTexture);
+    }
+
+    setLightingTextures();
+
+    bgfx::setState(meshState);
+
+    bgfx::submit(viewId_Mesh, s_cpuSkinning ? program : s_skinnedProgram);
+}
+
+// One submit per draw item, each binding its material's own 2D textures
+static void submitDrillPerItem(const float* mtxSpin, const float* camPos, uint64_t meshState)
+{
+    for (uint32_t i = 0; i < s_drawItems.size(); ++i)
+    {
+        if (!s_itemVisible[i])
+        {
+            continue;
+        }
+
+        const DrillDrawItem& item = s_drawItems[i];
+        if (item.skinInstance >= 0)
+        {
+            submitSkinnedItem(item, mtxSpin, camPos, meshState);
+            continue;
+        }
+        const DrillMesh& mesh = s_meshes[item.meshIndex];
+        const DrillMaterial& material = s_materials[item.materialIndex];
+
+        float mtxModel[16];
+        drawItemModelMatrix(item, mtxSpin, mtxModel);
+
+        // Set shader uniforms
+        bgfx::setUniform(u_myModelMatrix, mtxModel);
+        bgfx::setUniform(u_camPos, camPos);
+
+        // Submit the geometry
+        bgfx::setTransform(mtxModel);
+        bgfx::setVertexBuffer(0, mesh.vbh);
+        bgfx::setIndexBuffer(mesh.ibh);
+
+        // Materials always have valid textures, missing ones are replaced by 1x1 stand-ins at load time
+        bgfx::setTexture(0, s_texColor, material.diffuseTex);
+        bgfx::setTexture(1, s_texNormal, material.normalTex);
+        bgfx::setTexture(2, s_texARM, material.armTex);
+
+        setLightingTextures();
+
+        bgfx::setState(meshState);
+
+        bgfx::submit(viewId_Mesh, program);
+    }
+}
+
+// One instanced submit per (mesh, material batch): the batch's texture arrays are bound once and
+// each instance carries its model matrix and its material's layers
+static void submitDrillInstanced(const float* mtxSpin, const float* camPos, uint64_t meshState)
+{
+    if (!s_skinInstances.empty())
+    {
+        for (uint32_t i = 0; i < s_drawItems.size(); ++i)
+        {
+            if (s_drawItems[i].skinInstance >= 0 && s_itemVisible[i])
+            {
+                submitSkinnedItem(s_drawItems[i], mtxSpin, camPos, meshState);
+            }
+        }
+    }
+
+    static std::vector<uint32_t> visibleItems;
+    for (const DrillInstanceGroup& group : s_instanceGroups)
+    {
+        const DrillMesh& mesh = s_meshes[group.meshIndex];
+        const MaterialBatcher::Batch& batch = s_materialBatcher.batch(group.batch);
+
+        visibleItems.clear();
+        for (uint32_t itemIndex : group.drawItems)
+        {
+            if (s_itemVisible[itemIndex])
+            {
+                visibleItems.push_back(itemIndex);
+            }
+        }
+
+        uint32_t first = 0;
+        while (first < visibleItems.size())
+        {
+            bgfx::InstanceDataBuffer idb;
+            const uint32_t count = allocDrillInstances(uint32_t(visibleItems.size()) - first, idb);
+            if (count == 0)
+            {
+                return;
+            }
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const DrillDrawItem& item = s_drawItems[visibleItems[first + i]];
+                float mtxModel[16];
+                drawItemModelMatrix(item, mtxSpin, mtxModel);
+                writeDrillInstance(idb, i, mtxModel, s_materialBatcher.material(item.materialIndex).layers);
+            }
+
+            bgfx::setUniform(u_camPos, camPos);
+
+            bgfx::setVertexBuffer(0, mesh.vbh);
+            bgfx::setIndexBuffer(mesh.ibh);
+            bgfx::setInstanceDataBuffer(&idb);
+
+            bgfx::setTexture(0, s_texColor, batch.arrays[MaterialBatcher::Slot_Color]);
+            bgfx::setTexture(1, s_texNormal, batch.arrays[MaterialBatcher::Slot_Normal]);
+            bgfx::setTexture(2, s_texARM, batch.arrays[MaterialBatcher::Slot_ARM]);
+
+            setLightingTextures();
+
+            bgfx::setState(meshState);
+
+            bgfx::submit(viewId_Mesh, program);
+            first += count;
+        }
+    }
+}
+
+// The resident chunks of the streamed mesh that are in the frustum, with the material of the first draw item
+static void submitStreamedChunks(const float* view, const float* proj, const bx::Vec3& eye, const float* camPos, uint64_t meshState)
+{
+    float toCenter[16];
+    float spin[16];
+    float fromCenter[16];
+    bx::mtxTranslate(toCenter, -kStreamedMeshCenter[0], -kStreamedMeshCenter[1], -kStreamedMeshCenter[2]);
+    bx::mtxRotateY(spin, s_streamedSpinSpeed * theTime);
+    bx::mtxTranslate(fromCenter, kStreamedMeshCenter[0], kStreamedMeshCenter[1], kStreamedMeshCenter[2]);
+    float centered[16];
+    float spun[16];
+    bx::mtxMul(centered, s_streamedFit, toCenter);
+    bx::mtxMul(spun, centered, spin);
+    bx::mtxMul(s_streamedModel, spun, fromCenter);
+
+    float viewProj[16];
+    bx::mtxMul(viewProj, view, proj);
+    s_chunkStreamer.update(s_streamedModel, viewProj, eye, bgfx::getCaps()->homogeneousDepth);
+    const uint32_t materialIndex = s_drawItems[0].materialIndex;
+
+    s_chunkStreamer.forEachVisible([&](bgfx::DynamicVertexBufferHandle vb, bgfx::DynamicIndexBufferHandle ib, uint32_t numVertices, uint32_t numIndices)
+    {
+        if (s_materialBatching)
+        {
+            bgfx::InstanceDataBuffer idb;
+            if (allocDrillInstances(1, idb) == 0)
+            {
+                return;
+            }
+            const MaterialBatcher::MaterialRef& material = s_materialBatcher.material(materialIndex);
+            const MaterialBatcher::Batch& batch = s_materialBatcher.batch(material.batch);
+            writeDrillInstance(idb, 0, s_streamedModel, material.layers);
+            bgfx::setInstanceDataBuffer(&idb);
+            bgfx::setTexture(0, s_texColor, batch.arrays[MaterialBatcher::Slot_Color]);
+            bgfx::setTexture(1, s_texNormal, batch.arrays[MaterialBatcher::Slot_Normal]);
+            bgfx::setTexture(2, s_texARM, batch.arrays[MaterialBatcher::Slot_ARM]);
+        }
+        else
+        {
+            const DrillMaterial& material = s_materials[materialIndex];
+            bgfx::setUniform(u_myModelMatrix, s_streamedModel);
+            bgfx::setTransform(s_streamedModel);
+            bgfx::setTexture(0, s_texColor, material.diffuseTex);
+            bgfx::setTexture(1, s_texNormal, material.normalTex);
+            bgfx::setTexture(2, s_texARM, material.armTex);
+        }
+
+        bgfx::setUniform(u_camPos, camPos);
+        bgfx::setVertexBuffer(0, vb, 0, numVertices);
+        bgfx::setIndexBuffer(ib, 0, numIndices);
+
+        setLightingTextures();
+
+        bgfx::setState(meshState);
+
+        bgfx::submit(viewId_Mesh, program);
+    });
+}
+
+// The skybox and the drill(s) seen from one camera, with the dynamic items turned by mtxSpin, into whatever
+// viewId_Skybox and viewId_Mesh currently render to
+static void submitScene(const float* view, const float* proj, float nearZ, float farZ, const bx::Vec3& eye, const float* mtxSpin)
+{
+    //Skybox
+    float viewNoTrans[16];
+    bx::memCopy(viewNoTrans, view, sizeof(viewNoTrans));
+    viewNoTrans[12] = 0.0f;
+    viewNoTrans[13] = 0.0f;
+    viewNoTrans[14] = 0.0f;
+    float viewProjNoTrans[16];
+    bx::mtxMul(viewProjNoTrans, viewNoTrans, proj);
+    bgfx::setViewTransform(viewId_Skybox, viewNoTrans, viewProjNoTrans);
+    // Set uniforms for the skybox vertex shader
+    bgfx::setUniform(s_uView, view);
+    bgfx::setUniform(s_uProj, proj);
+
+    // Submit the skybox draw
+    bgfx::setVertexBuffer(0, s_skyboxVertBuffer);
+    bgfx::setIndexBuffer(s_skyboxIndexBuffer);
+
+    // Bind the cubemap
+    bgfx::setTexture(0, s_skyboxUniform, s_skyboxTexture);
+
+    bgfx::setState(BGFX_STATE_WRITE_RGB);
+
+    bgfx::submit(viewId_Skybox, s_skyboxProgram);
+
+
+
+
+    //Drill mesh
+    bgfx::setViewTransform(viewId_Mesh, view, proj);
+
+    updateLights(view, proj, nearZ, farZ);
+
+    updateShadows(view, proj, mtxSpin);
+
+    if (s_occlusionCulling)
+    {
+        cullDrawItems(view, proj, mtxSpin);
+    }
+
+    if (!s_skinInstances.empty())
+    {
+        updateSkinning();
+    }
+
+    // Use the `eye` position as `u_camPos`
+    float camPos[4] = { eye.x, eye.y, eye.z, 0.0f };
+
+#if 1 //opaque
+    const uint64_t meshState =
+        BGFX_STATE_WRITE_RGB |
+        BGFX_STATE_WRITE_Z |
+        BGFX_STATE_DEPTH_TEST_LESS |
+        BGFX_STATE_CULL_CCW |           // Culls backfaces (CCW is standard)
+        BGFX_STATE_MSAA                // Enables anti-aliasing (optional, if MSAA is supported)
+    ;
+#else
+    const uint64_t meshState =
+        BGFX_STATE_WRITE_RGB |
+        BGFX_STATE_WRITE_Z |
+        BGFX_STATE_DEPTH_TEST_LESS |
+        BGFX_STATE_CULL_CCW |
+        BGFX_STATE_MSAA |
+        BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA) // Standard alpha blending
+    ;
+#endif
+
+    const int64_t submitStart = bx::getHPCounter();
+    if (s_materialBatching)
+    {
+        submitDrillInstanced(mtxSpin, camPos, meshState);
+    }
+    else
+    {
+        submitDrillPerItem(mtxSpin, camPos, meshState);
+    }
+    if (s_chunkStreamer.isOpen())
+    {
+        submitStreamedChunks(view, proj, eye, camPos, meshState);
+    }
+    s_submitTimeAccum += bx::getHPCounter() - submitStart;
+    ++s_submitFrames;
+}
+
+void renderFrame()
+{
+    glfwPollEvents();
+
+    // Update time and do a rotation
+    double currentTime = glfwGetTime();
+    theTime = float(currentTime);
+
+    // Set up a simple camera, circling the drill with --orbit-camera
+    float view[16];
+    const float cameraAngle = s_cameraOrbitSpeed * theTime;
+    const bx::Vec3 at   = {0.0f, 0.1f, 0.0f};
+    const bx::Vec3 eye  = {0.25f * std::sin(cameraAngle), 0.25f, 0.25f * std::cos(cameraAngle)}; // Move slightly back so we can see the drill
+    const bx::Vec3 up   = {0.0f, 1.0f, 0.0f};
+    bx::mtxLookAt(view, eye, at, up);
+
+
+    const float nearZ = 0.1f;
+    const float farZ = 500.0f;
+    float proj[16];
+    {
+        bx::mtxProj(proj, 60.0f, float(fbWidth)/float(fbHeight), nearZ, farZ, bgfx::getCaps()->homogeneousDepth);
+    }
+
+    float mtxRotateY[16];
+    bx::mtxRotateY(mtxRotateY, theTime);
+
+    float mtxTranslate[16];
+    bx::mtxTranslate(mtxTranslate, 0.0f, 0.0f, 0.0f);
+
+    float mtxSpin[16];
+    bx::mtxMul(mtxSpin, mtxRotateY, mtxTranslate);
+
+    // Left click reports what's under the cursor
+    const bool pickButtonDown = glfwGetMouseButton(s_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pickButtonDown && !s_pickButtonDown)
+    {
+        pickAtCursor(view, proj, mtxSpin);
+    }
+    s_pickButtonDown = pickButtonDown;
+
+    submitScene(view, proj, nearZ, farZ, eye, mtxSpin);
+
+    if (currentTime - s_lastSubmitReport >= 5.0)
+    {
+        // numDraw is from the last completed frame, skybox included
+        const double submitMs = double(s_submitTimeAccum) * 1000.0 / double(bx::getHPFrequency()) / double(s_submitFrames);
+        std::cout << "[MaterialBatch] " << (s_materialBatching ? "instanced" : "per-draw") << ": " << bgfx::getStats()->numDraw
+                  << " draw calls/frame, drill submit " << submitMs << " ms/frame (CPU, " << s_submitFrames << " frames)" << std::endl;
+
+        const double assignMs = double(s_lightAssignTimeAccum) * 1000.0 / double(bx::getHPFrequency()) / double(s_submitFrames);
+        std::cout << "[ClusteredLights] " << s_lightClusterer.numLights() << " lights (" << s_lightClusterer.numSpots() << " spots), assignment "
+                  << assignMs << " ms/frame (CPU, " << parallelForNumThreads() << " threads), " << s_lightClusterer.averageLightsPerCluster()
+                  << " lights/cluster on average, " << s_lightDroppedAccum << " light/cluster pairs dropped over the per-cluster limit of "
+                  << LightClusterer::kMaxLightsPerCluster << " or a full index texture" << std::endl;
+        if (s_shadowMaps.isEnabled())
+        {
+            s_shadowMaps.printStats();
+        }
+        if (s_occlusionCulling)
+        {
+            const double frequency = double(bx::getHPFrequency());
+            const double rasterMs = double(s_occlusionRasterTimeAccum) * 1000.0 / frequency / double(s_submitFrames);
+            const double testMs = double(s_occlusionTestTimeAccum) * 1000.0 / frequency / double(s_submitFrames);
+            const double triangles = double(s_occluderTrianglesAccum) / double(s_submitFrames);
+            std::cout << "[OcclusionCulling] " << triangles << " occluder triangles/frame, raster + HiZ " << rasterMs << " ms ("
+                      << (rasterMs > 0.0 ? triangles / rasterMs / 1000.0 : 0.0) << " Mtri/s), tests " << testMs << " ms; culled "
+                      << (100.0 * double(s_occlusionCulledAccum) / double(std::max<uint64_t>(s_occlusionTestedAccum, 1))) << "% occluded + "
+                      << (100.0 * double(s_offScreenCulledAccum) / double(std::max<uint64_t>(s_occlusionTestedAccum, 1))) << "% off-screen of "
+                      << s_drawItems.size() << " items" << std::endl;
+            s_occlusionRasterTimeAccum = 0;
+            s_occlusionTestTimeAccum = 0;
+            s_occluderTrianglesAccum = 0;
+            s_occlusionTestedAccum = 0;
+            s_occlusionCulledAccum = 0;
+            s_offScreenCulledAccum = 0;
+        }
+        if (!s_skinInstances.empty())
+        {
+            const double frequency = double(bx::getHPFrequency());
+            const double paletteMs = double(s_paletteTimeAccum) * 1000.0 / frequency / double(s_submitFrames);
+            std::cout << "[Skinning] " << s_skinInstances.size() << " instances, " << s_skeleton.numJoints() << " joints each: palettes "
+                      << paletteMs << " ms/frame (CPU, " << parallelForNumThreads() << " threads)";
+            if (s_cpuSkinning)
+            {
+                std::cout << ", CPU skinning " << double(s_cpuSkinTimeAccum) * 1000.0 / frequency / double(s_submitFrames) << " ms/frame";
+            }
+            std::cout << std::endl;
+            s_paletteTimeAccum = 0;
+            s_cpuSkinTimeAccum = 0;
+        }
+        if (s_chunkStreamer.isOpen())
+        {
+            s_chunkStreamer.printStats();
+        }
+
+        s_lightAssignTimeAccum = 0;
+        s_lightDroppedAccum = 0;
+        s_submitTimeAccum = 0;
+        s_submitFrames = 0;
+        s_lastSubmitReport = currentTime;
+    }
+
+    // Advance frame
+    bgfx::frame();
+    //glfwSwapBuffers(window);
+}
+
+// What the command line adds around the asset
+struct SceneOptions
+{
+    uint32_t stressMaterials;
+    uint32_t orbitingLights;
+    uint32_t defaultSpots;
+    uint32_t occlusionStress;
+    uint32_t skinningDemo;
+    bool bvhBenchmark;
+};
+
+// Imports the asset and builds everything drawn around it: meshes, materials, draw items, skins, lights
+static bool loadScene(const char* assetPath, const SceneOptions& options)
+{
+    bx::memCopy(s_sunDirection, kDefaultSunDirection, sizeof(s_sunDirection));
+    bx::memCopy(s_sunColor, kDefaultSunColor, sizeof(s_sunColor));
+
+    Assimp::Importer importer;
+    importer.SetIOHandler(new DataUriIOSystem()); // importer takes ownership
+    const aiScene* scene = importer.ReadFile(assetPath, kAssetImportFlags);
+
+    if (!scene)
+    {
+        std::cerr << "Failed to load scene via Assimp: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    //debug:
+    printMaterialTextures(scene);
+
+    // For simplicity, assume the scene has at least one mesh
+    if (scene->mNumMeshes < 1)
+    {
+        std::cerr << "No meshes found in the scene." << std::endl;
+        return false;
+    }
 
-    // Compute Model-View-Projection (MVP) matrix
-    float modelViewProj[16];
-    bx::mtxMul(modelViewProj, mtxModel, view); // Multiply Model * View
-    bx::mtxMul(modelViewProj, modelViewProj, proj); // Multiply result * Projection
-    bgfx::setTransform(modelViewProj);
+    // Every node is a joint, so bones and animation channels can refer to any of them
+    s_skeleton.addSceneNodes(scene->mRootNode, -1);
 
-    // Set shader uniforms
-    bgfx::setUniform(u_myModelMatrix, mtxModel);
-    //bgfx::setUniform(u_myModelViewProj, modelViewProj);
+    // Convert every mesh straight into bgfx memory
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+    {
+        const aiMesh* mesh = scene->mMeshes[m];
 
-    // Use the `eye` position as `u_camPos`
-    float camPos[4] = { eye.x, eye.y, eye.z, 0.0f };
-    bgfx::setUniform(u_camPos, camPos);
+        const bgfx::Memory* vertexMem = nullptr;
+        const bgfx::Memory* indexMem = nullptr;
+        if (!assimpMeshToBuffers(mesh, vertexMem, indexMem))
+        {
+            std::cerr << "Failed to convert mesh " << m << "." << std::endl;
+            return false;
+        }
+        std::cout << "mesh " << m << " num vertices:" << mesh->mNumVertices << std::endl;
+        std::cout << "mesh " << m << " num indices:" << indexMem->size / sizeof(uint32_t) << std::endl;
+
+        DrillMesh drillMesh;
+        drillMesh.materialIndex = mesh->mMaterialIndex;
+        computeMeshBounds(mesh, drillMesh);
+        drillMesh.occluder = addOccluderMesh(mesh);
+        drillMesh.skin = -1;
+        drillMesh.skinVbh = BGFX_INVALID_HANDLE;
+        SkinBinding skin;
+        if (importSkin(mesh, s_skeleton, skin) || (m == 0 && options.skinningDemo > 0 && buildChuckSpinRig(mesh, drillMesh, skin)))
+        {
+            addSkin(std::move(skin), vertexMem, drillMesh);
+        }
 
-    // Submit the geometry
-    bgfx::setTransform(mtxModel);
-    bgfx::setVertexBuffer(0, vbh);
-    bgfx::setIndexBuffer(ibh);
+        // Create static vertex/index buffers (bgfx takes ownership of the memory)
+        drillMesh.vbh = bgfx::createVertexBuffer(vertexMem, g_vertexLayout);
+        drillMesh.ibh = bgfx::createIndexBuffer(
+                    indexMem,
+                    BGFX_BUFFER_INDEX32 // IMPORTANT: 32-bit indices
+                    );
+        s_meshes.push_back(drillMesh);
+    }
 
-    if (bgfx::isValid(diffuseTex)) bgfx::setTexture(0, s_texColor, diffuseTex);
-    else std::cerr << "Error: diffuseTex (s_texColor) is invalid!" << std::endl;
+    buildPickMeshes(scene);
+    if (options.bvhBenchmark)
+    {
+        runBvhBenchmark();
+    }
 
-    if (bgfx::isValid(normalTex)) bgfx::setTexture(1, s_texNormal, normalTex);
-    else std::cerr << "Error: normalTex (s_texNormal) is invalid!" << std::endl;
+    for (unsigned int a = 0; a < scene->mNumAnimations; ++a)
+    {
+        AnimationClip clip;
+        if (importAnimation(scene->mAnimations[a], s_skeleton, clip))
+        {
+            s_clips.push_back(std::move(clip));
+        }
+    }
+    s_skeleton.finalize();
+    for (AnimationClip& clip : s_clips)
+    {
+        bakeClip(s_skeleton, 30.0f, clip);
+    }
 
-    if (bgfx::isValid(armTex)) bgfx::setTexture(2, s_texARM, armTex);
-    else std::cerr << "Error: armTex (s_texARM) is invalid!" << std::endl;
+    collectDrawItems(scene->mRootNode, aiMatrix4x4());
+    addSceneSkinInstances();
+    computeDrawItemBounds(s_assetBoundsMin, s_assetBoundsMax);
 
-    if (bgfx::isValid(irradianceTex)) bgfx::setTexture(3, s_irradiance, irradianceTex);
-    else std::cerr << "Error: irradianceTex (s_irradiance) is invalid!" << std::endl;
+    const bgfx::Caps* caps = bgfx::getCaps();
+    if (!s_skins.empty() && !s_cpuSkinning && 0 == (caps->formats[bgfx::TextureFormat::RGBA32F] & BGFX_CAPS_FORMAT_TEXTURE_VERTEX))
+    {
+        std::cerr << "GPU skinning needs RGBA32F vertex textures, skinning on the CPU instead." << std::endl;
+        s_cpuSkinning = true;
+    }
+    if (s_materialBatching && (0 == (caps->supported & BGFX_CAPS_INSTANCING) || 0 == (caps->supported & BGFX_CAPS_TEXTURE_2D_ARRAY)))
+    {
+        std::cerr << "Material batching needs instancing and 2D texture arrays, falling back to per-draw materials." << std::endl;
+        s_materialBatching = false;
+    }
 
-    if (bgfx::isValid(radianceTex)) bgfx::setTexture(4, s_radiance, radianceTex);
-    else std::cerr << "Error: radianceTex (s_radiance) is invalid!" << std::endl;
+    if (s_materialBatching)
+    {
+        // Material images are decoded once per unique content and packed into texture arrays
+        for (unsigned int m = 0; m < scene->mNumMaterials; ++m)
+        {
+            addBatchedMaterial(scene, m);
+        }
+        addMaterialStressScene(options.stressMaterials);
+        addOcclusionStressScene(options.occlusionStress);
+        addSkinningDemo(options.skinningDemo);
+        addGroundPlane();
+        if (!s_materialBatcher.build(caps->limits.maxTextureLayers))
+        {
+            std::cerr << "Could not build the material texture arrays." << std::endl;
+            return false;
+        }
+        buildInstanceGroups();
+    }
+    else
+    {
+        // Materials sharing images (or one image used for several slots) share textures through g_resources
+        for (unsigned int m = 0; m < scene->mNumMaterials; ++m)
+        {
+            s_materials.push_back(loadMaterial(scene, m));
+        }
+        addMaterialStressScene(options.stressMaterials);
+        addOcclusionStressScene(options.occlusionStress);
+        addSkinningDemo(options.skinningDemo);
+        addGroundPlane();
+    }
+    computeSceneBounds();
+    s_itemVisible.assign(s_drawItems.size(), 1);
+
+    collectSceneLights(scene);
+    addDefaultSpotLights(options.defaultSpots);
+    addOrbitingLights(options.orbitingLights); // last: updateLights() moves the tail of s_lights
+    bx::Vec3 sunDirection = bx::normalize(bx::Vec3{ s_sunDirection[0], s_sunDirection[1], s_sunDirection[2] });
+    s_sunDirection[0] = sunDirection.x;
+    s_sunDirection[1] = sunDirection.y;
+    s_sunDirection[2] = sunDirection.z;
+
+    if (!s_skinInstances.empty())
+    {
+        if (!s_cpuSkinning)
+        {
+            s_skinnedProgram = loadProgram("vs_drill_skinned.bin", s_materialBatching ? "fs_drill_batched.bin" : "fs_drill.bin");
+            if (!bgfx::isValid(s_skinnedProgram))
+            {
+                std::cerr << "Warning: could not create the skinning program, skinning on the CPU instead." << std::endl;
+                s_cpuSkinning = true;
+            }
+            else
+            {
+                s_skinnedShadowProgram = loadProgram("vs_shadow_skinned.bin", "fs_shadow.bin");
+            }
+        }
+        createSkinningResources();
+    }
+    return true;
+}
 
-    if (bgfx::isValid(brdfLutTex)) bgfx::setTexture(5, s_brdfLUT, brdfLutTex);
-    else std::cerr << "Error: brdfLutTex (s_brdfLUT) is invalid!" << std::endl;
+// Releases what loadScene created, so another asset can be loaded in its place
+static void unloadScene()
+{
+    for (const DrillMesh& mesh : s_meshes)
+    {
+        bgfx::destroy(mesh.vbh);
+        bgfx::destroy(mesh.ibh);
+        if (bgfx::isValid(mesh.skinVbh))
+        {
+            bgfx::destroy(mesh.skinVbh);
+        }
+    }
+    for (bgfx::DynamicVertexBufferHandle buffer : s_cpuSkinnedBuffers)
+    {
+        bgfx::destroy(buffer);
+    }
+    if (bgfx::isValid(s_skinPaletteTexture))
+    {
+        bgfx::destroy(s_skinPaletteTexture);
+        s_skinPaletteTexture = BGFX_INVALID_HANDLE;
+    }
+    // loadScene acquires the skinning programs per asset
+    if (bgfx::isValid(s_skinnedProgram))
+    {
+        g_resources.release(s_skinnedProgram);
+        s_skinnedProgram = BGFX_INVALID_HANDLE;
+    }
+    if (bgfx::isValid(s_skinnedShadowProgram))
+    {
+        g_resources.release(s_skinnedShadowProgram);
+        s_skinnedShadowProgram = BGFX_INVALID_HANDLE;
+    }
+    for (const DrillMaterial& material : s_materials)
+    {
+        g_resources.release(material.diffuseTex);
+        g_resources.release(material.normalTex);
+        g_resources.release(material.armTex);
+    }
+    s_materialBatcher.destroy();
+
+    s_meshes.clear();
+    s_materials.clear();
+    s_drawItems.clear();
+    s_instanceGroups.clear();
+    s_occluderMeshes.clear();
+    s_itemVisible.clear();
+    s_pickMeshes.clear();
+    s_skeleton = Skeleton();
+    s_clips.clear();
+    s_skins.clear();
+    s_skinInstances.clear();
+    s_skinPalette.clear();
+    s_skinPaletteRows = 0;
+    s_skinBindVertices.clear();
+    s_cpuSkinnedBuffers.clear();
+    s_lights.clear();
+    s_orbitingLights.clear();
+    s_spotLights.clear();
+    s_shadowMaps.invalidate();
+}
 
-#if 1 //opaque
-    bgfx::setState(
-        BGFX_STATE_WRITE_RGB |
-        BGFX_STATE_WRITE_Z |
-        BGFX_STATE_DEPTH_TEST_LESS |
-        BGFX_STATE_CULL_CCW |           // Culls backfaces (CCW is standard)
-        BGFX_STATE_MSAA                // Enables anti-aliasing (optional, if MSAA is supported)
-    );
-#else
-    bgfx::setState(
-        BGFX_STATE_WRITE_RGB |
-        BGFX_STATE_WRITE_Z |
-        BGFX_STATE_DEPTH_TEST_LESS |
-        BGFX_STATE_CULL_CCW |
-        BGFX_STATE_MSAA |
-        BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA) // Standard alpha blending
-    );
-#endif
+// --chunk-mesh IN OUT: splits every mesh of an asset (pre-transformed into one space) into chunks for --stream-mesh.
+// PLY files are chunked out of core (ply_chunking.h), anything else is imported whole by assimp first.
+static bool runChunkMesh(const char* assetPath, const char* outputPath, uint32_t maxTriangles)
+{
+    const int64_t start = bx::getHPCounter();
+    ChunkWriteStats stats;
+#if !__EMSCRIPTEN__
+    const std::string extension = std::filesystem::path(assetPath).extension().string();
+    if (extension.size() == 4 && std::tolower(extension[1]) == 'p' && std::tolower(extension[2]) == 'l' && std::tolower(extension[3]) == 'y')
+    {
+        PlyChunkStats plyStats;
+        if (!writeChunkedMeshFromPly(assetPath, outputPath, maxTriangles, &stats, &plyStats))
+        {
+            return false;
+        }
+        std::printf("[ChunkMesh] %s: %llu triangles, %llu vertices out of core in %u partitions (largest %llu triangles), %u chunks, %.1f MiB, %.0f ms\n",
+            outputPath, (unsigned long long)stats.numTriangles, (unsigned long long)plyStats.numVertices, plyStats.numPartitions,
+            (unsigned long long)plyStats.largestPartition, stats.numChunks, double(stats.fileBytes) / (1024.0 * 1024.0),
+            double(bx::getHPCounter() - start) * 1000.0 / double(bx::getHPFrequency()));
+        return true;
+    }
+#endif // !__EMSCRIPTEN__
+
+    Assimp::Importer importer;
+    importer.SetIOHandler(new DataUriIOSystem()); // importer takes ownership
+    const aiScene* scene = importer.ReadFile(assetPath, kAssetImportFlags | aiProcess_PreTransformVertices);
+    if (!scene || scene->mNumMeshes < 1)
+    {
+        std::cerr << "[runChunkMesh] Failed to load " << assetPath << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    const int64_t imported = bx::getHPCounter();
 
-    bgfx::submit(viewId_Mesh, program);
+    if (!writeChunkedMesh(outputPath, scene->mMeshes, scene->mNumMeshes, maxTriangles, &stats))
+    {
+        return false;
+    }
+    const int64_t written = bx::getHPCounter();
 
-    // Advance frame
-    bgfx::frame();
-    //glfwSwapBuffers(window);
+    std::printf("[ChunkMesh] %s: %llu triangles from %u meshes in %u chunks, %.1f MiB, import %.0f ms, chunking %.0f ms\n",
+        outputPath, (unsigned long long)stats.numTriangles, scene->mNumMeshes, stats.numChunks, double(stats.fileBytes) / (1024.0 * 1024.0),
+        double(imported - start) * 1000.0 / double(bx::getHPFrequency()),
+        double(written - imported) * 1000.0 / double(bx::getHPFrequency()));
+    return true;
+}
+
+// --stream-mesh FILE: opens a chunked mesh and scales its bounds to kStreamedMeshRadius around kStreamedMeshCenter
+static bool openStreamedMesh(const char* path, uint64_t budgetBytes)
+{
+    if (!s_chunkStreamer.open(path, budgetBytes, g_vertexLayout))
+    {
+        return false;
+    }
+    const ChunkFileHeader& header = s_chunkStreamer.header();
+    const bx::Vec3 boundsMin = { header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] };
+    const bx::Vec3 boundsMax = { header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] };
+    const bx::Vec3 center = bx::mul(bx::add(boundsMin, boundsMax), 0.5f);
+    const float radius = bx::max(bx::length(bx::sub(boundsMax, boundsMin)) * 0.5f, 1e-6f);
+    const float scale = kStreamedMeshRadius / radius;
+    bx::mtxSRT(s_streamedFit, scale, scale, scale, 0.0f, 0.0f, 0.0f,
+        kStreamedMeshCenter[0] - center.x * scale, kStreamedMeshCenter[1] - center.y * scale, kStreamedMeshCenter[2] - center.z * scale);
+    return true;
+}
+
+// --batch-render: every asset x environment x turntable angle, rendered offscreen and written out as PNG or EXR
+struct BatchOptions
+{
+    std::string outputDir;
+    std::vector<std::string> assets;       // glTF/... files, Drill_01_1k.gltf if none is given
+    std::vector<std::string> environments; // directories holding skybox.ktx, irradiance.ktx and radiance.ktx, "." if none
+    uint32_t angles = 8;
+    uint16_t size = 512;
+    bool exr = false;                      // RGBA16F target and half-float EXR, otherwise RGBA8 and PNG
+    uint32_t readbacksInFlight = 3;
+};
+
+#if !__EMSCRIPTEN__
+
+// A skybox and its prefiltered IBL maps
+struct Environment
+{
+    std::string name;
+    bgfx::TextureHandle skybox;
+    bgfx::TextureHandle irradiance;
+    bgfx::TextureHandle radiance;
+};
+
+static bool loadEnvironment(const std::string& directory, Environment& out)
+{
+    const std::filesystem::path path(directory);
+    out.name = path.filename().string();
+    if (out.name.empty() || out.name == ".")
+    {
+        out.name = "default";
+    }
+    out.skybox = loadTexture((path / "skybox.ktx").string().c_str());
+    out.irradiance = loadTexture((path / "irradiance.ktx").string().c_str());
+    out.radiance = loadTexture((path / "radiance.ktx").string().c_str());
+    if (!bgfx::isValid(out.skybox) || !bgfx::isValid(out.irradiance) || !bgfx::isValid(out.radiance))
+    {
+        std::cerr << "[loadEnvironment] " << directory << " needs skybox.ktx, irradiance.ktx and radiance.ktx." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The environments are loaded once up front and shared by every asset. Each image is rendered into the same
+// offscreen framebuffer and handed to a ReadbackRing; images that have arrived are encoded on a background
+// queue while the next ones render, so neither the GPU nor the encoders wait for each other until the ring
+// or the encoding backlog is full.
+static bool runBatchRender(const BatchOptions& batch, const SceneOptions& sceneOptions)
+{
+    std::vector<Environment> environments(batch.environments.size());
+    for (size_t e = 0; e < environments.size(); ++e)
+    {
+        if (!loadEnvironment(batch.environments[e], environments[e]))
+        {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::create_directories(batch.outputDir, error);
+    if (error)
+    {
+        std::cerr << "[runBatchRender] Could not create " << batch.outputDir << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    const bgfx::TextureFormat::Enum colorFormat = batch.exr ? bgfx::TextureFormat::RGBA16F : bgfx::TextureFormat::RGBA8;
+    const bgfx::TextureHandle targets[2] =
+    {
+        bgfx::createTexture2D(batch.size, batch.size, false, 1, colorFormat, BGFX_TEXTURE_RT),
+        bgfx::createTexture2D(batch.size, batch.size, false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT_WRITE_ONLY),
+    };
+    bgfx::FrameBufferHandle frameBuffer = bgfx::createFrameBuffer(2, targets, true);
+    ReadbackRing readbacks;
+    if (!bgfx::isValid(frameBuffer) || !readbacks.create(batch.size, batch.size, colorFormat, batch.readbacksInFlight))
+    {
+        std::cerr << "[runBatchRender] Could not create the offscreen target." << std::endl;
+        if (bgfx::isValid(frameBuffer)) bgfx::destroy(frameBuffer);
+        return false;
+    }
+    bgfx::setViewFrameBuffer(viewId_Skybox, frameBuffer);
+    bgfx::setViewFrameBuffer(viewId_Mesh, frameBuffer);
+    bgfx::setViewRect(viewId_Skybox, 0, 0, batch.size, batch.size);
+    bgfx::setViewRect(viewId_Mesh, 0, 0, batch.size, batch.size);
+
+    // GL render targets come back bottom row first
+    const bool bottomUp = bgfx::getCaps()->originBottomLeft;
+    stbi_flip_vertically_on_write(bottomUp ? 1 : 0);
+    BackgroundJobQueue encoders(std::max(1u, std::max(1u, std::thread::hardware_concurrency()) - 1)); // 0 when unknown
+    std::atomic<int64_t> encodeTime{ 0 };
+    std::atomic<uint32_t> encodeFailures{ 0 };
+    std::vector<std::string> imagePaths; // by ring tag
+
+    uint32_t frame = 0;
+    std::vector<ReadbackRing::Image> arrived;
+    auto runFrame = [&]()
+    {
+        frame = bgfx::frame();
+        readbacks.collect(frame, arrived);
+        for (ReadbackRing::Image& image : arrived)
+        {
+            // Bounded, so a slow disk doesn't pile up every image in memory
+            encoders.waitForBacklog(encoders.numThreads() * 2);
+            encoders.push([&, path = imagePaths[image.tag], pixels = std::move(image.pixels)]()
+            {
+                const int64_t encodeStart = bx::getHPCounter();
+                const bool written = batch.exr
+                        ? writeExrHalfRGBA(path.c_str(), batch.size, batch.size, reinterpret_cast<const uint16_t*>(pixels.data()), bottomUp)
+                        : stbi_write_png(path.c_str(), batch.size, batch.size, 4, pixels.data(), batch.size * 4) != 0;
+                encodeTime += bx::getHPCounter() - encodeStart;
+                if (!written)
+                {
+                    std::cerr << "[runBatchRender] Could not write " << path << std::endl;
+                    ++encodeFailures;
+                }
+            });
+        }
+        arrived.clear();
+    };
+
+    const int64_t batchStart = bx::getHPCounter();
+    int64_t loadTime = 0;
+    for (size_t a = 0; a < batch.assets.size(); ++a)
+    {
+        if (a > 0)
+        {
+            // Buffers still used by frames in flight are released by bgfx once those are done
+            const int64_t loadStart = bx::getHPCounter();
+            unloadScene();
+            const bool loaded = loadScene(batch.assets[a].c_str(), sceneOptions);
+            loadTime += bx::getHPCounter() - loadStart;
+            if (!loaded)
+            {
+                std::cerr << "[runBatchRender] Skipping " << batch.assets[a] << std::endl;
+                continue;
+            }
+        }
+
+        // Orbit at a fixed elevation, far enough for the bounding sphere of the asset's whole turn to fit
+        const bx::Vec3 boundsMin = { s_assetBoundsMin[0], s_assetBoundsMin[1], s_assetBoundsMin[2] };
+        const bx::Vec3 boundsMax = { s_assetBoundsMax[0], s_assetBoundsMax[1], s_assetBoundsMax[2] };
+        const bx::Vec3 center = bx::mul(bx::add(boundsMin, boundsMax), 0.5f);
+        const float radius = std::max(0.5f * bx::length(bx::sub(boundsMax, boundsMin)), 0.001f);
+        const float fieldOfView = 30.0f;
+        const float elevation = bx::toRad(20.0f);
+        const float distance = radius / std::sin(bx::toRad(fieldOfView * 0.5f)) * 1.05f;
+        const bx::Vec3 eye = bx::add(center, bx::mul(bx::Vec3{ 0.0f, std::sin(elevation), std::cos(elevation) }, distance));
+        float view[16];
+        float proj[16];
+        bx::mtxLookAt(view, eye, center, bx::Vec3{ 0.0f, 1.0f, 0.0f });
+        const float nearZ = std::min(0.1f, distance * 0.01f); // the skybox cube is unit sized
+        const float farZ = std::max(500.0f, distance + radius * 8.0f);
+        bx::mtxProj(proj, fieldOfView, 1.0f, nearZ, farZ, bgfx::getCaps()->homogeneousDepth);
+        const std::string assetName = std::filesystem::path(batch.assets[a]).stem().string();
+
+        for (const Environment& environment : environments)
+        {
+            s_skyboxTexture = environment.skybox;
+            irradianceTex = environment.irradiance;
+            radianceTex = environment.radiance;
+            for (uint32_t angle = 0; angle < batch.angles; ++angle)
+            {
+                while (!readbacks.hasFreeSlot())
+                {
+                    runFrame();
+                }
+
+                char fileName[32];
+                std::snprintf(fileName, sizeof(fileName), "_%03u.%s", angle, batch.exr ? "exr" : "png");
+                imagePaths.push_back((std::filesystem::path(batch.outputDir) / (assetName + "_" + environment.name + fileName)).string());
+
+                // Frozen time: only the turntable angle differs between the images
+                theTime = 0.0f;
+                float mtxSpin[16];
+                bx::mtxRotateY(mtxSpin, 2.0f * bx::kPi * float(angle) / float(batch.angles));
+                submitScene(view, proj, nearZ, farZ, eye, mtxSpin);
+                readbacks.submit(viewId_Readback, bgfx::getTexture(frameBuffer, 0), uint32_t(imagePaths.size() - 1));
+                runFrame();
+            }
+        }
+    }
+    while (!readbacks.idle())
+    {
+        runFrame();
+    }
+    const int64_t renderEnd = bx::getHPCounter();
+    encoders.waitForBacklog(0);
+
+    const double frequency = double(bx::getHPFrequency());
+    const double totalSeconds = double(bx::getHPCounter() - batchStart) / frequency;
+    const double renderSeconds = double(renderEnd - batchStart - loadTime) / frequency;
+    const double images = double(imagePaths.size());
+    std::cout << "[BatchRender] " << imagePaths.size() << " images (" << batch.size << "x" << batch.size << " " << (batch.exr ? "EXR" : "PNG")
+              << ") in " << totalSeconds << " s: " << images / totalSeconds << " images/s overall, " << images / renderSeconds
+              << " images/s rendered and read back (" << batch.readbacksInFlight << " read-backs in flight), loading the other assets "
+              << double(loadTime) * 1000.0 / frequency << " ms, encoding " << double(encodeTime) * 1000.0 / frequency / std::max(images, 1.0)
+              << " ms/image on " << encoders.numThreads() << " threads" << std::endl;
+
+    readbacks.destroy();
+    bgfx::destroy(frameBuffer);
+    return encodeFailures == 0;
 }
 
+#endif // !__EMSCRIPTEN__
+
 // -----------------------------------------------------------------------------
 int main(int argc, char** argv)
 {
+    // --no-material-batching: one submit per draw item with plain 2D textures (for comparison)
+    // --material-stress N: adds N drills with a material each
+    // --lights N: number of orbiting point lights (default 8)
+    // --occlusion-culling: skip draw items hidden behind the biggest low-poly occluders
+    // --occlusion-stress N: adds a showroom of N drills behind partition walls (implies --occlusion-culling)
+    // --spots N: spotlights added on top of the asset's (default 2); past CachedShadowMaps::kMaxSpots in total they are unshadowed
+    // --orbit-camera SPEED: circles the camera around the drill at SPEED radians per second (default 0, a still camera)
+    // --skinning-demo N: rigs the drill with a spinning chuck and adds N animated drills
+    // --cpu-skinning: skin on the CPU instead of in vs_drill_skinned (to validate it)
+    // --bvh-benchmark: trace a grid of rays at every mesh's picking BVH at startup and print the rays per second
+    // --batch-render DIR: no window; renders turntables of every --batch-asset in every --batch-environment into DIR and exits
+    // --batch-asset FILE: an asset for --batch-render (repeatable, default Drill_01_1k.gltf)
+    // --batch-environment DIR: a directory with skybox.ktx, irradiance.ktx and radiance.ktx (repeatable, default .)
+    // --batch-angles N: turntable angles per asset and environment (default 8)
+    // --batch-size N: image width and height (default 512)
+    // --batch-exr: write half-float EXRs instead of PNGs
+    // --readbacks-in-flight N: read-back textures in the ring (default 3)
+    // --chunk-mesh IN OUT: no window; writes the meshes of asset IN (a PLY out of core) as a chunked mesh file OUT for --stream-mesh and exits
+    // --chunk-triangles N: at most N triangles per chunk for --chunk-mesh (default kDefaultChunkTriangles)
+    // --stream-mesh FILE: streams the chunks of FILE behind the drill, only the ones ranked best for the camera resident
+    // --stream-budget-mb N: GPU buffer budget of --stream-mesh in MiB (default 64)
+    // --stream-spin SPEED: spins the streamed mesh about its center at SPEED radians per second (default 0.2, 0 holds it
+    //   still), so chunks enter and leave the frustum; --orbit-camera moves the camera past it too
+    uint32_t stressMaterials = 0;
+    uint32_t orbitingLights = 8;
+    uint32_t defaultSpots = 2;
+    uint32_t occlusionStress = 0;
+    uint32_t skinningDemo = 0;
+    bool bvhBenchmark = false;
+    bool batchRender = false;
+    BatchOptions batchOptions;
+    const char* chunkMeshInput = nullptr;
+    const char* chunkMeshOutput = nullptr;
+    uint32_t chunkTriangles = kDefaultChunkTriangles;
+    const char* streamMeshPath = nullptr;
+    uint64_t streamBudgetMiB = 64;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--no-material-batching")
+        {
+            s_materialBatching = false;
+        }
+        else if (arg == "--material-stress" && i + 1 < argc)
+        {
+            stressMaterials = uint32_t(std::atoi(argv[++i]));
+        }
+        else if (arg == "--lights" && i + 1 < argc)
+        {
+            orbitingLights = uint32_t(std::atoi(argv[++i]));
+        }
+        else if (arg == "--orbit-camera" && i + 1 < argc)
+        {
+            s_cameraOrbitSpeed = float(std::atof(argv[++i]));
+        }
+        else if (arg == "--occlusion-culling")
+        {
+            s_occlusionCulling = true;
+        }
+        else if (arg == "--occlusion-stress" && i + 1 < argc)
+        {
+            occlusionStress = uint32_t(std::atoi(argv[++i]));
+            s_occlusionCulling = true;
+        }
+        else if (arg == "--spots" && i + 1 < argc)
+        {
+            defaultSpots = uint32_t(std::atoi(argv[++i]));
+        }
+        else if (arg == "--skinning-demo" && i + 1 < argc)
+        {
+            skinningDemo = uint32_t(std::atoi(argv[++i]));
+        }
+        else if (arg == "--cpu-skinning")
+        {
+            s_cpuSkinning = true;
+        }
+        else if (arg == "--bvh-benchmark")
+        {
+            bvhBenchmark = true;
+        }
+        else if (arg == "--batch-render" && i + 1 < argc)
+        {
+            batchRender = true;
+            batchOptions.outputDir = argv[++i];
+        }
+        else if (arg == "--batch-asset" && i + 1 < argc)
+        {
+            batchOptions.assets.push_back(argv[++i]);
+        }
+        else if (arg == "--batch-environment" && i + 1 < argc)
+        {
+            batchOptions.environments.push_back(argv[++i]);
+        }
+        else if (arg == "--batch-angles" && i + 1 < argc)
+        {
+            batchOptions.angles = uint32_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--batch-size" && i + 1 < argc)
+        {
+            batchOptions.size = uint16_t(bx::clamp(std::atoi(argv[++i]), 16, 8192));
+        }
+        else if (arg == "--batch-exr")
+        {
+            batchOptions.exr = true;
+        }
+        else if (arg == "--readbacks-in-flight" && i + 1 < argc)
+        {
+            batchOptions.readbacksInFlight = uint32_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--chunk-mesh" && i + 2 < argc)
+        {
+            chunkMeshInput = argv[++i];
+            chunkMeshOutput = argv[++i];
+        }
+        else if (arg == "--chunk-triangles" && i + 1 < argc)
+        {
+            chunkTriangles = uint32_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--stream-mesh" && i + 1 < argc)
+        {
+            streamMeshPath = argv[++i];
+        }
+        else if (arg == "--stream-budget-mb" && i + 1 < argc)
+        {
+            streamBudgetMiB = uint64_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--stream-spin" && i + 1 < argc)
+        {
+            s_streamedSpinSpeed = float(std::atof(argv[++i]));
+        }
+    }
+    if (batchOptions.assets.empty())
+    {
+        batchOptions.assets.push_back("Drill_01_1k.gltf");
+    }
+    if (batchOptions.environments.empty())
+    {
+        batchOptions.environments.push_back(".");
+    }
+    if (chunkMeshInput)
+    {
+        return runChunkMesh(chunkMeshInput, chunkMeshOutput, chunkTriangles) ? 0 : 1;
+    }
+
     // -------------------------------------------------------------------------
     // Initialize GLFW
     // -------------------------------------------------------------------------
@@ -716,6 +3141,11 @@ int main(int argc, char** argv)
 
     // We only need an OpenGL context so bgfx can hook into it
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+    if (batchRender)
+    {
+        // Batch mode only renders offscreen, the window just carries the GL context (Xvfb and llvmpipe do without a GPU)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
     GLFWwindow* window = glfwCreateWindow(1280, 720, "IBL PBR Drill", nullptr, nullptr);
     if (!window)
     {
@@ -724,6 +3154,7 @@ int main(int argc, char** argv)
         return -1;
     }
     glfwMakeContextCurrent(window);
+    s_window = window;
 
     // -------------------------------------------------------------------------
     // Initialize bgfx (using the OpenGL renderer)
@@ -742,7 +3173,7 @@ int main(int argc, char** argv)
     init.platformData = pd;
     init.resolution.width  = 1280;
     init.resolution.height = 720;
-    init.resolution.reset  = BGFX_RESET_VSYNC;
+    init.resolution.reset  = batchRender ? BGFX_RESET_NONE : BGFX_RESET_VSYNC;
     bgfx::init(init);
 
 
@@ -763,18 +3194,19 @@ int main(int argc, char** argv)
                 );
 
     // Load shaders
-    vsh = loadShader("vs_skybox.bin");
-    fsh = loadShader("fs_skybox.bin");
-    s_skyboxProgram = bgfx::createProgram(vsh, fsh, true);
+    s_skyboxProgram = loadProgram("vs_skybox.bin", "fs_skybox.bin");
 
     // Create uniforms
     s_skyboxUniform = bgfx::createUniform("s_skyMap", bgfx::UniformType::Sampler);
     s_uView  = bgfx::createUniform("u_viewMat",   bgfx::UniformType::Mat4);
     s_uProj  = bgfx::createUniform("u_projMat",   bgfx::UniformType::Mat4);
 
-    // Load cubemap KTX
+    // Load cubemap KTX (batch mode loads its --batch-environment directories instead)
     // Example: /dev/shm/mossyForestExr/skybox.ktx
-    s_skyboxTexture = loadTexture("skybox.ktx");
+    if (!batchRender)
+    {
+        s_skyboxTexture = loadTexture("skybox.ktx");
+    }
 
     // Set the view clear color (cornflower blue, for instance)
     bgfx::setViewClear(viewId_Skybox,
@@ -786,86 +3218,38 @@ int main(int argc, char** argv)
     bgfx::setViewClear(viewId_Mesh, BGFX_CLEAR_DEPTH);
 
     initVertexLayout();
-
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-                //"Drill_01_1k.glb"
-                "Drill_01_1k.gltf",
-                aiProcess_Triangulate |
-                aiProcess_GenNormals |
-                aiProcess_CalcTangentSpace |
-                //aiProcess_FlipUVs //|              // <-- Flips V texture coordinates
-                aiProcess_ConvertToLeftHanded     // <-- Converts to left-handed coordinate system
-                );
-
-    if (!scene)
+    initSkinVertexLayout(s_skinLayout);
+
+    SceneOptions sceneOptions;
+    sceneOptions.stressMaterials = stressMaterials;
+    sceneOptions.orbitingLights = orbitingLights;
+    sceneOptions.defaultSpots = defaultSpots;
+    sceneOptions.occlusionStress = occlusionStress;
+    sceneOptions.skinningDemo = skinningDemo;
+    sceneOptions.bvhBenchmark = bvhBenchmark;
+    if (!loadScene(batchRender ? batchOptions.assets[0].c_str() : "Drill_01_1k.gltf", sceneOptions))
     {
-        std::cerr << "Failed to load scene via Assimp: " << importer.GetErrorString() << std::endl;
         return -1;
     }
-
-    //debug:
-    printMaterialTextures(scene);
-
-    // For simplicity, assume the scene has at least one mesh
-    if (scene->mNumMeshes < 1)
+    if (streamMeshPath && !batchRender && !openStreamedMesh(streamMeshPath, streamBudgetMiB << 20))
     {
-        std::cerr << "No meshes found in the scene." << std::endl;
         return -1;
     }
+    s_lightClusterer.createTextures();
 
-    // Grab the first mesh
-    const aiMesh* mesh = scene->mMeshes[0];
-
-    // Convert to our arrays
-    assimpMeshToBuffers(mesh, vertices, indices);
-
-    // Create static vertex/index buffers
-    vbh = bgfx::createVertexBuffer(
-                bgfx::makeRef(vertices.data(), sizeof(MyFancyVertex) * vertices.size()),
-                g_vertexLayout
-                );
-
-    ibh = bgfx::createIndexBuffer(
-                bgfx::makeRef(indices.data(), sizeof(uint32_t) * indices.size()),
-                BGFX_BUFFER_INDEX32 // IMPORTANT: 32-bit indices
-                );
-
-
-    // Suppose we have one material
-    const aiMaterial* mat = scene->mMaterials[0];
-
-    diffuseTex   = loadTextureType(mat, aiTextureType_DIFFUSE, scene);
-    normalTex    = loadTextureType(mat, aiTextureType_NORMALS, scene);
-#ifdef __EMSCRIPTEN__
-    armTex = loadTextureType(mat, aiTextureType_METALNESS, scene);
-#else // Linux/X11
-    //my old Debian Bullseye version of assimp uses "UNKNOWN" for the arm, but the bleeding edge git version (which i had to get for wasm) uses either METALNESS or ROUGHNESS
-    armTex = loadTextureType(mat, aiTextureType_UNKNOWN, scene);
-#endif // __EMSCRIPTEN__
-    irradianceTex = loadTexture("irradiance.ktx");
-    radianceTex = loadTexture("radiance.ktx");
+    if (!batchRender)
+    {
+        irradianceTex = loadTexture("irradiance.ktx");
+        radianceTex = loadTexture("radiance.ktx");
+    }
     brdfLutTex    = loadTexture("brdf_lut.ktx");
 
 
-    if (!bgfx::isValid(armTex))
-    {
-        std::cerr << "Warning: No valid ARM (AO, Roughness, Metalness) texture found.\n";
-        return 1;
-    }
-    if (!bgfx::isValid(diffuseTex)) {
-        std::cerr << "Warning: No valid embedded texture found. The drill will be untextured." << std::endl;
-        return 1;
-    }
-    if (!bgfx::isValid(normalTex)) {
-        std::cerr << "Warning: No valid embedded normalTex texture found. The drill will be untextured normalTex." << std::endl;
-        return 1;
-    }
-    if (!bgfx::isValid(irradianceTex)) {
+    if (!batchRender && !bgfx::isValid(irradianceTex)) {
         std::cerr << "Warning: invalid irradianceTex handle." << std::endl;
         return 1;
     }
-    if (!bgfx::isValid(radianceTex)) {
+    if (!batchRender && !bgfx::isValid(radianceTex)) {
         std::cerr << "Warning: invalid radianceTex handle." << std::endl;
         return 1;
     }
@@ -890,14 +3274,46 @@ int main(int argc, char** argv)
     s_radiance   = bgfx::createUniform("s_radiance",   bgfx::UniformType::Sampler);
     s_brdfLUT    = bgfx::createUniform("s_brdfLUT",    bgfx::UniformType::Sampler);
 
+    s_clusterGrid   = bgfx::createUniform("s_clusterGrid",   bgfx::UniformType::Sampler);
+    s_lightIndices  = bgfx::createUniform("s_lightIndices",  bgfx::UniformType::Sampler);
+    s_lightData     = bgfx::createUniform("s_lightData",     bgfx::UniformType::Sampler);
+    u_clusterParams = bgfx::createUniform("u_clusterParams", bgfx::UniformType::Vec4);
+    u_clusterDepth  = bgfx::createUniform("u_clusterDepth",  bgfx::UniformType::Vec4);
+
+    s_shadowMap      = bgfx::createUniform("s_shadowMap",      bgfx::UniformType::Sampler);
+    u_sunDirection   = bgfx::createUniform("u_sunDirection",   bgfx::UniformType::Vec4);
+    u_sunColor       = bgfx::createUniform("u_sunColor",       bgfx::UniformType::Vec4);
+    u_cascadeSplits  = bgfx::createUniform("u_cascadeSplits",  bgfx::UniformType::Vec4);
+    u_cascadeMtx     = bgfx::createUniform("u_cascadeMtx",     bgfx::UniformType::Mat4, CachedShadowMaps::kNumCascades);
+    u_spotPosition   = bgfx::createUniform("u_spotPosition",   bgfx::UniformType::Vec4, CachedShadowMaps::kMaxSpots);
+    u_spotDirection  = bgfx::createUniform("u_spotDirection",  bgfx::UniformType::Vec4, CachedShadowMaps::kMaxSpots);
+    u_spotColor      = bgfx::createUniform("u_spotColor",      bgfx::UniformType::Vec4, CachedShadowMaps::kMaxSpots);
+    u_spotShadowMtx  = bgfx::createUniform("u_spotShadowMtx",  bgfx::UniformType::Mat4, CachedShadowMaps::kMaxSpots);
+    u_shadowParams   = bgfx::createUniform("u_shadowParams",   bgfx::UniformType::Vec4);
+
+    s_skinPaletteSampler = bgfx::createUniform("s_skinPalette", bgfx::UniformType::Sampler);
+    u_skinParams         = bgfx::createUniform("u_skinParams",  bgfx::UniformType::Vec4);
+
     // Load the drill shaders
-    program = loadProgram("vs_drill.bin", "fs_drill.bin");
+    program = s_materialBatching
+            ? loadProgram("vs_drill_instanced.bin", "fs_drill_batched.bin")
+            : loadProgram("vs_drill.bin", "fs_drill.bin");
     if (!bgfx::isValid(program))
     {
         std::cerr << "Could not create program. Exiting." << std::endl;
         return -1;
     }
 
+    // Shadows are optional: without the programs or depth compare support the lights are just unshadowed
+    s_shadowProgram = loadProgram("vs_shadow.bin", "fs_shadow.bin");
+    bgfx::ProgramHandle shadowCopyProgram = loadProgram("vs_shadow_copy.bin", "fs_shadow_copy.bin");
+    if (!bgfx::isValid(s_shadowProgram) || !bgfx::isValid(shadowCopyProgram) || !s_shadowMaps.create(viewId_ShadowFirst, shadowCopyProgram))
+    {
+        std::cerr << "Warning: shadow maps unavailable, lights will be unshadowed." << std::endl;
+    }
+
+    g_resources.printStats();
+
     // -------------------------------------------------------------------------
     // Main loop
     // -------------------------------------------------------------------------
@@ -905,7 +3321,7 @@ int main(int argc, char** argv)
     if (fbWidth < 1) fbWidth = 1;
     if (fbHeight < 1) fbHeight = 1;
 
-    bgfx::reset((uint32_t)fbWidth, (uint32_t)fbHeight, BGFX_RESET_VSYNC);
+    bgfx::reset((uint32_t)fbWidth, (uint32_t)fbHeight, init.resolution.reset);
 
     bgfx::setViewRect(viewId_Skybox, 0, 0, (uint16_t)fbWidth, (uint16_t)fbHeight);
     bgfx::setViewRect(viewId_Mesh, 0, 0, (uint16_t)fbWidth, (uint16_t)fbHeight);
@@ -915,51 +3331,69 @@ int main(int argc, char** argv)
 #if __EMSCRIPTEN__
     emscripten_set_main_loop(renderFrame, 0, true);
 #else // Linux/X11
-    while (!glfwWindowShouldClose(window))
+    int exitCode = 0;
+    if (batchRender)
     {
-        renderFrame();
+        exitCode = runBatchRender(batchOptions, sceneOptions) ? 0 : 1;
+    }
+    else
+    {
+        while (!glfwWindowShouldClose(window))
+        {
+            renderFrame();
+        }
     }
 
     // Cleanup
-    bgfx::destroy(program);
-    bgfx::destroy(vbh);
-    bgfx::destroy(ibh);
+    s_chunkStreamer.close();
+    unloadScene();
 
     // Destroy uniforms
     bgfx::destroy(u_myModelMatrix);
     //bgfx::destroy(u_myModelViewProj);
     bgfx::destroy(u_camPos);
 
-    if (bgfx::isValid(armTex))
-        bgfx::destroy(armTex);
-    if (bgfx::isValid(normalTex))
-        bgfx::destroy(normalTex);
-    if (bgfx::isValid(diffuseTex))
-        bgfx::destroy(diffuseTex);
-    if (bgfx::isValid(irradianceTex)) bgfx::destroy(irradianceTex);
-    if (bgfx::isValid(radianceTex)) bgfx::destroy(radianceTex);
-    if (bgfx::isValid(brdfLutTex))    bgfx::destroy(brdfLutTex);
-
     bgfx::destroy(s_texColor);
     bgfx::destroy(s_texNormal);
     bgfx::destroy(s_texARM);
     bgfx::destroy(s_irradiance);
     bgfx::destroy(s_radiance);
     bgfx::destroy(s_brdfLUT);
+    bgfx::destroy(s_clusterGrid);
+    bgfx::destroy(s_lightIndices);
+    bgfx::destroy(s_lightData);
+    bgfx::destroy(u_clusterParams);
+    bgfx::destroy(u_clusterDepth);
+    bgfx::destroy(s_shadowMap);
+    bgfx::destroy(u_sunDirection);
+    bgfx::destroy(u_sunColor);
+    bgfx::destroy(u_cascadeSplits);
+    bgfx::destroy(u_cascadeMtx);
+    bgfx::destroy(u_spotPosition);
+    bgfx::destroy(u_spotDirection);
+    bgfx::destroy(u_spotColor);
+    bgfx::destroy(u_spotShadowMtx);
+    bgfx::destroy(u_shadowParams);
+    bgfx::destroy(s_skinPaletteSampler);
+    bgfx::destroy(u_skinParams);
 
-    bgfx::destroy(s_skyboxTexture);
     bgfx::destroy(s_skyboxUniform);
     bgfx::destroy(s_uView);
     bgfx::destroy(s_uProj);
 
     bgfx::destroy(s_skyboxIndexBuffer);
     bgfx::destroy(s_skyboxVertBuffer);
-    bgfx::destroy(s_skyboxProgram);
+
+    s_lightClusterer.destroyTextures();
+    s_shadowMaps.destroy();
+
+    // Textures, shaders and programs (drill and skybox) are owned by the resource cache
+    g_resources.destroyAll();
 
     bgfx::shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    return 0;
+    return exitCode;
 #endif // __EMSCRIPTEN__
 }
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+// A decoded BGRA8 image kept on the CPU until it's packed into a texture array
+struct DecodedImage
+{
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::shared_ptr<uint8_t> pixels;
+};
+
+inline DecodedImage makeSolidImage(uint8_t b, uint8_t g, uint8_t r, uint8_t a)
+{
+    DecodedImage image;
+    image.width = 1;
+    image.height = 1;
+    image.pixels = std::shared_ptr<uint8_t>(new uint8_t[4] { b, g, r, a }, std::default_delete<uint8_t[]>());
+    return image;
+}
+
+// 2x2 box filter, edges clamp for odd sizes
+inline void downsampleBGRA8(const uint8_t* src, uint16_t srcWidth, uint16_t srcHeight, uint8_t* dst, uint16_t dstWidth, uint16_t dstHeight)
+{
+    for (uint16_t y = 0; y < dstHeight; ++y)
+    {
+        const uint8_t* row0 = src + size_t(std::min<int>(y * 2, srcHeight - 1)) * srcWidth * 4;
+        const uint8_t* row1 = src + size_t(std::min<int>(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+        for (uint16_t x = 0; x < dstWidth; ++x)
+        {
+            size_t x0 = size_t(std::min<int>(x * 2, srcWidth - 1)) * 4;
+            size_t x1 = size_t(std::min<int>(x * 2 + 1, srcWidth - 1)) * 4;
+            for (int c = 0; c < 4; ++c)
+            {
+                dst[(size_t(y) * dstWidth + x) * 4 + c] = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Packs material images into 2D texture arrays so draws with different
+// materials can share one set of bindings. Every slot (color, normal, ARM) is
+// packed separately: unique images (by content key) are grouped by size and
+// each group becomes one array (split at the layer limit). Materials whose
+// three slots ended up in the same three arrays form a batch; within a batch
+// the material is just three layer indices, passed per instance.
+// -----------------------------------------------------------------------------
+class MaterialBatcher
+{
+public:
+    enum Slot
+    {
+        Slot_Color,
+        Slot_Normal,
+        Slot_ARM,
+
+        Slot_Count
+    };
+
+    struct MaterialRef
+    {
+        uint16_t batch;
+        float layers[Slot_Count];
+    };
+
+    struct Batch
+    {
+        bgfx::TextureHandle arrays[Slot_Count];
+    };
+
+    bool hasImage(Slot slot, uint64_t key) const
+    {
+        return m_imageIndex[slot].count(key) != 0;
+    }
+
+    // Images whose key is already known may be passed empty. Returns the material's id.
+    uint32_t addMaterial(const uint64_t keys[Slot_Count], const DecodedImage images[Slot_Count])
+    {
+        PendingMaterial material;
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            auto inserted = m_imageIndex[slot].emplace(keys[slot], uint32_t(m_images[slot].size()));
+            if (inserted.second)
+            {
+                m_images[slot].push_back(images[slot]);
+            }
+            material.images[slot] = inserted.first->second;
+        }
+        m_pending.push_back(material);
+        return uint32_t(m_pending.size() - 1);
+    }
+
+    // Creates the arrays, uploads every layer with a full mip chain and frees the CPU images
+    bool build(uint16_t maxLayers)
+    {
+        maxLayers = std::max<uint16_t>(maxLayers, 1);
+
+        // Image -> (array, layer), per slot
+        std::vector<std::pair<uint32_t, uint16_t>> placement[Slot_Count];
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            std::map<std::pair<uint16_t, uint16_t>, uint32_t> openArrayBySize;
+            placement[slot].resize(m_images[slot].size());
+            for (uint32_t i = 0; i < m_images[slot].size(); ++i)
+            {
+                const DecodedImage& image = m_images[slot][i];
+                auto size = std::make_pair(image.width, image.height);
+                auto open = openArrayBySize.find(size);
+                if (open == openArrayBySize.end() || m_arrays[slot][open->second].images.size() >= maxLayers)
+                {
+                    m_arrays[slot].push_back(ArrayBuild{ image.width, image.height, {}, BGFX_INVALID_HANDLE });
+                    openArrayBySize[size] = uint32_t(m_arrays[slot].size() - 1);
+                    open = openArrayBySize.find(size);
+                }
+                ArrayBuild& array = m_arrays[slot][open->second];
+                placement[slot][i] = std::make_pair(open->second, uint16_t(array.images.size()));
+                array.images.push_back(i);
+            }
+
+            for (ArrayBuild& array : m_arrays[slot])
+            {
+                array.handle = createArray(slot, array);
+                if (!bgfx::isValid(array.handle))
+                {
+                    std::cerr << "[MaterialBatcher] Failed to create " << array.width << "x" << array.height << "x" << array.images.size() << " texture array.\n";
+                    return false;
+                }
+            }
+        }
+
+        std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint16_t> batchByArrays;
+        m_materials.clear();
+        for (const PendingMaterial& pending : m_pending)
+        {
+            MaterialRef material;
+            uint32_t arrays[Slot_Count];
+            for (int slot = 0; slot < Slot_Count; ++slot)
+            {
+                arrays[slot] = placement[slot][pending.images[slot]].first;
+                material.layers[slot] = float(placement[slot][pending.images[slot]].second);
+            }
+
+            auto key = std::make_tuple(arrays[Slot_Color], arrays[Slot_Normal], arrays[Slot_ARM]);
+            auto it = batchByArrays.find(key);
+            if (it == batchByArrays.end())
+            {
+                Batch batch;
+                for (int slot = 0; slot < Slot_Count; ++slot)
+                {
+                    batch.arrays[slot] = m_arrays[slot][arrays[slot]].handle;
+                }
+                m_batches.push_back(batch);
+                it = batchByArrays.emplace(key, uint16_t(m_batches.size() - 1)).first;
+            }
+            material.batch = it->second;
+            m_materials.push_back(material);
+        }
+
+        // Every reference past the first to an image is a layer (with its mip chain) that wasn't uploaded twice
+        uint32_t imageRequests = 0;
+        uint32_t imageHits = 0;
+        uint64_t bytesSaved = 0;
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            std::vector<uint32_t> references(m_images[slot].size(), 0);
+            for (const PendingMaterial& pending : m_pending)
+            {
+                ++references[pending.images[slot]];
+            }
+            for (uint32_t i = 0; i < m_images[slot].size(); ++i)
+            {
+                imageRequests += references[i];
+                if (references[i] > 1)
+                {
+                    const DecodedImage& image = m_images[slot][i];
+                    bgfx::TextureInfo info;
+                    bgfx::calcTextureSize(info, image.width, image.height, 1, false, true, 1, bgfx::TextureFormat::BGRA8);
+                    imageHits += references[i] - 1;
+                    bytesSaved += uint64_t(references[i] - 1) * info.storageSize;
+                }
+            }
+        }
+
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            m_images[slot].clear();
+            m_imageIndex[slot].clear();
+        }
+        m_pending.clear();
+
+        std::cout << "[MaterialBatcher] " << m_materials.size() << " materials in " << m_batches.size() << " batch(es), texture arrays: "
+                  << m_arrays[Slot_Color].size() << " color, " << m_arrays[Slot_Normal].size() << " normal, " << m_arrays[Slot_ARM].size() << " ARM\n";
+        std::cout << "[MaterialBatcher] images: " << imageRequests << " requests, " << imageHits << " shared ("
+                  << (imageRequests ? 100.0 * imageHits / imageRequests : 0.0) << "%), " << (bytesSaved / 1024) << " KiB saved including mips\n";
+        return true;
+    }
+
+    const MaterialRef& material(uint32_t id) const { return m_materials[id]; }
+    const Batch& batch(uint16_t index) const { return m_batches[index]; }
+    size_t numBatches() const { return m_batches.size(); }
+
+    void destroy()
+    {
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            for (ArrayBuild& array : m_arrays[slot])
+            {
+                if (bgfx::isValid(array.handle)) bgfx::destroy(array.handle);
+            }
+            m_arrays[slot].clear();
+        }
+        m_batches.clear();
+        m_materials.clear();
+    }
+
+private:
+    struct PendingMaterial
+    {
+        uint32_t images[Slot_Count];
+    };
+
+    struct ArrayBuild
+    {
+        uint16_t width;
+        uint16_t height;
+        std::vector<uint32_t> images; // index into m_images[slot], in layer order
+        bgfx::TextureHandle handle;
+    };
+
+    bgfx::TextureHandle createArray(int slot, const ArrayBuild& array)
+    {
+        const uint16_t numLayers = uint16_t(array.images.size());
+        bgfx::TextureHandle handle = bgfx::createTexture2D(array.width, array.height, true, numLayers, bgfx::TextureFormat::BGRA8, BGFX_TEXTURE_NONE | BGFX_SAMPLER_NONE);
+        if (!bgfx::isValid(handle))
+        {
+            return handle;
+        }
+
+        for (uint16_t layer = 0; layer < numLayers; ++layer)
+        {
+            const DecodedImage& image = m_images[slot][array.images[layer]];
+            uint16_t width = image.width;
+            uint16_t height = image.height;
+            const bgfx::Memory* mem = bgfx::copy(image.pixels.get(), uint32_t(width) * height * 4);
+            bgfx::updateTexture2D(handle, layer, 0, 0, 0, width, height, mem);
+
+            // Each layer is its own image, so its mips are built per layer and never bleed into neighbours
+            for (uint8_t mip = 1; width > 1 || height > 1; ++mip)
+            {
+                uint16_t mipWidth = std::max<uint16_t>(width / 2, 1);
+                uint16_t mipHeight = std::max<uint16_t>(height / 2, 1);
+                const bgfx::Memory* mipMem = bgfx::alloc(uint32_t(mipWidth) * mipHeight * 4);
+                downsampleBGRA8(mem->data, width, height, mipMem->data, mipWidth, mipHeight);
+                bgfx::updateTexture2D(handle, layer, mip, 0, 0, mipWidth, mipHeight, mipMem);
+                mem = mipMem;
+                width = mipWidth;
+                height = mipHeight;
+            }
+        }
+        return handle;
+    }
+
+    std::vector<DecodedImage> m_images[Slot_Count];
+    std::unordered_map<uint64_t, uint32_t> m_imageIndex[Slot_Count];
+    std::vector<PendingMaterial> m_pending;
+
+    std::vector<ArrayBuild> m_arrays[Slot_Count];
+    std::vector<Batch> m_batches;
+    std::vector<MaterialRef> m_materials;
+};
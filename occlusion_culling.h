@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "parallel_for.h"
+#include "simd_float4.h"
+
+// CPU-side copy of a low-poly mesh that is rasterized as an occluder
+struct OccluderMesh
+{
+    std::vector<float> positions; // xyz per vertex, model space
+    std::vector<uint32_t> indices;
+};
+
+namespace occlusion_detail
+{
+
+// Lanes whose pixel center is inside all three edges
+inline simd4::Float4 insideMask(simd4::Float4 e0, simd4::Float4 e1, simd4::Float4 e2)
+{
+    return simd4::greaterEqual(simd4::min(simd4::min(e0, e1), e2), simd4::splat(0.0f));
+}
+
+} // namespace occlusion_detail
+
+// -----------------------------------------------------------------------------
+// Software occlusion culling. Each frame a few low-poly occluders are
+// rasterized into a small depth buffer (NDC z/w, nearest wins), which is then
+// reduced into a hierarchical-Z pyramid holding the farthest depth of every
+// 2^n x 2^n block. An object is hidden when the nearest point of its bounding
+// box is farther than the pyramid over its screen rectangle.
+//
+// Rasterization is binned: triangles are transformed, near-clipped and set up
+// in parallel jobs that sort them into screen tiles, then the tiles are filled
+// in parallel, so no two threads ever write the same pixel. Within a tile
+// the edge functions and depth are evaluated four pixels at a time.
+// Occluders are drawn two-sided; a closed mesh's back faces are behind its
+// front faces anyway, and this doesn't depend on the asset's winding.
+// -----------------------------------------------------------------------------
+class OcclusionCuller
+{
+public:
+    static constexpr uint32_t kWidth = 256;
+    static constexpr uint32_t kHeight = 128;
+    static constexpr uint32_t kTileWidth = 32; // multiple of 4, quads never straddle tiles
+    static constexpr uint32_t kTileHeight = 16;
+    static constexpr uint32_t kTilesX = kWidth / kTileWidth;
+    static constexpr uint32_t kTilesY = kHeight / kTileHeight;
+    static constexpr uint32_t kNumTiles = kTilesX * kTilesY;
+    static constexpr uint32_t kTrianglesPerJob = 256;
+
+    struct Stats
+    {
+        uint32_t occluders = 0;
+        uint32_t trianglesSubmitted = 0;  // occluder triangles handed to the rasterizer
+        uint32_t trianglesRasterized = 0; // left after near clipping and rejecting off-screen/degenerate ones
+    };
+
+    OcclusionCuller()
+    {
+        m_depth.assign(kWidth * kHeight, FLT_MAX);
+        for (uint32_t width = kWidth / 2, height = kHeight / 2; width >= 1 && height >= 1; width /= 2, height /= 2)
+        {
+            m_hiZ.push_back(std::vector<float>(width * height, FLT_MAX));
+        }
+    }
+
+    // viewProj is a bx view * projection matrix; homogeneousDepth as in bgfx::Caps (near plane at z = -w instead of 0)
+    void beginFrame(const float* viewProj, bool homogeneousDepth)
+    {
+        std::memcpy(m_viewProj, viewProj, sizeof(m_viewProj));
+        m_homogeneousDepth = homogeneousDepth;
+        m_occluders.clear();
+        m_stats = Stats();
+    }
+
+    // The mesh must stay alive until rasterize() returns
+    void addOccluder(const OccluderMesh& mesh, const float* model)
+    {
+        Occluder occluder;
+        occluder.mesh = &mesh;
+        simd4::multiplyMatrix(model, m_viewProj, occluder.modelViewProj);
+        m_occluders.push_back(occluder);
+        ++m_stats.occluders;
+        m_stats.trianglesSubmitted += uint32_t(mesh.indices.size() / 3);
+    }
+
+    void rasterize()
+    {
+        // Jobs of up to kTrianglesPerJob triangles of one occluder. m_jobs only grows, so the bins keep their capacity.
+        size_t numJobs = 0;
+        for (uint32_t o = 0; o < m_occluders.size(); ++o)
+        {
+            const uint32_t numTriangles = uint32_t(m_occluders[o].mesh->indices.size() / 3);
+            for (uint32_t first = 0; first < numTriangles; first += kTrianglesPerJob)
+            {
+                if (numJobs == m_jobs.size())
+                {
+                    m_jobs.emplace_back();
+                }
+                SetupJob& job = m_jobs[numJobs++];
+                job.occluder = o;
+                job.firstTriangle = first;
+                job.numTriangles = std::min(kTrianglesPerJob, numTriangles - first);
+            }
+        }
+
+        parallelFor(numJobs, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t j = begin; j < end; ++j)
+            {
+                setupJob(m_jobs[j]);
+            }
+        });
+
+        parallelFor(kNumTiles, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t tile = begin; tile < end; ++tile)
+            {
+                rasterizeTile(uint32_t(tile), numJobs);
+            }
+        });
+
+        for (size_t j = 0; j < numJobs; ++j)
+        {
+            m_stats.trianglesRasterized += uint32_t(m_jobs[j].triangles.size());
+        }
+
+        buildHiZ();
+    }
+
+    // False when the box is off-screen or behind the occluders. Thread-safe once rasterize() has returned.
+    bool isVisible(const float boundsMin[3], const float boundsMax[3], const float* model, bool* outOffScreen = nullptr) const
+    {
+        float modelViewProj[16];
+        simd4::multiplyMatrix(model, m_viewProj, modelViewProj);
+        if (outOffScreen) *outOffScreen = false;
+
+        float ndcMin[2] = { FLT_MAX, FLT_MAX };
+        float ndcMax[2] = { -FLT_MAX, -FLT_MAX };
+        float nearestDepth = FLT_MAX;
+        uint32_t outsideAll = 0xf; // planes -x, +x, -y, +y that every corner is outside of
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float local[3] =
+            {
+                (corner & 1) ? boundsMax[0] : boundsMin[0],
+                (corner & 2) ? boundsMax[1] : boundsMin[1],
+                (corner & 4) ? boundsMax[2] : boundsMin[2],
+            };
+            float clip[4];
+            simd4::transformPoint(modelViewProj, local, clip);
+
+            // Crossing the near plane: can't be projected, assume visible
+            if (nearDistance(clip) <= 0.0f || clip[3] <= 0.0f)
+            {
+                return true;
+            }
+
+            uint32_t outside = (clip[0] < -clip[3] ? 1u : 0u) | (clip[0] > clip[3] ? 2u : 0u) | (clip[1] < -clip[3] ? 4u : 0u) | (clip[1] > clip[3] ? 8u : 0u);
+            outsideAll &= outside;
+
+            const float invW = 1.0f / clip[3];
+            ndcMin[0] = std::min(ndcMin[0], clip[0] * invW);
+            ndcMax[0] = std::max(ndcMax[0], clip[0] * invW);
+            ndcMin[1] = std::min(ndcMin[1], clip[1] * invW);
+            ndcMax[1] = std::max(ndcMax[1], clip[1] * invW);
+            nearestDepth = std::min(nearestDepth, clip[2] * invW);
+        }
+        // Pixel rectangle, inclusive, rows top-down like the depth buffer
+        const int x0 = std::max(0, int(std::floor((ndcMin[0] * 0.5f + 0.5f) * kWidth)));
+        const int x1 = std::min(int(kWidth) - 1, int(std::floor((ndcMax[0] * 0.5f + 0.5f) * kWidth)));
+        const int y0 = std::max(0, int(std::floor((0.5f - ndcMax[1] * 0.5f) * kHeight)));
+        const int y1 = std::min(int(kHeight) - 1, int(std::floor((0.5f - ndcMin[1] * 0.5f) * kHeight)));
+
+        if (outsideAll != 0 || x0 > x1 || y0 > y1)
+        {
+            if (outOffScreen) *outOffScreen = true;
+            return false;
+        }
+
+        // Coarsest level at which the rectangle still spans only a few texels
+        const int span = std::max(x1 - x0, y1 - y0) + 1;
+        int level = 0;
+        while ((span >> level) > 4 && level < int(m_hiZ.size()))
+        {
+            ++level;
+        }
+
+        const float* depth = level == 0 ? m_depth.data() : m_hiZ[level - 1].data();
+        const int levelWidth = int(kWidth) >> level;
+        float farthest = 0.0f;
+        for (int y = y0 >> level; y <= (y1 >> level); ++y)
+        {
+            for (int x = x0 >> level; x <= (x1 >> level); ++x)
+            {
+                farthest = std::max(farthest, depth[y * levelWidth + x]);
+            }
+        }
+        return nearestDepth <= farthest;
+    }
+
+    const Stats& stats() const { return m_stats; }
+
+    // Row-major kWidth x kHeight, FLT_MAX where no occluder was drawn
+    const float* depthBuffer() const { return m_depth.data(); }
+
+private:
+    struct Occluder
+    {
+        const OccluderMesh* mesh;
+        float modelViewProj[16];
+    };
+
+    // Pixel-center edge functions E(x, y) = a * x + b * y + c, all >= 0 inside; depth is a plane in the same form
+    struct RasterTriangle
+    {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        float depthA, depthB, depthC;
+        uint16_t minX, minY, maxX, maxY; // pixel bounds, inclusive
+    };
+
+    struct SetupJob
+    {
+        uint32_t occluder = 0;
+        uint32_t firstTriangle = 0;
+        uint32_t numTriangles = 0;
+        std::vector<RasterTriangle> triangles;
+        std::vector<uint32_t> bins[kNumTiles]; // indices into triangles
+    };
+
+    float nearDistance(const float* clip) const
+    {
+        return m_homogeneousDepth ? clip[2] + clip[3] : clip[2];
+    }
+
+    void setupJob(SetupJob& job)
+    {
+        job.triangles.clear();
+        for (std::vector<uint32_t>& bin : job.bins)
+        {
+            bin.clear();
+        }
+
+        const Occluder& occluder = m_occluders[job.occluder];
+        const float* positions = occluder.mesh->positions.data();
+        const uint32_t* indices = occluder.mesh->indices.data() + size_t(job.firstTriangle) * 3;
+        for (uint32_t t = 0; t < job.numTriangles; ++t)
+        {
+            float clip[3][4];
+            for (int v = 0; v < 3; ++v)
+            {
+                simd4::transformPoint(occluder.modelViewProj, positions + size_t(indices[t * 3 + v]) * 3, clip[v]);
+            }
+
+            // Trivially outside one side of the frustum
+            bool outside = false;
+            for (int axis = 0; axis < 2 && !outside; ++axis)
+            {
+                outside = (clip[0][axis] < -clip[0][3] && clip[1][axis] < -clip[1][3] && clip[2][axis] < -clip[2][3])
+                       || (clip[0][axis] > clip[0][3] && clip[1][axis] > clip[1][3] && clip[2][axis] > clip[2][3]);
+            }
+            if (outside)
+            {
+                continue;
+            }
+
+            // Clip against the near plane: 3 or 4 vertices, drawn as a fan
+            float polygon[4][4];
+            int numVertices = 0;
+            for (int v = 0; v < 3; ++v)
+            {
+                const float* a = clip[v];
+                const float* b = clip[(v + 1) % 3];
+                const float da = nearDistance(a);
+                const float db = nearDistance(b);
+                if (da >= 0.0f)
+                {
+                    std::memcpy(polygon[numVertices++], a, sizeof(float) * 4);
+                }
+                if ((da >= 0.0f) != (db >= 0.0f))
+                {
+                    const float s = da / (da - db);
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        polygon[numVertices][c] = a[c] + (b[c] - a[c]) * s;
+                    }
+                    ++numVertices;
+                }
+            }
+            for (int v = 2; v < numVertices; ++v)
+            {
+                addTriangle(job, polygon[0], polygon[v - 1], polygon[v]);
+            }
+        }
+    }
+
+    void addTriangle(SetupJob& job, const float* c0, const float* c1, const float* c2)
+    {
+        float x[3], y[3], z[3];
+        const float* clip[3] = { c0, c1, c2 };
+        for (int v = 0; v < 3; ++v)
+        {
+            if (clip[v][3] <= 0.0f)
+            {
+                return;
+            }
+            const float invW = 1.0f / clip[v][3];
+            x[v] = (clip[v][0] * invW * 0.5f + 0.5f) * float(kWidth);
+            y[v] = (0.5f - clip[v][1] * invW * 0.5f) * float(kHeight);
+            z[v] = clip[v][2] * invW;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0.0f)
+        {
+            return;
+        }
+        if (area < 0.0f)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        const float minX = std::min(std::min(x[0], x[1]), x[2]);
+        const float maxX = std::max(std::max(x[0], x[1]), x[2]);
+        const float minY = std::min(std::min(y[0], y[1]), y[2]);
+        const float maxY = std::max(std::max(y[0], y[1]), y[2]);
+        // Pixels whose centers can be inside
+        const int pixelMinX = std::max(0, int(std::ceil(minX - 0.5f)));
+        const int pixelMaxX = std::min(int(kWidth) - 1, int(std::floor(maxX - 0.5f)));
+        const int pixelMinY = std::max(0, int(std::ceil(minY - 0.5f)));
+        const int pixelMaxY = std::min(int(kHeight) - 1, int(std::floor(maxY - 0.5f)));
+        if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+        {
+            return;
+        }
+
+        RasterTriangle triangle;
+        // Edge i is opposite vertex i, so its value over the area is vertex i's barycentric weight
+        for (int e = 0; e < 3; ++e)
+        {
+            const int a = (e + 1) % 3;
+            const int b = (e + 2) % 3;
+            triangle.edgeA[e] = -(y[b] - y[a]);
+            triangle.edgeB[e] = x[b] - x[a];
+            triangle.edgeC[e] = -(triangle.edgeA[e] * x[a] + triangle.edgeB[e] * y[a]);
+        }
+        const float invArea = 1.0f / area;
+        triangle.depthA = (triangle.edgeA[0] * z[0] + triangle.edgeA[1] * z[1] + triangle.edgeA[2] * z[2]) * invArea;
+        triangle.depthB = (triangle.edgeB[0] * z[0] + triangle.edgeB[1] * z[1] + triangle.edgeB[2] * z[2]) * invArea;
+        triangle.depthC = (triangle.edgeC[0] * z[0] + triangle.edgeC[1] * z[1] + triangle.edgeC[2] * z[2]) * invArea;
+        triangle.minX = uint16_t(pixelMinX);
+        triangle.maxX = uint16_t(pixelMaxX);
+        triangle.minY = uint16_t(pixelMinY);
+        triangle.maxY = uint16_t(pixelMaxY);
+
+        const uint32_t index = uint32_t(job.triangles.size());
+        job.triangles.push_back(triangle);
+        for (uint32_t ty = pixelMinY / kTileHeight; ty <= pixelMaxY / kTileHeight; ++ty)
+        {
+            for (uint32_t tx = pixelMinX / kTileWidth; tx <= pixelMaxX / kTileWidth; ++tx)
+            {
+                job.bins[ty * kTilesX + tx].push_back(index);
+            }
+        }
+    }
+
+    void rasterizeTile(uint32_t tile, size_t numJobs)
+    {
+        using namespace simd4;
+        using occlusion_detail::insideMask;
+
+        const uint32_t tileX0 = (tile % kTilesX) * kTileWidth;
+        const uint32_t tileY0 = (tile / kTilesX) * kTileHeight;
+        for (uint32_t y = tileY0; y < tileY0 + kTileHeight; ++y)
+        {
+            std::fill_n(m_depth.data() + y * kWidth + tileX0, kTileWidth, FLT_MAX);
+        }
+
+        static const float kLaneOffsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        const Float4 laneOffsets = load(kLaneOffsets);
+
+        for (size_t j = 0; j < numJobs; ++j)
+        {
+            const SetupJob& job = m_jobs[j];
+            for (uint32_t index : job.bins[tile])
+            {
+                const RasterTriangle& tri = job.triangles[index];
+                const uint32_t xBegin = std::max<uint32_t>(tri.minX, tileX0) & ~3u;
+                const uint32_t xEnd = std::min<uint32_t>(tri.maxX, tileX0 + kTileWidth - 1);
+                const uint32_t yBegin = std::max<uint32_t>(tri.minY, tileY0);
+                const uint32_t yEnd = std::min<uint32_t>(tri.maxY, tileY0 + kTileHeight - 1);
+
+                const Float4 step0 = splat(tri.edgeA[0] * 4.0f);
+                const Float4 step1 = splat(tri.edgeA[1] * 4.0f);
+                const Float4 step2 = splat(tri.edgeA[2] * 4.0f);
+                const Float4 stepZ = splat(tri.depthA * 4.0f);
+                const Float4 lane0 = mul(laneOffsets, splat(tri.edgeA[0]));
+                const Float4 lane1 = mul(laneOffsets, splat(tri.edgeA[1]));
+                const Float4 lane2 = mul(laneOffsets, splat(tri.edgeA[2]));
+                const Float4 laneZ = mul(laneOffsets, splat(tri.depthA));
+
+                for (uint32_t y = yBegin; y <= yEnd; ++y)
+                {
+                    const float px = float(xBegin) + 0.5f;
+                    const float py = float(y) + 0.5f;
+                    Float4 e0 = add(splat(tri.edgeA[0] * px + tri.edgeB[0] * py + tri.edgeC[0]), lane0);
+                    Float4 e1 = add(splat(tri.edgeA[1] * px + tri.edgeB[1] * py + tri.edgeC[1]), lane1);
+                    Float4 e2 = add(splat(tri.edgeA[2] * px + tri.edgeB[2] * py + tri.edgeC[2]), lane2);
+                    Float4 z = add(splat(tri.depthA * px + tri.depthB * py + tri.depthC), laneZ);
+
+                    float* row = m_depth.data() + y * kWidth;
+                    for (uint32_t x = xBegin; x <= xEnd; x += 4)
+                    {
+                        const Float4 inside = insideMask(e0, e1, e2);
+                        if (any(inside))
+                        {
+                            const Float4 old = load(row + x);
+                            store(row + x, select(inside, min(old, z), old));
+                        }
+                        e0 = add(e0, step0);
+                        e1 = add(e1, step1);
+                        e2 = add(e2, step2);
+                        z = add(z, stepZ);
+                    }
+                }
+            }
+        }
+    }
+
+    // Each level keeps the farthest depth of the 2x2 texels below it
+    void buildHiZ()
+    {
+        const float* src = m_depth.data();
+        uint32_t srcWidth = kWidth;
+        for (std::vector<float>& level : m_hiZ)
+        {
+            const uint32_t width = srcWidth / 2;
+            const uint32_t height = uint32_t(level.size()) / width;
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                const float* row0 = src + (y * 2) * srcWidth;
+                const float* row1 = row0 + srcWidth;
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    level[y * width + x] = std::max(std::max(row0[x * 2], row0[x * 2 + 1]), std::max(row1[x * 2], row1[x * 2 + 1]));
+                }
+            }
+            src = level.data();
+            srcWidth = width;
+        }
+    }
+
+    float m_viewProj[16];
+    bool m_homogeneousDepth = false;
+    std::vector<Occluder> m_occluders;
+    std::vector<SetupJob> m_jobs;
+    std::vector<float> m_depth;
+    std::vector<std::vector<float>> m_hiZ; // level 1 (half size) and down, level 0 is m_depth
+    Stats m_stats;
+};
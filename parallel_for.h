@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if !__EMSCRIPTEN__
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif // !__EMSCRIPTEN__
+
+// -----------------------------------------------------------------------------
+// Splits [0, count) into contiguous ranges of at least minGrain items and calls
+// fn(begin, end) for each of them. Native builds spread the ranges over a
+// persistent pool of worker threads (the calling thread helps too). The wasm
+// build is compiled without pthreads, so there everything runs inline.
+// -----------------------------------------------------------------------------
+
+#if !__EMSCRIPTEN__
+
+class ParallelForPool
+{
+public:
+    static ParallelForPool& instance()
+    {
+        static ParallelForPool pool;
+        return pool;
+    }
+
+    size_t numThreads() const { return m_workers.size() + 1; }
+
+    void run(size_t count, size_t minGrain, const std::function<void(size_t, size_t)>& fn)
+    {
+        size_t numChunks = std::min((count + minGrain - 1) / minGrain, numThreads() * 4);
+
+        // Nested calls from inside a job (or a tiny range) just run on this thread
+        if (numChunks <= 1 || t_insideJob)
+        {
+            if (count > 0) fn(0, count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> runLock(m_runMutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &fn;
+            m_count = count;
+            m_chunkSize = (count + numChunks - 1) / numChunks;
+            m_numChunks = (count + m_chunkSize - 1) / m_chunkSize;
+            m_nextChunk = 0;
+            m_workersInJob = m_workers.size();
+            ++m_generation;
+        }
+        m_wakeCv.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait(lock, [this] { return m_workersInJob == 0; });
+        m_job = nullptr;
+    }
+
+private:
+    ParallelForPool()
+    {
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 1; i < hw; ++i)
+        {
+            m_workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ParallelForPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeCv.notify_all();
+        for (std::thread& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void drain()
+    {
+        t_insideJob = true;
+        for (;;)
+        {
+            size_t chunk = m_nextChunk.fetch_add(1);
+            if (chunk >= m_numChunks) break;
+            size_t begin = chunk * m_chunkSize;
+            size_t end = std::min(m_count, begin + m_chunkSize);
+            (*m_job)(begin, end);
+        }
+        t_insideJob = false;
+    }
+
+    void workerLoop()
+    {
+        uint64_t seenGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeCv.wait(lock, [&] { return m_quit || m_generation != seenGeneration; });
+                if (m_quit) return;
+                seenGeneration = m_generation;
+            }
+
+            drain();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_workersInJob == 0)
+            {
+                m_doneCv.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_runMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCv;
+    std::condition_variable m_doneCv;
+
+    const std::function<void(size_t, size_t)>* m_job = nullptr;
+    size_t m_count = 0;
+    size_t m_chunkSize = 0;
+    size_t m_numChunks = 0;
+    std::atomic<size_t> m_nextChunk{0};
+    size_t m_workersInJob = 0;
+    uint64_t m_generation = 0;
+    bool m_quit = false;
+
+    static inline thread_local bool t_insideJob = false;
+};
+
+// -----------------------------------------------------------------------------
+// A few threads running queued jobs in the background, for work the frame loop
+// hands off and doesn't wait for (parallelFor only does fork-join). Native
+// only, like the pool. The caller bounds the backlog with waitForBacklog().
+// -----------------------------------------------------------------------------
+class BackgroundJobQueue
+{
+public:
+    explicit BackgroundJobQueue(uint32_t numThreads)
+    {
+        for (uint32_t i = 0; i < std::max(numThreads, 1u); ++i)
+        {
+            m_threads.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~BackgroundJobQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeCv.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    size_t numThreads() const { return m_threads.size(); }
+
+    void push(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+            ++m_unfinished;
+        }
+        m_wakeCv.notify_one();
+    }
+
+    // Blocks until at most maxUnfinished jobs are queued or running
+    void waitForBacklog(size_t maxUnfinished)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait(lock, [&] { return m_unfinished <= maxUnfinished; });
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeCv.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_unfinished;
+            }
+            m_doneCv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCv;
+    std::condition_variable m_doneCv;
+    std::deque<std::function<void()>> m_jobs;
+    size_t m_unfinished = 0;
+    bool m_quit = false;
+};
+
+#endif // !__EMSCRIPTEN__
+
+template <typename Fn>
+inline void parallelFor(size_t count, size_t minGrain, Fn&& fn)
+{
+#if __EMSCRIPTEN__
+    (void)minGrain;
+    if (count > 0) fn(size_t(0), count);
+#else // Linux/X11
+    ParallelForPool::instance().run(count, std::max<size_t>(minGrain, 1), std::function<void(size_t, size_t)>(std::forward<Fn>(fn)));
+#endif // __EMSCRIPTEN__
+}
+
+inline size_t parallelForNumThreads()
+{
+#if __EMSCRIPTEN__
+    return 1;
+#else // Linux/X11
+    return ParallelForPool::instance().numThreads();
+#endif // __EMSCRIPTEN__
+}
@@ -0,0 +1,675 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "chunk_streaming.h"
+
+// -----------------------------------------------------------------------------
+// Out-of-core chunking of PLY meshes (what scans usually come as), for meshes
+// that don't fit in memory to import. Nothing holds the whole mesh:
+//   1. the vertices are streamed into a MyFancyVertex scratch file next to the
+//      output, which is then mapped so the OS pages it in and out
+//   2. the faces are streamed, fan triangulated and appended to one of at most
+//      kPlyMaxPartitions partition files, by the grid cell of their centroid.
+//      Face normals are accumulated into the mapped vertices when the file has
+//      no normals
+//   3. each partition is read back and split into chunks as writeChunkedMesh
+//      does, gathering its vertices from the mapping
+// Memory is one partition's triangles plus what the OS keeps of the mapping.
+// Like the assimp path (kAssetImportFlags' ConvertToLeftHanded), z is flipped
+// to left-handed and v to 1 - v.
+// Native only: the browser build has no file to map.
+// -----------------------------------------------------------------------------
+static constexpr uint32_t kPlyMaxPartitions = 256;
+// Partitions are sized for this many chunks each, so the split inside one stays cheap
+static constexpr uint32_t kPlyChunksPerPartition = 16;
+
+namespace ply_detail
+{
+
+enum class Type : uint8_t { Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64, None };
+
+inline Type parseType(const char* name)
+{
+    static const struct { const char* name; Type type; } kTypes[] =
+    {
+        { "char", Type::Int8 },    { "int8", Type::Int8 },
+        { "uchar", Type::Uint8 },  { "uint8", Type::Uint8 },
+        { "short", Type::Int16 },  { "int16", Type::Int16 },
+        { "ushort", Type::Uint16 },{ "uint16", Type::Uint16 },
+        { "int", Type::Int32 },    { "int32", Type::Int32 },
+        { "uint", Type::Uint32 },  { "uint32", Type::Uint32 },
+        { "float", Type::Float32 },{ "float32", Type::Float32 },
+        { "double", Type::Float64 },{ "float64", Type::Float64 },
+    };
+    for (const auto& entry : kTypes)
+    {
+        if (std::strcmp(name, entry.name) == 0) return entry.type;
+    }
+    return Type::None;
+}
+
+inline uint32_t typeSize(Type type)
+{
+    static const uint32_t kSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+    return kSizes[uint32_t(type)];
+}
+
+struct Property
+{
+    std::string name;
+    Type type = Type::None;
+    Type countType = Type::None; // set for list properties
+};
+
+struct Element
+{
+    std::string name;
+    uint64_t count = 0;
+    std::vector<Property> properties;
+
+    int find(const char* const* names) const
+    {
+        for (; *names; ++names)
+        {
+            for (size_t p = 0; p < properties.size(); ++p)
+            {
+                if (properties[p].countType == Type::None && properties[p].name == *names) return int(p);
+            }
+        }
+        return -1;
+    }
+};
+
+// Reads a PLY header, then the body value by value through its own buffer
+class Reader
+{
+public:
+    ~Reader()
+    {
+        if (m_file)
+        {
+            std::fclose(m_file);
+        }
+    }
+
+    bool open(const char* path)
+    {
+        m_file = std::fopen(path, "rb");
+        if (!m_file)
+        {
+            std::cerr << "[PlyReader] Could not open " << path << ".\n";
+            return false;
+        }
+
+        char line[4096];
+        if (!std::fgets(line, sizeof(line), m_file) || std::strncmp(line, "ply", 3) != 0)
+        {
+            std::cerr << "[PlyReader] " << path << " is not a PLY file.\n";
+            return false;
+        }
+        bool haveFormat = false;
+        while (std::fgets(line, sizeof(line), m_file))
+        {
+            char word[4][256] = {};
+            const int numWords = std::sscanf(line, "%255s %255s %255s %255s", word[0], word[1], word[2], word[3]);
+            if (numWords < 1 || std::strcmp(word[0], "comment") == 0 || std::strcmp(word[0], "obj_info") == 0)
+            {
+                continue;
+            }
+            if (std::strcmp(word[0], "end_header") == 0)
+            {
+                if (!haveFormat)
+                {
+                    std::cerr << "[PlyReader] " << path << " has no format line.\n";
+                    return false;
+                }
+                return true;
+            }
+            if (std::strcmp(word[0], "format") == 0 && numWords >= 2)
+            {
+                if (std::strcmp(word[1], "ascii") == 0) m_format = Format::Ascii;
+                else if (std::strcmp(word[1], "binary_little_endian") == 0) m_format = Format::LittleEndian;
+                else if (std::strcmp(word[1], "binary_big_endian") == 0) m_format = Format::BigEndian;
+                else
+                {
+                    std::cerr << "[PlyReader] Unknown format " << word[1] << " in " << path << ".\n";
+                    return false;
+                }
+                haveFormat = true;
+            }
+            else if (std::strcmp(word[0], "element") == 0 && numWords >= 3)
+            {
+                Element element;
+                element.name = word[1];
+                element.count = std::strtoull(word[2], nullptr, 10);
+                m_elements.push_back(element);
+            }
+            else if (std::strcmp(word[0], "property") == 0 && numWords >= 3 && !m_elements.empty())
+            {
+                Property property;
+                if (std::strcmp(word[1], "list") == 0 && numWords >= 4)
+                {
+                    char name[256] = {};
+                    std::sscanf(line, "%*s %*s %*s %*s %255s", name);
+                    property.countType = parseType(word[2]);
+                    property.type = parseType(word[3]);
+                    property.name = name;
+                    if (property.countType == Type::None || property.type == Type::None)
+                    {
+                        std::cerr << "[PlyReader] Unknown list type in " << path << ": " << line;
+                        return false;
+                    }
+                }
+                else
+                {
+                    property.type = parseType(word[1]);
+                    property.name = word[2];
+                    if (property.type == Type::None)
+                    {
+                        std::cerr << "[PlyReader] Unknown property type " << word[1] << " in " << path << ".\n";
+                        return false;
+                    }
+                }
+                m_elements.back().properties.push_back(property);
+            }
+        }
+        std::cerr << "[PlyReader] " << path << " has no end_header.\n";
+        return false;
+    }
+
+    const std::vector<Element>& elements() const { return m_elements; }
+
+    bool read(Type type, double& out)
+    {
+        return m_format == Format::Ascii ? readAscii(out) : readBinary(type, out);
+    }
+
+    // Reads one element's values into `values` (one per property, a list's count for list properties)
+    // and a list property's items into `list`
+    bool readElement(const Element& element, double* values, int listProperty, std::vector<uint32_t>& list)
+    {
+        list.clear();
+        for (size_t p = 0; p < element.properties.size(); ++p)
+        {
+            const Property& property = element.properties[p];
+            if (property.countType == Type::None)
+            {
+                if (!read(property.type, values[p])) return false;
+                continue;
+            }
+
+            double count = 0.0;
+            if (!read(property.countType, count) || count < 0.0) return false;
+            for (uint32_t i = 0; i < uint32_t(count); ++i)
+            {
+                double item = 0.0;
+                if (!read(property.type, item)) return false;
+                if (int(p) == listProperty) list.push_back(item < 0.0 ? UINT32_MAX : uint32_t(item));
+            }
+            values[p] = count;
+        }
+        return true;
+    }
+
+private:
+    enum class Format { Ascii, LittleEndian, BigEndian };
+
+    bool fill()
+    {
+        if (m_pos < m_end) return true;
+        m_end = std::fread(m_buffer, 1, sizeof(m_buffer), m_file);
+        m_pos = 0;
+        return m_end > 0;
+    }
+
+    bool readBinary(Type type, double& out)
+    {
+        uint8_t bytes[8];
+        const uint32_t size = typeSize(type);
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            if (!fill()) return false;
+            bytes[i] = m_buffer[m_pos++];
+        }
+        const uint16_t probe = 1;
+        const bool littleEndianHost = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+        if ((m_format == Format::LittleEndian) != littleEndianHost)
+        {
+            std::reverse(bytes, bytes + size);
+        }
+
+        switch (type)
+        {
+        case Type::Int8:    { int8_t v;   std::memcpy(&v, bytes, 1); out = v; break; }
+        case Type::Uint8:   { uint8_t v;  std::memcpy(&v, bytes, 1); out = v; break; }
+        case Type::Int16:   { int16_t v;  std::memcpy(&v, bytes, 2); out = v; break; }
+        case Type::Uint16:  { uint16_t v; std::memcpy(&v, bytes, 2); out = v; break; }
+        case Type::Int32:   { int32_t v;  std::memcpy(&v, bytes, 4); out = v; break; }
+        case Type::Uint32:  { uint32_t v; std::memcpy(&v, bytes, 4); out = v; break; }
+        case Type::Float32: { float v;    std::memcpy(&v, bytes, 4); out = v; break; }
+        case Type::Float64: { double v;   std::memcpy(&v, bytes, 8); out = v; break; }
+        default: return false;
+        }
+        return true;
+    }
+
+    bool readAscii(double& out)
+    {
+        while (fill() && std::isspace(m_buffer[m_pos]))
+        {
+            ++m_pos;
+        }
+        char token[64];
+        size_t length = 0;
+        while (fill() && !std::isspace(m_buffer[m_pos]) && length + 1 < sizeof(token))
+        {
+            token[length++] = char(m_buffer[m_pos++]);
+        }
+        if (length == 0) return false;
+        token[length] = '\0';
+        char* tokenEnd = nullptr;
+        out = std::strtod(token, &tokenEnd);
+        return tokenEnd == token + length;
+    }
+
+    FILE* m_file = nullptr;
+    Format m_format = Format::Ascii;
+    std::vector<Element> m_elements;
+    uint8_t m_buffer[1 << 20];
+    size_t m_pos = 0;
+    size_t m_end = 0;
+};
+
+// A scratch file that's removed again when this goes away
+struct ScratchFile
+{
+    std::string path;
+    FILE* file = nullptr;
+
+    ~ScratchFile()
+    {
+        if (file)
+        {
+            std::fclose(file);
+            std::remove(path.c_str());
+        }
+    }
+
+    bool open(const std::string& scratchPath)
+    {
+        path = scratchPath;
+        file = std::fopen(path.c_str(), "w+b");
+        if (!file)
+        {
+            std::cerr << "[writeChunkedMeshFromPly] Could not create " << path << ".\n";
+        }
+        return file != nullptr;
+    }
+};
+
+// The mapped vertex scratch file
+struct VertexMapping
+{
+    MyFancyVertex* vertices = nullptr;
+    size_t bytes = 0;
+
+    ~VertexMapping()
+    {
+        if (vertices)
+        {
+            munmap(vertices, bytes);
+        }
+    }
+};
+
+// Tangent orthogonal to n, for meshes that come without UVs to derive one from
+inline void fillTangent(MyFancyVertex& vertex)
+{
+    const float ax = std::fabs(vertex.nx) < 0.9f ? 1.0f : 0.0f;
+    const float ay = 1.0f - ax;
+    // t = normalize(a - n * dot(a, n))
+    const float d = ax * vertex.nx + ay * vertex.ny;
+    float tx = ax - vertex.nx * d;
+    float ty = ay - vertex.ny * d;
+    float tz = -vertex.nz * d;
+    const float length = std::sqrt(tx * tx + ty * ty + tz * tz);
+    vertex.tx = tx / length;
+    vertex.ty = ty / length;
+    vertex.tz = tz / length;
+    vertex.tw = 1.0f;
+}
+
+} // namespace ply_detail
+
+struct PlyChunkStats
+{
+    uint64_t numVertices = 0;
+    uint32_t numPartitions = 0;
+    uint64_t largestPartition = 0; // triangles, which bounds the memory the chunking needs
+};
+
+// Chunks a PLY mesh of any size into `path` (see above). Scratch files are written next to `path`.
+inline bool writeChunkedMeshFromPly(const char* plyPath, const char* path, uint32_t maxTriangles, ChunkWriteStats* outStats = nullptr, PlyChunkStats* outPlyStats = nullptr)
+{
+    using namespace ply_detail;
+    maxTriangles = std::clamp(maxTriangles, 1u, kMaxChunkTriangles);
+
+    std::unique_ptr<Reader> reader(new Reader());
+    if (!reader->open(plyPath))
+    {
+        return false;
+    }
+    const std::vector<Element>& elements = reader->elements();
+    size_t vertexElement = elements.size();
+    size_t faceElement = elements.size();
+    for (size_t e = 0; e < elements.size(); ++e)
+    {
+        if (elements[e].name == "vertex" && vertexElement == elements.size()) vertexElement = e;
+        if (elements[e].name == "face" && faceElement == elements.size()) faceElement = e;
+    }
+    if (vertexElement == elements.size() || faceElement == elements.size() || faceElement < vertexElement)
+    {
+        std::cerr << "[writeChunkedMeshFromPly] " << plyPath << " needs vertex then face elements.\n";
+        return false;
+    }
+
+    const Element& vertexDesc = elements[vertexElement];
+    const Element& faceDesc = elements[faceElement];
+    static const char* const kX[] = { "x", nullptr };
+    static const char* const kY[] = { "y", nullptr };
+    static const char* const kZ[] = { "z", nullptr };
+    static const char* const kNx[] = { "nx", nullptr };
+    static const char* const kNy[] = { "ny", nullptr };
+    static const char* const kNz[] = { "nz", nullptr };
+    static const char* const kU[] = { "u", "s", "texture_u", "texture_s", nullptr };
+    static const char* const kV[] = { "v", "t", "texture_v", "texture_t", nullptr };
+    const int x = vertexDesc.find(kX), y = vertexDesc.find(kY), z = vertexDesc.find(kZ);
+    const int nx = vertexDesc.find(kNx), ny = vertexDesc.find(kNy), nz = vertexDesc.find(kNz);
+    const int u = vertexDesc.find(kU), v = vertexDesc.find(kV);
+    const bool hasNormals = nx >= 0 && ny >= 0 && nz >= 0;
+    int indexList = -1;
+    for (size_t p = 0; p < faceDesc.properties.size(); ++p)
+    {
+        const Property& property = faceDesc.properties[p];
+        if (property.countType != Type::None && (property.name == "vertex_indices" || property.name == "vertex_index")) indexList = int(p);
+    }
+    if (x < 0 || y < 0 || z < 0 || indexList < 0 || vertexDesc.count == 0 || vertexDesc.count >= UINT32_MAX)
+    {
+        std::cerr << "[writeChunkedMeshFromPly] " << plyPath << " has no x/y/z vertices or vertex_indices faces (or over 4G vertices).\n";
+        return false;
+    }
+
+    // Elements before the vertices are skipped
+    std::vector<double> values;
+    std::vector<uint32_t> list;
+    for (size_t e = 0; e < vertexElement; ++e)
+    {
+        values.resize(elements[e].properties.size());
+        for (uint64_t i = 0; i < elements[e].count; ++i)
+        {
+            if (!reader->readElement(elements[e], values.data(), -1, list)) return false;
+        }
+    }
+
+    // 1. Vertices into the scratch file
+    const std::string outputPath = path;
+    ScratchFile vertexFile;
+    if (!vertexFile.open(outputPath + ".vertices.tmp"))
+    {
+        return false;
+    }
+    float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    std::vector<MyFancyVertex> batch;
+    batch.reserve(64 * 1024);
+    values.assign(vertexDesc.properties.size(), 0.0);
+    for (uint64_t i = 0; i < vertexDesc.count; ++i)
+    {
+        if (!reader->readElement(vertexDesc, values.data(), -1, list))
+        {
+            std::cerr << "[writeChunkedMeshFromPly] " << plyPath << " ends in vertex " << i << ".\n";
+            return false;
+        }
+        MyFancyVertex vertex = {};
+        vertex.px = float(values[x]);
+        vertex.py = float(values[y]);
+        vertex.pz = -float(values[z]);
+        if (hasNormals)
+        {
+            vertex.nx = float(values[nx]);
+            vertex.ny = float(values[ny]);
+            vertex.nz = -float(values[nz]);
+        }
+        vertex.u = u >= 0 ? float(values[u]) : 0.0f;
+        vertex.v = v >= 0 ? 1.0f - float(values[v]) : 0.0f;
+        const float position[3] = { vertex.px, vertex.py, vertex.pz };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], position[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], position[axis]);
+        }
+        batch.push_back(vertex);
+        if (batch.size() == batch.capacity() || i + 1 == vertexDesc.count)
+        {
+            if (std::fwrite(batch.data(), sizeof(MyFancyVertex), batch.size(), vertexFile.file) != batch.size())
+            {
+                std::cerr << "[writeChunkedMeshFromPly] Could not write " << vertexFile.path << ".\n";
+                return false;
+            }
+            batch.clear();
+        }
+    }
+    const uint32_t numVertices = uint32_t(vertexDesc.count);
+    if (std::fflush(vertexFile.file) != 0)
+    {
+        return false;
+    }
+    VertexMapping mapping;
+    mapping.bytes = size_t(numVertices) * sizeof(MyFancyVertex);
+    void* mapped = mmap(nullptr, mapping.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(vertexFile.file), 0);
+    if (mapped == MAP_FAILED)
+    {
+        std::cerr << "[writeChunkedMeshFromPly] Could not map " << vertexFile.path << ".\n";
+        return false;
+    }
+    mapping.vertices = static_cast<MyFancyVertex*>(mapped);
+    MyFancyVertex* vertices = mapping.vertices;
+
+    for (size_t e = vertexElement + 1; e < faceElement; ++e)
+    {
+        values.resize(elements[e].properties.size());
+        for (uint64_t i = 0; i < elements[e].count; ++i)
+        {
+            if (!reader->readElement(elements[e], values.data(), -1, list)) return false;
+        }
+    }
+
+    // 2. Faces into grid partitions by centroid. The grid is refined along its longest cells until it
+    // has enough partitions for the face count (quads and bigger polygons only make partitions bigger).
+    const uint64_t wantedPartitions = faceDesc.count / (uint64_t(maxTriangles) * kPlyChunksPerPartition) + 1;
+    uint32_t grid[3] = { 1, 1, 1 };
+    while (uint64_t(grid[0]) * grid[1] * grid[2] * 2 <= std::min<uint64_t>(wantedPartitions, kPlyMaxPartitions))
+    {
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+        {
+            if ((boundsMax[a] - boundsMin[a]) / float(grid[a]) > (boundsMax[axis] - boundsMin[axis]) / float(grid[axis])) axis = a;
+        }
+        grid[axis] *= 2;
+    }
+    const uint32_t numPartitions = grid[0] * grid[1] * grid[2];
+    std::vector<std::unique_ptr<ScratchFile>> partitions(numPartitions);
+    std::vector<uint64_t> partitionTriangles(numPartitions, 0);
+    for (uint32_t p = 0; p < numPartitions; ++p)
+    {
+        partitions[p].reset(new ScratchFile());
+        if (!partitions[p]->open(outputPath + ".part" + std::to_string(p) + ".tmp"))
+        {
+            return false;
+        }
+    }
+
+    values.assign(faceDesc.properties.size(), 0.0);
+    for (uint64_t f = 0; f < faceDesc.count; ++f)
+    {
+        if (!reader->readElement(faceDesc, values.data(), indexList, list))
+        {
+            std::cerr << "[writeChunkedMeshFromPly] " << plyPath << " ends in face " << f << ".\n";
+            return false;
+        }
+        for (size_t corner = 2; corner < list.size(); ++corner)
+        {
+            // Winding reversed along with z
+            const uint32_t triangle[3] = { list[0], list[corner], list[corner - 1] };
+            if (triangle[0] >= numVertices || triangle[1] >= numVertices || triangle[2] >= numVertices)
+            {
+                std::cerr << "[writeChunkedMeshFromPly] Face " << f << " of " << plyPath << " indexes past the vertices.\n";
+                return false;
+            }
+            const MyFancyVertex& a = vertices[triangle[0]];
+            const MyFancyVertex& b = vertices[triangle[1]];
+            const MyFancyVertex& c = vertices[triangle[2]];
+            const float centroid[3] = { (a.px + b.px + c.px) / 3.0f, (a.py + b.py + c.py) / 3.0f, (a.pz + b.pz + c.pz) / 3.0f };
+            uint32_t partition = 0;
+            for (int axis = 2; axis >= 0; --axis)
+            {
+                const float extent = boundsMax[axis] - boundsMin[axis];
+                const float cell = extent > 0.0f ? (centroid[axis] - boundsMin[axis]) / extent * float(grid[axis]) : 0.0f;
+                partition = partition * grid[axis] + std::min(uint32_t(std::max(cell, 0.0f)), grid[axis] - 1);
+            }
+            if (std::fwrite(triangle, sizeof(triangle), 1, partitions[partition]->file) != 1)
+            {
+                std::cerr << "[writeChunkedMeshFromPly] Could not write " << partitions[partition]->path << ".\n";
+                return false;
+            }
+            ++partitionTriangles[partition];
+
+            if (!hasNormals)
+            {
+                // Area weighted face normal
+                const float e1[3] = { b.px - a.px, b.py - a.py, b.pz - a.pz };
+                const float e2[3] = { c.px - a.px, c.py - a.py, c.pz - a.pz };
+                const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                for (uint32_t vertex : triangle)
+                {
+                    vertices[vertex].nx += n[0];
+                    vertices[vertex].ny += n[1];
+                    vertices[vertex].nz += n[2];
+                }
+            }
+        }
+    }
+    reader.reset();
+
+    // 3. Chunks, partition by partition
+    ChunkFileWriter writer;
+    if (!writer.open(path))
+    {
+        return false;
+    }
+    ChunkVertexMap vertexMap;
+    std::vector<uint32_t> chunkVertexIds;
+    std::vector<uint32_t> partitionIndices;
+    std::vector<float> centroids;
+    std::vector<uint32_t> triangles;
+    uint64_t largestPartition = 0;
+    for (uint32_t p = 0; p < numPartitions; ++p)
+    {
+        const uint64_t numTriangles = partitionTriangles[p];
+        if (numTriangles == 0)
+        {
+            continue;
+        }
+        largestPartition = std::max(largestPartition, numTriangles);
+        partitionIndices.resize(numTriangles * 3);
+        std::rewind(partitions[p]->file);
+        if (std::fread(partitionIndices.data(), sizeof(uint32_t) * 3, numTriangles, partitions[p]->file) != numTriangles)
+        {
+            std::cerr << "[writeChunkedMeshFromPly] Could not read " << partitions[p]->path << ".\n";
+            return false;
+        }
+        partitions[p].reset();
+
+        triangles.resize(numTriangles);
+        centroids.resize(numTriangles * 3);
+        parallelFor(numTriangles, 64 * 1024, [&](size_t begin, size_t end)
+        {
+            for (size_t t = begin; t < end; ++t)
+            {
+                triangles[t] = uint32_t(t);
+                const MyFancyVertex& a = vertices[partitionIndices[t * 3 + 0]];
+                const MyFancyVertex& b = vertices[partitionIndices[t * 3 + 1]];
+                const MyFancyVertex& c = vertices[partitionIndices[t * 3 + 2]];
+                centroids[t * 3 + 0] = (a.px + b.px + c.px) * (1.0f / 3.0f);
+                centroids[t * 3 + 1] = (a.py + b.py + c.py) * (1.0f / 3.0f);
+                centroids[t * 3 + 2] = (a.pz + b.pz + c.pz) * (1.0f / 3.0f);
+            }
+        });
+
+        const bool ok = splitTrianglesByCentroid(triangles, centroids.data(), maxTriangles, [&](size_t begin, size_t end)
+        {
+            chunkVertexIds.clear();
+            vertexMap.clear();
+            const uint32_t numIndices = uint32_t(end - begin) * 3;
+            std::vector<uint16_t> localIndices(numIndices);
+            for (size_t t = begin; t < end; ++t)
+            {
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    localIndices[(t - begin) * 3 + corner] = vertexMap.localIndex(partitionIndices[size_t(triangles[t]) * 3 + corner], chunkVertexIds);
+                }
+            }
+
+            MyFancyVertex* chunkVertices = writer.beginChunk(uint32_t(chunkVertexIds.size()), numIndices);
+            for (size_t i = 0; i < chunkVertexIds.size(); ++i)
+            {
+                MyFancyVertex vertex = vertices[chunkVertexIds[i]];
+                const float length = std::sqrt(vertex.nx * vertex.nx + vertex.ny * vertex.ny + vertex.nz * vertex.nz);
+                if (length > 0.0f)
+                {
+                    vertex.nx /= length;
+                    vertex.ny /= length;
+                    vertex.nz /= length;
+                }
+                else
+                {
+                    vertex.nx = 0.0f;
+                    vertex.ny = 1.0f;
+                    vertex.nz = 0.0f;
+                }
+                fillTangent(vertex);
+                chunkVertices[i] = vertex;
+            }
+            std::memcpy(writer.chunkIndices(), localIndices.data(), numIndices * sizeof(uint16_t));
+            return writer.endChunk();
+        });
+        if (!ok)
+        {
+            break;
+        }
+    }
+
+    if (outPlyStats)
+    {
+        outPlyStats->numVertices = numVertices;
+        outPlyStats->numPartitions = numPartitions;
+        outPlyStats->largestPartition = largestPartition;
+    }
+    return writer.finish(outStats);
+}
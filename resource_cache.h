@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+// -----------------------------------------------------------------------------
+// 64-bit content hash (XXH64-style: four independent multiply-rotate lanes over
+// 32-byte stripes, then an avalanche). Used to key GPU resources by what they
+// contain rather than by where they came from.
+// -----------------------------------------------------------------------------
+namespace resource_hash_detail
+{
+
+static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t read32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t lane)
+{
+    acc ^= round(0, lane);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace resource_hash_detail
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    using namespace resource_hash_detail;
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        do
+        {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else
+    {
+        h = seed + kPrime5;
+    }
+
+    h += uint64_t(size);
+
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (end - p >= 4)
+    {
+        h ^= uint64_t(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        h ^= (*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t hashString(std::string_view str, uint64_t seed = 0)
+{
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+// Seeds that keep the kinds of content a resource can be keyed by apart, so equal bytes of different
+// kinds (four BGRA texels and a 4-byte file, say) never share a key
+inline constexpr uint64_t kContentEncodedImage = 0x656e636f64656431ull; // PNG/JPG/... from a file, an embedded texture or a data URI
+inline constexpr uint64_t kContentTextureFile  = 0x746578747572ull;     // KTX/DDS containers bgfx loads as they are
+inline constexpr uint64_t kContentPixels       = 0x706978656c73ull;     // BGRA8 texels, keyed together with their size
+inline constexpr uint64_t kContentShader       = 0x736861646572ull;     // compiled shader binaries
+
+inline uint64_t pixelsContentKey(const uint8_t* bgra, uint16_t width, uint16_t height)
+{
+    const uint16_t size[2] = { width, height };
+    return hashBytes(bgra, size_t(width) * height * 4, hashBytes(size, sizeof(size), kContentPixels));
+}
+
+// -----------------------------------------------------------------------------
+// Registry of GPU resources keyed by content. Each unique texture/shader is
+// created once; repeated requests hand out the same handle and bump its
+// refcount, and the bgfx resource is destroyed when the last reference is
+// released. File-backed resources can also be looked up by canonical path so a
+// repeated reference doesn't even have to re-read and re-hash the file.
+// -----------------------------------------------------------------------------
+class ResourceCache
+{
+public:
+    struct Stats
+    {
+        uint32_t textureRequests = 0;
+        uint32_t textureHits     = 0;
+        uint32_t shaderRequests  = 0;
+        uint32_t shaderHits      = 0;
+        uint32_t programRequests = 0;
+        uint32_t programHits     = 0;
+        uint64_t textureBytesSaved = 0; // GPU memory not spent on duplicate textures
+    };
+
+    // Returns the texture for `contentKey`, calling create(outGpuBytes) only if it isn't cached yet.
+    // Invalid handles aren't cached.
+    template <typename CreateFn>
+    bgfx::TextureHandle acquireTexture(uint64_t contentKey, CreateFn&& create)
+    {
+        ++m_stats.textureRequests;
+        auto it = m_textures.find(contentKey);
+        if (it != m_textures.end())
+        {
+            ++m_stats.textureHits;
+            ++it->second.refCount;
+            m_stats.textureBytesSaved += it->second.gpuBytes;
+            return it->second.handle;
+        }
+
+        uint32_t gpuBytes = 0;
+        bgfx::TextureHandle handle = create(gpuBytes);
+        if (bgfx::isValid(handle))
+        {
+            m_textures[contentKey] = TextureEntry{ handle, 1, gpuBytes };
+            m_textureKeys[handle.idx] = contentKey;
+        }
+        else
+        {
+            forgetPathKeys(contentKey);
+        }
+        return handle;
+    }
+
+    template <typename CreateFn>
+    bgfx::ShaderHandle acquireShader(uint64_t contentKey, CreateFn&& create)
+    {
+        ++m_stats.shaderRequests;
+        auto it = m_shaders.find(contentKey);
+        if (it != m_shaders.end())
+        {
+            ++m_stats.shaderHits;
+            ++it->second.refCount;
+            return it->second.handle;
+        }
+
+        bgfx::ShaderHandle handle = create();
+        if (bgfx::isValid(handle))
+        {
+            m_shaders[contentKey] = ShaderEntry{ handle, 1 };
+            m_shaderKeys[handle.idx] = contentKey;
+        }
+        else
+        {
+            forgetPathKeys(contentKey);
+        }
+        return handle;
+    }
+
+    // Takes over the caller's references to vsh/fsh: they're released again if the program already exists or can't be created
+    bgfx::ProgramHandle acquireProgram(bgfx::ShaderHandle vsh, bgfx::ShaderHandle fsh)
+    {
+        ++m_stats.programRequests;
+        if (!bgfx::isValid(vsh) || !bgfx::isValid(fsh))
+        {
+            release(vsh);
+            release(fsh);
+            return BGFX_INVALID_HANDLE;
+        }
+
+        uint64_t key = (uint64_t(vsh.idx) << 16) | fsh.idx;
+        auto it = m_programs.find(key);
+        if (it != m_programs.end())
+        {
+            ++m_stats.programHits;
+            ++it->second.refCount;
+            release(vsh);
+            release(fsh);
+            return it->second.handle;
+        }
+
+        // The shaders are shared through the cache, so the program must not destroy them
+        bgfx::ProgramHandle handle = bgfx::createProgram(vsh, fsh, false);
+        if (!bgfx::isValid(handle))
+        {
+            release(vsh);
+            release(fsh);
+            return handle;
+        }
+        m_programs[key] = ProgramEntry{ handle, 1, vsh, fsh };
+        m_programKeys[handle.idx] = key;
+        return handle;
+    }
+
+    // Path -> content key within one content kind (kContent*), for skipping the read+hash of something already seen.
+    // The path is forgotten again together with the resource it leads to.
+    bool findPathKey(const std::string& canonicalPath, uint64_t contentKind, uint64_t& outContentKey) const
+    {
+        auto it = m_pathKeys.find(pathKeyName(canonicalPath, contentKind));
+        if (it == m_pathKeys.end()) return false;
+        outContentKey = it->second;
+        return true;
+    }
+
+    void rememberPathKey(const std::string& canonicalPath, uint64_t contentKind, uint64_t contentKey)
+    {
+        auto inserted = m_pathKeys.emplace(pathKeyName(canonicalPath, contentKind), contentKey);
+        if (inserted.second)
+        {
+            m_contentPaths[contentKey].push_back(inserted.first->first);
+        }
+    }
+
+    // Adds a reference to an already acquired texture (e.g. when copying it into a second material)
+    void addRef(bgfx::TextureHandle handle)
+    {
+        auto keyIt = m_textureKeys.find(handle.idx);
+        if (keyIt != m_textureKeys.end()) ++m_textures[keyIt->second].refCount;
+    }
+
+    void release(bgfx::TextureHandle handle)
+    {
+        auto keyIt = m_textureKeys.find(handle.idx);
+        if (!bgfx::isValid(handle) || keyIt == m_textureKeys.end()) return;
+
+        auto it = m_textures.find(keyIt->second);
+        if (--it->second.refCount == 0)
+        {
+            bgfx::destroy(it->second.handle);
+            forgetPathKeys(it->first);
+            m_textures.erase(it);
+            m_textureKeys.erase(keyIt);
+        }
+    }
+
+    void release(bgfx::ShaderHandle handle)
+    {
+        auto keyIt = m_shaderKeys.find(handle.idx);
+        if (!bgfx::isValid(handle) || keyIt == m_shaderKeys.end()) return;
+
+        auto it = m_shaders.find(keyIt->second);
+        if (--it->second.refCount == 0)
+        {
+            bgfx::destroy(it->second.handle);
+            forgetPathKeys(it->first);
+            m_shaders.erase(it);
+            m_shaderKeys.erase(keyIt);
+        }
+    }
+
+    void release(bgfx::ProgramHandle handle)
+    {
+        auto keyIt = m_programKeys.find(handle.idx);
+        if (!bgfx::isValid(handle) || keyIt == m_programKeys.end()) return;
+
+        auto it = m_programs.find(keyIt->second);
+        if (--it->second.refCount == 0)
+        {
+            bgfx::destroy(it->second.handle);
+            release(it->second.vsh);
+            release(it->second.fsh);
+            m_programs.erase(it);
+            m_programKeys.erase(keyIt);
+        }
+    }
+
+    // Destroys whatever is still referenced, call before bgfx::shutdown()
+    void destroyAll()
+    {
+        for (auto& program : m_programs) bgfx::destroy(program.second.handle);
+        for (auto& shader : m_shaders) bgfx::destroy(shader.second.handle);
+        for (auto& texture : m_textures) bgfx::destroy(texture.second.handle);
+        m_programs.clear();
+        m_programKeys.clear();
+        m_shaders.clear();
+        m_shaderKeys.clear();
+        m_textures.clear();
+        m_textureKeys.clear();
+        m_pathKeys.clear();
+        m_contentPaths.clear();
+    }
+
+    const Stats& stats() const { return m_stats; }
+
+    void printStats() const
+    {
+        auto hitRate = [](uint32_t hits, uint32_t requests) { return requests ? 100.0 * hits / requests : 0.0; };
+        std::cout << "[ResourceCache] textures: " << m_stats.textureRequests << " requests, " << m_stats.textureHits << " hits ("
+                  << hitRate(m_stats.textureHits, m_stats.textureRequests) << "%), " << m_textures.size() << " unique, "
+                  << (m_stats.textureBytesSaved / 1024) << " KiB saved\n";
+        std::cout << "[ResourceCache] shaders: " << m_stats.shaderRequests << " requests, " << m_stats.shaderHits << " hits; programs: "
+                  << m_stats.programRequests << " requests, " << m_stats.programHits << " hits\n";
+    }
+
+private:
+    static std::string pathKeyName(const std::string& canonicalPath, uint64_t contentKind)
+    {
+        return std::to_string(contentKind) + '|' + canonicalPath;
+    }
+
+    // Drops the paths that led to contentKey, so a long session loading and releasing many files doesn't keep every name
+    void forgetPathKeys(uint64_t contentKey)
+    {
+        auto it = m_contentPaths.find(contentKey);
+        if (it == m_contentPaths.end()) return;
+        for (const std::string& name : it->second) m_pathKeys.erase(name);
+        m_contentPaths.erase(it);
+    }
+
+    struct TextureEntry
+    {
+        bgfx::TextureHandle handle;
+        uint32_t refCount;
+        uint32_t gpuBytes;
+    };
+
+    struct ShaderEntry
+    {
+        bgfx::ShaderHandle handle;
+        uint32_t refCount;
+    };
+
+    struct ProgramEntry
+    {
+        bgfx::ProgramHandle handle;
+        uint32_t refCount;
+        bgfx::ShaderHandle vsh;
+        bgfx::ShaderHandle fsh;
+    };
+
+    std::unordered_map<uint64_t, TextureEntry> m_textures;
+    std::unordered_map<uint16_t, uint64_t> m_textureKeys;
+    std::unordered_map<uint64_t, ShaderEntry> m_shaders;
+    std::unordered_map<uint16_t, uint64_t> m_shaderKeys;
+    std::unordered_map<uint64_t, ProgramEntry> m_programs;
+    std::unordered_map<uint16_t, uint64_t> m_programKeys;
+    std::unordered_map<std::string, uint64_t> m_pathKeys;
+    std::unordered_map<uint64_t, std::vector<std::string>> m_contentPaths; // content key -> its m_pathKeys names
+    Stats m_stats;
+};
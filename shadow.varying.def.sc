@@ -0,0 +1,9 @@
+// Shadow map passes: depth-only casters (position only) and the fullscreen
+// copy of the static shadow cache (position + texcoord).
+
+vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
+
+vec3 a_position  : POSITION;
+vec2 a_texcoord0 : TEXCOORD0;
+vec4 a_indices   : BLENDINDICES;
+vec4 a_weight    : BLENDWEIGHT;
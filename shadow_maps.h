@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <bgfx/bgfx.h>
+#include <bx/math.h>
+
+#include "resource_cache.h"
+
+// A spotlight that gets its own shadow map tile
+struct ShadowedSpotLight
+{
+    float position[3];
+    float direction[3]; // normalized
+    float range;
+    float innerAngle;   // degrees, half angle
+    float outerAngle;   // degrees, half angle
+    float color[3];     // linear color * intensity
+};
+
+// -----------------------------------------------------------------------------
+// Shadow maps for one directional light (cascades) and a few spotlights, all
+// tiles of one depth atlas. Static casters are rendered into a cache atlas
+// only when a tile's light matrix or the static casters change. The cascades
+// keep one light view per scene (origin and depth range from the scene's
+// bounds) and only slide their ortho window over it in steps of
+// kCascadeSnapTexels, so a moving camera re-renders a cascade's static layer
+// only when its window steps or its size changes. Every frame
+// the cache is copied into the sampled atlas (a depth-writing fullscreen pass,
+// so it also works on WebGL2 where depth blits aren't available) and the
+// dynamic casters are drawn on top.
+//
+// Views, in submission order: one static view per tile (cache atlas), the
+// copy view, one dynamic view per tile (sampled atlas).
+// -----------------------------------------------------------------------------
+class CachedShadowMaps
+{
+public:
+    static constexpr uint32_t kNumCascades = 3;
+    static constexpr uint32_t kMaxSpots = 4;
+    static constexpr uint32_t kNumTiles = kNumCascades + kMaxSpots;
+    static constexpr uint32_t kAtlasColumns = 4;
+    static constexpr uint32_t kAtlasRows = 2;
+    static constexpr uint16_t kTileSize = 1024;
+    static constexpr uint16_t kAtlasWidth = kTileSize * kAtlasColumns;
+    static constexpr uint16_t kAtlasHeight = kTileSize * kAtlasRows;
+    static constexpr uint32_t kNumViews = kNumTiles * 2 + 1;
+    static constexpr int32_t kCascadeSnapTexels = 32; // cascade windows move in steps of this many texels
+
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t staticRenders = 0;        // tiles whose static layer was re-rendered
+        uint64_t invalidatedByLight = 0;   // ... because the light or the cascade fit changed
+        uint64_t invalidatedByCasters = 0; // ... because a static caster moved
+    };
+
+    // copyProgram is vs_shadow_copy/fs_shadow_copy, owned by the caller
+    bool create(bgfx::ViewId firstView, bgfx::ProgramHandle copyProgram)
+    {
+        const uint64_t rtFlags = BGFX_TEXTURE_RT | BGFX_SAMPLER_UVW_CLAMP;
+        if (!bgfx::isTextureValid(0, false, 1, bgfx::TextureFormat::D16, rtFlags | BGFX_SAMPLER_COMPARE_LEQUAL) ||
+            0 == (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_COMPARE_LEQUAL))
+        {
+            std::cerr << "[CachedShadowMaps] Depth compare textures aren't supported, shadows disabled.\n";
+            return false;
+        }
+
+        m_firstView = firstView;
+        m_copyProgram = copyProgram;
+        m_copySampler = bgfx::createUniform("s_shadowCache", bgfx::UniformType::Sampler);
+
+        bgfx::TextureHandle cacheTexture = bgfx::createTexture2D(kAtlasWidth, kAtlasHeight, false, 1, bgfx::TextureFormat::D16, rtFlags | BGFX_SAMPLER_POINT);
+        bgfx::TextureHandle shadowTexture = bgfx::createTexture2D(kAtlasWidth, kAtlasHeight, false, 1, bgfx::TextureFormat::D16, rtFlags | BGFX_SAMPLER_COMPARE_LEQUAL);
+        m_cacheTexture = cacheTexture;
+        m_shadowTexture = shadowTexture;
+        m_cacheFrameBuffer = bgfx::createFrameBuffer(1, &cacheTexture, true);
+        m_shadowFrameBuffer = bgfx::createFrameBuffer(1, &shadowTexture, true);
+
+        m_layout.begin()
+                .add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+                .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+                .end();
+
+        for (uint32_t tile = 0; tile < kNumTiles; ++tile)
+        {
+            uint16_t x = uint16_t((tile % kAtlasColumns) * kTileSize);
+            uint16_t y = uint16_t((tile / kAtlasColumns) * kTileSize);
+
+            bgfx::setViewName(staticView(tile), "shadow cache");
+            bgfx::setViewFrameBuffer(staticView(tile), m_cacheFrameBuffer);
+            bgfx::setViewRect(staticView(tile), x, y, kTileSize, kTileSize);
+            bgfx::setViewClear(staticView(tile), BGFX_CLEAR_DEPTH, 0, 1.0f, 0);
+
+            bgfx::setViewName(dynamicView(tile), "shadow dynamic");
+            bgfx::setViewFrameBuffer(dynamicView(tile), m_shadowFrameBuffer);
+            bgfx::setViewRect(dynamicView(tile), x, y, kTileSize, kTileSize);
+            bgfx::setViewClear(dynamicView(tile), BGFX_CLEAR_NONE);
+        }
+        bgfx::setViewName(copyView(), "shadow copy");
+        bgfx::setViewFrameBuffer(copyView(), m_shadowFrameBuffer);
+        bgfx::setViewRect(copyView(), 0, 0, kAtlasWidth, kAtlasHeight);
+        bgfx::setViewClear(copyView(), BGFX_CLEAR_NONE);
+
+        return true;
+    }
+
+    void destroy()
+    {
+        if (bgfx::isValid(m_cacheFrameBuffer)) bgfx::destroy(m_cacheFrameBuffer);
+        if (bgfx::isValid(m_shadowFrameBuffer)) bgfx::destroy(m_shadowFrameBuffer);
+        if (bgfx::isValid(m_copySampler)) bgfx::destroy(m_copySampler);
+        m_cacheFrameBuffer = BGFX_INVALID_HANDLE;
+        m_shadowFrameBuffer = BGFX_INVALID_HANDLE;
+        m_copySampler = BGFX_INVALID_HANDLE;
+    }
+
+    bool isEnabled() const { return bgfx::isValid(m_shadowFrameBuffer); }
+
+    // Forces every tile's static layer to be re-rendered, for when the static casters are replaced wholesale
+    // (same transforms, different meshes) and the caster hash can't tell
+    void invalidate()
+    {
+        for (uint32_t tile = 0; tile < kNumTiles; ++tile)
+        {
+            m_tileKey[tile] = TileKey();
+        }
+    }
+
+    // Fits the cascades to the camera and sets up this frame's views. Tiles whose light matrix or
+    // static casters changed are flagged for a static re-render (see needsStaticRender).
+    void update(const float* view, const float* proj, const float sceneCenter[3], float sceneRadius,
+                const float sunDirection[3], const ShadowedSpotLight* spots, uint32_t numSpots, uint64_t staticCasterHash)
+    {
+        ++m_stats.frames;
+        m_numSpots = std::min(numSpots, kMaxSpots);
+
+        TileKey keys[kNumTiles];
+        fitCascades(view, proj, sceneCenter, sceneRadius, sunDirection, keys);
+        for (uint32_t i = 0; i < m_numSpots; ++i)
+        {
+            fitSpot(kNumCascades + i, spots[i], keys[kNumCascades + i]);
+        }
+
+        for (uint32_t tile = 0; tile < kNumTiles; ++tile)
+        {
+            m_needsStaticRender[tile] = false;
+            if (!isTileActive(tile))
+            {
+                m_tileKey[tile] = TileKey();
+                continue;
+            }
+
+            float viewProj[16];
+            bx::mtxMul(viewProj, m_lightView[tile], m_lightProj[tile]);
+            const bool lightChanged = keys[tile] != m_tileKey[tile];
+            if (lightChanged || staticCasterHash != m_tileCasterHash[tile])
+            {
+                ++(lightChanged ? m_stats.invalidatedByLight : m_stats.invalidatedByCasters);
+                ++m_stats.staticRenders;
+                m_tileKey[tile] = keys[tile];
+                m_tileCasterHash[tile] = staticCasterHash;
+                m_needsStaticRender[tile] = true;
+
+                bgfx::setViewTransform(staticView(tile), m_lightView[tile], m_lightProj[tile]);
+                bgfx::touch(staticView(tile)); // clears the tile even if nothing is drawn into it
+            }
+            bgfx::setViewTransform(dynamicView(tile), m_lightView[tile], m_lightProj[tile]);
+
+            float tileBias[16];
+            tileBiasMatrix(tile, tileBias);
+            bx::mtxMul(m_shadowMatrix[tile], viewProj, tileBias);
+        }
+
+        submitCopy();
+    }
+
+    bool isTileActive(uint32_t tile) const { return tile < kNumCascades + m_numSpots; }
+    bool needsStaticRender(uint32_t tile) const { return m_needsStaticRender[tile]; }
+    bgfx::ViewId staticView(uint32_t tile) const { return bgfx::ViewId(m_firstView + tile); }
+    bgfx::ViewId copyView() const { return bgfx::ViewId(m_firstView + kNumTiles); }
+    bgfx::ViewId dynamicView(uint32_t tile) const { return bgfx::ViewId(m_firstView + kNumTiles + 1 + tile); }
+
+    bgfx::TextureHandle shadowTexture() const { return m_shadowTexture; }
+
+    // World -> atlas (uv, depth) for tile's light, cascades first then spots
+    const float* shadowMatrix(uint32_t tile) const { return m_shadowMatrix[tile]; }
+
+    // View-space far distance of each cascade
+    const float* cascadeSplits() const { return m_cascadeSplits; }
+
+    const Stats& stats() const { return m_stats; }
+
+    void printStats() const
+    {
+        std::cout << "[ShadowCache] cascade splits: " << m_cascadeSplits[0] << " " << m_cascadeSplits[1] << " " << m_cascadeSplits[2]
+                  << ", static tile re-renders: " << m_stats.staticRenders << " in " << m_stats.frames << " frames (light/cascade changes: "
+                  << m_stats.invalidatedByLight << ", static casters moved: " << m_stats.invalidatedByCasters << ")\n";
+    }
+
+private:
+    // What a tile's static layer was rendered with. Cascades compare their light (direction and scene
+    // bounds) plus the integer window position and size, spots their light's parameters.
+    struct TileKey
+    {
+        uint64_t lightHash = 0;
+        int32_t windowX = 0;    // cascades: window center in texels of the light view
+        int32_t windowY = 0;
+        int32_t windowSize = 0; // cascades: half size in units of sceneRadius / kRadiusSteps
+
+        bool operator!=(const TileKey& other) const
+        {
+            return lightHash != other.lightHash || windowX != other.windowX || windowY != other.windowY || windowSize != other.windowSize;
+        }
+    };
+
+    static constexpr float kRadiusSteps = 64.0f;
+
+    void fitCascades(const float* view, const float* proj, const float sceneCenter[3], float sceneRadius, const float sunDirection[3], TileKey* keys)
+    {
+        float invView[16];
+        bx::mtxInverse(invView, view);
+        const bx::Vec3 eye = { invView[12], invView[13], invView[14] };
+        const bx::Vec3 center = { sceneCenter[0], sceneCenter[1], sceneCenter[2] };
+        const bx::Vec3 dir = bx::normalize(bx::Vec3{ sunDirection[0], sunDirection[1], sunDirection[2] });
+
+        // One light view for all cascades, placed by the scene alone: every caster lies between
+        // depth sceneRadius and 3 * sceneRadius, whatever the camera does
+        const float backOff = 2.0f * sceneRadius;
+        const bx::Vec3 lightEye = bx::sub(center, bx::mul(dir, backOff));
+        const bx::Vec3 up = std::fabs(dir.y) > 0.99f ? bx::Vec3{ 1.0f, 0.0f, 0.0f } : bx::Vec3{ 0.0f, 1.0f, 0.0f };
+        float lightView[16];
+        bx::mtxLookAt(lightView, lightEye, center, up);
+        const float lightParams[7] = { dir.x, dir.y, dir.z, center.x, center.y, center.z, sceneRadius };
+        const uint64_t lightHash = hashBytes(lightParams, sizeof(lightParams));
+
+        // Only shadow as far as there is scene, split practically (a mix of log and uniform)
+        const float nearZ = 0.1f;
+        const float farZ = std::max(bx::length(bx::sub(center, eye)) + sceneRadius, nearZ * 2.0f);
+        const float lambda = 0.75f;
+        float splitNear = nearZ;
+        for (uint32_t cascade = 0; cascade < kNumCascades; ++cascade)
+        {
+            float t = float(cascade + 1) / float(kNumCascades);
+            float splitFar = lambda * nearZ * std::pow(farZ / nearZ, t) + (1.0f - lambda) * (nearZ + (farZ - nearZ) * t);
+            m_cascadeSplits[cascade] = splitFar;
+
+            // Bounding sphere of the frustum slice: its radius only depends on the split depths, not on
+            // where the camera looks
+            bx::Vec3 corners[8];
+            bx::Vec3 sphereCenter = { 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 8; ++i)
+            {
+                float depth = (i & 4) ? splitFar : splitNear;
+                bx::Vec3 viewCorner = { ((i & 1) ? 1.0f : -1.0f) * depth / proj[0], ((i & 2) ? 1.0f : -1.0f) * depth / proj[5], depth };
+                corners[i] = bx::mul(viewCorner, invView);
+                sphereCenter = bx::add(sphereCenter, corners[i]);
+            }
+            sphereCenter = bx::mul(sphereCenter, 1.0f / 8.0f);
+            float radius = 0.0f;
+            for (const bx::Vec3& corner : corners)
+            {
+                radius = std::max(radius, bx::length(bx::sub(corner, sphereCenter)));
+            }
+
+            // The window is a square of whole texels in the light view. Its center snaps to every
+            // kCascadeSnapTexels-th texel, so it is padded by half a step to still cover the sphere.
+            const float snapFraction = float(kCascadeSnapTexels) / float(kTileSize);
+            const int32_t windowSize = int32_t(std::ceil(radius / (1.0f - snapFraction) / sceneRadius * kRadiusSteps));
+            const float halfSize = float(windowSize) * sceneRadius / kRadiusSteps;
+            const float texel = 2.0f * halfSize / float(kTileSize);
+            const bx::Vec3 lightSpaceCenter = bx::mul(sphereCenter, lightView);
+            const float step = texel * float(kCascadeSnapTexels);
+            const int32_t windowX = int32_t(std::round(lightSpaceCenter.x / step)) * kCascadeSnapTexels;
+            const int32_t windowY = int32_t(std::round(lightSpaceCenter.y / step)) * kCascadeSnapTexels;
+            const float x = float(windowX) * texel;
+            const float y = float(windowY) * texel;
+
+            std::memcpy(m_lightView[cascade], lightView, sizeof(lightView));
+            bx::mtxOrtho(m_lightProj[cascade], x - halfSize, x + halfSize, y - halfSize, y + halfSize, 0.0f, 2.0f * backOff, 0.0f,
+                         bgfx::getCaps()->homogeneousDepth);
+
+            keys[cascade].lightHash = lightHash;
+            keys[cascade].windowX = windowX;
+            keys[cascade].windowY = windowY;
+            keys[cascade].windowSize = windowSize;
+
+            splitNear = splitFar;
+        }
+    }
+
+    void fitSpot(uint32_t tile, const ShadowedSpotLight& spot, TileKey& key)
+    {
+        const bx::Vec3 position = { spot.position[0], spot.position[1], spot.position[2] };
+        const bx::Vec3 dir = { spot.direction[0], spot.direction[1], spot.direction[2] };
+        const bx::Vec3 up = std::fabs(dir.y) > 0.99f ? bx::Vec3{ 1.0f, 0.0f, 0.0f } : bx::Vec3{ 0.0f, 1.0f, 0.0f };
+        bx::mtxLookAt(m_lightView[tile], position, bx::add(position, dir), up);
+        bx::mtxProj(m_lightProj[tile], spot.outerAngle * 2.0f, 1.0f, spot.range * 0.01f, spot.range, bgfx::getCaps()->homogeneousDepth);
+
+        const float lightParams[8] = { spot.position[0], spot.position[1], spot.position[2], spot.direction[0], spot.direction[1], spot.direction[2],
+                                       spot.range, spot.outerAngle };
+        key = TileKey();
+        key.lightHash = hashBytes(lightParams, sizeof(lightParams));
+    }
+
+    // Clip space -> the tile's part of the atlas, depth to [0, 1]
+    static void tileBiasMatrix(uint32_t tile, float* result)
+    {
+        const bgfx::Caps* caps = bgfx::getCaps();
+        const float column = float(tile % kAtlasColumns);
+        const float row = float(tile / kAtlasColumns);
+        const float sx = 0.5f / float(kAtlasColumns);
+        const float sy = (caps->originBottomLeft ? 0.5f : -0.5f) / float(kAtlasRows);
+        const float sz = caps->homogeneousDepth ? 0.5f : 1.0f;
+        const float tz = caps->homogeneousDepth ? 0.5f : 0.0f;
+        const float ox = (column + 0.5f) / float(kAtlasColumns);
+        // View rects are top-down, GL textures bottom-up
+        const float oy = caps->originBottomLeft ? (float(kAtlasRows) - row - 0.5f) / float(kAtlasRows) : (row + 0.5f) / float(kAtlasRows);
+
+        const float bias[16] =
+        {
+            sx,   0.0f, 0.0f, 0.0f,
+            0.0f, sy,   0.0f, 0.0f,
+            0.0f, 0.0f, sz,   0.0f,
+            ox,   oy,   tz,   1.0f,
+        };
+        std::memcpy(result, bias, sizeof(bias));
+    }
+
+    void submitCopy()
+    {
+        if (3 != bgfx::getAvailTransientVertexBuffer(3, m_layout))
+        {
+            return;
+        }
+
+        // One triangle covering the whole atlas
+        const bool originBottomLeft = bgfx::getCaps()->originBottomLeft;
+        const float v0 = originBottomLeft ? 0.0f : 1.0f;
+        const float v1 = originBottomLeft ? 2.0f : -1.0f;
+        const float vertices[3][5] =
+        {
+            { -1.0f, -1.0f, 0.0f, 0.0f, v0 },
+            {  3.0f, -1.0f, 0.0f, 2.0f, v0 },
+            { -1.0f,  3.0f, 0.0f, 0.0f, v1 },
+        };
+
+        bgfx::TransientVertexBuffer tvb;
+        bgfx::allocTransientVertexBuffer(&tvb, 3, m_layout);
+        std::memcpy(tvb.data, vertices, sizeof(vertices));
+
+        bgfx::setVertexBuffer(0, &tvb);
+        bgfx::setTexture(0, m_copySampler, m_cacheTexture, BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+        bgfx::setState(BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_ALWAYS);
+        bgfx::submit(copyView(), m_copyProgram);
+    }
+
+    bgfx::ViewId m_firstView = 0;
+    bgfx::ProgramHandle m_copyProgram = BGFX_INVALID_HANDLE;
+    bgfx::UniformHandle m_copySampler = BGFX_INVALID_HANDLE;
+    bgfx::VertexLayout m_layout;
+    bgfx::TextureHandle m_cacheTexture = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle m_shadowTexture = BGFX_INVALID_HANDLE;
+    bgfx::FrameBufferHandle m_cacheFrameBuffer = BGFX_INVALID_HANDLE;
+    bgfx::FrameBufferHandle m_shadowFrameBuffer = BGFX_INVALID_HANDLE;
+
+    uint32_t m_numSpots = 0;
+    float m_cascadeSplits[kNumCascades] = {};
+    float m_lightView[kNumTiles][16];
+    float m_lightProj[kNumTiles][16];
+    float m_shadowMatrix[kNumTiles][16];
+    TileKey m_tileKey[kNumTiles];
+    uint64_t m_tileCasterHash[kNumTiles] = {};
+    bool m_needsStaticRender[kNumTiles] = {};
+    Stats m_stats;
+};
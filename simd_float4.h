@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// Just enough of a 4-wide float vector for the CPU-side geometry code
+// (occlusion rasterizer, skinning, ray picking). Masks are all-ones or
+// all-zeros lanes, the scalar fallback uses 1.0/0.0.
+// -----------------------------------------------------------------------------
+namespace simd4
+{
+
+#if defined(__SSE2__) || defined(_M_X64)
+typedef __m128 Float4;
+inline Float4 splat(float v) { return _mm_set1_ps(v); }
+inline Float4 load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 inverseSqrt(Float4 v) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(v)); }
+inline Float4 greaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a, b); }
+inline Float4 maskAnd(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline bool any(Float4 mask) { return _mm_movemask_ps(mask) != 0; }
+inline int maskBits(Float4 mask) { return _mm_movemask_ps(mask); }
+#elif defined(__ARM_NEON)
+typedef float32x4_t Float4;
+inline Float4 splat(float v) { return vdupq_n_f32(v); }
+inline Float4 load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 div(Float4 a, Float4 b)
+{
+    // Reciprocal estimate plus two Newton-Raphson steps
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, vmulq_f32(r, vrecpsq_f32(b, r)));
+}
+inline Float4 min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 inverseSqrt(Float4 v)
+{
+    // Estimate plus two Newton-Raphson steps (ARMv7 has no vector sqrt)
+    float32x4_t r = vrsqrteq_f32(v);
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+    return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+}
+inline Float4 greaterEqual(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline Float4 maskAnd(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+inline bool any(Float4 mask)
+{
+    uint32x4_t bits = vreinterpretq_u32_f32(mask);
+    uint32x2_t half = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(vpmax_u32(half, half), 0) != 0;
+}
+inline int maskBits(Float4 mask)
+{
+    static const uint32_t kLaneBits[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vandq_u32(vreinterpretq_u32_f32(mask), vld1q_u32(kLaneBits));
+    uint32x2_t half = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return int(vget_lane_u32(half, 0) | vget_lane_u32(half, 1));
+}
+#elif defined(__wasm_simd128__)
+typedef v128_t Float4;
+inline Float4 splat(float v) { return wasm_f32x4_splat(v); }
+inline Float4 load(const float* p) { return wasm_v128_load(p); }
+inline void store(float* p, Float4 v) { wasm_v128_store(p, v); }
+inline Float4 add(Float4 a, Float4 b) { return wasm_f32x4_add(a, b); }
+inline Float4 sub(Float4 a, Float4 b) { return wasm_f32x4_sub(a, b); }
+inline Float4 mul(Float4 a, Float4 b) { return wasm_f32x4_mul(a, b); }
+inline Float4 div(Float4 a, Float4 b) { return wasm_f32x4_div(a, b); }
+inline Float4 min(Float4 a, Float4 b) { return wasm_f32x4_min(a, b); }
+inline Float4 max(Float4 a, Float4 b) { return wasm_f32x4_max(a, b); }
+inline Float4 inverseSqrt(Float4 v) { return wasm_f32x4_div(wasm_f32x4_splat(1.0f), wasm_f32x4_sqrt(v)); }
+inline Float4 greaterEqual(Float4 a, Float4 b) { return wasm_f32x4_ge(a, b); }
+inline Float4 maskAnd(Float4 a, Float4 b) { return wasm_v128_and(a, b); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return wasm_v128_bitselect(a, b, mask); }
+inline bool any(Float4 mask) { return wasm_v128_any_true(mask); }
+inline int maskBits(Float4 mask) { return int(wasm_i32x4_bitmask(mask)); }
+#else
+struct Float4 { float v[4]; };
+inline Float4 splat(float v) { return Float4{ { v, v, v, v } }; }
+inline Float4 load(const float* p) { Float4 r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void store(float* p, Float4 v) { std::memcpy(p, v.v, sizeof(v.v)); }
+inline Float4 add(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+inline Float4 sub(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+inline Float4 mul(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+inline Float4 div(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] /= b.v[i]; return a; }
+inline Float4 min(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = std::min(a.v[i], b.v[i]); return a; }
+inline Float4 max(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = std::max(a.v[i], b.v[i]); return a; }
+inline Float4 inverseSqrt(Float4 v) { for (int i = 0; i < 4; ++i) v.v[i] = 1.0f / std::sqrt(v.v[i]); return v; }
+inline Float4 greaterEqual(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = a.v[i] >= b.v[i] ? 1.0f : 0.0f; return a; }
+inline Float4 maskAnd(Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = a.v[i] != 0.0f && b.v[i] != 0.0f ? 1.0f : 0.0f; return a; }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return a; }
+inline bool any(Float4 mask) { return mask.v[0] != 0.0f || mask.v[1] != 0.0f || mask.v[2] != 0.0f || mask.v[3] != 0.0f; }
+inline int maskBits(Float4 mask) { return (mask.v[0] != 0.0f ? 1 : 0) | (mask.v[1] != 0.0f ? 2 : 0) | (mask.v[2] != 0.0f ? 4 : 0) | (mask.v[3] != 0.0f ? 8 : 0); }
+#endif
+
+// Row vector times bx matrix (translation in [12..14])
+inline void transformPoint(const float* m, const float* p, float* out)
+{
+    Float4 r = add(add(mul(splat(p[0]), load(m)), mul(splat(p[1]), load(m + 4))), add(mul(splat(p[2]), load(m + 8)), load(m + 12)));
+    store(out, r);
+}
+
+// a then b, like bx::mtxMul
+inline void multiplyMatrix(const float* a, const float* b, float* out)
+{
+    for (int row = 0; row < 4; ++row)
+    {
+        Float4 r = add(add(mul(splat(a[row * 4 + 0]), load(b)), mul(splat(a[row * 4 + 1]), load(b + 4))),
+                       add(mul(splat(a[row * 4 + 2]), load(b + 8)), mul(splat(a[row * 4 + 3]), load(b + 12))));
+        store(out + row * 4, r);
+    }
+}
+
+} // namespace simd4
@@ -0,0 +1,630 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <assimp/anim.h>
+#include <assimp/mesh.h>
+#include <assimp/scene.h>
+#include <bgfx/bgfx.h>
+
+#include "parallel_for.h"
+#include "simd_float4.h"
+#include "vertex_format.h"
+
+// Per-vertex skinning stream: the four strongest bones and their weights (summing to 255)
+struct SkinInfluence
+{
+    uint8_t bones[4];
+    uint8_t weights[4];
+};
+
+// Second vertex stream next to MyFancyVertex. Must match a_indices/a_weight in drill.varying.def.sc.
+inline void initSkinVertexLayout(bgfx::VertexLayout& layout)
+{
+    layout.begin()
+        .add(bgfx::Attrib::Indices, 4, bgfx::AttribType::Uint8)       // arrives as 0..255 floats
+        .add(bgfx::Attrib::Weight,  4, bgfx::AttribType::Uint8, true) // normalized
+        .end();
+}
+
+// Local joint transforms as SoA streams, so they can be sampled and composed four joints at a time
+struct LocalPose
+{
+    enum Component { TX, TY, TZ, RX, RY, RZ, RW, SX, SY, SZ, Count };
+
+    uint32_t stride = 0; // joints rounded up to a multiple of 4
+    std::vector<float> data;
+
+    void resize(uint32_t numJoints)
+    {
+        stride = (numJoints + 3) & ~3u;
+        data.assign(size_t(stride) * Count, 0.0f);
+    }
+
+    float* operator[](Component component) { return data.data() + size_t(component) * stride; }
+    const float* operator[](Component component) const { return data.data() + size_t(component) * stride; }
+};
+
+// -----------------------------------------------------------------------------
+// Joint hierarchy. Every node of the scene becomes a joint (depth first, so
+// parents always come before their children); skins pick theirs by name.
+// Joints are added with their rest transform, finalize() packs the rest pose.
+// -----------------------------------------------------------------------------
+struct Skeleton
+{
+    std::vector<int32_t> parents; // -1 for roots
+    std::vector<std::string> names;
+    std::vector<std::array<float, LocalPose::Count>> rest;
+    LocalPose restPose;
+
+    int32_t find(const char* name) const
+    {
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i] == name) return int32_t(i);
+        }
+        return -1;
+    }
+
+    // rotation is x, y, z, w
+    uint32_t addJoint(const std::string& name, int32_t parent, const float translation[3], const float rotation[4], const float scale[3])
+    {
+        parents.push_back(parent);
+        names.push_back(name);
+        rest.push_back({ translation[0], translation[1], translation[2], rotation[0], rotation[1], rotation[2], rotation[3], scale[0], scale[1], scale[2] });
+        return uint32_t(parents.size() - 1);
+    }
+
+    void addSceneNodes(const aiNode* node, int32_t parent)
+    {
+        aiVector3D scale;
+        aiQuaternion rotation;
+        aiVector3D translation;
+        node->mTransformation.Decompose(scale, rotation, translation);
+        const float t[3] = { translation.x, translation.y, translation.z };
+        const float r[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+        const float s[3] = { scale.x, scale.y, scale.z };
+        int32_t joint = int32_t(addJoint(node->mName.C_Str(), parent, t, r, s));
+        for (unsigned int i = 0; i < node->mNumChildren; ++i)
+        {
+            addSceneNodes(node->mChildren[i], joint);
+        }
+    }
+
+    void finalize()
+    {
+        restPose.resize(uint32_t(parents.size()));
+        for (size_t joint = 0; joint < rest.size(); ++joint)
+        {
+            for (int c = 0; c < LocalPose::Count; ++c)
+            {
+                restPose[LocalPose::Component(c)][joint] = rest[joint][c];
+            }
+        }
+        // Padding joints are identities, so the SIMD paths can run over whole groups of four
+        for (size_t joint = rest.size(); joint < restPose.stride; ++joint)
+        {
+            restPose[LocalPose::RW][joint] = 1.0f;
+            restPose[LocalPose::SX][joint] = restPose[LocalPose::SY][joint] = restPose[LocalPose::SZ][joint] = 1.0f;
+        }
+    }
+
+    uint32_t numJoints() const { return uint32_t(parents.size()); }
+};
+
+// How one mesh is bound to the skeleton
+struct SkinBinding
+{
+    static constexpr uint32_t kMaxBones = 256; // the influence stream stores bone indices as bytes
+
+    std::vector<uint32_t> joints;      // per bone
+    std::vector<float> inverseBind;    // per bone, 16 floats in bx layout (aiBone::mOffsetMatrix transposed)
+    std::vector<SkinInfluence> influences;
+    bool jointsInMeshSpace = false;    // joints placed relative to the mesh rather than the scene root, so no mesh inverse
+
+    uint32_t numBones() const { return uint32_t(joints.size()); }
+};
+
+// Per-vertex weights -> the 4 strongest, renormalized and quantized so they add up to exactly 255
+inline void packInfluences(const std::vector<std::vector<std::pair<float, uint32_t>>>& weights, std::vector<SkinInfluence>& out, uint32_t* outUnweighted = nullptr)
+{
+    uint32_t unweighted = 0;
+    out.resize(weights.size());
+    for (size_t v = 0; v < weights.size(); ++v)
+    {
+        std::pair<float, uint32_t> strongest[4] = {};
+        for (const auto& weight : weights[v])
+        {
+            if (weight.first > strongest[3].first)
+            {
+                strongest[3] = weight;
+                for (int i = 3; i > 0 && strongest[i].first > strongest[i - 1].first; --i)
+                {
+                    std::swap(strongest[i], strongest[i - 1]);
+                }
+            }
+        }
+
+        SkinInfluence& influence = out[v];
+        const float total = strongest[0].first + strongest[1].first + strongest[2].first + strongest[3].first;
+        if (total <= 0.0f)
+        {
+            // Follows bone 0 rather than collapsing to the origin
+            ++unweighted;
+            influence = SkinInfluence{ { 0, 0, 0, 0 }, { 255, 0, 0, 0 } };
+            continue;
+        }
+        int sum = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            influence.bones[i] = uint8_t(strongest[i].second);
+            influence.weights[i] = uint8_t(std::lround(strongest[i].first / total * 255.0f));
+            sum += influence.weights[i];
+        }
+        influence.weights[0] = uint8_t(influence.weights[0] + (255 - sum));
+    }
+    if (outUnweighted) *outUnweighted = unweighted;
+}
+
+inline bool importSkin(const aiMesh* mesh, const Skeleton& skeleton, SkinBinding& out)
+{
+    if (!mesh->HasBones())
+    {
+        return false;
+    }
+    if (mesh->mNumBones > SkinBinding::kMaxBones)
+    {
+        std::cerr << "[importSkin] " << mesh->mName.C_Str() << " has " << mesh->mNumBones << " bones, at most " << SkinBinding::kMaxBones << " are supported.\n";
+        return false;
+    }
+
+    std::vector<std::vector<std::pair<float, uint32_t>>> weights(mesh->mNumVertices);
+    out.joints.resize(mesh->mNumBones);
+    out.inverseBind.resize(size_t(mesh->mNumBones) * 16);
+    for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+    {
+        const aiBone* bone = mesh->mBones[b];
+        int32_t joint = skeleton.find(bone->mName.C_Str());
+        if (joint < 0)
+        {
+            std::cerr << "[importSkin] Bone " << bone->mName.C_Str() << " of " << mesh->mName.C_Str() << " has no node.\n";
+            return false;
+        }
+        out.joints[b] = uint32_t(joint);
+
+        aiMatrix4x4 offset = bone->mOffsetMatrix;
+        offset.Transpose();
+        std::memcpy(&out.inverseBind[size_t(b) * 16], &offset.a1, sizeof(float) * 16);
+
+        for (unsigned int w = 0; w < bone->mNumWeights; ++w)
+        {
+            const aiVertexWeight& weight = bone->mWeights[w];
+            if (weight.mVertexId < mesh->mNumVertices)
+            {
+                weights[weight.mVertexId].push_back(std::make_pair(weight.mWeight, uint32_t(b)));
+            }
+        }
+    }
+
+    uint32_t unweighted = 0;
+    packInfluences(weights, out.influences, &unweighted);
+    if (unweighted > 0)
+    {
+        std::cerr << "[importSkin] " << unweighted << " vertices of " << mesh->mName.C_Str() << " have no bone weights.\n";
+    }
+    return true;
+}
+
+struct AnimationChannel
+{
+    uint32_t joint;
+    std::vector<float> positionTimes; // seconds
+    std::vector<float> positions;     // xyz
+    std::vector<float> rotationTimes;
+    std::vector<float> rotations;     // xyzw
+    std::vector<float> scalingTimes;
+    std::vector<float> scalings;      // xyz
+};
+
+struct AnimationClip
+{
+    std::string name;
+    float duration = 0.0f; // seconds, the clip loops
+    std::vector<AnimationChannel> channels;
+
+    // Filled by bakeClip: whole poses at a fixed rate, each laid out like LocalPose::data
+    uint32_t numFrames = 0;
+    float frameDuration = 0.0f;
+    std::vector<float> frames;
+};
+
+inline bool importAnimation(const aiAnimation* animation, const Skeleton& skeleton, AnimationClip& out)
+{
+    const double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+    out.name = animation->mName.C_Str();
+    out.duration = float(animation->mDuration / ticksPerSecond);
+    out.channels.clear();
+    for (unsigned int c = 0; c < animation->mNumChannels; ++c)
+    {
+        const aiNodeAnim* nodeAnim = animation->mChannels[c];
+        int32_t joint = skeleton.find(nodeAnim->mNodeName.C_Str());
+        if (joint < 0)
+        {
+            std::cerr << "[importAnimation] " << out.name << ": no node " << nodeAnim->mNodeName.C_Str() << ", channel skipped.\n";
+            continue;
+        }
+
+        AnimationChannel channel;
+        channel.joint = uint32_t(joint);
+        for (unsigned int k = 0; k < nodeAnim->mNumPositionKeys; ++k)
+        {
+            const aiVectorKey& key = nodeAnim->mPositionKeys[k];
+            channel.positionTimes.push_back(float(key.mTime / ticksPerSecond));
+            channel.positions.insert(channel.positions.end(), { key.mValue.x, key.mValue.y, key.mValue.z });
+        }
+        for (unsigned int k = 0; k < nodeAnim->mNumRotationKeys; ++k)
+        {
+            const aiQuatKey& key = nodeAnim->mRotationKeys[k];
+            channel.rotationTimes.push_back(float(key.mTime / ticksPerSecond));
+            channel.rotations.insert(channel.rotations.end(), { key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w });
+        }
+        for (unsigned int k = 0; k < nodeAnim->mNumScalingKeys; ++k)
+        {
+            const aiVectorKey& key = nodeAnim->mScalingKeys[k];
+            channel.scalingTimes.push_back(float(key.mTime / ticksPerSecond));
+            channel.scalings.insert(channel.scalings.end(), { key.mValue.x, key.mValue.y, key.mValue.z });
+        }
+        out.channels.push_back(std::move(channel));
+    }
+    return !out.channels.empty();
+}
+
+namespace skinning_detail
+{
+
+// Index of the key at or before time and the blend factor towards the next one
+inline size_t findKey(const std::vector<float>& times, float time, float& outBlend)
+{
+    outBlend = 0.0f;
+    if (times.size() < 2 || time <= times.front()) return 0;
+    if (time >= times.back()) return times.size() - 1;
+    size_t next = size_t(std::upper_bound(times.begin(), times.end(), time) - times.begin());
+    size_t key = next - 1;
+    float span = times[next] - times[key];
+    outBlend = span > 0.0f ? (time - times[key]) / span : 0.0f;
+    return key;
+}
+
+} // namespace skinning_detail
+
+// Writes the clip's channels at `time` (clamped to the keys) over a pose that already holds the rest transforms
+inline void sampleKeys(const AnimationClip& clip, float time, LocalPose& pose)
+{
+    using skinning_detail::findKey;
+
+    for (const AnimationChannel& channel : clip.channels)
+    {
+        const uint32_t j = channel.joint;
+        float blend;
+        if (!channel.positionTimes.empty())
+        {
+            size_t key = findKey(channel.positionTimes, time, blend);
+            const float* a = &channel.positions[key * 3];
+            const float* b = blend > 0.0f ? a + 3 : a;
+            pose[LocalPose::TX][j] = a[0] + (b[0] - a[0]) * blend;
+            pose[LocalPose::TY][j] = a[1] + (b[1] - a[1]) * blend;
+            pose[LocalPose::TZ][j] = a[2] + (b[2] - a[2]) * blend;
+        }
+        if (!channel.rotationTimes.empty())
+        {
+            // Normalized lerp along the shorter arc
+            size_t key = findKey(channel.rotationTimes, time, blend);
+            const float* a = &channel.rotations[key * 4];
+            const float* b = blend > 0.0f ? a + 4 : a;
+            const float sign = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]) < 0.0f ? -1.0f : 1.0f;
+            float q[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                q[c] = a[c] + (b[c] * sign - a[c]) * blend;
+            }
+            const float invLength = 1.0f / std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+            pose[LocalPose::RX][j] = q[0] * invLength;
+            pose[LocalPose::RY][j] = q[1] * invLength;
+            pose[LocalPose::RZ][j] = q[2] * invLength;
+            pose[LocalPose::RW][j] = q[3] * invLength;
+        }
+        if (!channel.scalingTimes.empty())
+        {
+            size_t key = findKey(channel.scalingTimes, time, blend);
+            const float* a = &channel.scalings[key * 3];
+            const float* b = blend > 0.0f ? a + 3 : a;
+            pose[LocalPose::SX][j] = a[0] + (b[0] - a[0]) * blend;
+            pose[LocalPose::SY][j] = a[1] + (b[1] - a[1]) * blend;
+            pose[LocalPose::SZ][j] = a[2] + (b[2] - a[2]) * blend;
+        }
+    }
+}
+
+// Resamples the keys into whole poses at a fixed rate, so sampling is a blend of two SoA poses rather than a
+// key search per channel. Takes stride * LocalPose::Count floats per frame; the skeleton must be finalized.
+inline void bakeClip(const Skeleton& skeleton, float framesPerSecond, AnimationClip& clip)
+{
+    const uint32_t intervals = clip.duration > 0.0f ? std::max(1u, uint32_t(std::ceil(clip.duration * framesPerSecond))) : 0u;
+    clip.numFrames = intervals + 1;
+    clip.frameDuration = intervals > 0 ? clip.duration / float(intervals) : 0.0f;
+
+    const size_t poseFloats = skeleton.restPose.data.size();
+    clip.frames.resize(poseFloats * clip.numFrames);
+    LocalPose pose;
+    for (uint32_t frame = 0; frame < clip.numFrames; ++frame)
+    {
+        pose = skeleton.restPose;
+        sampleKeys(clip, float(frame) * clip.frameDuration, pose);
+        std::copy(pose.data.begin(), pose.data.end(), clip.frames.begin() + frame * poseFloats);
+    }
+}
+
+// Baked clips overwrite the whole pose (sized for the skeleton) with a blend of the two frames around the looped
+// `time`, four joints at a time; unbaked ones fall back to sampleKeys over the rest pose already in `pose`
+inline void sampleClip(const AnimationClip& clip, float time, LocalPose& pose)
+{
+    using namespace simd4;
+
+    if (clip.duration > 0.0f)
+    {
+        time = std::fmod(time, clip.duration);
+        if (time < 0.0f) time += clip.duration;
+    }
+    if (clip.frames.empty())
+    {
+        sampleKeys(clip, time, pose);
+        return;
+    }
+
+    const float position = clip.frameDuration > 0.0f ? time / clip.frameDuration : 0.0f;
+    const uint32_t frame = std::min(uint32_t(position), clip.numFrames - 1);
+    const uint32_t next = std::min(frame + 1, clip.numFrames - 1);
+    const size_t poseFloats = pose.data.size();
+    const float* a = &clip.frames[frame * poseFloats];
+    const float* b = &clip.frames[next * poseFloats];
+    const Float4 blend = splat(position - float(frame));
+    const uint32_t stride = pose.stride;
+
+    static const LocalPose::Component kLinear[] = { LocalPose::TX, LocalPose::TY, LocalPose::TZ, LocalPose::SX, LocalPose::SY, LocalPose::SZ };
+    for (LocalPose::Component component : kLinear)
+    {
+        const size_t offset = size_t(component) * stride;
+        for (uint32_t first = 0; first < stride; first += 4)
+        {
+            const Float4 from = load(a + offset + first);
+            store(pose[component] + first, add(from, mul(sub(load(b + offset + first), from), blend)));
+        }
+    }
+
+    // Normalized lerp along the shorter arc
+    const size_t rx = size_t(LocalPose::RX) * stride;
+    const size_t ry = size_t(LocalPose::RY) * stride;
+    const size_t rz = size_t(LocalPose::RZ) * stride;
+    const size_t rw = size_t(LocalPose::RW) * stride;
+    for (uint32_t first = 0; first < stride; first += 4)
+    {
+        const Float4 ax = load(a + rx + first), ay = load(a + ry + first), az = load(a + rz + first), aw = load(a + rw + first);
+        Float4 bx = load(b + rx + first), by = load(b + ry + first), bz = load(b + rz + first), bw = load(b + rw + first);
+        const Float4 dot = add(add(mul(ax, bx), mul(ay, by)), add(mul(az, bz), mul(aw, bw)));
+        const Float4 sign = select(greaterEqual(dot, splat(0.0f)), splat(1.0f), splat(-1.0f));
+        bx = mul(bx, sign); by = mul(by, sign); bz = mul(bz, sign); bw = mul(bw, sign);
+
+        const Float4 x = add(ax, mul(sub(bx, ax), blend));
+        const Float4 y = add(ay, mul(sub(by, ay), blend));
+        const Float4 z = add(az, mul(sub(bz, az), blend));
+        const Float4 w = add(aw, mul(sub(bw, aw), blend));
+        const Float4 invLength = inverseSqrt(add(add(mul(x, x), mul(y, y)), add(mul(z, z), mul(w, w))));
+        store(pose[LocalPose::RX] + first, mul(x, invLength));
+        store(pose[LocalPose::RY] + first, mul(y, invLength));
+        store(pose[LocalPose::RZ] + first, mul(z, invLength));
+        store(pose[LocalPose::RW] + first, mul(w, invLength));
+    }
+}
+
+// Local TRS -> bx matrices (scale, then rotation, then translation), four joints at a time from the SoA streams
+inline void composeLocalMatrices(const LocalPose& pose, float* matrices)
+{
+    using namespace simd4;
+
+    const Float4 one = splat(1.0f);
+    const Float4 two = splat(2.0f);
+    for (uint32_t first = 0; first < pose.stride; first += 4)
+    {
+        const Float4 x = load(pose[LocalPose::RX] + first);
+        const Float4 y = load(pose[LocalPose::RY] + first);
+        const Float4 z = load(pose[LocalPose::RZ] + first);
+        const Float4 w = load(pose[LocalPose::RW] + first);
+        const Float4 sx = load(pose[LocalPose::SX] + first);
+        const Float4 sy = load(pose[LocalPose::SY] + first);
+        const Float4 sz = load(pose[LocalPose::SZ] + first);
+
+        const Float4 xx = mul(x, x), yy = mul(y, y), zz = mul(z, z);
+        const Float4 xy = mul(x, y), xz = mul(x, z), yz = mul(y, z);
+        const Float4 wx = mul(w, x), wy = mul(w, y), wz = mul(w, z);
+
+        // Rows of the row-vector matrix, each scaled by its axis
+        Float4 elements[12];
+        elements[0]  = mul(sx, sub(one, mul(two, add(yy, zz))));
+        elements[1]  = mul(sx, mul(two, add(xy, wz)));
+        elements[2]  = mul(sx, mul(two, sub(xz, wy)));
+        elements[3]  = mul(sy, mul(two, sub(xy, wz)));
+        elements[4]  = mul(sy, sub(one, mul(two, add(xx, zz))));
+        elements[5]  = mul(sy, mul(two, add(yz, wx)));
+        elements[6]  = mul(sz, mul(two, add(xz, wy)));
+        elements[7]  = mul(sz, mul(two, sub(yz, wx)));
+        elements[8]  = mul(sz, sub(one, mul(two, add(xx, yy))));
+        elements[9]  = load(pose[LocalPose::TX] + first);
+        elements[10] = load(pose[LocalPose::TY] + first);
+        elements[11] = load(pose[LocalPose::TZ] + first);
+
+        // SoA -> one matrix per joint
+        float lanes[12][4];
+        for (int e = 0; e < 12; ++e)
+        {
+            store(lanes[e], elements[e]);
+        }
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            float* m = matrices + size_t(first + lane) * 16;
+            m[0]  = lanes[0][lane];  m[1]  = lanes[1][lane];  m[2]  = lanes[2][lane];  m[3]  = 0.0f;
+            m[4]  = lanes[3][lane];  m[5]  = lanes[4][lane];  m[6]  = lanes[5][lane];  m[7]  = 0.0f;
+            m[8]  = lanes[6][lane];  m[9]  = lanes[7][lane];  m[10] = lanes[8][lane];  m[11] = 0.0f;
+            m[12] = lanes[9][lane];  m[13] = lanes[10][lane]; m[14] = lanes[11][lane]; m[15] = 1.0f;
+        }
+    }
+}
+
+// One animated copy of a skinned mesh
+struct SkinInstance
+{
+    uint32_t skin;        // SkinBinding
+    int32_t clip;         // -1 for the rest pose
+    float timeOffset;
+    uint32_t firstBone;   // into the palette
+    float meshInverse[16]; // world -> mesh space at bind time (inverse of the mesh node's transform), bx layout
+};
+
+// -----------------------------------------------------------------------------
+// Evaluates the skinning palettes of all instances, in parallel over the
+// instances. Per instance the baked clip is sampled into an SoA pose, the
+// local transforms are composed four joints at a time and the hierarchy is
+// walked in order (parents first) with SIMD matrix products. Each bone's matrix
+// (inverse bind * joint * mesh inverse) is stored as the three rows of the
+// affine column-vector form, which is how the palette texture and
+// vs_drill_skinned.sc read it: 12 floats per bone.
+// -----------------------------------------------------------------------------
+class SkinningPaletteEvaluator
+{
+public:
+    static constexpr uint32_t kFloatsPerBone = 12;
+
+    void evaluate(const Skeleton& skeleton, const std::vector<AnimationClip>& clips, const std::vector<SkinBinding>& skins,
+                  const std::vector<SkinInstance>& instances, float time, float* palette) const
+    {
+        parallelFor(instances.size(), 8, [&](size_t begin, size_t end)
+        {
+            thread_local LocalPose pose;
+            thread_local std::vector<float> local;
+            thread_local std::vector<float> global;
+            local.resize(size_t(skeleton.restPose.stride) * 16);
+            global.resize(size_t(skeleton.restPose.stride) * 16);
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                const SkinInstance& instance = instances[i];
+                const AnimationClip* clip = instance.clip >= 0 ? &clips[size_t(instance.clip)] : nullptr;
+                if (!clip || clip->frames.empty())
+                {
+                    pose = skeleton.restPose;
+                }
+                else if (pose.stride != skeleton.restPose.stride)
+                {
+                    pose.resize(skeleton.numJoints());
+                }
+                if (clip)
+                {
+                    sampleClip(*clip, time + instance.timeOffset, pose);
+                }
+                composeLocalMatrices(pose, local.data());
+
+                // The mesh inverse goes in at the roots, so every global already ends in mesh space
+                const uint32_t numJoints = skeleton.numJoints();
+                for (uint32_t joint = 0; joint < numJoints; ++joint)
+                {
+                    const int32_t parent = skeleton.parents[joint];
+                    const float* parentMatrix = parent < 0 ? instance.meshInverse : &global[size_t(parent) * 16];
+                    simd4::multiplyMatrix(&local[size_t(joint) * 16], parentMatrix, &global[size_t(joint) * 16]);
+                }
+
+                const SkinBinding& skin = skins[instance.skin];
+                float* out = palette + size_t(instance.firstBone) * kFloatsPerBone;
+                for (uint32_t bone = 0; bone < skin.numBones(); ++bone)
+                {
+                    float boneMatrix[16];
+                    simd4::multiplyMatrix(&skin.inverseBind[size_t(bone) * 16], &global[size_t(skin.joints[bone]) * 16], boneMatrix);
+                    storeRows(boneMatrix, out + size_t(bone) * kFloatsPerBone);
+                }
+            }
+        });
+    }
+
+private:
+    // bx (row-vector) matrix -> rows 0..2 of the column-vector form
+    static void storeRows(const float* m, float* rows)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            rows[r * 4 + 0] = m[r];
+            rows[r * 4 + 1] = m[4 + r];
+            rows[r * 4 + 2] = m[8 + r];
+            rows[r * 4 + 3] = m[12 + r];
+        }
+    }
+};
+
+// Linear blend skinning on the CPU, in parallel over the vertices. Same math as vs_drill_skinned.sc, used to check it.
+// bonePalette holds 12 floats per bone as written by SkinningPaletteEvaluator.
+inline void skinVertices(const MyFancyVertex* src, const SkinInfluence* influences, size_t count, const float* bonePalette, MyFancyVertex* dst)
+{
+    parallelFor(count, 1024, [&](size_t begin, size_t end)
+    {
+        using namespace simd4;
+
+        for (size_t v = begin; v < end; ++v)
+        {
+            const SkinInfluence& influence = influences[v];
+            Float4 rows[3] = { splat(0.0f), splat(0.0f), splat(0.0f) };
+            for (int i = 0; i < 4; ++i)
+            {
+                if (influence.weights[i] == 0) continue;
+                const Float4 weight = splat(float(influence.weights[i]) * (1.0f / 255.0f));
+                const float* bone = bonePalette + size_t(influence.bones[i]) * SkinningPaletteEvaluator::kFloatsPerBone;
+                rows[0] = add(rows[0], mul(weight, load(bone)));
+                rows[1] = add(rows[1], mul(weight, load(bone + 4)));
+                rows[2] = add(rows[2], mul(weight, load(bone + 8)));
+            }
+
+            // Back to bx layout, so a point is x * m[0..3] + y * m[4..7] + z * m[8..11] + m[12..15]
+            float r[3][4];
+            store(r[0], rows[0]);
+            store(r[1], rows[1]);
+            store(r[2], rows[2]);
+            const float m[16] =
+            {
+                r[0][0], r[1][0], r[2][0], 0.0f,
+                r[0][1], r[1][1], r[2][1], 0.0f,
+                r[0][2], r[1][2], r[2][2], 0.0f,
+                r[0][3], r[1][3], r[2][3], 1.0f,
+            };
+
+            const MyFancyVertex& in = src[v];
+            MyFancyVertex& out = dst[v];
+            float position[4];
+            const float p[3] = { in.px, in.py, in.pz };
+            transformPoint(m, p, position);
+            const Float4 normal = add(add(mul(splat(in.nx), load(m)), mul(splat(in.ny), load(m + 4))), mul(splat(in.nz), load(m + 8)));
+            const Float4 tangent = add(add(mul(splat(in.tx), load(m)), mul(splat(in.ty), load(m + 4))), mul(splat(in.tz), load(m + 8)));
+            float n[4];
+            float t[4];
+            store(n, normal);
+            store(t, tangent);
+
+            out.px = position[0]; out.py = position[1]; out.pz = position[2];
+            out.nx = n[0]; out.ny = n[1]; out.nz = n[2];
+            out.tx = t[0]; out.ty = t[1]; out.tz = t[2]; out.tw = in.tw;
+            out.u = in.u; out.v = in.v;
+        }
+    });
+}
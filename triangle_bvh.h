@@ -0,0 +1,737 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "parallel_for.h"
+#include "simd_float4.h"
+
+// Four rays in SoA form for TriangleBvh::intersect4; a lane with a negative tMax is inactive
+struct RayPacket4
+{
+    float origin[3][4];
+    float direction[3][4];
+    float tMax[4];
+};
+
+struct RayHit
+{
+    float t = FLT_MAX;               // in units of the ray direction; also the farthest hit accepted
+    float u = 0.0f;                  // barycentrics of the triangle's second and third vertex
+    float v = 0.0f;
+    uint32_t triangle = UINT32_MAX;  // index in the source index buffer / 3, UINT32_MAX if nothing was hit
+};
+
+namespace bvh_detail
+{
+
+// Padded to four lanes so grow() is two SIMD ops; the fourth lane is ignored
+struct Bounds
+{
+    float min[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    // p must have four readable floats
+    void grow(const float* p)
+    {
+        const simd4::Float4 point = simd4::load(p);
+        simd4::store(min, simd4::min(simd4::load(min), point));
+        simd4::store(max, simd4::max(simd4::load(max), point));
+    }
+
+    void grow(const Bounds& other)
+    {
+        simd4::store(min, simd4::min(simd4::load(min), simd4::load(other.min)));
+        simd4::store(max, simd4::max(simd4::load(max), simd4::load(other.max)));
+    }
+
+    float halfArea() const
+    {
+        if (min[0] > max[0]) return 0.0f;
+        const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+// Slab test; returns the entry distance, or FLT_MAX when the box is missed or farther than tMax
+inline float rayBoxEntry(const float* boxMin, const float* boxMax, const float* origin, const float* invDirection, float tMax)
+{
+    float tNear = 0.0f;
+    float tFar = tMax;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t0 = (boxMin[axis] - origin[axis]) * invDirection[axis];
+        float t1 = (boxMax[axis] - origin[axis]) * invDirection[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+    }
+    return tNear <= tFar ? tNear : FLT_MAX;
+}
+
+// 1 / d, with zero components replaced by a tiny value of the same sign so the slab test never sees 0 * inf
+inline float safeInverse(float d)
+{
+    return 1.0f / (std::fabs(d) > 1e-30f ? d : std::copysign(1e-30f, d));
+}
+
+} // namespace bvh_detail
+
+// -----------------------------------------------------------------------------
+// Bounding volume hierarchy over one triangle mesh, for ray picking and
+// queries on the CPU.
+//
+// Built top-down with the surface area heuristic over binned centroids. The
+// top levels are split with the binning spread over the thread pool until
+// there are enough independent subtrees, which are then built in parallel
+// and stitched together.
+//
+// Nodes are 32 bytes and the two children of a node are adjacent, so both
+// boxes of a traversal step share one cache line. Leaves point into a copy of
+// the triangles reordered to leaf order (first vertex plus two edges, ready
+// for the intersection test). intersect() traces a single ray, intersect4()
+// traces a packet of four rays with every box and triangle test done for the
+// four lanes at once, which pays off for coherent rays (screen-space grids).
+// Triangles are two-sided.
+// -----------------------------------------------------------------------------
+class TriangleBvh
+{
+public:
+    static constexpr uint32_t kMaxLeafTriangles = 8;
+    static constexpr uint32_t kMaxDepth = 64; // deeper nodes stay leaves, however many triangles they hold
+    static constexpr int kBins = 12;
+    static constexpr float kTraversalCost = 1.0f; // relative to one triangle test
+    static constexpr uint32_t kParallelBuildTriangles = 16384; // smaller meshes build on a single thread
+
+    struct Node
+    {
+        float boundsMin[3];
+        uint32_t leftOrFirst; // interior: left child (the right one follows it); leaf: first triangle
+        float boundsMax[3];
+        uint32_t count;       // triangles in a leaf, 0 for interior nodes
+    };
+    static_assert(sizeof(Node) == 32, "Two sibling nodes should fill one cache line");
+
+    // positions: xyz per vertex; indices: three per triangle
+    void build(const float* positions, const uint32_t* indices, uint32_t numTriangles)
+    {
+        m_nodes.clear();
+        m_triangles.clear();
+        m_triangleIds.clear();
+        if (numTriangles == 0)
+        {
+            return;
+        }
+
+        m_primitiveBounds.resize(numTriangles);
+        m_centroids.resize(size_t(numTriangles) * 4);
+        parallelFor(numTriangles, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t t = begin; t < end; ++t)
+            {
+                bvh_detail::Bounds bounds;
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const float* p = positions + size_t(indices[t * 3 + corner]) * 3;
+                    const float point[4] = { p[0], p[1], p[2], 0.0f };
+                    bounds.grow(point);
+                }
+                m_primitiveBounds[t] = bounds;
+                simd4::store(&m_centroids[t * 4], simd4::mul(simd4::add(simd4::load(bounds.min), simd4::load(bounds.max)), simd4::splat(0.5f)));
+            }
+        });
+        m_order.resize(numTriangles);
+        std::iota(m_order.begin(), m_order.end(), 0u);
+
+        // Top levels: split breadth-first with parallel binning until every thread has a few subtrees to build
+        const uint32_t subtreeTriangles = std::max<uint32_t>(kParallelBuildTriangles / 4, uint32_t(numTriangles / (parallelForNumThreads() * 8)));
+        std::vector<BuildRange> pending(1);
+        pending[0].node = 0;
+        pending[0].begin = 0;
+        pending[0].end = numTriangles;
+        pending[0].depth = 0;
+        computeRangeBounds(pending[0], true);
+        std::vector<BuildRange> subtrees;
+        m_nodes.resize(1);
+        while (!pending.empty())
+        {
+            const BuildRange task = pending.back();
+            pending.pop_back();
+            if (task.end - task.begin <= subtreeTriangles)
+            {
+                subtrees.push_back(task);
+                continue;
+            }
+            BuildRange children[2];
+            if (splitNode(m_nodes, task, children, true))
+            {
+                pending.push_back(children[0]);
+                pending.push_back(children[1]);
+            }
+        }
+
+        std::vector<std::vector<Node>> blocks(subtrees.size());
+        parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                BuildRange range = subtrees[i];
+                range.node = 0;
+                blocks[i].reserve(size_t(range.end - range.begin) / 2 + 1);
+                blocks[i].resize(1);
+                buildSubtree(blocks[i], range);
+            }
+        });
+
+        // Each block's root replaces its placeholder, the rest is appended with the child indices rebased
+        for (size_t i = 0; i < subtrees.size(); ++i)
+        {
+            const uint32_t base = uint32_t(m_nodes.size()) - 1;
+            for (size_t n = 0; n < blocks[i].size(); ++n)
+            {
+                Node node = blocks[i][n];
+                if (node.count == 0)
+                {
+                    node.leftOrFirst += base;
+                }
+                if (n == 0) m_nodes[subtrees[i].node] = node;
+                else m_nodes.push_back(node);
+            }
+        }
+
+        m_triangles.resize(numTriangles);
+        m_triangleIds = m_order;
+        parallelFor(numTriangles, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t* triangle = indices + size_t(m_order[i]) * 3;
+                const float* p0 = positions + size_t(triangle[0]) * 3;
+                const float* p1 = positions + size_t(triangle[1]) * 3;
+                const float* p2 = positions + size_t(triangle[2]) * 3;
+                Triangle& out = m_triangles[i];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    out.v0[axis] = p0[axis];
+                    out.e1[axis] = p1[axis] - p0[axis];
+                    out.e2[axis] = p2[axis] - p0[axis];
+                }
+            }
+        });
+
+        m_primitiveBounds = std::vector<bvh_detail::Bounds>();
+        m_centroids = std::vector<float>();
+        m_order = std::vector<uint32_t>();
+    }
+
+    bool empty() const { return m_nodes.empty(); }
+    size_t numNodes() const { return m_nodes.size(); }
+    size_t numTriangles() const { return m_triangles.size(); }
+    size_t memoryBytes() const { return m_nodes.size() * sizeof(Node) + m_triangles.size() * (sizeof(Triangle) + sizeof(uint32_t)); }
+    const Node& root() const { return m_nodes[0]; }
+
+    // Closest hit along origin + t * direction for 0 < t < hit.t; returns whether hit was updated
+    bool intersect(const float* origin, const float* direction, RayHit& hit) const
+    {
+        using bvh_detail::rayBoxEntry;
+
+        if (m_nodes.empty())
+        {
+            return false;
+        }
+        const float invDirection[3] = { bvh_detail::safeInverse(direction[0]), bvh_detail::safeInverse(direction[1]), bvh_detail::safeInverse(direction[2]) };
+        if (rayBoxEntry(m_nodes[0].boundsMin, m_nodes[0].boundsMax, origin, invDirection, hit.t) == FLT_MAX)
+        {
+            return false;
+        }
+
+        bool found = false;
+        uint32_t stack[kMaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+        for (;;)
+        {
+            const Node& node = m_nodes[nodeIndex];
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+                {
+                    if (intersectTriangle(m_triangles[i], origin, direction, hit))
+                    {
+                        hit.triangle = m_triangleIds[i];
+                        found = true;
+                    }
+                }
+            }
+            else
+            {
+                // Nearer child first, the other one waits on the stack
+                uint32_t near = node.leftOrFirst;
+                uint32_t far = near + 1;
+                float nearEntry = rayBoxEntry(m_nodes[near].boundsMin, m_nodes[near].boundsMax, origin, invDirection, hit.t);
+                float farEntry = rayBoxEntry(m_nodes[far].boundsMin, m_nodes[far].boundsMax, origin, invDirection, hit.t);
+                if (farEntry < nearEntry)
+                {
+                    std::swap(near, far);
+                    std::swap(nearEntry, farEntry);
+                }
+                if (nearEntry != FLT_MAX)
+                {
+                    if (farEntry != FLT_MAX)
+                    {
+                        stack[stackSize++] = far;
+                    }
+                    nodeIndex = near;
+                    continue;
+                }
+            }
+
+            if (stackSize == 0)
+            {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+        }
+        return found;
+    }
+
+    // Closest hits for four rays at once; hits[i].t must be initialized like intersect()'s (packet.tMax is the start value)
+    void intersect4(const RayPacket4& packet, RayHit hits[4]) const
+    {
+        using namespace simd4;
+
+        if (m_nodes.empty())
+        {
+            return;
+        }
+
+        Float4 origin[3];
+        Float4 direction[3];
+        Float4 invDirection[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis] = load(packet.origin[axis]);
+            direction[axis] = load(packet.direction[axis]);
+            float inverse[4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                inverse[lane] = bvh_detail::safeInverse(packet.direction[axis][lane]);
+            }
+            invDirection[axis] = load(inverse);
+        }
+        Float4 tBest = load(packet.tMax);
+
+        // Lanes hitting the box, with their entry distances
+        auto boxTest = [&](const Node& node, Float4& outEntry) -> Float4
+        {
+            Float4 tNear = splat(0.0f);
+            Float4 tFar = tBest;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const Float4 t0 = mul(sub(splat(node.boundsMin[axis]), origin[axis]), invDirection[axis]);
+                const Float4 t1 = mul(sub(splat(node.boundsMax[axis]), origin[axis]), invDirection[axis]);
+                tNear = max(tNear, min(t0, t1));
+                tFar = min(tFar, max(t0, t1));
+            }
+            outEntry = tNear;
+            return greaterEqual(tFar, tNear);
+        };
+        auto nearestEntry = [](Float4 entry, int laneBits)
+        {
+            float lanes[4];
+            store(lanes, entry);
+            float nearest = FLT_MAX;
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (laneBits & (1 << lane)) nearest = std::min(nearest, lanes[lane]);
+            }
+            return nearest;
+        };
+
+        Float4 rootEntry;
+        if (!any(boxTest(m_nodes[0], rootEntry)))
+        {
+            return;
+        }
+
+        uint32_t stack[kMaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+        for (;;)
+        {
+            const Node& node = m_nodes[nodeIndex];
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+                {
+                    intersectTriangle4(m_triangles[i], m_triangleIds[i], origin, direction, tBest, hits);
+                }
+            }
+            else
+            {
+                uint32_t near = node.leftOrFirst;
+                uint32_t far = near + 1;
+                Float4 nearEntry;
+                Float4 farEntry;
+                int nearBits = maskBits(boxTest(m_nodes[near], nearEntry));
+                int farBits = maskBits(boxTest(m_nodes[far], farEntry));
+                if (nearBits && farBits && nearestEntry(farEntry, farBits) < nearestEntry(nearEntry, nearBits))
+                {
+                    std::swap(near, far);
+                    std::swap(nearBits, farBits);
+                }
+                if (nearBits || farBits)
+                {
+                    if (nearBits && farBits)
+                    {
+                        stack[stackSize++] = far;
+                    }
+                    nodeIndex = nearBits ? near : far;
+                    continue;
+                }
+            }
+
+            if (stackSize == 0)
+            {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+        }
+    }
+
+private:
+    struct Triangle
+    {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+    };
+
+    // Moller-Trumbore
+    static bool intersectTriangle(const Triangle& triangle, const float* origin, const float* direction, RayHit& hit)
+    {
+        const float* e1 = triangle.e1;
+        const float* e2 = triangle.e2;
+        const float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+        const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::fabs(det) < 1e-20f)
+        {
+            return false;
+        }
+        const float invDet = 1.0f / det;
+        const float s[3] = { origin[0] - triangle.v0[0], origin[1] - triangle.v0[1], origin[2] - triangle.v0[2] };
+        const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+        if (u < 0.0f || u > 1.0f)
+        {
+            return false;
+        }
+        const float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        const float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+        {
+            return false;
+        }
+        const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+        if (t <= 0.0f || t >= hit.t)
+        {
+            return false;
+        }
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+    static void intersectTriangle4(const Triangle& triangle, uint32_t triangleId, const simd4::Float4* origin, const simd4::Float4* direction,
+                                   simd4::Float4& tBest, RayHit hits[4])
+    {
+        using namespace simd4;
+
+        const Float4 e1[3] = { splat(triangle.e1[0]), splat(triangle.e1[1]), splat(triangle.e1[2]) };
+        const Float4 e2[3] = { splat(triangle.e2[0]), splat(triangle.e2[1]), splat(triangle.e2[2]) };
+        const Float4 p[3] =
+        {
+            sub(mul(direction[1], e2[2]), mul(direction[2], e2[1])),
+            sub(mul(direction[2], e2[0]), mul(direction[0], e2[2])),
+            sub(mul(direction[0], e2[1]), mul(direction[1], e2[0])),
+        };
+        const Float4 det = add(add(mul(e1[0], p[0]), mul(e1[1], p[1])), mul(e1[2], p[2]));
+        Float4 mask = greaterEqual(max(det, sub(splat(0.0f), det)), splat(1e-20f));
+        if (!any(mask))
+        {
+            return;
+        }
+        const Float4 invDet = div(splat(1.0f), select(mask, det, splat(1.0f)));
+        const Float4 s[3] = { sub(origin[0], splat(triangle.v0[0])), sub(origin[1], splat(triangle.v0[1])), sub(origin[2], splat(triangle.v0[2])) };
+        const Float4 u = mul(add(add(mul(s[0], p[0]), mul(s[1], p[1])), mul(s[2], p[2])), invDet);
+        const Float4 q[3] =
+        {
+            sub(mul(s[1], e1[2]), mul(s[2], e1[1])),
+            sub(mul(s[2], e1[0]), mul(s[0], e1[2])),
+            sub(mul(s[0], e1[1]), mul(s[1], e1[0])),
+        };
+        const Float4 v = mul(add(add(mul(direction[0], q[0]), mul(direction[1], q[1])), mul(direction[2], q[2])), invDet);
+        const Float4 t = mul(add(add(mul(e2[0], q[0]), mul(e2[1], q[1])), mul(e2[2], q[2])), invDet);
+        mask = maskAnd(mask, maskAnd(greaterEqual(u, splat(0.0f)), greaterEqual(v, splat(0.0f))));
+        mask = maskAnd(mask, greaterEqual(splat(1.0f), add(u, v)));
+        mask = maskAnd(mask, maskAnd(greaterEqual(t, splat(1e-30f)), greaterEqual(tBest, t)));
+        const int bits = maskBits(mask);
+        if (bits == 0)
+        {
+            return;
+        }
+
+        tBest = select(mask, t, tBest);
+        float tLanes[4], uLanes[4], vLanes[4];
+        store(tLanes, t);
+        store(uLanes, u);
+        store(vLanes, v);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (bits & (1 << lane))
+            {
+                hits[lane].t = tLanes[lane];
+                hits[lane].u = uLanes[lane];
+                hits[lane].v = vLanes[lane];
+                hits[lane].triangle = triangleId;
+            }
+        }
+    }
+
+    // A node's triangle range plus the bounds of its triangles and of their centroids, which the parent's
+    // binning already knows, so only the root needs a pass over its triangles to find them
+    struct BuildRange
+    {
+        uint32_t node, begin, end, depth;
+        bvh_detail::Bounds bounds;
+        bvh_detail::Bounds centroidBounds;
+    };
+
+    void computeRangeBounds(BuildRange& range, bool parallel)
+    {
+        using bvh_detail::Bounds;
+
+        auto accumulate = [&](size_t rangeBegin, size_t rangeEnd, Bounds& outBounds, Bounds& outCentroids)
+        {
+            for (size_t i = rangeBegin; i < rangeEnd; ++i)
+            {
+                const uint32_t primitive = m_order[i];
+                outBounds.grow(m_primitiveBounds[primitive]);
+                outCentroids.grow(&m_centroids[size_t(primitive) * 4]);
+            }
+        };
+        range.bounds = Bounds();
+        range.centroidBounds = Bounds();
+        if (!parallel)
+        {
+            accumulate(range.begin, range.end, range.bounds, range.centroidBounds);
+            return;
+        }
+        std::mutex mergeMutex;
+        parallelFor(range.end - range.begin, 16384, [&](size_t rangeBegin, size_t rangeEnd)
+        {
+            Bounds localBounds;
+            Bounds localCentroids;
+            accumulate(range.begin + rangeBegin, range.begin + rangeEnd, localBounds, localCentroids);
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            range.bounds.grow(localBounds);
+            range.centroidBounds.grow(localCentroids);
+        });
+    }
+
+    // Writes the node's bounds and either leaves it a leaf (returns false) or partitions its range between two
+    // new children (returns true and fills `children`). `parallel` spreads the binning over the thread pool.
+    bool splitNode(std::vector<Node>& nodes, const BuildRange& range, BuildRange children[2], bool parallel)
+    {
+        using bvh_detail::Bounds;
+
+        struct Bin
+        {
+            Bounds bounds;
+            Bounds centroidBounds;
+            uint32_t count = 0;
+        };
+
+        const uint32_t begin = range.begin;
+        const uint32_t end = range.end;
+        const Bounds& centroidBounds = range.centroidBounds;
+        Node& node = nodes[range.node];
+        std::memcpy(node.boundsMin, range.bounds.min, sizeof(node.boundsMin));
+        std::memcpy(node.boundsMax, range.bounds.max, sizeof(node.boundsMax));
+        node.leftOrFirst = begin;
+        node.count = end - begin;
+        const uint32_t count = end - begin;
+        if (count <= 1 || range.depth + 1 >= kMaxDepth)
+        {
+            return false;
+        }
+
+        // Bin the centroids along every axis; small nodes use fewer bins, which costs them nothing in quality
+        const int numBins = int(std::min<uint32_t>(kBins, std::max<uint32_t>(count, 4)));
+        float binScale[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            binScale[axis] = extent > 0.0f ? float(numBins) / extent : 0.0f;
+        }
+        const float binScale4[4] = { binScale[0], binScale[1], binScale[2], 0.0f };
+        const simd4::Float4 binOrigin = simd4::load(centroidBounds.min);
+        const simd4::Float4 binScaleVector = simd4::load(binScale4);
+        // Binning and partitioning must agree exactly, so both go through the same SIMD expression
+        auto binOffsets = [&](uint32_t primitive, float* offsets)
+        {
+            simd4::store(offsets, simd4::mul(simd4::sub(simd4::load(&m_centroids[size_t(primitive) * 4]), binOrigin), binScaleVector));
+        };
+        Bin bins[3][kBins];
+        auto binRange = [&](size_t rangeBegin, size_t rangeEnd, Bin (&outBins)[3][kBins])
+        {
+            for (size_t i = rangeBegin; i < rangeEnd; ++i)
+            {
+                const uint32_t primitive = m_order[i];
+                float offsets[4];
+                binOffsets(primitive, offsets);
+                const Bounds& primitiveBounds = m_primitiveBounds[primitive];
+                const float* centroid = &m_centroids[size_t(primitive) * 4];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    Bin& bin = outBins[axis][std::min(numBins - 1, int(offsets[axis]))];
+                    bin.bounds.grow(primitiveBounds);
+                    bin.centroidBounds.grow(centroid);
+                    ++bin.count;
+                }
+            }
+        };
+        if (parallel)
+        {
+            std::mutex mergeMutex;
+            parallelFor(count, 16384, [&](size_t rangeBegin, size_t rangeEnd)
+            {
+                Bin localBins[3][kBins];
+                binRange(begin + rangeBegin, begin + rangeEnd, localBins);
+                std::lock_guard<std::mutex> lock(mergeMutex);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    for (int b = 0; b < numBins; ++b)
+                    {
+                        bins[axis][b].bounds.grow(localBins[axis][b].bounds);
+                        bins[axis][b].centroidBounds.grow(localBins[axis][b].centroidBounds);
+                        bins[axis][b].count += localBins[axis][b].count;
+                    }
+                }
+            });
+        }
+        else
+        {
+            binRange(begin, end, bins);
+        }
+
+        // Sweep the split planes between bins: cost = traversal + (area L * count L + area R * count R) / area
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (binScale[axis] == 0.0f)
+            {
+                continue;
+            }
+            float rightArea[kBins];
+            uint32_t rightCount[kBins];
+            Bounds accumulated;
+            uint32_t accumulatedCount = 0;
+            for (int b = numBins - 1; b > 0; --b)
+            {
+                accumulated.grow(bins[axis][b].bounds);
+                accumulatedCount += bins[axis][b].count;
+                rightArea[b] = accumulated.halfArea();
+                rightCount[b] = accumulatedCount;
+            }
+            accumulated = Bounds();
+            accumulatedCount = 0;
+            for (int b = 0; b < numBins - 1; ++b)
+            {
+                accumulated.grow(bins[axis][b].bounds);
+                accumulatedCount += bins[axis][b].count;
+                const float cost = accumulated.halfArea() * float(accumulatedCount) + rightArea[b + 1] * float(rightCount[b + 1]);
+                if (accumulatedCount > 0 && rightCount[b + 1] > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        const float area = range.bounds.halfArea();
+        const float splitCost = bestAxis >= 0 && area > 0.0f ? kTraversalCost + bestCost / area : FLT_MAX;
+        if (count <= kMaxLeafTriangles && float(count) <= splitCost)
+        {
+            return false;
+        }
+
+        const uint32_t left = uint32_t(nodes.size());
+        nodes.resize(nodes.size() + 2);
+        nodes[range.node].leftOrFirst = left;
+        nodes[range.node].count = 0;
+        for (int side = 0; side < 2; ++side)
+        {
+            children[side].node = left + side;
+            children[side].depth = range.depth + 1;
+        }
+        children[0].begin = begin;
+        children[1].end = end;
+
+        if (bestAxis >= 0)
+        {
+            const uint32_t mid = uint32_t(std::partition(m_order.begin() + begin, m_order.begin() + end, [&](uint32_t primitive)
+            {
+                float offsets[4];
+                binOffsets(primitive, offsets);
+                return std::min(numBins - 1, int(offsets[bestAxis])) <= bestSplit;
+            }) - m_order.begin());
+            children[0].end = mid;
+            children[1].begin = mid;
+            for (int b = 0; b < numBins; ++b)
+            {
+                BuildRange& child = children[b <= bestSplit ? 0 : 1];
+                child.bounds.grow(bins[bestAxis][b].bounds);
+                child.centroidBounds.grow(bins[bestAxis][b].centroidBounds);
+            }
+        }
+        else
+        {
+            // All centroids coincide, too many for one leaf: halve the range
+            children[0].end = begin + count / 2;
+            children[1].begin = begin + count / 2;
+            computeRangeBounds(children[0], parallel);
+            computeRangeBounds(children[1], parallel);
+        }
+        return true;
+    }
+
+    void buildSubtree(std::vector<Node>& nodes, const BuildRange& range)
+    {
+        BuildRange children[2];
+        if (!splitNode(nodes, range, children, false))
+        {
+            return;
+        }
+        buildSubtree(nodes, children[0]);
+        buildSubtree(nodes, children[1]);
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles;   // leaf order
+    std::vector<uint32_t> m_triangleIds; // leaf order -> source triangle
+
+    // Build scratch
+    std::vector<bvh_detail::Bounds> m_primitiveBounds;
+    std::vector<float> m_centroids;
+    std::vector<uint32_t> m_order;
+};
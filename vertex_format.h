@@ -0,0 +1,320 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <assimp/mesh.h>
+#include <bgfx/bgfx.h>
+
+#include "parallel_for.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+struct MyFancyVertex
+{
+    float px, py, pz;  // Position
+    float nx, ny, nz;  // Normal
+    float tx, ty, tz, tw;  // Tangent (includes handedness)
+    float u, v;        // Texture coordinates
+};
+
+// Which aiMesh stream a vertex attribute is copied from
+enum class VertexSource : uint8_t
+{
+    Position,
+    Normal,
+    Tangent,
+    TexCoord0,
+};
+
+struct VertexAttributeDesc
+{
+    bgfx::Attrib::Enum     attrib;
+    uint8_t                num;
+    bgfx::AttribType::Enum type;
+    VertexSource           source;
+    float                  fallback[4]; // Used when the mesh lacks the stream, and for components the stream doesn't have
+};
+
+// -----------------------------------------------------------------------------
+// The one description of MyFancyVertex. initVertexLayout() builds the
+// bgfx::VertexLayout from it and the SoA->AoS copy kernels below are generated
+// from it, so the layout, the struct and the converter can't drift apart.
+// This layout must match the usage in drill.varying.def.sc.
+// -----------------------------------------------------------------------------
+inline constexpr VertexAttributeDesc kFancyVertexFormat[] =
+{
+    { bgfx::Attrib::Position,  3, bgfx::AttribType::Float, VertexSource::Position,  { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { bgfx::Attrib::Normal,    3, bgfx::AttribType::Float, VertexSource::Normal,    { 0.0f, 1.0f, 0.0f, 0.0f } }, // default to up if missing
+    { bgfx::Attrib::Tangent,   4, bgfx::AttribType::Float, VertexSource::Tangent,   { 1.0f, 0.0f, 0.0f, 1.0f } }, // dummy tangent space, w = handedness
+    { bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, VertexSource::TexCoord0, { 0.0f, 0.0f, 0.0f, 0.0f } },
+};
+inline constexpr size_t kFancyVertexFormatCount = sizeof(kFancyVertexFormat) / sizeof(kFancyVertexFormat[0]);
+
+constexpr uint32_t vertexAttributeOffset(const VertexAttributeDesc* format, size_t index)
+{
+    uint32_t offset = 0;
+    for (size_t i = 0; i < index; ++i)
+    {
+        offset += format[i].num * uint32_t(sizeof(float));
+    }
+    return offset;
+}
+
+constexpr bool vertexFormatIsAllFloat(const VertexAttributeDesc* format, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (format[i].type != bgfx::AttribType::Float) return false;
+    }
+    return true;
+}
+
+static_assert(vertexFormatIsAllFloat(kFancyVertexFormat, kFancyVertexFormatCount), "The stream kernels only write float attributes");
+static_assert(vertexAttributeOffset(kFancyVertexFormat, kFancyVertexFormatCount) == sizeof(MyFancyVertex), "kFancyVertexFormat doesn't match MyFancyVertex");
+static_assert(vertexAttributeOffset(kFancyVertexFormat, 1) == offsetof(MyFancyVertex, nx), "kFancyVertexFormat doesn't match MyFancyVertex");
+static_assert(vertexAttributeOffset(kFancyVertexFormat, 2) == offsetof(MyFancyVertex, tx), "kFancyVertexFormat doesn't match MyFancyVertex");
+static_assert(vertexAttributeOffset(kFancyVertexFormat, 3) == offsetof(MyFancyVertex, u), "kFancyVertexFormat doesn't match MyFancyVertex");
+
+// Every aiMesh stream we read from is an array of aiVector3D
+static constexpr uint32_t kVertexSourceComponents = 3;
+static_assert(sizeof(aiVector3D) == kVertexSourceComponents * sizeof(float), "assimp built with ASSIMP_DOUBLE_PRECISION is not supported");
+
+inline void buildVertexLayout(const VertexAttributeDesc* format, size_t count, bgfx::VertexLayout& layout)
+{
+    layout.begin();
+    for (size_t i = 0; i < count; ++i)
+    {
+        layout.add(format[i].attrib, format[i].num, format[i].type);
+    }
+    layout.end();
+}
+
+// Returns nullptr if the mesh doesn't have the stream
+inline const float* vertexSourceStream(const aiMesh* mesh, VertexSource source)
+{
+    const aiVector3D* stream = nullptr;
+    switch (source)
+    {
+    case VertexSource::Position:  stream = mesh->mVertices; break;
+    case VertexSource::Normal:    stream = mesh->HasNormals() ? mesh->mNormals : nullptr; break;
+    case VertexSource::Tangent:   stream = mesh->HasTangentsAndBitangents() ? mesh->mTangents : nullptr; break;
+    case VertexSource::TexCoord0: stream = mesh->mTextureCoords[0]; break;
+    }
+    return reinterpret_cast<const float*>(stream);
+}
+
+namespace vertex_stream_detail
+{
+
+// One unaligned 4-float load + store
+inline void copyFloat4(float* dst, const float* src)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    _mm_storeu_ps(dst, _mm_loadu_ps(src));
+#elif defined(__ARM_NEON)
+    vst1q_f32(dst, vld1q_f32(src));
+#elif defined(__wasm_simd128__)
+    wasm_v128_store(dst, wasm_v128_load(src));
+#else
+    std::memcpy(dst, src, 4 * sizeof(float));
+#endif
+}
+
+// Writes attribute `Index` of vertex `i`. The Wide variant always moves a full
+// 4-float register and is allowed to spill past the attribute into the next
+// attribute/vertex (and to read one float past the source element), so it's
+// only used when whatever it spills into gets written afterwards.
+template <const VertexAttributeDesc* Format, size_t Index, bool Present, bool Wide>
+inline void writeAttribute(uint8_t* vertex, const float* const* streams, size_t i)
+{
+    constexpr VertexAttributeDesc desc = Format[Index];
+    constexpr uint32_t offset = vertexAttributeOffset(Format, Index);
+    float* dst = reinterpret_cast<float*>(vertex + offset);
+
+    if constexpr (Present)
+    {
+        const float* src = streams[Index] + i * kVertexSourceComponents;
+        if constexpr (Wide)
+        {
+            copyFloat4(dst, src);
+        }
+        else
+        {
+            for (uint32_t c = 0; c < desc.num && c < kVertexSourceComponents; ++c)
+            {
+                dst[c] = src[c];
+            }
+        }
+        // Components the stream doesn't have (e.g. tangent handedness)
+        for (uint32_t c = kVertexSourceComponents; c < desc.num; ++c)
+        {
+            dst[c] = desc.fallback[c];
+        }
+    }
+    else
+    {
+        if constexpr (Wide)
+        {
+            copyFloat4(dst, Format[Index].fallback);
+        }
+        else
+        {
+            for (uint32_t c = 0; c < desc.num; ++c)
+            {
+                dst[c] = desc.fallback[c];
+            }
+        }
+    }
+}
+
+template <const VertexAttributeDesc* Format, size_t Count, uint32_t PresentMask, size_t... Is>
+inline void streamVertexRange(uint8_t* dst, const float* const* streams, size_t begin, size_t end, std::index_sequence<Is...>)
+{
+    constexpr uint32_t stride = vertexAttributeOffset(Format, Count);
+
+    size_t i = begin;
+    // Attributes are written in offset order, so every vertex but the last one of the range can spill into its successor
+    for (; i + 1 < end; ++i)
+    {
+        uint8_t* vertex = dst + i * stride;
+        (writeAttribute<Format, Is, ((PresentMask >> Is) & 1u) != 0u, true>(vertex, streams, i), ...);
+    }
+    for (; i < end; ++i)
+    {
+        uint8_t* vertex = dst + i * stride;
+        (writeAttribute<Format, Is, ((PresentMask >> Is) & 1u) != 0u, false>(vertex, streams, i), ...);
+    }
+}
+
+using VertexStreamKernel = void (*)(uint8_t* dst, const float* const* streams, size_t begin, size_t end);
+
+template <const VertexAttributeDesc* Format, size_t Count, uint32_t PresentMask>
+void vertexStreamKernel(uint8_t* dst, const float* const* streams, size_t begin, size_t end)
+{
+    streamVertexRange<Format, Count, PresentMask>(dst, streams, begin, end, std::make_index_sequence<Count>());
+}
+
+// One specialized kernel per combination of present/missing streams
+template <const VertexAttributeDesc* Format, size_t Count, size_t... Masks>
+constexpr std::array<VertexStreamKernel, sizeof...(Masks)> makeVertexStreamKernels(std::index_sequence<Masks...>)
+{
+    return {{ &vertexStreamKernel<Format, Count, uint32_t(Masks)>... }};
+}
+
+} // namespace vertex_stream_detail
+
+// Vertices per job when a mesh is split across threads
+static constexpr size_t kVertexStreamGrain = 16 * 1024;
+
+// -----------------------------------------------------------------------------
+// Interleaves the aiMesh's SoA streams into `dst`, which must hold
+// mesh->mNumVertices vertices of `Format` (e.g. bgfx::alloc'd memory).
+// -----------------------------------------------------------------------------
+namespace vertex_stream_detail
+{
+
+// Fills `streams` with the mesh's source streams and returns the kernel for the ones it has
+template <const VertexAttributeDesc* Format, size_t Count>
+inline VertexStreamKernel selectKernel(const aiMesh* mesh, const float** streams)
+{
+    static_assert(Count <= 8, "Too many attributes for a kernel per combination");
+    static constexpr auto kKernels = makeVertexStreamKernels<Format, Count>(std::make_index_sequence<size_t(1) << Count>());
+
+    uint32_t presentMask = 0;
+    for (size_t i = 0; i < Count; ++i)
+    {
+        streams[i] = vertexSourceStream(mesh, Format[i].source);
+        if (streams[i]) presentMask |= 1u << i;
+    }
+    return kKernels[presentMask];
+}
+
+} // namespace vertex_stream_detail
+
+template <const VertexAttributeDesc* Format, size_t Count>
+inline void streamVertices(const aiMesh* mesh, void* dst)
+{
+    const float* streams[Count];
+    vertex_stream_detail::VertexStreamKernel kernel = vertex_stream_detail::selectKernel<Format, Count>(mesh, streams);
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    parallelFor(mesh->mNumVertices, kVertexStreamGrain, [&](size_t begin, size_t end)
+    {
+        kernel(out, streams, begin, end);
+    });
+}
+
+// Like streamVertices, but writes the vertices listed in `vertexIds`, in that order (the chunker's per-chunk vertex sets)
+template <const VertexAttributeDesc* Format, size_t Count>
+inline void gatherVertices(const aiMesh* mesh, const uint32_t* vertexIds, size_t count, void* dst)
+{
+    constexpr uint32_t stride = vertexAttributeOffset(Format, Count);
+    const float* streams[Count];
+    vertex_stream_detail::VertexStreamKernel kernel = vertex_stream_detail::selectKernel<Format, Count>(mesh, streams);
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    parallelFor(count, kVertexStreamGrain, [&](size_t begin, size_t end)
+    {
+        const float* shifted[Count];
+        for (size_t v = begin; v < end; ++v)
+        {
+            // A one-vertex range of the kernel, with the streams moved to the source vertex
+            for (size_t i = 0; i < Count; ++i)
+            {
+                shifted[i] = streams[i] ? streams[i] + size_t(vertexIds[v]) * kVertexSourceComponents : nullptr;
+            }
+            kernel(out + v * stride, shifted, 0, 1);
+        }
+    });
+}
+
+// Number of indices streamTriangleIndices() writes (non-triangle faces are skipped)
+inline uint32_t countTriangleIndices(const aiMesh* mesh)
+{
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    {
+        return mesh->mNumFaces * 3;
+    }
+
+    uint32_t numIndices = 0;
+    for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+    {
+        if (mesh->mFaces[f].mNumIndices == 3) numIndices += 3;
+    }
+    return numIndices;
+}
+
+inline void streamTriangleIndices(const aiMesh* mesh, uint32_t* dst)
+{
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    {
+        // Triangles only (the usual case after aiProcess_Triangulate), so face f lands at 3*f
+        parallelFor(mesh->mNumFaces, kVertexStreamGrain, [&](size_t begin, size_t end)
+        {
+            for (size_t f = begin; f < end; ++f)
+            {
+                std::memcpy(dst + f * 3, mesh->mFaces[f].mIndices, 3 * sizeof(uint32_t));
+            }
+        });
+        return;
+    }
+
+    // Mixed primitive types (points/lines survive triangulation), keep triangles only
+    for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+    {
+        const aiFace& face = mesh->mFaces[f];
+        if (face.mNumIndices == 3)
+        {
+            std::memcpy(dst, face.mIndices, 3 * sizeof(uint32_t));
+            dst += 3;
+        }
+    }
+}
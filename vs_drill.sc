@@ -1,5 +1,5 @@
 $input a_position, a_normal, a_tangent, a_texcoord0
-$output v_texcoord0, v_tbn, v_worldPos
+$output v_texcoord0, v_tbn, v_worldPos, v_layers
 
 #include <bgfx_shader.sh>
 
@@ -15,9 +15,12 @@ void main()
 
     v_texcoord0 = a_texcoord0;
 
-    vec3 T = normalize(mul(u_myModelMatrix, a_tangent).xyz);
+    vec3 T = normalize(mul(u_myModelMatrix, vec4(a_tangent.xyz, 0.0)).xyz); // w is the handedness, not a point
     vec3 N = normalize(mul(u_myModelMatrix, vec4(a_normal, 0.0)).xyz);
     vec3 B = cross(N, T) * (a_tangent.w != 0.0 ? a_tangent.w : 1.0);
 
     v_tbn = mat3(T, B, N);
+
+    // Only the batched fragment shader samples texture arrays by layer
+    v_layers = vec3_splat(0.0);
 }
@@ -0,0 +1,27 @@
+$input a_position, a_normal, a_tangent, a_texcoord0, i_data0, i_data1, i_data2, i_data3, i_data4
+$output v_texcoord0, v_tbn, v_worldPos, v_layers
+
+#include <bgfx_shader.sh>
+
+// Material batching variant of vs_drill.sc: the model matrix comes per instance (i_data0..3)
+// along with the material's texture array layers (i_data4: color, normal, ARM)
+
+void main()
+{
+    mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+
+    vec4 worldPos = mul(model, vec4(a_position, 1.0));
+    v_worldPos = worldPos.xyz;
+
+    gl_Position = mul(u_viewProj, worldPos);
+
+    v_texcoord0 = a_texcoord0;
+
+    vec3 T = normalize(mul(model, vec4(a_tangent.xyz, 0.0)).xyz); // w is the handedness, not a point
+    vec3 N = normalize(mul(model, vec4(a_normal, 0.0)).xyz);
+    vec3 B = cross(N, T) * (a_tangent.w != 0.0 ? a_tangent.w : 1.0);
+
+    v_tbn = mat3(T, B, N);
+
+    v_layers = i_data4.xyz;
+}
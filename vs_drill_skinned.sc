@@ -0,0 +1,56 @@
+$input a_position, a_normal, a_tangent, a_texcoord0, a_indices, a_weight
+$output v_texcoord0, v_tbn, v_worldPos, v_layers
+
+#include <bgfx_shader.sh>
+
+// Skinning variant of vs_drill.sc: up to four bones per vertex (a_indices, a_weight) are blended
+// from the palette texture, which holds the three rows of each bone's affine matrix in consecutive
+// texels. u_skinParams.x is the instance's first bone, yzw its material's texture array layers
+// (only read by the batched fragment shader).
+
+uniform mat4 u_myModelMatrix;
+uniform vec4 u_skinParams;
+
+SAMPLER2D(s_skinPalette, 10);
+
+#define SKIN_PALETTE_WIDTH 1024
+
+vec4 paletteRow(float bone, int row)
+{
+    int texel = int(u_skinParams.x + bone) * 3 + row;
+    return texelFetch(s_skinPalette, ivec2(texel % SKIN_PALETTE_WIDTH, texel / SKIN_PALETTE_WIDTH), 0);
+}
+
+void main()
+{
+    vec4 row0 = vec4_splat(0.0);
+    vec4 row1 = vec4_splat(0.0);
+    vec4 row2 = vec4_splat(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+        float weight = a_weight[i];
+        row0 += weight * paletteRow(a_indices[i], 0);
+        row1 += weight * paletteRow(a_indices[i], 1);
+        row2 += weight * paletteRow(a_indices[i], 2);
+    }
+
+    vec4 position = vec4(a_position, 1.0);
+    vec3 skinnedPos = vec3(dot(row0, position), dot(row1, position), dot(row2, position));
+    vec3 skinnedNormal = vec3(dot(row0.xyz, a_normal), dot(row1.xyz, a_normal), dot(row2.xyz, a_normal));
+    vec3 skinnedTangent = vec3(dot(row0.xyz, a_tangent.xyz), dot(row1.xyz, a_tangent.xyz), dot(row2.xyz, a_tangent.xyz));
+
+    vec4 worldPos = mul(u_myModelMatrix, vec4(skinnedPos, 1.0));
+    v_worldPos = worldPos.xyz;
+
+    gl_Position = mul(u_modelViewProj, vec4(skinnedPos, 1.0));
+
+    v_texcoord0 = a_texcoord0;
+
+    vec3 T = normalize(mul(u_myModelMatrix, vec4(skinnedTangent, 0.0)).xyz);
+    vec3 N = normalize(mul(u_myModelMatrix, vec4(skinnedNormal, 0.0)).xyz);
+    vec3 B = cross(N, T) * (a_tangent.w != 0.0 ? a_tangent.w : 1.0);
+
+    v_tbn = mat3(T, B, N);
+
+    v_layers = u_skinParams.yzw;
+}
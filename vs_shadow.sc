@@ -0,0 +1,8 @@
+$input a_position
+
+#include <bgfx_shader.sh>
+
+void main()
+{
+    gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
+}
@@ -0,0 +1,11 @@
+$input a_position, a_texcoord0
+$output v_texcoord0
+
+#include <bgfx_shader.sh>
+
+// Already in clip space: one triangle covering the whole shadow atlas
+void main()
+{
+    gl_Position = vec4(a_position.xy, 0.0, 1.0);
+    v_texcoord0 = a_texcoord0;
+}
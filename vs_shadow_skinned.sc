@@ -0,0 +1,36 @@
+$input a_position, a_indices, a_weight
+
+#include <bgfx_shader.sh>
+
+// Skinning variant of vs_shadow.sc for animated casters, with the same palette layout as
+// vs_drill_skinned.sc. u_skinParams.x is the instance's first bone.
+
+uniform vec4 u_skinParams;
+
+SAMPLER2D(s_skinPalette, 10);
+
+#define SKIN_PALETTE_WIDTH 1024
+
+vec4 paletteRow(float bone, int row)
+{
+    int texel = int(u_skinParams.x + bone) * 3 + row;
+    return texelFetch(s_skinPalette, ivec2(texel % SKIN_PALETTE_WIDTH, texel / SKIN_PALETTE_WIDTH), 0);
+}
+
+void main()
+{
+    vec4 row0 = vec4_splat(0.0);
+    vec4 row1 = vec4_splat(0.0);
+    vec4 row2 = vec4_splat(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+        float weight = a_weight[i];
+        row0 += weight * paletteRow(a_indices[i], 0);
+        row1 += weight * paletteRow(a_indices[i], 1);
+        row2 += weight * paletteRow(a_indices[i], 2);
+    }
+
+    vec4 position = vec4(a_position, 1.0);
+    vec3 skinnedPos = vec3(dot(row0, position), dot(row1, position), dot(row2, position));
+    gl_Position = mul(u_modelViewProj, vec4(skinnedPos, 1.0));
+}